@@ -0,0 +1,150 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "articulation.h"
+
+ArticulationCache::ArticulationCache(const GalElement* w_s, int num_obs_s,
+                                     bool symmetric_s)
+: w(w_s), num_obs(num_obs_s), symmetric(symmetric_s), is_cut(num_obs_s, 0),
+mark(num_obs_s, 0), stamp(0), disc(num_obs_s, 0), low(num_obs_s, 0),
+parent(num_obs_s, -1)
+{
+}
+
+ArticulationCache::~ArticulationCache()
+{
+}
+
+bool ArticulationCache::CheckSymmetric(const GalElement* w, int num_obs)
+{
+    // Tarjan's algorithm needs undirected links; a walk along asymmetric
+    // weights (e.g. k-nearest neighbors) depends on where it starts
+    std::vector<std::pair<int, int> > links, rev_links;
+    for (int i=0; i<num_obs; i++) {
+        GalNbrs nbrs = w[i].GetNbrs();
+        for (size_t k=0; k<nbrs.size(); k++) {
+            int j = (int)nbrs[k];
+            if (j < 0 || j >= num_obs) return false;
+            if (j == i) continue;
+            links.push_back(std::make_pair(i, j));
+            rev_links.push_back(std::make_pair(j, i));
+        }
+    }
+    std::sort(links.begin(), links.end());
+    links.erase(std::unique(links.begin(), links.end()), links.end());
+    std::sort(rev_links.begin(), rev_links.end());
+    rev_links.erase(std::unique(rev_links.begin(), rev_links.end()),
+                    rev_links.end());
+    return links == rev_links;
+}
+
+void ArticulationCache::Invalidate(int region)
+{
+    if (region >= 0 && region < (int)valid.size()) valid[region] = 0;
+}
+
+void ArticulationCache::InvalidateAll()
+{
+    std::fill(valid.begin(), valid.end(), 0);
+}
+
+bool ArticulationCache::IsValid(int region) const
+{
+    return region >= 0 && region < (int)valid.size() && valid[region];
+}
+
+void ArticulationCache::Update(int region, const std::vector<int>& members)
+{
+    if (region < 0) return;
+    if (region >= (int)valid.size()) {
+        valid.resize(region + 1, 0);
+        connected.resize(region + 1, 0);
+        region_size.resize(region + 1, 0);
+    }
+    valid[region] = 1;
+    connected[region] = 0;
+    region_size[region] = (int)members.size();
+    if (!symmetric || members.size() < 2) return;
+
+    stamp += 1;
+    if (stamp == std::numeric_limits<int>::max()) {
+        std::fill(mark.begin(), mark.end(), 0);
+        stamp = 1;
+    }
+    for (size_t i=0; i<members.size(); i++) {
+        int a = members[i];
+        mark[a] = stamp;
+        disc[a] = 0;
+        is_cut[a] = 0;
+    }
+
+    // iterative DFS from the first area; low[a] is the smallest discovery
+    // time reachable from the subtree of a with one back link
+    int root = members[0];
+    int time = 0;
+    int root_children = 0;
+    disc[root] = low[root] = ++time;
+    parent[root] = -1;
+    dfs_area.clear();
+    dfs_next.clear();
+    dfs_area.push_back(root);
+    dfs_next.push_back(0);
+    while (!dfs_area.empty()) {
+        int a = dfs_area.back();
+        GalNbrs nbrs = w[a].GetNbrs();
+        int& k = dfs_next.back();
+        if (k < (int)nbrs.size()) {
+            int b = (int)nbrs[k++];
+            if (mark[b] != stamp) continue; // not in this region
+            if (disc[b] == 0) {
+                parent[b] = a;
+                disc[b] = low[b] = ++time;
+                if (a == root) root_children += 1;
+                dfs_area.push_back(b);
+                dfs_next.push_back(0);
+            } else if (b != parent[a] && disc[b] < low[a]) {
+                low[a] = disc[b];
+            }
+        } else {
+            dfs_area.pop_back();
+            dfs_next.pop_back();
+            int p = parent[a];
+            if (p >= 0) {
+                if (low[a] < low[p]) low[p] = low[a];
+                if (p != root && low[a] >= disc[p]) is_cut[p] = 1;
+            }
+        }
+    }
+    if (root_children > 1) is_cut[root] = 1;
+    connected[region] = (time == (int)members.size());
+}
+
+bool ArticulationCache::CanRemove(int region, int area, bool& feasible) const
+{
+    if (!IsValid(region) || !connected[region] || region_size[region] < 2) {
+        return false;
+    }
+    feasible = !is_cut[area];
+    return true;
+}
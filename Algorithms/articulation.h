@@ -0,0 +1,91 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_ARTICULATION_H__
+#define __GEODA_CENTER_ARTICULATION_H__
+
+#include <vector>
+
+#include "../ShapeOperations/GalWeight.h"
+
+/**
+ Articulation points (cut vertices) of the regions of a regionalization,
+ used to check if an area can leave its region without breaking the region
+ apart: it can, unless it is an articulation point of the subgraph of the
+ weights spanned by the region.
+
+ The points of a region are found with Tarjan's DFS in O(areas + links) the
+ first time the region is asked about, and are kept until Invalidate() is
+ called for the region, i.e. after an area moves in or out. Between two
+ moves every check of the region is a lookup.
+
+ The cache only answers for a connected region with two areas or more, and
+ only if the weights are symmetric; CanRemove() returns false otherwise
+ and the caller does its own search. The symmetry is checked by the owner
+ of the weights, once, with CheckSymmetric(), since it sorts all links.
+ */
+class ArticulationCache
+{
+public:
+    /** symmetric: CheckSymmetric() of w */
+    ArticulationCache(const GalElement* w, int num_obs, bool symmetric);
+    virtual ~ArticulationCache();
+
+    void Invalidate(int region);
+    void InvalidateAll();
+    bool IsValid(int region) const;
+
+    /** Finds the articulation points of region, made of the areas members */
+    void Update(int region, const std::vector<int>& members);
+
+    /** True if the answer is known, then feasible tells if area, one of the
+     members of region, can be removed with the rest still connected.
+     Update() the region first if it is not IsValid() */
+    bool CanRemove(int region, int area, bool& feasible) const;
+
+    bool IsSymmetric() const { return symmetric; }
+
+    /** True if j is a neighbor of i iff i is a neighbor of j, O(E log E) */
+    static bool CheckSymmetric(const GalElement* w, int num_obs);
+
+protected:
+    const GalElement* w;
+    int num_obs;
+    bool symmetric;
+
+    // per region: 1 if cut points are up to date, 1 if connected, size
+    std::vector<char> valid;
+    std::vector<char> connected;
+    std::vector<int> region_size;
+
+    // per area: 1 if an articulation point of its region
+    std::vector<char> is_cut;
+
+    // DFS state, reused between calls
+    std::vector<int> mark; // == stamp for areas of the current region
+    int stamp;
+    std::vector<int> disc;
+    std::vector<int> low;
+    std::vector<int> parent;
+    std::vector<int> dfs_area;
+    std::vector<int> dfs_next; // next neighbor to visit
+};
+
+#endif
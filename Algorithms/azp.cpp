@@ -286,10 +286,12 @@ RegionMaker::RegionMaker(int _p, GalElement* const _w,
                          RawDistMatrix* _dist_matrix,
                          int _n, int _m, const std::vector<ZoneControl>& c,
                          const std::vector<int>& _init_regions,
-                         long long seed)
+                         long long seed, int _w_symmetric)
 : p(_p), w(_w), data(_data), dist_matrix(_dist_matrix), n(_n), m(_m), controls(c),
 am(_n, _m, _w, _data, _dist_matrix), objInfo(-1), init_regions(_init_regions),
-rng(seed), is_control_satisfied(true)
+rng(seed), is_control_satisfied(true),
+w_symmetric(_w_symmetric < 0 ? ArticulationCache::CheckSymmetric(_w, _n)
+            : _w_symmetric != 0)
 {
     if (p < 0) {
         is_control_satisfied = false;
@@ -323,7 +325,7 @@ rng(seed), is_control_satisfied(true)
         }
 
         //  create objectiveFunction object for local improvement
-        objective_function = new ObjectiveFunction(n, m, data, w, region2Area);
+        objective_function = new ObjectiveFunction(n, m, data, w, region2Area, w_symmetric);
 
         // get objective function value
         this->objInfo = objective_function->GetValue();
@@ -356,7 +358,7 @@ void RegionMaker::Copy(RegionMaker& rm)
     if (objective_function) {
         delete objective_function;
     }
-    this->objective_function = new ObjectiveFunction(n, m, data, w, region2Area);
+    this->objective_function = new ObjectiveFunction(n, m, data, w, region2Area, w_symmetric);
 }
 
 void RegionMaker::InitFromRegion(std::vector<int>& init_regions)
@@ -389,7 +391,7 @@ void RegionMaker::InitFromRegion(std::vector<int>& init_regions)
     }
 
     //  create objectiveFunction object for local improvement
-    objective_function = new ObjectiveFunction(n, m, data, w, region2Area);
+    objective_function = new ObjectiveFunction(n, m, data, w, region2Area, w_symmetric);
 
     // get objective function value
     this->objInfo = objective_function->GetValue();
@@ -590,7 +592,7 @@ void RegionMaker::assignSeeds(int areaID, int regionID)
 
     // check neighbors of areaID that are not been assigned yet
     // and assign neighbor to potential regions
-    const std::vector<long>& nbrs = w[areaID].GetNbrs();
+    GalNbrs nbrs = w[areaID].GetNbrs();
     for (int i=0; i<nbrs.size(); ++i) {
         int neigh = (int)nbrs[i];
         if (assignedAreas.find(neigh) == assignedAreas.end()) {
@@ -703,7 +705,7 @@ bool RegionMaker::assignArea(int areaID, int regionID)
 
     //for neigh in self.neighsMinusAssigned:
     // assign regionID as a potential region for neigh
-    const std::vector<long>& neighs = this->w[areaID].GetNbrs();
+    GalNbrs neighs = this->w[areaID].GetNbrs();
     for (int i=0; i< neighs.size(); ++i) {
         int nn = (int)neighs[i];
         if (assignedAreas.find(nn) == assignedAreas.end()) {
@@ -742,7 +744,7 @@ std::set<int> RegionMaker::getBufferingAreas(boost::unordered_map<int, bool>& ar
     boost::unordered_map<int, bool>::iterator it;
     for (it = areas.begin(); it != areas.end(); ++it) {
         int area = it->first;
-        const std::vector<long>& nn  = w[area].GetNbrs();
+        GalNbrs nn  = w[area].GetNbrs();
         for (int i=0; i<nn.size(); ++i) {
             if (areas.find((int)nn[i])  == areas.end()) {
                 // neighbor not in this region, then the area is at border
@@ -761,7 +763,7 @@ void RegionMaker::getBorderingAreas(int regionID)
     boost::unordered_map<int, bool>::iterator it;
     for (it = areas.begin(); it != areas.end(); ++it) {
         int area = it->first;
-        const std::vector<long>& nn  = w[area].GetNbrs();
+        GalNbrs nn  = w[area].GetNbrs();
         areas[area] = false;  // not a border area by default
         for (int i=0; i<nn.size(); ++i) {
             if (areas.find((int)nn[i])  == areas.end()) {
@@ -785,7 +787,7 @@ std::set<int> RegionMaker::getPossibleMove(int area)
         }
     }
 
-    const std::vector<long>& nn  = w[area].GetNbrs();
+    GalNbrs nn  = w[area].GetNbrs();
     for (int i=0; i<nn.size(); ++i) {
         // check neighbors, which region it belongs to
         int nbrRegion = area2Region[(int)nn[i]];
@@ -850,6 +852,12 @@ void AZP::LocalImproving()
                         areas[randomArea] = false;
                         // get possible move of this randomArea
                         std::set<int> possibleMove = getPossibleMove(randomArea);
+                        // a move that breaks the region is never made: skip
+                        // the area before evaluating the objective
+                        if (!possibleMove.empty() &&
+                            !objective_function->checkFeasibility(region, randomArea)) {
+                            continue;
+                        }
                         // check obj change before contiguity check
                         for (move_it = possibleMove.begin();
                              !moved && move_it != possibleMove.end();
@@ -899,8 +907,9 @@ MaxpRegionMaker::MaxpRegionMaker(GalElement* const _w,
                                  RawDistMatrix* _dist_matrix,
                                  int _n, int _m, const std::vector<ZoneControl>& c,
                                  const std::vector<int>& _init_areas,
-                                 long long seed)
-: RegionMaker(-1, _w, _data, _dist_matrix, _n, _m, c, std::vector<int>(), seed),
+                                 long long seed, int _w_symmetric)
+: RegionMaker(-1, _w, _data, _dist_matrix, _n, _m, c, std::vector<int>(), seed,
+              _w_symmetric),
 init_areas(_init_areas)
 {
     objective_function = 0;
@@ -1037,7 +1046,7 @@ void MaxpRegionMaker::InitSolution()
         p = (int)region2Area.size();
 
         //  create objectiveFunction object for local improvement
-        objective_function = new ObjectiveFunction(n, m, data, w, region2Area);
+        objective_function = new ObjectiveFunction(n, m, data, w, region2Area, w_symmetric);
 
         // get objective function value
         this->objInfo = objective_function->GetValue();
@@ -1099,7 +1108,8 @@ init_areas(init_regions), max_iter(_max_iter)
 
 void MaxpRegion::RunConstruction(long long seed)
 {
-    MaxpRegionMaker rm_local(w, data, dist_matrix, n, m, controls, init_areas, seed);
+    MaxpRegionMaker rm_local(w, data, dist_matrix, n, m, controls, init_areas, seed,
+                             w_symmetric);
     int tmp_p = rm_local.GetPRegions();
     double of = rm_local.GetInitObjectiveFunction();
     
@@ -1116,7 +1126,8 @@ void MaxpRegion::RunConstruction(long long seed)
 
 void MaxpRegion::RunAZP(std::vector<int>& solution, long long seed, int i)
 {
-    AZP azp(largest_p, w, data, dist_matrix, n, m, controls, 0, solution, seed);
+    AZP azp(largest_p, w, data, dist_matrix, n, m, controls, 0, solution, seed,
+            w_symmetric);
     
     std::vector<int> result = azp.GetResults();
     double of = azp.GetFinalObjectiveFunction();
@@ -1170,7 +1181,8 @@ alpha(_alpha), sa_iter(_sa_iter)
 
 void MaxpSA::RunConstruction(long long seed)
 {
-    MaxpRegionMaker rm_local(w, data, dist_matrix, n, m, controls, init_areas, seed);
+    MaxpRegionMaker rm_local(w, data, dist_matrix, n, m, controls, init_areas, seed,
+                             w_symmetric);
     int tmp_p = rm_local.GetPRegions();
     double of = rm_local.GetInitObjectiveFunction();
     
@@ -1187,7 +1199,8 @@ void MaxpSA::RunConstruction(long long seed)
 
 void MaxpSA::RunAZP(std::vector<int>& solution, long long seed, int i)
 {
-    AZPSA azp(largest_p, w, data, dist_matrix, n, m, controls, alpha, sa_iter, 0, solution, seed);
+    AZPSA azp(largest_p, w, data, dist_matrix, n, m, controls, alpha, sa_iter, 0, solution, seed,
+              w_symmetric);
     
     std::vector<int> result = azp.GetResults();
     double of = azp.GetFinalObjectiveFunction();
@@ -1243,7 +1256,8 @@ tabuLength(_tabu_length), convTabu(_conv_tabu)
 
 void MaxpTabu::RunConstruction(long long seed)
 {
-    MaxpRegionMaker rm_local(w, data, dist_matrix, n, m, controls, init_areas, seed);
+    MaxpRegionMaker rm_local(w, data, dist_matrix, n, m, controls, init_areas, seed,
+                             w_symmetric);
     int tmp_p = rm_local.GetPRegions();
     double of = rm_local.GetInitObjectiveFunction();
     
@@ -1260,7 +1274,8 @@ void MaxpTabu::RunConstruction(long long seed)
 
 void MaxpTabu::RunAZP(std::vector<int>& solution, long long seed, int i)
 {
-    AZPTabu azp(largest_p, w, data, dist_matrix, n, m, controls, tabuLength, convTabu, 0, solution, seed);
+    AZPTabu azp(largest_p, w, data, dist_matrix, n, m, controls, tabuLength, convTabu, 0, solution, seed,
+                w_symmetric);
     
     std::vector<int> result = azp.GetResults();
     double of = azp.GetFinalObjectiveFunction();
@@ -1325,6 +1340,12 @@ void AZPSA::LocalImproving()
                         areas[randomArea] = false;
                         // get possible move of this randomArea
                         std::set<int> possibleMove = getPossibleMove(randomArea);
+                        // a move that breaks the region is never made: skip
+                        // the area before evaluating the objective
+                        if (!possibleMove.empty() &&
+                            !objective_function->checkFeasibility(region, randomArea)) {
+                            continue;
+                        }
                         // check obj change before contiguity check
                         for (move_it = possibleMove.begin();
                              !moved && move_it != possibleMove.end();
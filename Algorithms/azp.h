@@ -32,6 +32,7 @@
 
 #include "../ShapeOperations/GalWeight.h"
 #include "rng.h"
+#include "articulation.h"
 #include "DataUtils.h"
 
 typedef boost::unordered_map<int, boost::unordered_map<int, bool> > REGION_AREAS;
@@ -139,11 +140,29 @@ protected:
 ////////////////////////////////////////////////////////////////////////////////
 // ObjectiveFunction: the target of the AZP is to minimize the objective function
 // of clustering results. E.g. sum of squares
+//
+// The sum of squares of each region is cached in region_of, together with the
+// number of areas and the sum of the variables of the region, so the change
+// of moving one area between two regions is computed in O(m) from the mean
+// of the regions, without copying them:
+//   remove x from n areas with mean c:  ss - n/(n-1) * |x - c|^2
+//   add x to n areas with mean c:       ss + n/(n+1) * |x - c|^2
+// area_region is a flat copy of the membership used by the contiguity check,
+// which looks up the articulation points of the region when it can.
+// The cache is rebuilt by UpdateRegions() / UpdateRegion() after the regions
+// are changed from outside.
 class ObjectiveFunction
 {
 public:
-    ObjectiveFunction(int _n, int _m, double** _data, GalElement* _w, REGION_AREAS& _regions)
-    : n(_n), m(_m), data(_data), w(_w), regions(_regions) {}
+    // w_symmetric: ArticulationCache::CheckSymmetric() of w
+    ObjectiveFunction(int _n, int _m, double** _data, GalElement* _w, REGION_AREAS& _regions,
+                      bool w_symmetric)
+    : n(_n), m(_m), data(_data), w(_w), regions(_regions),
+    area_region(_n, -1), visited(_n, 0), visit_stamp(0),
+    cut_points(_w, _n, w_symmetric)
+    {
+        UpdateRegions();
+    }
     virtual ~ObjectiveFunction() {}
 
     virtual double GetValue() {
@@ -152,10 +171,9 @@ public:
         REGION_AREAS::iterator it;
         for (it = regions.begin(); it != regions.end(); ++it) {
             int region = it->first;
-            if (region_of.find(region) == region_of.end()) {
+            if (!HasRegion(region)) {
                 // objective function of region needs to be computed
-                double obj = getObjectiveValue(regions[region]);
-                region_of[region] = obj;
+                UpdateRegionStats(region);
             }
             ss += region_of[region];
         }
@@ -177,24 +195,20 @@ public:
     
 
     virtual void UpdateRegions() {
-        // region changes, update it's
+        // regions change, rebuild all cached values
+        std::fill(area_region.begin(), area_region.end(), -1);
+        std::fill(has_region.begin(), has_region.end(), 0);
+        cut_points.InvalidateAll();
         REGION_AREAS::iterator it;
         for (it = regions.begin(); it != regions.end(); ++it) {
-            int region = it->first;
-            double obj = getObjectiveValue(regions[region]);
-            region_of[region] = obj;
+            UpdateRegionStats(it->first);
         }
     }
 
     virtual void UpdateRegion(int region) {
         // region changes, update it's
-        REGION_AREAS::iterator it;
-        for (it = regions.begin(); it != regions.end(); ++it) {
-            int r = it->first;
-            if (r == region) {
-                double obj = getObjectiveValue(regions[region]);
-                region_of[region] = obj;
-            }
+        if (regions.find(region) != regions.end()) {
+            UpdateRegionStats(region);
         }
     }
 
@@ -226,16 +240,8 @@ public:
     virtual double TabuSwap(int area, int from_region, int to_region) {
         // try to swap area to region, compute the value of objective function
         // no phyical swap happens
-        boost::unordered_map<int, bool> from_areas = regions[from_region];
-        boost::unordered_map<int, bool> to_areas = regions[to_region];
-        from_areas.erase(area);
-        to_areas[area] = false;
-
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
         double ss = GetValue();
-        double delta = ss_from + ss_to - region_of[from_region] - region_of[to_region];
+        double delta = RemoveDelta(area, from_region) + AddDelta(area, to_region);
         double new_ss = ss + delta;
 
         return new_ss;
@@ -244,24 +250,16 @@ public:
     virtual std::pair<double, bool> TrySwap(int area, int from_region, int to_region) {
         // try to swap area to region, compute the value of objective function
         // phyical swap could happen if contiguity check is passed
-        boost::unordered_map<int, bool> from_areas = regions[from_region];
-        boost::unordered_map<int, bool> to_areas = regions[to_region];
-        from_areas.erase(area);
-        to_areas[area] = false;
+        double delta_from = RemoveDelta(area, from_region);
+        double delta_to = AddDelta(area, to_region);
 
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
-        double delta = ss_from + ss_to - region_of[from_region] - region_of[to_region];
+        double delta = delta_from + delta_to;
         if (delta <= 0) {
             // improved
             if (checkFeasibility(from_region, area)) {
-                region_of[from_region] = ss_from;
-                region_of[to_region] = ss_to;
                 // confirm swap, lock
                 // update values for two changed regions
-                regions[from_region] = from_areas;
-                regions[to_region] = to_areas;
+                ApplyMove(area, from_region, to_region, delta_from, delta_to);
                 return std::make_pair(delta, true);
             }
         }
@@ -271,27 +269,18 @@ public:
     virtual std::pair<double, bool> TrySwapSA(int area, int from_region, int to_region, double best_of) {
         // try to swap area to region, compute the value of objective function
         // phyical swap could happen if contiguity check is passed
-        boost::unordered_map<int, bool> from_areas = regions[from_region];
-        boost::unordered_map<int, bool> to_areas = regions[to_region];
-        from_areas.erase(area);
-        to_areas[area] = false;
-        
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
         double ss = GetValue();
-        double delta = ss_from + ss_to - region_of[from_region] - region_of[to_region];
-        double new_ss = ss + delta;
+        double delta_from = RemoveDelta(area, from_region);
+        double delta_to = AddDelta(area, to_region);
+
+        double new_ss = ss + delta_from + delta_to;
 
         if (new_ss <= best_of) {
             // improved
             if (checkFeasibility(from_region, area)) {
-                region_of[from_region] = ss_from;
-                region_of[to_region] = ss_to;
                 // confirm swap, lock
                 // update values for two changed regions
-                regions[from_region] = from_areas;
-                regions[to_region] = to_areas;
+                ApplyMove(area, from_region, to_region, delta_from, delta_to);
                 return std::make_pair(new_ss, true);
             }
         }
@@ -299,70 +288,193 @@ public:
     }
 
     virtual double MakeMove(int area, int from_region, int to_region) {
-        // use reference here to make actual change
-        boost::unordered_map<int, bool>& from_areas = regions[from_region];
-        boost::unordered_map<int, bool>& to_areas = regions[to_region];
-        
-        if (from_areas.size() <=1) {
+        if (regions[from_region].size() <=1) {
             // has to make sure each region has at least one area
             return 0;
         }
-        from_areas.erase(area);
-        to_areas[area] = false;
-
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
-        region_of[from_region] = ss_from;
-        region_of[to_region] = ss_to;
-        // update values for two changed regions
-        regions[from_region] = from_areas;
-        regions[to_region] = to_areas;
+        double delta_from = RemoveDelta(area, from_region);
+        double delta_to = AddDelta(area, to_region);
+        ApplyMove(area, from_region, to_region, delta_from, delta_to);
 
         return GetValue();
     }
 
     bool checkFeasibility(int regionID, int areaID, bool is_remove = true)
     {
-        // Check feasibility from a change region
-        boost::unordered_map<int, bool> areas2Eval = regions[regionID];
-
-        if (is_remove) {
-            // removing an area from a region
-            areas2Eval.erase(areaID);
-        } else {
-            // adding an area from a region)
-            areas2Eval[areaID] = true;
+        // Check feasibility from a change region: after removing (or adding)
+        // areaID, all areas of the region should still be connected
+        boost::unordered_map<int, bool>& areas = regions[regionID];
+        bool in_region = IsInRegion(areaID, regionID);
+        size_t n_eval = areas.size();
+        if (is_remove && in_region) {
+            n_eval -= 1;
+        } else if (!is_remove && !in_region) {
+            n_eval += 1;
         }
-        
-        if (areas2Eval.empty()) {
+
+        if (n_eval == 0) {
             return false;
         }
-        
-        // remove the area first
-        int seedArea = areas2Eval.begin()->first;
+
+        if (is_remove && in_region) {
+            // an area can leave unless it's an articulation point
+            if (!cut_points.IsValid(regionID)) {
+                region_members.clear();
+                boost::unordered_map<int, bool>::iterator mit;
+                for (mit = areas.begin(); mit != areas.end(); ++mit) {
+                    region_members.push_back(mit->first);
+                }
+                cut_points.Update(regionID, region_members);
+            }
+            bool feasible = false;
+            if (cut_points.CanRemove(regionID, areaID, feasible)) {
+                return feasible;
+            }
+        }
+
+        // start from any area of the changed region
+        int seedArea = areaID;
+        boost::unordered_map<int, bool>::iterator it;
+        for (it = areas.begin(); it != areas.end(); ++it) {
+            if (!is_remove || it->first != areaID) {
+                seedArea = it->first;
+                break;
+            }
+        }
 
         // then, start from 1st object, do BFS
-        std::stack<int> processed_ids;
-        processed_ids.push(seedArea);
+        NextVisitStamp();
+        if (is_remove) {
+            visited[areaID] = visit_stamp; // don't walk through it
+        }
+        size_t n_reached = 0;
+        processed_ids.clear();
+        processed_ids.push_back(seedArea);
+        visited[seedArea] = visit_stamp;
         while (processed_ids.empty() == false) {
-            int fid = processed_ids.top();
-            processed_ids.pop();
-            areas2Eval.erase(fid); // remove area from current group as processed
-            const std::vector<long>& nbrs = w[fid].GetNbrs();
+            int fid = processed_ids.back();
+            processed_ids.pop_back();
+            n_reached += 1;
+            GalNbrs nbrs = w[fid].GetNbrs();
             for (int i=0; i<nbrs.size(); i++ ) {
-                int nid = nbrs[i];
-                if (areas2Eval.find(nid) != areas2Eval.end()) {
+                int nid = (int)nbrs[i];
+                if (visited[nid] == visit_stamp) {
+                    continue;
+                }
+                bool in_group = nid == areaID ? !is_remove :
+                                    area_region[nid] == regionID;
+                if (in_group) {
                     // only processed the neighbor in current group
-                    processed_ids.push(nid);
+                    visited[nid] = visit_stamp;
+                    processed_ids.push_back(nid);
                 }
             }
         }
-        // all should be removed if all connected
-        return areas2Eval.empty();
+        // all should be reached if all connected
+        return n_reached == n_eval;
     }
     
 protected:
+    bool HasRegion(int region) {
+        return region < (int)has_region.size() && has_region[region];
+    }
+
+    bool IsInRegion(int area, int region) {
+        return area_region[area] == region;
+    }
+
+    void EnsureRegion(int region) {
+        if (region >= (int)has_region.size()) {
+            has_region.resize(region + 1, 0);
+            region_of.resize(region + 1, 0);
+            region_size.resize(region + 1, 0);
+            region_sum.resize((size_t)(region + 1) * m, 0);
+        }
+    }
+
+    void UpdateRegionStats(int region) {
+        // sum of squares, number of areas and sum of the variables of region
+        EnsureRegion(region);
+        boost::unordered_map<int, bool>& areas = regions[region];
+        double* sum = m > 0 ? &region_sum[(size_t)region * m] : 0;
+        for (int j=0; j<m; ++j) {
+            sum[j] = 0;
+        }
+        boost::unordered_map<int, bool>::iterator sit;
+        for (sit = areas.begin(); sit != areas.end(); ++sit) {
+            int idx = sit->first;
+            area_region[idx] = region;
+            for (int j=0; j<m; ++j) {
+                sum[j] += data[idx][j];
+            }
+        }
+        region_size[region] = (int)areas.size();
+        region_of[region] = getObjectiveValue(areas);
+        has_region[region] = 1;
+        cut_points.Invalidate(region);
+    }
+
+    double DistanceToMean(int area, int region) {
+        // squared distance from area to the mean of region
+        double n_areas = (double)region_size[region];
+        const double* sum = &region_sum[(size_t)region * m];
+        double d = 0, tmp = 0;
+        for (int j=0; j<m; ++j) {
+            tmp = data[area][j] - sum[j] / n_areas;
+            d += tmp * tmp;
+        }
+        return d;
+    }
+
+    double RemoveDelta(int area, int region) {
+        // change of the sum of squares of region if area is removed
+        if (!HasRegion(region)) UpdateRegionStats(region);
+        int sz = region_size[region];
+        if (sz <= 1) {
+            return -region_of[region];
+        }
+        return -DistanceToMean(area, region) * sz / (sz - 1.0);
+    }
+
+    double AddDelta(int area, int region) {
+        // change of the sum of squares of region if area is added
+        if (!HasRegion(region)) UpdateRegionStats(region);
+        int sz = region_size[region];
+        if (sz == 0) {
+            return 0;
+        }
+        return DistanceToMean(area, region) * sz / (sz + 1.0);
+    }
+
+    void ApplyMove(int area, int from_region, int to_region,
+                   double delta_from, double delta_to) {
+        regions[from_region].erase(area);
+        regions[to_region][area] = false;
+        area_region[area] = to_region;
+        cut_points.Invalidate(from_region);
+        cut_points.Invalidate(to_region);
+
+        region_size[from_region] -= 1;
+        region_size[to_region] += 1;
+        double* from_sum = &region_sum[(size_t)from_region * m];
+        double* to_sum = &region_sum[(size_t)to_region * m];
+        for (int j=0; j<m; ++j) {
+            from_sum[j] -= data[area][j];
+            to_sum[j] += data[area][j];
+        }
+        region_of[from_region] = region_size[from_region] > 0 ?
+                                    region_of[from_region] + delta_from : 0;
+        region_of[to_region] += delta_to;
+    }
+
+    void NextVisitStamp() {
+        visit_stamp += 1;
+        if (visit_stamp == std::numeric_limits<int>::max()) {
+            std::fill(visited.begin(), visited.end(), 0);
+            visit_stamp = 1;
+        }
+    }
+
     // n: number of observations
     int n;
 
@@ -375,9 +487,24 @@ protected:
     // original row-wise data
     double** data;
 
-    // cache the cetnroids for regions, any change of the region should
-    // call updateRegionCentroids()
-    std::map<int, double > region_of;
+    // cache the sum of squares of regions, indexed by region, any change of
+    // the region should call UpdateRegion()
+    std::vector<double> region_of;
+    std::vector<char> has_region;
+    std::vector<int> region_size;
+    std::vector<double> region_sum; // region * m + j
+
+    // region of each area, -1 if not assigned
+    std::vector<int> area_region;
+
+    // BFS of checkFeasibility(), reused between calls
+    std::vector<int> visited;
+    int visit_stamp;
+    std::vector<int> processed_ids;
+
+    // articulation points of the regions, see UpdateRegion()
+    ArticulationCache cut_points;
+    std::vector<int> region_members;
 
     // a reference to region data: region2Area
     REGION_AREAS& regions;
@@ -390,12 +517,14 @@ class RegionMaker
 {
 public:
     // for p-region problem
+    // w_symmetric is ArticulationCache::CheckSymmetric() of w, or -1 to
+    // check it here; the region makers built by this one get it passed in
     RegionMaker(int p, GalElement* const w,
                 double** data, // row-wise
                 RawDistMatrix* dist_matrix,
                 int n, int m, const std::vector<ZoneControl>& c,
                 const std::vector<int>& init_regions=std::vector<int>(),
-                long long seed=123456789);
+                long long seed=123456789, int w_symmetric=-1);
 
     virtual ~RegionMaker();
 
@@ -483,6 +612,9 @@ protected:
     Xoroshiro128Random rng;
     
     bool is_control_satisfied;
+
+    // the links of w are symmetric, for the ArticulationCache
+    bool w_symmetric;
     
 public:
     // for copy
@@ -527,7 +659,7 @@ public:
                 RawDistMatrix* dist_matrix,
                 int n, int m, const std::vector<ZoneControl>& c,
                 const std::vector<int>& init_areas=std::vector<int>(),
-                long long seed=123456789);
+                long long seed=123456789, int w_symmetric=-1);
 
     virtual ~MaxpRegionMaker() {
         if (objective_function) {
@@ -750,13 +882,14 @@ public:
         RawDistMatrix* dist_matrix,
         int n, int m, const std::vector<ZoneControl>& c, int inits=0,
         const std::vector<int>& init_regions=std::vector<int>(),
-        long long seed=123456789)
-    : RegionMaker(p,w,data,dist_matrix,n,m,c,init_regions, seed)
+        long long seed=123456789, int w_symmetric=-1)
+    : RegionMaker(p,w,data,dist_matrix,n,m,c,init_regions, seed, w_symmetric)
     {
         if (inits > 0) {
             // ARiSeL
             for (int i=0; i<inits-1; ++i) {
-                RegionMaker rm(p,w,data,dist_matrix,n,m,c,init_regions, seed + i);
+                RegionMaker rm(p,w,data,dist_matrix,n,m,c,init_regions, seed + i,
+                               this->w_symmetric);
                 if (rm.objInfo < this->objInfo && rm.IsSatisfyControls())  {
                     // better initial solution
                     this->Copy(rm);
@@ -830,14 +963,16 @@ public:
           int n, int m, const std::vector<ZoneControl>& c,
           double _alpha = 0.85, int _max_iter= 1, int inits=0,
           const std::vector<int>& init_regions=std::vector<int>(),
-          long long seed=123456789)
-    : RegionMaker(p,w,data,dist_matrix,n,m,c,init_regions,seed), temperature(1.0),
+          long long seed=123456789, int w_symmetric=-1)
+    : RegionMaker(p,w,data,dist_matrix,n,m,c,init_regions,seed,w_symmetric),
+    temperature(1.0),
     alpha(_alpha), max_iter(_max_iter)
     {
         if (inits > 0) {
             // ARiSeL
             for (int i=0; i<inits-1; ++i) {
-                RegionMaker rm(p,w,data,dist_matrix,n,m,c,init_regions, seed + i);
+                RegionMaker rm(p,w,data,dist_matrix,n,m,c,init_regions, seed + i,
+                               this->w_symmetric);
                 if (rm.objInfo < this->objInfo && rm.IsSatisfyControls())  {
                     // better initial solution
                     this->Copy(rm);
@@ -936,14 +1071,15 @@ public:
             int n, int m, const std::vector<ZoneControl>& c,
             int tabu_length=10, int _convTabu=0,  int inits = 0,
             const std::vector<int>& init_regions=std::vector<int>(),
-            long long seed=123456789)
-    : RegionMaker(p,w,data,dist_matrix,n,m,c,init_regions, seed),
+            long long seed=123456789, int w_symmetric=-1)
+    : RegionMaker(p,w,data,dist_matrix,n,m,c,init_regions, seed, w_symmetric),
     tabuLength(tabu_length), convTabu(_convTabu)
     {
         if (inits > 0) {
             // ARiSeL
             for (int i=0; i<inits-1; ++i) {
-                RegionMaker rm(p,w,data,dist_matrix,n,m,c,init_regions, seed + i);
+                RegionMaker rm(p,w,data,dist_matrix,n,m,c,init_regions, seed + i,
+                               this->w_symmetric);
                 if (rm.objInfo < this->objInfo && rm.IsSatisfyControls())  {
                     // better initial solution
                     this->Copy(rm);
@@ -0,0 +1,202 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/ref.hpp>
+
+#include "perm_sampler.h"
+#include "perm_scheduler.h"
+#include "cpu_lisa.h"
+
+namespace {
+
+/** Flat data shared by all workers of one run */
+struct CpuKernelData
+{
+    int rows;
+    int permutations;
+    std::vector<int> num_nbrs; // neighbor count without self
+    std::vector<char> undefs; // empty if there are no undefined values
+    PermutationSampler sampler;
+
+    CpuKernelData(int rows_s, int permutations_s, GalElement* w,
+                  const std::vector<bool>& undefs_s)
+    : rows(rows_s), permutations(permutations_s), num_nbrs(rows_s, 0)
+    {
+        for (int i=0; i<rows; i++) {
+            num_nbrs[i] = (int)w[i].Size();
+            if (w[i].Check(i)) num_nbrs[i] -= 1; // self-neighbor
+        }
+        bool has_undef = false;
+        for (int i=0; i<rows && i<(int)undefs_s.size(); i++) {
+            if (undefs_s[i]) { has_undef = true; break; }
+        }
+        if (has_undef) {
+            undefs.resize(rows, 0);
+            for (int i=0; i<rows; i++) undefs[i] = undefs_s[i];
+        }
+    }
+
+    const char* GetUndefs() const { return undefs.empty() ? 0 : &undefs[0]; }
+};
+
+struct CpuLisaJob
+{
+    const CpuKernelData* d;
+    const double* values;
+    const double* lag_values;
+    const double* local_moran;
+    bool row_standardize;
+    double* p;
+
+    void operator()(int obs_start, int obs_end, uint64_t seed_start) const
+    {
+        PermutationSampler::Buffer perm_buf(d->sampler);
+        const char* undefs = d->GetUndefs();
+        const uint64_t permutations = d->permutations;
+
+        for (int i=obs_start; i<=obs_end; i++) {
+            int numNeighbors = d->num_nbrs[i];
+            if (numNeighbors == 0) continue; // isolate
+            const double xi = values[i];
+            const double lmi = local_moran[i];
+            uint64_t countLarger = 0;
+
+            for (uint64_t perm=0; perm<permutations; perm++) {
+                int nn = d->sampler.Draw(perm_buf, i, numNeighbors, seed_start);
+                const int* nbrs = perm_buf.GetNeighbors();
+                int validNeighbors = 0;
+                double permutedLag = 0;
+                if (undefs == 0) {
+                    for (int j=0; j<nn; j++) permutedLag += lag_values[nbrs[j]];
+                    validNeighbors = nn;
+                } else {
+                    for (int j=0; j<nn; j++) {
+                        int nb = nbrs[j];
+                        if (!undefs[nb]) {
+                            permutedLag += lag_values[nb];
+                            validNeighbors ++;
+                        }
+                    }
+                }
+                if (validNeighbors > 0 && row_standardize) {
+                    permutedLag /= validNeighbors;
+                }
+                if (permutedLag * xi >= lmi) countLarger++;
+            }
+            // pick the smallest
+            if (permutations-countLarger <= countLarger) {
+                countLarger = permutations-countLarger;
+            }
+            p[i] = (countLarger+1.0)/(permutations+1);
+        }
+    }
+};
+
+struct CpuLocalJCJob
+{
+    const CpuKernelData* d;
+    const int* zz;
+    const double* local_jc;
+    double* p;
+
+    void operator()(int obs_start, int obs_end, uint64_t seed_start) const
+    {
+        PermutationSampler::Buffer perm_buf(d->sampler);
+        const char* undefs = d->GetUndefs();
+        const int permutations = d->permutations;
+
+        for (int i=obs_start; i<=obs_end; i++) {
+            if (undefs && undefs[i]) continue;
+            if (local_jc[i] == 0) {
+                p[i] = 0;
+                continue;
+            }
+            int numNeighbors = d->num_nbrs[i];
+            if (numNeighbors == 0) continue; // isolate
+            int countLarger = 0;
+
+            for (int perm=0; perm<permutations; perm++) {
+                int nn = d->sampler.Draw(perm_buf, i, numNeighbors, seed_start);
+                const int* nbrs = perm_buf.GetNeighbors();
+                double perm_jc = 0;
+                for (int j=0; j<nn; j++) perm_jc += zz[nbrs[j]];
+                if (perm_jc >= local_jc[i]) countLarger++;
+            }
+            // pick the smallest
+            if (permutations-countLarger < countLarger) {
+                countLarger = permutations - countLarger;
+            }
+            p[i] = (countLarger + 1.0)/(permutations+1.0);
+        }
+    }
+};
+
+}
+
+bool cpu_lisa(int rows, int permutations, unsigned long long last_seed_used,
+              double* values, double* lag_values, double* local_moran,
+              const std::vector<bool>& undefs, bool row_standardize,
+              GalElement* w, double* p)
+{
+    if (rows <= 0 || values == 0 || lag_values == 0) return false;
+
+    CpuKernelData d(rows, permutations, w, undefs);
+    // observations that are not isolates can be drawn as permuted neighbors
+    std::vector<bool> candidates(rows);
+    for (int i=0; i<rows; i++) candidates[i] = w[i].Size() > 0;
+    d.sampler.Init(candidates, PermutationSampler::GetDefaultType());
+
+    CpuLisaJob job;
+    job.d = &d;
+    job.values = values;
+    job.lag_values = lag_values;
+    job.local_moran = local_moran;
+    job.row_standardize = row_standardize;
+    job.p = p;
+
+    PermutationScheduler scheduler(rows, w, permutations,
+                                   d.sampler.GetType());
+    scheduler.Run(boost::cref(job), last_seed_used);
+    return true;
+}
+
+bool cpu_localjoincount(int rows, int permutations,
+                        unsigned long long last_seed_used, int* zz,
+                        double* local_jc, const std::vector<bool>& undefs,
+                        GalElement* w, double* p)
+{
+    if (rows <= 0 || zz == 0) return false;
+
+    CpuKernelData d(rows, permutations, w, undefs);
+    // observations with defined values can be drawn as permuted neighbors
+    std::vector<bool> candidates(rows);
+    for (int i=0; i<rows; i++) candidates[i] = d.undefs.empty() || !d.undefs[i];
+    d.sampler.Init(candidates, PermutationSampler::GetDefaultType());
+
+    CpuLocalJCJob job;
+    job.d = &d;
+    job.zz = zz;
+    job.local_jc = local_jc;
+    job.p = p;
+
+    PermutationScheduler scheduler(rows, w, permutations,
+                                   d.sampler.GetType());
+    scheduler.Run(boost::cref(job), last_seed_used);
+    return true;
+}
@@ -0,0 +1,53 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_CPU_LISA_H__
+#define __GEODA_CENTER_CPU_LISA_H__
+
+#include <vector>
+
+#include "../ShapeOperations/GalWeight.h"
+
+/**
+ CPU counterparts of gpu_lisa() and gpu_localjoincount() for machines
+ without an OpenCL device.
+
+ The data are laid out as for the OpenCL kernels: a flat array of neighbor
+ counts (self-neighbors excluded), the values, a byte mask of undefined
+ values, and one random stream per observation. The observations are run
+ with PermutationScheduler and the neighbors are drawn with
+ PermutationSampler, exactly as LisaCoordinator and JCCoordinator do, so
+ the pseudo p-values are identical to those of their CalcPseudoP_threaded()
+ for the same seed (checked by main_cpu_lisa_test() in cpu_lisa_test.cpp).
+ Isolates are left untouched in p.
+
+ values is the variable of the observation, lag_values the variable of the
+ permuted neighbors (values for the univariate LISA).
+ */
+bool cpu_lisa(int rows, int permutations, unsigned long long last_seed_used,
+              double* values, double* lag_values, double* local_moran,
+              const std::vector<bool>& undefs, bool row_standardize,
+              GalElement* w, double* p);
+
+bool cpu_localjoincount(int rows, int permutations,
+                        unsigned long long last_seed_used, int* zz,
+                        double* local_jc, const std::vector<bool>& undefs,
+                        GalElement* w, double* p);
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ Test code for cpu_lisa(): the pseudo p-values of the CPU kernel must be
+ identical to those of AbstractCoordinator::CalcPseudoP_range() for the
+ same seed, on any number of cores and with either permutation sampler.
+
+ The test writes a rook GAL file of a grid with a few isolates, runs the
+ univariate and the bivariate LISA of LisaCoordinator once with
+ CalcPseudoP_threaded() and once with the CPU kernel, and compares the
+ p-values bit by bit. main_cpu_lisa_test() returns the number of failed
+ cases; build with -DGEODA_CPU_LISA_TEST_MAIN to get a main() for it.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "../GdaConst.h"
+#include "../GenUtils.h"
+#include "../Explore/LisaCoordinator.h"
+#include "cpu_lisa.h"
+
+namespace {
+
+/** Gives the test access to the seed and the p-values */
+class CpuLisaTestCoordinator : public LisaCoordinator
+{
+public:
+    CpuLisaTestCoordinator(const wxString& gal_path, int n,
+                           const std::vector<double>& x,
+                           const std::vector<double>& y, int lisa_type)
+    : LisaCoordinator(gal_path, n, x, y, lisa_type, 999, true, true) {}
+
+    std::vector<double> Run(uint64_t seed, bool use_cpu_kernel)
+    {
+        GdaConst::gda_use_gpu = false;
+        GdaConst::gda_use_cpu_kernel = use_cpu_kernel;
+        reuse_last_seed = true;
+        last_seed_used = seed;
+        CalcPseudoP();
+        double* p = GetLocalSignificanceValues(0);
+        return std::vector<double>(p, p + num_obs);
+    }
+};
+
+/** rook contiguity of a rows x cols grid; the cells of the last column
+ of every fifth row are isolates */
+void write_grid_gal(const char* path, int rows, int cols)
+{
+    std::ofstream out(path);
+    out << "0 " << rows * cols << "\n";
+    for (int r=0; r<rows; r++) {
+        for (int c=0; c<cols; c++) {
+            std::vector<int> nbrs;
+            bool isolate = (c == cols-1 && r % 5 == 0);
+            if (!isolate) {
+                if (r > 0 && !(c == cols-1 && (r-1) % 5 == 0))
+                    nbrs.push_back((r-1) * cols + c);
+                if (r < rows-1 && !(c == cols-1 && (r+1) % 5 == 0))
+                    nbrs.push_back((r+1) * cols + c);
+                if (c > 0) nbrs.push_back(r * cols + c - 1);
+                if (c < cols-1 && !(c+1 == cols-1 && r % 5 == 0))
+                    nbrs.push_back(r * cols + c + 1);
+            }
+            out << r * cols + c + 1 << " " << nbrs.size() << "\n";
+            for (size_t j=0; j<nbrs.size(); j++) {
+                out << (j > 0 ? " " : "") << nbrs[j] + 1;
+            }
+            out << "\n";
+        }
+    }
+}
+
+int compare_pvalues(const char* name, const std::vector<double>& ref,
+                    const std::vector<double>& p)
+{
+    for (size_t i=0; i<ref.size(); i++) {
+        if (ref[i] != p[i]) {
+            printf("FAILED %s: observation %d, CalcPseudoP_range %.17g, "
+                   "cpu_lisa %.17g\n", name, (int)i, ref[i], p[i]);
+            return 1;
+        }
+    }
+    printf("ok %s\n", name);
+    return 0;
+}
+
+}
+
+int main_cpu_lisa_test(int argc, char** argv)
+{
+    const char* gal_path = argc > 1 ? argv[1] : "cpu_lisa_test.gal";
+    const int rows = 40, cols = 25, n = rows * cols;
+    const uint64_t seed = 123456789;
+    write_grid_gal(gal_path, rows, cols);
+
+    std::vector<double> x(n), y(n);
+    for (int i=0; i<n; i++) {
+        x[i] = Gda::ThomasWangHashDouble(i);
+        y[i] = Gda::ThomasWangHashDouble(n + i);
+    }
+
+    bool use_gpu = GdaConst::gda_use_gpu;
+    bool use_cpu_kernel = GdaConst::gda_use_cpu_kernel;
+    bool early_stop = GdaConst::gda_perm_early_stop;
+    bool legacy = GdaConst::gda_use_legacy_perm_sampler;
+    bool set_cores = GdaConst::gda_set_cpu_cores;
+    int cores = GdaConst::gda_cpu_cores;
+    GdaConst::gda_perm_early_stop = false;
+    GdaConst::gda_set_cpu_cores = true;
+
+    int failed = 0;
+    const int lisa_types[] = { 0, 1 }; // univariate, bivariate
+    const int num_cores[] = { 1, 4 };
+    for (int l=0; l<2; l++) {
+        CpuLisaTestCoordinator lisa(gal_path, n, x, y, lisa_types[l]);
+        for (int s=0; s<2; s++) {
+            GdaConst::gda_use_legacy_perm_sampler = (s == 1);
+            for (int c=0; c<2; c++) {
+                GdaConst::gda_cpu_cores = num_cores[c];
+                char name[128];
+                sprintf(name, "%s, %s sampler, %d cores",
+                        lisa_types[l] == 0 ? "univariate" : "bivariate",
+                        s == 1 ? "legacy" : "floyd", num_cores[c]);
+                std::vector<double> ref = lisa.Run(seed, false);
+                std::vector<double> p = lisa.Run(seed, true);
+                failed += compare_pvalues(name, ref, p);
+            }
+        }
+    }
+
+    GdaConst::gda_use_gpu = use_gpu;
+    GdaConst::gda_use_cpu_kernel = use_cpu_kernel;
+    GdaConst::gda_perm_early_stop = early_stop;
+    GdaConst::gda_use_legacy_perm_sampler = legacy;
+    GdaConst::gda_set_cpu_cores = set_cores;
+    GdaConst::gda_cpu_cores = cores;
+    remove(gal_path);
+    return failed;
+}
+
+#ifdef GEODA_CPU_LISA_TEST_MAIN
+int main(int argc, char** argv)
+{
+    return main_cpu_lisa_test(argc, argv) == 0 ? 0 : 1;
+}
+#endif
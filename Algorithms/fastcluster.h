@@ -384,16 +384,20 @@ namespace fastcluster {
     
     
     
-    /* Functions for the update of the dissimilarity array */
+    /* Functions for the update of the dissimilarity array, which holds
+       t_float or float values */
     
-    inline static void f_single( t_float * const b, const t_float a ) {
-        if (*b > a) *b = a;
+    template <typename t_dist>
+    inline static void f_single( t_dist * const b, const t_float a ) {
+        if (*b > a) *b = static_cast<t_dist>(a);
     }
-    inline static void f_complete( t_float * const b, const t_float a ) {
-        if (*b < a) *b = a;
+    template <typename t_dist>
+    inline static void f_complete( t_dist * const b, const t_float a ) {
+        if (*b < a) *b = static_cast<t_dist>(a);
     }
-    inline static void f_average( t_float * const b, const t_float a, const t_float s, const t_float t) {
-        *b = s*a + t*(*b);
+    template <typename t_dist>
+    inline static void f_average( t_dist * const b, const t_float a, const t_float s, const t_float t) {
+        *b = static_cast<t_dist>(s*a + t*(*b));
 #ifndef FE_INVALID
 #if HAVE_DIAGNOSTIC
 #pragma GCC diagnostic push
@@ -407,8 +411,9 @@ namespace fastcluster {
 #endif
 #endif
     }
-    inline static void f_weighted( t_float * const b, const t_float a) {
-        *b = (a+*b)*.5;
+    template <typename t_dist>
+    inline static void f_weighted( t_dist * const b, const t_float a) {
+        *b = static_cast<t_dist>((a+*b)*.5);
 #ifndef FE_INVALID
 #if HAVE_DIAGNOSTIC
 #pragma GCC diagnostic push
@@ -422,8 +427,9 @@ namespace fastcluster {
 #endif
 #endif
     }
-    inline static void f_ward( t_float * const b, const t_float a, const t_float c, const t_float s, const t_float t, const t_float v) {
-        *b = ( (v+s)*a - v*c + (v+t)*(*b) ) / (s+t+v);
+    template <typename t_dist>
+    inline static void f_ward( t_dist * const b, const t_float a, const t_float c, const t_float s, const t_float t, const t_float v) {
+        *b = static_cast<t_dist>( ( (v+s)*a - v*c + (v+t)*(*b) ) / (s+t+v) );
         //*b = a+(*b)-(t*a+s*(*b)+v*c)/(s+t+v);
 #ifndef FE_INVALID
 #if HAVE_DIAGNOSTIC
@@ -1047,12 +1053,13 @@ namespace fastcluster {
     void MST_linkage_core(const t_index N, const t_float * const D,
                           cluster_result & Z2);
     
-    template <const unsigned char method, typename t_members>
-    void NN_chain_core(const t_index N, t_float * const D, t_members * const members, cluster_result & Z2)
+    template <const unsigned char method, typename t_members, typename t_dist>
+    void NN_chain_core(const t_index N, t_dist * const D, t_members * const members, cluster_result & Z2)
     {
         /*
          N: integer
-         D: condensed distance matrix N*(N-1)/2
+         D: condensed distance matrix N*(N-1)/2, of t_float or of float to
+            use half of the memory
          Z2: output data structure
          
          This is the NN-chain algorithm, described on page 86 in the following book:
@@ -1072,7 +1079,7 @@ namespace fastcluster {
         
         t_float min;
         
-        for (t_float const * DD=D; DD!=D+(static_cast<std::ptrdiff_t>(N)*(N-1)>>1);
+        for (t_dist const * DD=D; DD!=D+(static_cast<std::ptrdiff_t>(N)*(N-1)>>1);
              ++DD) {
 #if HAVE_DIAGNOSTIC
 #pragma GCC diagnostic push
@@ -1318,7 +1325,7 @@ namespace fastcluster {
         }
         
         if (c1 != 0) {
-            const std::vector<long>& nbrs = w[idx2].GetNbrs();
+            GalNbrs nbrs = w[idx2].GetNbrs();
             for (int i=0; i<nbrs.size(); i++ ) {
                 t_index nid = nbrs[i];
                 if ( clsts[nid]  ==  c1)  {
@@ -1326,7 +1333,7 @@ namespace fastcluster {
                 }
             }
         }  else if (c2 != 0) {
-            const std::vector<long>& nbrs = w[idx1].GetNbrs();
+            GalNbrs nbrs = w[idx1].GetNbrs();
             for (int i=0; i<nbrs.size(); i++ ) {
                 t_index nid = nbrs[i];
                 if ( clsts[nid]  ==  c2)  {
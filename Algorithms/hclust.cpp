@@ -0,0 +1,496 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <utility>
+
+#include "DataUtils.h"
+#include "hclust.h"
+
+using namespace fastcluster;
+
+namespace {
+    /* Squared Euclidean distances of the rows and the cluster centers, as
+       generic_linkage_vector() wants them for Ward's linkage. Clusters are
+       merged in place: a row holds the center of the cluster it stands for
+       and members its size. */
+    class WardVectorDissimilarity {
+        t_float* X;
+        t_index* members;
+        std::ptrdiff_t dim;
+
+    public:
+        WardVectorDissimilarity(t_float* X_s, t_index* members_s,
+                                std::ptrdiff_t dim_s)
+        : X(X_s), members(members_s), dim(dim_s) {}
+
+        template <const bool check_NaN>
+        t_float sqeuclidean(const t_index i, const t_index j) const {
+            t_float sum = 0;
+            t_float const * Pi = X+i*dim;
+            t_float const * Pj = X+j*dim;
+            for (std::ptrdiff_t k=0; k<dim; ++k) {
+                t_float diff = Pi[k] - Pj[k];
+                sum += diff*diff;
+            }
+            if (check_NaN && fc_isnan(sum)) {
+                throw(nan_error());
+            }
+            return sum;
+        }
+
+        t_float ward_initial(const t_index i, const t_index j) const {
+            return sqeuclidean<true>(i,j);
+        }
+
+        static t_float ward_initial_conversion(const t_float min) {
+            return min*.5;
+        }
+
+        t_float ward(const t_index i, const t_index j) const {
+            t_float mi = static_cast<t_float>(members[i]);
+            t_float mj = static_cast<t_float>(members[j]);
+            return sqeuclidean<true>(i,j)*mi*mj/(mi+mj);
+        }
+
+        void merge_inplace(const t_index i, const t_index j) const {
+            t_float const * const Pi = X+i*dim;
+            t_float * const Pj = X+j*dim;
+            t_float mi = static_cast<t_float>(members[i]);
+            t_float mj = static_cast<t_float>(members[j]);
+            for (std::ptrdiff_t k=0; k<dim; ++k) {
+                Pj[k] = (Pi[k]*mi + Pj[k]*mj) / (mi+mj);
+            }
+            members[j] += members[i];
+        }
+
+        void merge_inplace_weighted(const t_index i, const t_index j) const {
+            t_float const * const Pi = X+i*dim;
+            t_float * const Pj = X+j*dim;
+            for (std::ptrdiff_t k=0; k<dim; ++k) {
+                Pj[k] = (Pi[k]+Pj[k])*.5;
+            }
+        }
+    };
+
+    /* kd-tree for Boruvka's algorithm. Each node knows if all of its points
+       are in one component, so the search for the nearest point of another
+       component skips the subtrees of the own component at once. */
+    class BoruvkaTree {
+    public:
+        BoruvkaTree(const double* x_s, int n_s, int dim_s, bool manhattan_s)
+        : x(x_s), n(n_s), dim(dim_s), manhattan(manhattan_s), idx(n_s)
+        {
+            for (int i=0; i<n; i++) idx[i] = i;
+            Build(0, n);
+        }
+
+        /* component of every point; sets the component of the nodes */
+        void SetComponents(const std::vector<int>& comp_s) {
+            comp = &comp_s[0];
+            for (int k=(int)nodes.size()-1; k>=0; k--) {
+                Node& nd = nodes[k];
+                if (nd.left < 0) {
+                    int c = comp[idx[nd.begin]];
+                    for (int i=nd.begin+1; i<nd.end && c >= 0; i++) {
+                        if (comp[idx[i]] != c) c = -1;
+                    }
+                    nd.comp = c;
+                } else {
+                    int c = nodes[nd.left].comp;
+                    nd.comp = (c == nodes[nd.right].comp) ? c : -1;
+                }
+            }
+        }
+
+        /* nearest point to p that is not in component c and is closer than
+           best_d; returns false if there is none */
+        bool Nearest(int p, int c, double& best_d, int& best_q) const {
+            int q = -1;
+            Search(0, x + (size_t)p*dim, c, best_d, q);
+            if (q < 0) return false;
+            best_q = q;
+            return true;
+        }
+
+    protected:
+        struct Node {
+            int begin, end;
+            int left, right;
+            int comp;
+            size_t box; // position of min[dim], max[dim] in boxes
+        };
+
+        static const int leaf_size = 16;
+
+        int Build(int begin, int end) {
+            int k = (int)nodes.size();
+            Node nd;
+            nd.begin = begin;
+            nd.end = end;
+            nd.left = nd.right = -1;
+            nd.comp = -1;
+            nd.box = boxes.size();
+            boxes.resize(boxes.size() + 2*dim);
+            double* lo = &boxes[nd.box];
+            double* hi = lo + dim;
+            for (int d=0; d<dim; d++) {
+                lo[d] = std::numeric_limits<double>::max();
+                hi[d] = -std::numeric_limits<double>::max();
+            }
+            for (int i=begin; i<end; i++) {
+                const double* a = x + (size_t)idx[i]*dim;
+                for (int d=0; d<dim; d++) {
+                    if (a[d] < lo[d]) lo[d] = a[d];
+                    if (a[d] > hi[d]) hi[d] = a[d];
+                }
+            }
+            nodes.push_back(nd);
+            if (end - begin <= leaf_size) return k;
+
+            // split at the median of the widest side
+            int split_d = 0;
+            for (int d=1; d<dim; d++) {
+                if (hi[d] - lo[d] > hi[split_d] - lo[split_d]) split_d = d;
+            }
+            if (hi[split_d] <= lo[split_d]) return k; // all points equal
+            int mid = (begin + end) / 2;
+            std::nth_element(idx.begin() + begin, idx.begin() + mid,
+                             idx.begin() + end, AxisLess(x, dim, split_d));
+            int left = Build(begin, mid);
+            int right = Build(mid, end);
+            nodes[k].left = left;
+            nodes[k].right = right;
+            return k;
+        }
+
+        double BoxDistance(int k, const double* a) const {
+            const double* lo = &boxes[nodes[k].box];
+            const double* hi = lo + dim;
+            double d = 0;
+            for (int i=0; i<dim; i++) {
+                double t = 0;
+                if (a[i] < lo[i]) t = lo[i] - a[i];
+                else if (a[i] > hi[i]) t = a[i] - hi[i];
+                d += manhattan ? t : t*t;
+            }
+            return d;
+        }
+
+        void Search(int k, const double* a, int c, double& best_d,
+                    int& best_q) const {
+            const Node& nd = nodes[k];
+            if (nd.comp == c) return;
+            if (nd.left < 0) {
+                for (int i=nd.begin; i<nd.end; i++) {
+                    int q = idx[i];
+                    if (comp[q] == c) continue;
+                    const double* b = x + (size_t)q*dim;
+                    double d = 0;
+                    for (int j=0; j<dim && d < best_d; j++) {
+                        double t = a[j] - b[j];
+                        d += manhattan ? fabs(t) : t*t;
+                    }
+                    if (d < best_d) {
+                        best_d = d;
+                        best_q = q;
+                    }
+                }
+                return;
+            }
+            double dl = BoxDistance(nd.left, a);
+            double dr = BoxDistance(nd.right, a);
+            int first = nd.left, second = nd.right;
+            if (dr < dl) {
+                std::swap(first, second);
+                std::swap(dl, dr);
+            }
+            if (dl < best_d) Search(first, a, c, best_d, best_q);
+            if (dr < best_d) Search(second, a, c, best_d, best_q);
+        }
+
+        struct AxisLess {
+            const double* x;
+            int dim, d;
+            AxisLess(const double* x_s, int dim_s, int d_s)
+            : x(x_s), dim(dim_s), d(d_s) {}
+            bool operator()(int i, int j) const {
+                return x[(size_t)i*dim + d] < x[(size_t)j*dim + d];
+            }
+        };
+
+        const double* x;
+        int n;
+        int dim;
+        bool manhattan;
+        std::vector<int> idx;
+        std::vector<Node> nodes;
+        std::vector<double> boxes;
+        const int* comp;
+    };
+
+    struct MSTEdge {
+        double dist;
+        int from, to;
+        bool operator<(const MSTEdge& e) const { return dist < e.dist; }
+    };
+
+    int FindRoot(std::vector<int>& parent, int i) {
+        int r = i;
+        while (parent[r] != r) r = parent[r];
+        while (parent[i] != r) {
+            int next = parent[i];
+            parent[i] = r;
+            i = next;
+        }
+        return r;
+    }
+}
+
+HClustering::HClustering(double** data_s, const double* weight_s, int rows_s,
+                         int columns_s, char method_s, char dist_s)
+: data(data_s), weight(weight_s), rows(rows_s), columns(columns_s),
+method(method_s), dist(dist_s)
+{
+}
+
+HClustering::~HClustering()
+{
+}
+
+double HClustering::GetDenseBytes(int rows, bool use_float)
+{
+    double n = rows;
+    return n * (n - 1) / 2.0 * (use_float ? sizeof(float) : sizeof(double));
+}
+
+HClustering::Path HClustering::ChoosePath(int rows, char method, char dist,
+                                          bool use_float, double avail_bytes)
+{
+    if (use_float && (method == 'a' || method == 'm')) {
+        return dense_float_path;
+    }
+    double budget = avail_bytes > 0 ? avail_bytes / 2.0 : 2147483648.0;
+    if (GetDenseBytes(rows, false) <= budget) {
+        return dense_path;
+    }
+    if (method == 's') {
+        return mst_path;
+    }
+    if (method == 'w' && dist == 'e') {
+        return vector_path;
+    }
+    if (method == 'a' || method == 'm') {
+        return dense_float_path;
+    }
+    return dense_path;
+}
+
+bool HClustering::Run(Path path, cluster_result& Z2)
+{
+    if (rows < 2) return false;
+    try {
+        switch (path) {
+            case dense_path:
+                RunDense(Z2);
+                break;
+            case dense_float_path:
+                RunDenseFloat(Z2);
+                break;
+            case vector_path:
+                if (method != 'w' || dist != 'e') return false;
+                RunWardVector(Z2);
+                break;
+            case mst_path:
+                if (method != 's') return false;
+                RunBoruvkaMST(Z2);
+                break;
+        }
+    } catch (std::bad_alloc&) {
+        return false;
+    }
+    return true;
+}
+
+double HClustering::Distance(int i, int j) const
+{
+    double* w = const_cast<double*>(weight);
+    if (dist == 'b') {
+        return DataUtils::ManhattanDistance(data[i], data[j], columns, w);
+    }
+    return DataUtils::EuclideanDistance(data[i], data[j], columns, w);
+}
+
+void HClustering::GetScaledData(std::vector<double>& x) const
+{
+    x.resize((size_t)rows * columns);
+    for (int j=0; j<columns; j++) {
+        double w = weight ? weight[j] : 1.0;
+        // squared Euclidean sums w * diff^2, Manhattan w * |diff|
+        double s = dist == 'b' ? w : sqrt(w);
+        for (int i=0; i<rows; i++) {
+            x[(size_t)i*columns + j] = data[i][j] * s;
+        }
+    }
+}
+
+void HClustering::RunDense(cluster_result& Z2)
+{
+    double* pwdist = NULL;
+    if (dist == 'e') {
+        pwdist = DataUtils::getPairWiseDistance(data,
+                                                const_cast<double*>(weight),
+                                                rows, columns,
+                                                DataUtils::EuclideanDistance);
+    } else {
+        pwdist = DataUtils::getPairWiseDistance(data,
+                                                const_cast<double*>(weight),
+                                                rows, columns,
+                                                DataUtils::ManhattanDistance);
+    }
+
+    auto_array_ptr<t_index> members;
+    if (method == 's') {
+        MST_linkage_core(rows, pwdist, Z2);
+    } else if (method == 'w') {
+        members.init(rows, 1);
+        NN_chain_core<METHOD_METR_WARD, t_index>(rows, pwdist, members, Z2);
+    } else if (method == 'm') {
+        NN_chain_core<METHOD_METR_COMPLETE, t_index>(rows, pwdist, NULL, Z2);
+    } else if (method == 'a') {
+        members.init(rows, 1);
+        NN_chain_core<METHOD_METR_AVERAGE, t_index>(rows, pwdist, members, Z2);
+    }
+    delete[] pwdist;
+}
+
+void HClustering::RunDenseFloat(cluster_result& Z2)
+{
+    size_t nn = (size_t)rows * (rows - 1) / 2;
+    float* pwdist = new float[nn];
+    size_t cnt = 0;
+    for (int i=0; i<rows; i++) {
+        for (int j=i+1; j<rows; j++) {
+            pwdist[cnt++] = (float)Distance(i, j);
+        }
+    }
+
+    auto_array_ptr<t_index> members;
+    if (method == 's') {
+        NN_chain_core<METHOD_METR_SINGLE, t_index>(rows, pwdist, NULL, Z2);
+    } else if (method == 'w') {
+        members.init(rows, 1);
+        NN_chain_core<METHOD_METR_WARD, t_index>(rows, pwdist, members, Z2);
+    } else if (method == 'm') {
+        NN_chain_core<METHOD_METR_COMPLETE, t_index>(rows, pwdist, NULL, Z2);
+    } else if (method == 'a') {
+        members.init(rows, 1);
+        NN_chain_core<METHOD_METR_AVERAGE, t_index>(rows, pwdist, members, Z2);
+    }
+    delete[] pwdist;
+}
+
+void HClustering::RunWardVector(cluster_result& Z2)
+{
+    std::vector<double> x;
+    GetScaledData(x);
+    auto_array_ptr<t_index> members(rows, 1);
+    WardVectorDissimilarity dissim(&x[0], members, columns);
+
+    cluster_result Z_vec(rows-1);
+    generic_linkage_vector<METHOD_METR_WARD>(rows, dissim, Z_vec);
+
+    // Z_vec names clusters by node: rows+k is the cluster of merge k. Use
+    // one observation of each cluster instead, as NN_chain_core() does.
+    // Ward's distances are half of the Lance-Williams update on squared
+    // distances used by the dense path.
+    std::vector<t_index> repr(2 * rows - 1);
+    for (int i=0; i<rows; i++) repr[i] = i;
+    for (int k=0; k<rows-1; k++) {
+        node* nd = Z_vec[k];
+        t_index a = repr[nd->node1];
+        t_index b = repr[nd->node2];
+        repr[rows + k] = a;
+        Z2.append(a, b, 2 * nd->dist);
+    }
+}
+
+void HClustering::RunBoruvkaMST(cluster_result& Z2)
+{
+    std::vector<double> x;
+    GetScaledData(x);
+    BoruvkaTree tree(&x[0], rows, columns, dist == 'b');
+
+    std::vector<int> parent(rows);
+    std::vector<int> comp(rows);
+    for (int i=0; i<rows; i++) parent[i] = i;
+
+    // nearest point of another component found for each point: it stays
+    // the nearest one while it is in another component
+    std::vector<int> nn_idx(rows, -1);
+    std::vector<double> nn_dist(rows, 0);
+
+    std::vector<MSTEdge> best(rows);
+    std::vector<MSTEdge> edges;
+    int n_comps = rows;
+    while (n_comps > 1) {
+        for (int i=0; i<rows; i++) comp[i] = FindRoot(parent, i);
+        tree.SetComponents(comp);
+
+        for (int i=0; i<rows; i++) {
+            best[i].dist = std::numeric_limits<double>::infinity();
+            best[i].from = -1;
+        }
+        for (int p=0; p<rows; p++) {
+            int c = comp[p];
+            MSTEdge& e = best[c];
+            if (nn_idx[p] < 0 || comp[nn_idx[p]] == c) {
+                nn_idx[p] = -1;
+                double d = e.dist;
+                int q = -1;
+                if (!tree.Nearest(p, c, d, q)) continue;
+                nn_idx[p] = q;
+                nn_dist[p] = d;
+            }
+            if (nn_dist[p] < e.dist) {
+                e.dist = nn_dist[p];
+                e.from = p;
+                e.to = nn_idx[p];
+            }
+        }
+
+        // add the shortest edge of every component, shortest first
+        edges.clear();
+        for (int i=0; i<rows; i++) {
+            if (comp[i] == i && best[i].from >= 0) edges.push_back(best[i]);
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t k=0; k<edges.size(); k++) {
+            int a = FindRoot(parent, edges[k].from);
+            int b = FindRoot(parent, edges[k].to);
+            if (a == b) continue;
+            parent[a] = b;
+            Z2.append(edges[k].from, edges[k].to, edges[k].dist);
+            n_comps -= 1;
+        }
+    }
+}
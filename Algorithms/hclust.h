@@ -0,0 +1,95 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_HCLUST_H__
+#define __GEODA_CENTER_HCLUST_H__
+
+#include <vector>
+
+#include "fastcluster.h"
+
+/**
+ Hierarchical clustering of rows x columns data for the Hierarchical
+ Clustering dialog. The dense path keeps the n*(n-1)/2 distances in memory
+ (8 bytes each, 40 GB for 100k rows); when they don't fit, the distances
+ are not stored:
+
+   single linkage   minimum spanning tree by Boruvka's algorithm; the
+                    nearest point of another component is searched in the
+                    kd-tree of hclust.cpp (BoruvkaTree), which skips the
+                    subtrees that lie in one component
+   Ward's linkage   fastcluster's generic_linkage_vector(), which computes
+                    distances from the data and cluster centers
+   average/complete the distance array of floats (half the memory)
+
+ All paths give the merges as fastcluster's NN_chain_core() does: Z2 holds
+ rows-1 merges of two observations with the height of the merge, which
+ the dialog sorts and resolves with a union-find. The heights use the same
+ (squared Euclidean or Manhattan) distances on every path.
+ */
+class HClustering
+{
+public:
+    enum Path {
+        dense_path,
+        dense_float_path,
+        vector_path,
+        mst_path
+    };
+
+    /** method is one of 's','w','m','a' and dist one of 'e','b' as in
+     HClusterDlg; weight holds the weight of each column */
+    HClustering(double** data, const double* weight, int rows, int columns,
+                char method, char dist);
+    virtual ~HClustering();
+
+    /** Bytes of the distance array of rows observations */
+    static double GetDenseBytes(int rows, bool use_float);
+
+    /** Dense path if the distance array of doubles takes at most half of
+     avail_bytes (2 GB if avail_bytes is not known, i.e. <= 0), otherwise the
+     one that does not store the distances for this method. use_float
+     always picks the float array for average and complete linkage */
+    static Path ChoosePath(int rows, char method, char dist, bool use_float,
+                           double avail_bytes);
+
+    /** False if the path does not suit the method or memory runs out */
+    bool Run(Path path, fastcluster::cluster_result& Z2);
+
+protected:
+    void RunDense(fastcluster::cluster_result& Z2);
+    void RunDenseFloat(fastcluster::cluster_result& Z2);
+    void RunWardVector(fastcluster::cluster_result& Z2);
+    void RunBoruvkaMST(fastcluster::cluster_result& Z2);
+
+    /** Row-major copy of the data, scaled so the plain (squared Euclidean or
+     Manhattan) distance equals the weighted one */
+    void GetScaledData(std::vector<double>& x) const;
+    double Distance(int i, int j) const;
+
+    double** data;
+    const double* weight;
+    int rows;
+    int columns;
+    char method;
+    char dist;
+};
+
+#endif
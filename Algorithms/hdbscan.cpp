@@ -1,7 +1,14 @@
 #include <deque>
+#include <queue>
+#include <functional>
 #include <algorithm>
+#include <float.h>
 
-#include <boost/graph/prim_minimum_spanning_tree.hpp>
+#define BOOST_PHOENIX_STL_TUPLE_H_
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include "../GdaConst.h"
 #include "pam.h"
 #include "hdbscan.h"
 
@@ -13,6 +20,313 @@ bool EdgeLess1(SimpleEdge* a,  SimpleEdge* b)
     return a->length < b->length;
 }
 
+namespace {
+    /* kd-tree over the rows of the data, for the core distances and for
+       Prim's algorithm on the mutual reachability graph. Each node keeps its
+       bounding box, the smallest core distance of its points and the number
+       of its points that are not in the spanning tree yet. */
+    class ReachabilityTree {
+    public:
+        ReachabilityTree(double** data_s, const double* weight_s, int n_s,
+                         int dim_s, bool manhattan_s)
+        : data(data_s), weight(weight_s), n(n_s), dim(dim_s),
+        manhattan(manhattan_s), alpha(1.0), idx(n_s), leaf_of(n_s),
+        in_tree(n_s, 0), core(0)
+        {
+            for (int i=0; i<n; i++) idx[i] = i;
+            Build(0, n, -1);
+        }
+
+        /* k-th smallest distance from point p, p itself included, as
+           ANNkd_tree::annkSearch() returns it: the sum of t*t (or |t|) over
+           the columns, without the weights */
+        double KthDistance(int p, int k, std::vector<double>& heap) const {
+            heap.clear();
+            KnnSearch(0, data[p], k, heap);
+            return heap.front();
+        }
+
+        void SetCoreDistances(const std::vector<double>& core_s,
+                              double alpha_s) {
+            core = &core_s[0];
+            alpha = alpha_s;
+            for (int k=(int)nodes.size()-1; k>=0; k--) {
+                Node& nd = nodes[k];
+                if (nd.left < 0) {
+                    nd.min_core = DBL_MAX;
+                    for (int i=nd.begin; i<nd.end; i++) {
+                        if (core[idx[i]] < nd.min_core) {
+                            nd.min_core = core[idx[i]];
+                        }
+                    }
+                } else {
+                    nd.min_core = std::min(nodes[nd.left].min_core,
+                                           nodes[nd.right].min_core);
+                }
+            }
+        }
+
+        void AddToTree(int p) {
+            in_tree[p] = 1;
+            for (int k=leaf_of[p]; k>=0; k=nodes[k].parent) {
+                nodes[k].num_open -= 1;
+            }
+        }
+
+        bool InTree(int p) const { return in_tree[p] != 0; }
+
+        /* max(core(p), core(q), d(p,q) / alpha), with d(p,q) computed as
+           sqrt() of the distancematrix() value: the squared weighted
+           Euclidean distance, or the sqrt of the weighted Manhattan one */
+        double Reachability(int p, int q) const {
+            const double* a = data[p];
+            const double* b = data[q];
+            double result = 0;
+            for (int j=0; j<dim; j++) {
+                double term = a[j] - b[j];
+                if (manhattan) {
+                    result = result + Weight(j)*fabs(term);
+                } else {
+                    result += Weight(j)*term*term;
+                }
+            }
+            return Mutual(p, core[q], result);
+        }
+
+        /* the point q outside the spanning tree with the smallest
+           (reachability, q); false if all points are in the tree */
+        bool Nearest(int p, double& best_d, int& best_q) const {
+            best_d = DBL_MAX;
+            best_q = -1;
+            Search(0, p, best_d, best_q);
+            return best_q >= 0;
+        }
+
+    protected:
+        struct Node {
+            int begin, end;
+            int left, right, parent;
+            int num_open;
+            double min_core;
+            size_t box; // position of min[dim], max[dim] in boxes
+        };
+
+        static const int leaf_size = 16;
+
+        double Weight(int j) const { return weight ? weight[j] : 1.0; }
+
+        double Mutual(int p, double core_q, double result) const {
+            if (manhattan) result = sqrt(result);
+            double d = sqrt(result);
+            if (alpha != 1.0) d /= alpha;
+            if (core[p] > d) d = core[p];
+            if (core_q > d) d = core_q;
+            return d;
+        }
+
+        int Build(int begin, int end, int parent) {
+            int k = (int)nodes.size();
+            Node nd;
+            nd.begin = begin;
+            nd.end = end;
+            nd.left = nd.right = -1;
+            nd.parent = parent;
+            nd.num_open = end - begin;
+            nd.min_core = 0;
+            nd.box = boxes.size();
+            boxes.resize(boxes.size() + 2*dim);
+            double* lo = &boxes[nd.box];
+            double* hi = lo + dim;
+            for (int d=0; d<dim; d++) {
+                lo[d] = DBL_MAX;
+                hi[d] = -DBL_MAX;
+            }
+            for (int i=begin; i<end; i++) {
+                const double* a = data[idx[i]];
+                for (int d=0; d<dim; d++) {
+                    if (a[d] < lo[d]) lo[d] = a[d];
+                    if (a[d] > hi[d]) hi[d] = a[d];
+                }
+            }
+            nodes.push_back(nd);
+
+            // split at the median of the widest side
+            int split_d = 0;
+            for (int d=1; d<dim; d++) {
+                if (hi[d] - lo[d] > hi[split_d] - lo[split_d]) split_d = d;
+            }
+            if (end - begin <= leaf_size || hi[split_d] <= lo[split_d]) {
+                for (int i=begin; i<end; i++) leaf_of[idx[i]] = k;
+                return k;
+            }
+            int mid = (begin + end) / 2;
+            std::nth_element(idx.begin() + begin, idx.begin() + mid,
+                             idx.begin() + end, AxisLess(data, split_d));
+            int left = Build(begin, mid, k);
+            int right = Build(mid, end, k);
+            nodes[k].left = left;
+            nodes[k].right = right;
+            return k;
+        }
+
+        /* lower bound of the distance from a to the points of node k; the
+           terms are never larger than the ones of the exact distance, so
+           neither is the sum */
+        double BoxDistance(int k, const double* a, bool weighted) const {
+            const double* lo = &boxes[nodes[k].box];
+            const double* hi = lo + dim;
+            double d = 0;
+            for (int i=0; i<dim; i++) {
+                double t = 0;
+                if (a[i] < lo[i]) t = lo[i] - a[i];
+                else if (a[i] > hi[i]) t = a[i] - hi[i];
+                double w = weighted ? Weight(i) : 1.0;
+                if (manhattan) d = d + w*t;
+                else d += w*t*t;
+            }
+            return d;
+        }
+
+        void KnnSearch(int k, const double* a, int kk,
+                       std::vector<double>& heap) const {
+            const Node& nd = nodes[k];
+            if (nd.left < 0) {
+                for (int i=nd.begin; i<nd.end; i++) {
+                    const double* b = data[idx[i]];
+                    double d = 0;
+                    for (int j=0; j<dim; j++) {
+                        double t = a[j] - b[j];
+                        d += manhattan ? fabs(t) : t*t;
+                    }
+                    if ((int)heap.size() < kk) {
+                        heap.push_back(d);
+                        std::push_heap(heap.begin(), heap.end());
+                    } else if (d < heap.front()) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back() = d;
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+                return;
+            }
+            double dl = BoxDistance(nd.left, a, false);
+            double dr = BoxDistance(nd.right, a, false);
+            int first = nd.left, second = nd.right;
+            if (dr < dl) {
+                std::swap(first, second);
+                std::swap(dl, dr);
+            }
+            if ((int)heap.size() < kk || dl < heap.front()) {
+                KnnSearch(first, a, kk, heap);
+            }
+            if ((int)heap.size() < kk || dr < heap.front()) {
+                KnnSearch(second, a, kk, heap);
+            }
+        }
+
+        double NodeBound(int k, int p) const {
+            double box_d = BoxDistance(k, data[p], true);
+            return Mutual(p, nodes[k].min_core, box_d);
+        }
+
+        void Search(int k, int p, double& best_d, int& best_q) const {
+            const Node& nd = nodes[k];
+            if (nd.num_open == 0) return;
+            if (nd.left < 0) {
+                for (int i=nd.begin; i<nd.end; i++) {
+                    int q = idx[i];
+                    if (in_tree[q] || core[q] > best_d) continue;
+                    double d = Reachability(p, q);
+                    if (d < best_d || (d == best_d && q < best_q)) {
+                        best_d = d;
+                        best_q = q;
+                    }
+                }
+                return;
+            }
+            double dl = NodeBound(nd.left, p);
+            double dr = NodeBound(nd.right, p);
+            int first = nd.left, second = nd.right;
+            if (dr < dl) {
+                std::swap(first, second);
+                std::swap(dl, dr);
+            }
+            // a node at best_d is searched: it may hold a smaller index
+            if (dl <= best_d) Search(first, p, best_d, best_q);
+            if (dr <= best_d) Search(second, p, best_d, best_q);
+        }
+
+        struct AxisLess {
+            double** data;
+            int d;
+            AxisLess(double** data_s, int d_s) : data(data_s), d(d_s) {}
+            bool operator()(int i, int j) const {
+                return data[i][d] < data[j][d];
+            }
+        };
+
+        double** data;
+        const double* weight;
+        int n;
+        int dim;
+        bool manhattan;
+        double alpha;
+        std::vector<int> idx;
+        std::vector<int> leaf_of;
+        std::vector<char> in_tree;
+        std::vector<Node> nodes;
+        std::vector<double> boxes;
+        const double* core;
+    };
+
+    struct CoreDistanceJob {
+        const ReachabilityTree* tree;
+        int k;
+        double* core;
+        void operator()(int a, int b) const {
+            std::vector<double> heap;
+            heap.reserve(k);
+            for (int i=a; i<b; i++) {
+                core[i] = sqrt(tree->KthDistance(i, k, heap));
+            }
+        }
+    };
+
+    /* runs job(a, b) on one range of [0, n) per core */
+    template <class Job>
+    void RunThreaded(int n, const Job& job)
+    {
+        int nCPUs = boost::thread::hardware_concurrency();
+        if (GdaConst::gda_set_cpu_cores) nCPUs = GdaConst::gda_cpu_cores;
+        if (nCPUs > n) nCPUs = n;
+        if (nCPUs <= 1) {
+            job(0, n);
+            return;
+        }
+        boost::thread_group threadPool;
+        for (int i=0; i<nCPUs; i++) {
+            int a = (int)((int64_t)n * i / nCPUs);
+            int b = (int)((int64_t)n * (i+1) / nCPUs);
+            threadPool.create_thread(boost::bind<void>(job, a, b));
+        }
+        threadPool.join_all();
+    }
+
+    /* the nearest point outside the spanning tree of a tree node; order
+       is the position of the node in the tree */
+    struct PrimCandidate {
+        double dist;
+        int dest;
+        int order;
+        int orig;
+        bool operator>(const PrimCandidate& c) const {
+            if (dist != c.dist) return dist > c.dist;
+            if (dest != c.dest) return dest > c.dest;
+            return order > c.order;
+        }
+    };
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // HDBSCAN
@@ -23,32 +337,74 @@ std::vector<double> HDBScan::ComputeCoreDistance(double** input_data, int n_pts,
                                             int n_dim, int min_samples,
                                             char dist)
 {
-    std::vector<double> core_d;
-    core_d.resize(n_pts);
-
-    double eps = 0; // error bound
-    if (dist == 'e') ANN_DIST_TYPE = 2; // euclidean
-    else if (dist == 'b') ANN_DIST_TYPE = 1; // manhattan
+    std::vector<double> core_d(n_pts, 0);
+    if (n_pts < 1) return core_d;
 
-    // KNN search will always return the query point itself, (self-included)
-    ANNkd_tree* kdTree = new ANNkd_tree(input_data, n_pts, n_dim);
-    ANNidxArray nnIdx = new ANNidx[min_samples];
-    ANNdistArray dists = new ANNdist[min_samples];
-    for (size_t i=0; i<n_pts; ++i) {
-        kdTree->annkSearch(input_data[i], min_samples, nnIdx, dists, eps);
-        core_d[i] = sqrt(dists[min_samples-1]);
-    }
-    delete[] nnIdx;
-    delete[] dists;
-    delete kdTree;
+    // the k-th nearest neighbor, self included; the queries only read the
+    // tree, so they run on all cores
+    int k = min_samples < n_pts ? min_samples : n_pts;
+    if (k < 1) k = 1;
+    ReachabilityTree tree(input_data, NULL, n_pts, n_dim, dist == 'b');
+    CoreDistanceJob job;
+    job.tree = &tree;
+    job.k = k;
+    job.core = &core_d[0];
+    RunThreaded(n_pts, job);
 
     return core_d;
 }
 
+std::vector<SimpleEdge*> HDBScan::mst_linkage_core_kdtree(double** data,
+                                      const double* weight, int n_pts,
+                                      int n_dim, char dist,
+                                      std::vector<double>& core_distances,
+                                      double alpha)
+{
+    // Prim's algorithm as in mst_linkage_core_vector(): the next edge is
+    // the lightest one out of the tree, on ties the one to the smallest
+    // point, from the tree node added first. Every tree node has its
+    // nearest outside point in a heap; when that point joins the tree the
+    // node looks for the next one, so no distance is stored.
+    std::vector<SimpleEdge*> rtn_mst_edges;
+    if (n_pts < 2) return rtn_mst_edges;
+
+    ReachabilityTree tree(data, weight, n_pts, n_dim, dist == 'b');
+    tree.SetCoreDistances(core_distances, alpha);
+
+    std::priority_queue<PrimCandidate, std::vector<PrimCandidate>,
+                        std::greater<PrimCandidate> > heap;
+    PrimCandidate c;
+    c.orig = 0;
+    c.order = 0;
+    tree.AddToTree(0);
+    tree.Nearest(0, c.dist, c.dest);
+    heap.push(c);
+
+    int order = 1;
+    while (order < n_pts && !heap.empty()) {
+        c = heap.top();
+        heap.pop();
+        if (tree.InTree(c.dest)) {
+            if (tree.Nearest(c.orig, c.dist, c.dest)) heap.push(c);
+            continue;
+        }
+        rtn_mst_edges.push_back(new SimpleEdge(c.orig, c.dest, c.dist));
+        heap.push(c); // looks for its next point when it is on top again
+
+        PrimCandidate nc;
+        nc.orig = c.dest;
+        nc.order = order++;
+        tree.AddToTree(nc.orig);
+        if (tree.Nearest(nc.orig, nc.dist, nc.dest)) heap.push(nc);
+    }
+    std::sort(rtn_mst_edges.begin(), rtn_mst_edges.end(), EdgeLess1);
+    return rtn_mst_edges;
+}
+
 HDBScan::HDBScan(int min_cluster_size, int min_samples, double alpha,
                  int _cluster_selection_method, bool _allow_single_cluster,
-                 int rows, int cols, RawDistMatrix* raw_dist,
-                 std::vector<double> _core_dist,
+                 int rows, int cols, double** data, const double* weight,
+                 char dist, std::vector<double> _core_dist,
                  const std::vector<bool>& _undefs)
 {
     int cluster_selection_method = _cluster_selection_method;
@@ -58,45 +414,14 @@ HDBScan::HDBScan(int min_cluster_size, int min_samples, double alpha,
     // Core distances
     core_dist = _core_dist;
 
-    // mutual distances
-    /*
-    mutual_dist.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        for (int j=i+1; j<rows; ++j) {
-            // max (core(a), core(b), dist(a,b))
-            double val = 0;
-            if (i != j) {
-                val = std::max(core_dist[i], core_dist[j]);
-                val = std::max(val, sqrt(raw_dist->getDistance(i, j)));
-            }
-            mutual_dist[i].push_back(val);
-        }
-    }
-
-    Graph g(rows);
-    for (int i=0; i<rows; i++) {
-        for (int j=i+1, k=0; j<rows; j++, k++) {
-            boost::add_edge(i, j, mutual_dist[i][k], g);
-        }
-    }
-    std::vector<int> p(num_vertices(g));
-    prim_minimum_spanning_tree(g, p.data());
-    for (int source = 0; source < p.size(); ++source) {
-        int target = p[source];
-        if (source != target) {
-            double cost = source < target ? mutual_dist[source][target - source -1] :
-            mutual_dist[target][source - target -1];
-            mst_edges.push_back(new SimpleEdge(source, target, cost));
-        }
-    }
-    */
     // clean up mst_edges if needed
     for (int i=0; i<mst_edges.size(); i++) {
         delete mst_edges[i];
     }
     mst_edges.clear();
-    // MST
-    mst_edges = mst_linkage_core_vector(cols, core_dist, raw_dist, alpha);
+    // MST of the mutual reachability graph, which is never stored
+    mst_edges = mst_linkage_core_kdtree(data, weight, rows, cols, dist,
+                                        core_dist, alpha);
     
     // Extract the HDBSCAN hierarchy as a dendrogram from mst
     int N = rows;
@@ -197,7 +197,9 @@ namespace Gda {
                 int cluster_selection_method,
                 bool allow_single_cluster,
                 int rows, int cols,
-                RawDistMatrix* raw_dist,
+                double** data,
+                const double* weight,
+                char dist,
                 std::vector<double> core_dist,
                 const std::vector<bool>& undefs
                 //GalElement * w,
@@ -209,6 +211,16 @@ namespace Gda {
         static std::vector<double> ComputeCoreDistance(double** input_data, int n_pts,
                                               int n_dim, int min_samples,
                                               char dist);
+        /* MST of the mutual reachability graph by Prim's algorithm with
+         nearest neighbor queries on a kd-tree of the data; the edges are the
+         ones mst_linkage_core_vector() finds on the distancematrix() of the
+         same data and weights */
+        static std::vector<SimpleEdge*> mst_linkage_core_kdtree(double** data,
+                                                    const double* weight,
+                                                    int n_pts, int n_dim,
+                                                    char dist,
+                                                    std::vector<double>& core_distances,
+                                                    double alpha);
         static std::vector<SimpleEdge*> mst_linkage_core_vector(int num_features,
                                                     std::vector<double>& core_distances,
                                                     RawDistMatrix* dist_metric,
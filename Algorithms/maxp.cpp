@@ -37,6 +37,7 @@
 #include "../logger.h"
 #include "../GenUtils.h"
 #include "../GdaConst.h"
+#include "articulation.h"
 #include "maxp.h"
 
 using namespace boost;
@@ -46,6 +47,8 @@ Maxp::Maxp(const GalElement* _w,  const std::vector<std::vector<double> >& _z, d
 {
     num_obs = z.size();
     num_vars = z[0].size();
+    // once for all the searches, which each make an ArticulationCache
+    w_symmetric = ArticulationCache::CheckSymmetric(w, num_obs);
 
     if (test) {
         initial = 2;
@@ -416,6 +419,7 @@ void Maxp::simulated_annealing(std::vector<std::vector<int> >& init_regions, boo
     
     int nr = init_regions.size();
     std::vector<int> changed_regions(nr, 1);
+    ArticulationCache cut_points(w, num_obs, w_symmetric);
    
     bool use_sa = false;
     double T = 1; // temperature
@@ -465,7 +469,7 @@ void Maxp::simulated_annealing(std::vector<std::vector<int> >& init_regions, boo
                     int nbr = n_it->first;
                     std::vector<int>& block = init_regions[ init_area2region[ nbr ] ];
                     if (check_floor(block, nbr)) {
-                        if (check_contiguity(w, block, nbr)) {
+                        if (check_contiguity(cut_points, block, init_area2region[nbr], nbr)) {
                             candidates.push_back(nbr);
                         }
                     }
@@ -501,6 +505,8 @@ void Maxp::simulated_annealing(std::vector<std::vector<int> >& init_regions, boo
                         moves_made += 1;
                         changed_regions[seed] = 1;
                         changed_regions[old_region] = 1;
+                        cut_points.Invalidate(seed);
+                        cut_points.Invalidate(old_region);
                     }
                 } else {
                     while (!candidates.empty()) {
@@ -532,6 +538,8 @@ void Maxp::simulated_annealing(std::vector<std::vector<int> >& init_regions, boo
                             moves_made += 1;
                             changed_regions[seed] = 1;
                             changed_regions[old_region] = 1;
+                            cut_points.Invalidate(seed);
+                            cut_points.Invalidate(old_region);
                             
                             // update candidates list after move in
                             member_dict[area] = true;
@@ -541,7 +549,7 @@ void Maxp::simulated_annealing(std::vector<std::vector<int> >& init_regions, boo
                                 if (member_dict[nbr] || neighbors_dict[nbr]) continue;
                                 std::vector<int>& block = init_regions[ init_area2region[ nbr ] ];
                                 if (check_floor(block, nbr)) {
-                                    if (check_contiguity(w, block, nbr)) {
+                                    if (check_contiguity(cut_points, block, init_area2region[nbr], nbr)) {
                                         candidates.push_back(nbr);
                                         neighbors_dict[nbr] = true;
                                     }
@@ -602,6 +610,7 @@ void Maxp::tabu_search(std::vector<std::vector<int> >& init_regions, boost::unor
     int nr = init_regions.size();
     
     std::vector<int> changed_regions(nr, 1);
+    ArticulationCache cut_points(w, num_obs, w_symmetric);
     // tabuLength: Number of times a reverse move is prohibited. Default value tabuLength = 85.
     int convTabu = 230 * sqrt((double)nr);
     // convTabu=230*numpy.sqrt(maxP)
@@ -644,7 +653,7 @@ void Maxp::tabu_search(std::vector<std::vector<int> >& init_regions, boost::unor
                 int nbr = n_it->first;
                 std::vector<int>& block = init_regions[ init_area2region[ nbr ] ];
                 if (check_floor(block, nbr)) {
-                    if (check_contiguity(w, block, nbr)) {
+                    if (check_contiguity(cut_points, block, init_area2region[nbr], nbr)) {
                         candidates.push_back(nbr);
                     }
                 }
@@ -680,6 +689,8 @@ void Maxp::tabu_search(std::vector<std::vector<int> >& init_regions, boost::unor
                         num_move ++;
                         changed_regions[seed] = 1;
                         changed_regions[old_region] = 1;
+                        cut_points.Invalidate(seed);
+                        cut_points.Invalidate(old_region);
                     }
                 }
             } else {
@@ -711,6 +722,8 @@ void Maxp::tabu_search(std::vector<std::vector<int> >& init_regions, boost::unor
                         num_move ++;
                         changed_regions[seed] = 1;
                         changed_regions[old_region] = 1;
+                        cut_points.Invalidate(seed);
+                        cut_points.Invalidate(old_region);
                     }
                 }
                 c++;
@@ -790,6 +803,7 @@ void Maxp::swap(std::vector<std::vector<int> >& init_regions, boost::unordered_m
     
     std::vector<int>::iterator iter;
     std::vector<int> changed_regions(nr, 1);
+    ArticulationCache cut_points(w, num_obs, w_symmetric);
     
     // nr = range(k)
     //while (swapping ) {
@@ -842,7 +856,7 @@ void Maxp::swap(std::vector<std::vector<int> >& init_regions, boost::unordered_m
                 int nbr = n_it->first;
                 std::vector<int>& block = init_regions[ init_area2region[ nbr ] ];
                 if (check_floor(block, nbr)) {
-                    if (check_contiguity(w, block, nbr)) {
+                    if (check_contiguity(cut_points, block, init_area2region[nbr], nbr)) {
                         candidates.push_back(nbr);
                     }
                 }
@@ -879,6 +893,8 @@ void Maxp::swap(std::vector<std::vector<int> >& init_regions, boost::unordered_m
                     moves_made += 1;
                     changed_regions[seed] = 1;
                     changed_regions[old_region] = 1;
+                    cut_points.Invalidate(seed);
+                    cut_points.Invalidate(old_region);
                    
                     // update candidates list after move in
                     
@@ -889,7 +905,7 @@ void Maxp::swap(std::vector<std::vector<int> >& init_regions, boost::unordered_m
                         if (member_dict[nbr] || neighbors_dict[nbr]) continue;
                         std::vector<int>& block = init_regions[ init_area2region[ nbr ] ];
                         if (check_floor(block, nbr)) {
-                            if (check_contiguity(w, block, nbr)) {
+                            if (check_contiguity(cut_points, block, init_area2region[nbr], nbr)) {
                                 candidates.push_back(nbr);
                                 neighbors_dict[nbr] = true;
                             }
@@ -1053,6 +1069,20 @@ double Maxp::objective_function_change(int area, std::vector<int>& current_inter
     return change;
 }
 
+bool Maxp::check_contiguity(ArticulationCache& cut_points,
+                            std::vector<int>& block, int region, int leaver)
+{
+    // leaver can go unless it's an articulation point of its region
+    if (!cut_points.IsValid(region)) {
+        cut_points.Update(region, block);
+    }
+    bool feasible = false;
+    if (cut_points.CanRemove(region, leaver, feasible)) {
+        return feasible;
+    }
+    return check_contiguity(w, block, leaver);
+}
+
 bool Maxp::check_contiguity(const GalElement* w, std::vector<int>& ids, int leaver)
 {
     //vector<int> ids = neighbors;
@@ -28,6 +28,8 @@
 
 #include "../ShapeOperations/GalWeight.h"
 
+class ArticulationCache;
+
 using namespace boost;
 
 class qvector
@@ -121,6 +123,9 @@ protected:
      */
     int num_obs;
     
+    //! True if the links of w are symmetric, see ArticulationCache.
+    bool w_symmetric;
+    
     //! A integer number of variables.
     /*!
      Details.
@@ -286,6 +291,10 @@ protected:
      \return boolean
      */
     bool check_contiguity(const GalElement* w, std::vector<int>& block, int neighbor);
+    /** Same check, answered from the articulation points of region when
+     they are known; block is the areas of region */
+    bool check_contiguity(ArticulationCache& cut_points,
+                          std::vector<int>& block, int region, int neighbor);
        
     void shuffle(std::vector<int>& arry, uint64_t& seed);
     
@@ -0,0 +1,171 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_PHOENIX_STL_TUPLE_H_
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include "../GenUtils.h"
+#include "perm_scheduler.h"
+#include "moran_perm.h"
+
+MoranPermutation::MoranPermutation(const GalElement* w_s,
+                                   const std::vector<double>& x_s,
+                                   const std::vector<double>& y_s,
+                                   const std::vector<bool>& undefs)
+: num_obs((int)x_s.size()), w(w_s), x(x_s), y(y_s), permutations(0), seed(0),
+results(0), num_blocks(0), next_block(0), num_done_blocks(0),
+cancelled(false), num_threads(1), mutex(new boost::mutex),
+block_cond(new boost::condition_variable), workers(0)
+{
+    for (int i=0; i<num_obs; ++i) {
+        if (undefs[i]) continue;
+        candidates.push_back(i);
+        if (w[i].Size() > 0) valid_obs.push_back(i);
+    }
+    stream_length = candidates.empty() ? 1 : candidates.size();
+}
+
+MoranPermutation::~MoranPermutation()
+{
+    Cancel();
+    delete block_cond;
+    delete mutex;
+}
+
+double MoranPermutation::Permute(int* perm, uint64_t seed_start) const
+{
+    for (int i=0; i<num_obs; ++i) perm[i] = i;
+    int m = (int)candidates.size();
+    for (int k=m-1; k>0; --k) {
+        int j = (int)(Gda::ThomasWangHashDouble(seed_start++) * (k+1));
+        if (j > k) j = k;
+        int a = candidates[k];
+        int b = candidates[j];
+        int tmp = perm[a];
+        perm[a] = perm[b];
+        perm[b] = tmp;
+    }
+
+    // same sum as GalElement::SpatialLag(y, perm, i) * x[perm[i]]
+    double moran = 0;
+    const double* yy = y.empty() ? 0 : &y[0];
+    for (size_t v=0; v<valid_obs.size(); ++v) {
+        int i = valid_obs[v];
+        GalNbrs nbrs = w[i].GetNbrs();
+        int sz = (int)nbrs.size();
+        double lag = 0;
+        int n_nbrs = 0;
+        for (int k=0; k<sz; ++k) {
+            if (nbrs[k] != i) {
+                lag += yy[perm[nbrs[k]]];
+                n_nbrs += 1;
+            }
+        }
+        if (n_nbrs > 0) lag /= (double) n_nbrs;
+        moran += lag * x[perm[i]];
+    }
+    return moran / ((double) valid_obs.size() - 1.0);
+}
+
+void MoranPermutation::Start(int permutations_s, uint64_t seed_s,
+                             double* results_s)
+{
+    Join();
+    permutations = permutations_s;
+    seed = seed_s;
+    results = results_s;
+    num_blocks = (permutations + block_size - 1) / block_size;
+    next_block = 0;
+    num_done_blocks = 0;
+    block_done.assign(num_blocks, 0);
+    cancelled = false;
+    if (num_blocks == 0) return;
+
+    num_threads = PermutationScheduler::GetDefaultNumThreads();
+    if (num_threads > num_blocks) num_threads = num_blocks;
+
+    workers = new boost::thread_group;
+    for (int k=0; k<num_threads; ++k) {
+        workers->create_thread(boost::bind(&MoranPermutation::Worker, this));
+    }
+}
+
+int MoranPermutation::WaitForResults(int msec)
+{
+    boost::unique_lock<boost::mutex> lk(*mutex);
+    if (num_done_blocks < num_blocks) {
+        block_cond->timed_wait(lk, boost::posix_time::milliseconds(msec));
+    }
+    int n = num_done_blocks * block_size;
+    return n < permutations ? n : permutations;
+}
+
+void MoranPermutation::Join()
+{
+    if (!workers) return;
+    workers->join_all();
+    delete workers;
+    workers = 0;
+}
+
+void MoranPermutation::Cancel()
+{
+    if (!workers) return;
+    {
+        boost::lock_guard<boost::mutex> lk(*mutex);
+        cancelled = true;
+    }
+    Join();
+}
+
+bool MoranPermutation::NextBlock(int& block)
+{
+    boost::lock_guard<boost::mutex> lk(*mutex);
+    if (cancelled || next_block >= num_blocks) return false;
+    block = next_block++;
+    return true;
+}
+
+void MoranPermutation::FinishBlock(int block)
+{
+    {
+        boost::lock_guard<boost::mutex> lk(*mutex);
+        block_done[block] = 1;
+        while (num_done_blocks < num_blocks && block_done[num_done_blocks]) {
+            num_done_blocks += 1;
+        }
+    }
+    block_cond->notify_all();
+}
+
+void MoranPermutation::Worker()
+{
+    std::vector<int> perm(num_obs > 0 ? num_obs : 1);
+    int block = 0;
+    while (NextBlock(block)) {
+        int p_start = block * block_size;
+        int p_end = p_start + block_size;
+        if (p_end > permutations) p_end = permutations;
+        for (int p=p_start; p<p_end; ++p) {
+            results[p] = Permute(&perm[0], seed + (uint64_t)p * stream_length);
+        }
+        FinishBlock(block);
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_MORAN_PERM_H__
+#define __GEODA_CENTER_MORAN_PERM_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "../ShapeOperations/GalWeight.h"
+
+namespace boost {
+    class mutex;
+    class condition_variable;
+    class thread_group;
+}
+
+/**
+ Reference distribution of the global (bivariate) Moran's I under random
+ permutation, as shown by the randomization dialog.
+
+ Each permutation shuffles the defined observations (Fisher-Yates) and
+ leaves the undefined ones in place, then sums lag_i * x[perm[i]] over the
+ observations with neighbors, where lag_i is the average of y[perm[j]] over
+ the neighbors j of i (self excluded). The neighbors are read in place
+ from w, which has to outlive the MoranPermutation.
+
+ Permutation p draws its random numbers with
+ Gda::ThomasWangHashDouble(seed + p * GetStreamLength() + k), so the result
+ of every permutation only depends on the seed, not on the number of cores
+ or on the thread that computed it.
+
+ Start() runs the permutations in blocks on the worker threads and returns
+ immediately; WaitForResults() tells how many permutations, counted from
+ the first one, are in the results array, so the caller can draw the
+ histogram while the others are still running. Cancel() stops the run
+ after the blocks that are being computed.
+ */
+class MoranPermutation
+{
+public:
+    /** y is the variable of the neighbors, x for the univariate Moran's I */
+    MoranPermutation(const GalElement* w, const std::vector<double>& x,
+                     const std::vector<double>& y,
+                     const std::vector<bool>& undefs);
+    virtual ~MoranPermutation();
+
+    /** results must hold permutations values until Join() returns */
+    void Start(int permutations, uint64_t seed, double* results);
+    /** Waits up to msec milliseconds for a block to finish and returns the
+     number of leading permutations that are done */
+    int WaitForResults(int msec);
+    void Join();
+    /** Stops handing out blocks and joins the workers */
+    void Cancel();
+    bool IsRunning() const { return workers != 0; }
+
+    /** Moran's I of the permutation started at seed; perm holds num_obs */
+    double Permute(int* perm, uint64_t seed) const;
+
+    /** Observations that enter the sum, i.e. defined and with neighbors */
+    int GetNumValidObs() const { return (int)valid_obs.size(); }
+    /** Random numbers reserved for each permutation */
+    uint64_t GetStreamLength() const { return stream_length; }
+    int GetNumThreads() const { return num_threads; }
+
+    static const int block_size = 8;
+
+protected:
+    void Worker();
+    bool NextBlock(int& block);
+    void FinishBlock(int block);
+
+    int num_obs;
+    const GalElement* w;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<int> candidates; // defined observations, shuffled
+    std::vector<int> valid_obs;
+    uint64_t stream_length;
+
+    // state of the current run
+    int permutations;
+    uint64_t seed;
+    double* results;
+    int num_blocks;
+    int next_block;
+    int num_done_blocks; // leading blocks that are all done
+    std::vector<char> block_done;
+    bool cancelled;
+    int num_threads;
+
+    boost::mutex* mutex;
+    boost::condition_variable* block_cond;
+    boost::thread_group* workers;
+};
+
+#endif
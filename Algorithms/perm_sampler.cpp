@@ -0,0 +1,134 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <math.h>
+
+#include "../GdaConst.h"
+#include "../GenUtils.h"
+#include "perm_sampler.h"
+
+PermutationSampler::Buffer::Buffer(const PermutationSampler& sampler)
+: flags(sampler.GetNumObs(), 0)
+{
+}
+
+PermutationSampler::PermutationSampler()
+: sampler_type(floyd), num_obs(0)
+{
+}
+
+PermutationSampler::~PermutationSampler()
+{
+}
+
+PermutationSampler::SamplerType PermutationSampler::GetDefaultType()
+{
+    if (GdaConst::gda_use_legacy_perm_sampler) return legacy_rejection;
+    return floyd;
+}
+
+void PermutationSampler::Init(const std::vector<bool>& is_candidate,
+                              SamplerType type)
+{
+    sampler_type = type;
+    num_obs = (int)is_candidate.size();
+    candidates.clear();
+    rank.resize(num_obs);
+    for (int i=0; i<num_obs; ++i) {
+        if (is_candidate[i]) {
+            rank[i] = (int)candidates.size();
+            candidates.push_back(i);
+        } else {
+            rank[i] = -1;
+        }
+    }
+}
+
+int PermutationSampler::Draw(Buffer& buf, int self, int k, uint64_t& seed) const
+{
+    int available = (int)candidates.size();
+    if (self >= 0 && self < num_obs && rank[self] >= 0) available -= 1;
+    if (k > available) k = available;
+    if (k <= 0) return 0;
+
+    if ((int)buf.nbrs.size() < k) buf.nbrs.resize(k);
+
+    if (sampler_type == legacy_rejection) {
+        return DrawLegacy(buf, self, k, seed);
+    }
+    return DrawFloyd(buf, self, k, seed);
+}
+
+int PermutationSampler::DrawFloyd(Buffer& buf, int self, int k,
+                                  uint64_t& seed) const
+{
+    // Floyd's algorithm: k distinct positions out of [0, m) where m is the
+    // number of candidates without self; one random number per position
+    int m = (int)candidates.size();
+    int self_pos = m;
+    if (self >= 0 && self < num_obs && rank[self] >= 0) {
+        self_pos = rank[self];
+        m -= 1;
+    }
+    char* flags = &buf.flags[0];
+    int* nbrs = &buf.nbrs[0];
+
+    int n = 0;
+    for (int j = m - k; j < m; ++j) {
+        int t = (int)(Gda::ThomasWangHashDouble(seed++) * (j + 1));
+        if (t > j) t = j;
+        if (flags[t]) t = j;
+        flags[t] = 1;
+        nbrs[n++] = t;
+    }
+    // map positions to observation ids, skipping self
+    for (int i=0; i<k; ++i) {
+        int t = nbrs[i];
+        flags[t] = 0;
+        nbrs[i] = candidates[t < self_pos ? t : t + 1];
+    }
+    return k;
+}
+
+int PermutationSampler::DrawLegacy(Buffer& buf, int self, int k,
+                                   uint64_t& seed) const
+{
+    int max_rand = num_obs - 1;
+    char* flags = &buf.flags[0];
+    int* nbrs = &buf.nbrs[0];
+
+    int n = 0;
+    while (n < k) {
+        // computing 'perfect' permutation of given size
+        double rng_val = Gda::ThomasWangHashDouble(seed++) * max_rand;
+        // round is needed to fix issue
+        // https://github.com/GeoDaCenter/geoda/issues/488
+        int newRandom = (int)(rng_val<0.0?ceil(rng_val - 0.5):floor(rng_val + 0.5));
+        if (newRandom != self && !flags[newRandom] && rank[newRandom] >= 0) {
+            flags[newRandom] = 1;
+            nbrs[n++] = newRandom;
+        }
+    }
+    for (int i=0; i<k; ++i) flags[nbrs[i]] = 0;
+    // GeoDaSet::Pop() returned the ids in reverse order; keep that order so
+    // the permuted sums are summed exactly as before
+    std::reverse(nbrs, nbrs + k);
+    return k;
+}
@@ -0,0 +1,91 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PERM_SAMPLER_H__
+#define __GEODA_CENTER_PERM_SAMPLER_H__
+
+#include <vector>
+#include <stdint.h>
+
+/**
+ Draws the random neighbor sets of the conditional permutation test used by
+ the local statistics: for observation i, k distinct observations other than
+ i, taken from a fixed set of candidates (e.g. the non-isolates).
+
+ The sampler only holds the read-only candidate index, so it is built once
+ per run and shared by all worker threads. Each thread draws through its own
+ PermutationSampler::Buffer, which is sized once and reused for every
+ permutation, so nothing is allocated inside the permutation loop.
+
+ Two sampling methods are available:
+
+ floyd: Floyd's algorithm over the candidate index array with observation i
+ left out. Exactly k random numbers are consumed per permutation.
+
+ legacy_rejection: the sampler of GeoDa 1.x, which draws ids over all
+ observations and rejects self, duplicates and non-candidates (GeoDaSet).
+ It is kept to reproduce the p-values of earlier versions for a given seed.
+ */
+class PermutationSampler
+{
+public:
+    enum SamplerType { floyd = 0, legacy_rejection = 1 };
+
+    /** Per-thread scratch space used by Draw() */
+    class Buffer
+    {
+    public:
+        Buffer(const PermutationSampler& sampler);
+        const int* GetNeighbors() const { return nbrs.empty() ? 0 : &nbrs[0]; }
+    protected:
+        friend class PermutationSampler;
+        std::vector<char> flags;
+        std::vector<int> nbrs;
+    };
+
+    PermutationSampler();
+    virtual ~PermutationSampler();
+
+    /** candidates[j] is true if observation j can be drawn as a neighbor */
+    void Init(const std::vector<bool>& candidates, SamplerType type);
+
+    /** Draw up to k distinct candidates other than self into buf, using
+     Gda::ThomasWangHashDouble(seed++) as the random stream. Returns the
+     number of neighbors drawn, which is less than k only if there are not
+     enough candidates. */
+    int Draw(Buffer& buf, int self, int k, uint64_t& seed) const;
+
+    SamplerType GetType() const { return sampler_type; }
+    int GetNumObs() const { return num_obs; }
+    int GetNumCandidates() const { return (int)candidates.size(); }
+
+    /** Sampler selected in the user preferences */
+    static SamplerType GetDefaultType();
+
+protected:
+    int DrawFloyd(Buffer& buf, int self, int k, uint64_t& seed) const;
+    int DrawLegacy(Buffer& buf, int self, int k, uint64_t& seed) const;
+
+    SamplerType sampler_type;
+    int num_obs;
+    std::vector<int> candidates; // ascending ids of candidate observations
+    std::vector<int> rank; // position in candidates, -1 if not a candidate
+};
+
+#endif
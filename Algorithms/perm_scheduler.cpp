@@ -0,0 +1,210 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_PHOENIX_STL_TUPLE_H_
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include "../GdaConst.h"
+#include "perm_scheduler.h"
+
+PermutationScheduler::PermutationScheduler(int num_obs_s, GalElement* w,
+                                           int permutations_s,
+                                           PermutationSampler::SamplerType type)
+: num_obs(num_obs_s), num_threads(1), permutations(permutations_s),
+sampler_type(type), queue_mutexes(0)
+{
+    std::vector<int> cost(num_obs, 1);
+    for (int i=0; i<num_obs; ++i) {
+        cost[i] += (int)w[i].Size();
+    }
+    MakeChunks(cost);
+}
+
+PermutationScheduler::PermutationScheduler(int num_obs_s,
+                                           const std::vector<GalWeight*>& w_vecs,
+                                           int permutations_s,
+                                           PermutationSampler::SamplerType type)
+: num_obs(num_obs_s), num_threads(1), permutations(permutations_s),
+sampler_type(type), queue_mutexes(0)
+{
+    // the permutation of each observation is shared by all time periods, so
+    // the cost is driven by the largest neighbor set over time
+    std::vector<int> cost(num_obs, 1);
+    for (size_t t=0; t<w_vecs.size(); ++t) {
+        GalElement* w = w_vecs[t]->gal;
+        for (int i=0; i<num_obs; ++i) {
+            int sz = 1 + (int)w[i].Size();
+            if (sz > cost[i]) cost[i] = sz;
+        }
+    }
+    MakeChunks(cost);
+}
+
+PermutationScheduler::~PermutationScheduler()
+{
+    if (queue_mutexes) delete[] queue_mutexes;
+}
+
+int PermutationScheduler::GetDefaultNumThreads()
+{
+    int n_threads = GdaConst::gda_cpu_cores;
+    if (!GdaConst::gda_set_cpu_cores) {
+        n_threads = boost::thread::hardware_concurrency();
+    }
+    if (n_threads < 1) n_threads = 1;
+    return n_threads;
+}
+
+void PermutationScheduler::MakeChunks(const std::vector<int>& cost)
+{
+    chunks.clear();
+    seed_offsets.clear();
+    num_threads = GetDefaultNumThreads();
+    if (num_obs <= 0) return;
+
+    if (sampler_type == PermutationSampler::legacy_rejection) {
+        MakeStaticBlocks();
+        MakeQueues();
+        return;
+    }
+
+    seed_offsets.resize(num_obs + 1);
+    seed_offsets[0] = 0;
+    uint64_t total_cost = 0;
+    for (int i=0; i<num_obs; ++i) {
+        total_cost += cost[i];
+        seed_offsets[i+1] = seed_offsets[i] + (uint64_t)permutations * (cost[i]-1);
+    }
+
+    uint64_t chunk_cost = total_cost / target_num_chunks;
+    if (chunk_cost < 1) chunk_cost = 1;
+
+    int start = 0;
+    uint64_t acc = 0;
+    for (int i=0; i<num_obs; ++i) {
+        acc += cost[i];
+        if (acc >= chunk_cost) {
+            chunks.push_back(PermChunk(start, i));
+            start = i + 1;
+            acc = 0;
+        }
+    }
+    if (start < num_obs) {
+        chunks.push_back(PermChunk(start, num_obs - 1));
+    }
+    MakeQueues();
+}
+
+void PermutationScheduler::MakeStaticBlocks()
+{
+    // one block per core, as the wxThread workers of GeoDa 1.x did
+    int quotient = num_obs / num_threads;
+    int remainder = num_obs % num_threads;
+    int tot_threads = (quotient > 0) ? num_threads : remainder;
+    for (int i=0; i<tot_threads; i++) {
+        int a=0;
+        int b=0;
+        if (i < remainder) {
+            a = i*(quotient+1);
+            b = a+quotient;
+        } else {
+            a = remainder*(quotient+1) + (i-remainder)*quotient;
+            b = a+quotient-1;
+        }
+        chunks.push_back(PermChunk(a, b));
+    }
+}
+
+void PermutationScheduler::MakeQueues()
+{
+    if (num_threads > (int)chunks.size()) num_threads = (int)chunks.size();
+    if (num_threads < 1) num_threads = 1;
+
+    // deal the chunks to the workers in contiguous runs
+    queues.clear();
+    queues.resize(num_threads);
+    int n_chunks = (int)chunks.size();
+    for (int k=0; k<num_threads; ++k) {
+        int a = (int)((int64_t)k * n_chunks / num_threads);
+        int b = (int)((int64_t)(k + 1) * n_chunks / num_threads);
+        for (int c=a; c<b; ++c) queues[k].push_back(c);
+    }
+    if (queue_mutexes) delete[] queue_mutexes;
+    queue_mutexes = new boost::mutex[num_threads];
+}
+
+uint64_t PermutationScheduler::GetSeedOffset(int obs) const
+{
+    if (seed_offsets.empty()) return (uint64_t)obs;
+    return seed_offsets[obs];
+}
+
+bool PermutationScheduler::PopChunk(int worker_id, int& chunk_id)
+{
+    boost::lock_guard<boost::mutex> lk(queue_mutexes[worker_id]);
+    if (queues[worker_id].empty()) return false;
+    chunk_id = queues[worker_id].front();
+    queues[worker_id].pop_front();
+    return true;
+}
+
+bool PermutationScheduler::StealChunk(int worker_id, int& chunk_id)
+{
+    for (int k=1; k<num_threads; ++k) {
+        int victim = (worker_id + k) % num_threads;
+        boost::lock_guard<boost::mutex> lk(queue_mutexes[victim]);
+        if (!queues[victim].empty()) {
+            chunk_id = queues[victim].back();
+            queues[victim].pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void PermutationScheduler::Worker(int worker_id, const perm_range_job_t* job,
+                                  uint64_t seed)
+{
+    int chunk_id = 0;
+    while (PopChunk(worker_id, chunk_id) || StealChunk(worker_id, chunk_id)) {
+        const PermChunk& c = chunks[chunk_id];
+        (*job)(c.start, c.end, seed + GetSeedOffset(c.start));
+    }
+}
+
+void PermutationScheduler::Run(const perm_range_job_t& job, uint64_t seed)
+{
+    if (chunks.empty()) return;
+
+    if (num_threads <= 1) {
+        for (size_t i=0; i<chunks.size(); ++i) {
+            job(chunks[i].start, chunks[i].end,
+                seed + GetSeedOffset(chunks[i].start));
+        }
+        return;
+    }
+
+    boost::thread_group workers;
+    for (int k=0; k<num_threads; ++k) {
+        workers.create_thread(boost::bind(&PermutationScheduler::Worker,
+                                          this, k, &job, seed));
+    }
+    workers.join_all();
+}
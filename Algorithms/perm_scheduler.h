@@ -0,0 +1,112 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PERM_SCHEDULER_H__
+#define __GEODA_CENTER_PERM_SCHEDULER_H__
+
+#include <vector>
+#include <stdint.h>
+#include <boost/function.hpp>
+#include <boost/container/deque.hpp>
+
+#include "../ShapeOperations/GalWeight.h"
+#include "perm_sampler.h"
+
+namespace boost { class mutex; }
+
+/** Job executed by the permutation scheduler: compute the pseudo p-values
+ of observations [obs_start, obs_end] (inclusive), drawing random numbers
+ with Gda::ThomasWangHashDouble(seed_start++). */
+typedef boost::function<void (int, int, uint64_t)> perm_range_job_t;
+
+/** A contiguous range [start, end] of observations computed as one unit */
+struct PermChunk {
+    int start;
+    int end;
+    PermChunk() : start(0), end(-1) {}
+    PermChunk(int s, int e) : start(s), end(e) {}
+};
+
+/**
+ Work-stealing scheduler shared by the conditional permutation tests of the
+ local statistics (LISA, Local Geary, Getis-Ord, Local Join Count).
+
+ The observations are cut into small chunks of roughly equal cost, where the
+ cost of an observation is its number of neighbors (plus one), so a chunk of
+ kNN-50 observations holds far fewer rows than a chunk of rook neighbors.
+ The chunks are dealt to the workers in contiguous runs; a worker that runs
+ out of chunks steals from the tail of another worker's queue.
+
+ Each chunk starts its random stream at seed + sum_{j<start} permutations *
+ |N(j)|, which is an upper bound of the random numbers used by the preceding
+ observations with PermutationSampler::floyd, so the streams never overlap.
+ The chunk boundaries only depend on the weights, not on the number of cores
+ or on which worker runs a chunk, so the pseudo p-values are reproducible
+ for a given seed on any machine. They are not the p-values of GeoDa 1.x for
+ the same seed: the old workers used one block per core, so their streams
+ started at other observations.
+
+ With PermutationSampler::legacy_rejection (the "Use permutation sampler of
+ GeoDa 1.x" preference) the observations are split into one block per core
+ and each block starts at seed + first observation, as in GeoDa 1.x, so the
+ earlier multi-core results are reproduced on the same number of cores.
+ */
+class PermutationScheduler
+{
+public:
+    PermutationScheduler(int num_obs, GalElement* w, int permutations,
+                         PermutationSampler::SamplerType sampler_type);
+    PermutationScheduler(int num_obs, const std::vector<GalWeight*>& w_vecs,
+                         int permutations,
+                         PermutationSampler::SamplerType sampler_type);
+    virtual ~PermutationScheduler();
+
+    /** Run job on every chunk; returns when all chunks are done */
+    void Run(const perm_range_job_t& job, uint64_t seed);
+
+    int GetNumThreads() const { return num_threads; }
+    int GetNumChunks() const { return (int)chunks.size(); }
+    const std::vector<PermChunk>& GetChunks() const { return chunks; }
+
+    /** Number of threads from the user's CPU core preference */
+    static int GetDefaultNumThreads();
+
+    /** Chunks are sized so that there are about this many per run */
+    static const int target_num_chunks = 1024;
+
+protected:
+    void MakeChunks(const std::vector<int>& cost);
+    void MakeStaticBlocks();
+    void MakeQueues();
+    uint64_t GetSeedOffset(int obs) const;
+    void Worker(int worker_id, const perm_range_job_t* job, uint64_t seed);
+    bool PopChunk(int worker_id, int& chunk_id);
+    bool StealChunk(int worker_id, int& chunk_id);
+
+    int num_obs;
+    int num_threads;
+    int permutations;
+    PermutationSampler::SamplerType sampler_type;
+    std::vector<uint64_t> seed_offsets; // start of each observation's stream
+    std::vector<PermChunk> chunks;
+    std::vector<boost::container::deque<int> > queues;
+    boost::mutex* queue_mutexes;
+};
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../GdaConst.h"
+#include "perm_stop_rule.h"
+
+const double PermutationStopRule::cutoff_margin = 2.0;
+
+PermutationStopRule::PermutationStopRule()
+: enabled(false), max_cutoff(1.0), stop_ratio(1.0)
+{
+}
+
+void PermutationStopRule::Init(int permutations, double cutoff)
+{
+    // largest cutoff of the significance filter menu
+    max_cutoff = cutoff < 0.05 ? 0.05 : cutoff;
+    stop_ratio = cutoff_margin * max_cutoff;
+    // with too few permutations nothing can be gained
+    enabled = GdaConst::gda_perm_early_stop && stop_ratio < 0.5 &&
+              permutations > 4 * min_exceedances;
+}
@@ -0,0 +1,84 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PERM_STOP_RULE_H__
+#define __GEODA_CENTER_PERM_STOP_RULE_H__
+
+#include <stdint.h>
+
+/**
+ Sequential Monte Carlo stopping rule for the conditional permutation test
+ (Besag and Clifford, 1991).
+
+ The permutations of an observation stop as soon as the smaller of the two
+ tail counts has reached min_exceedances and the pseudo p-value is at least
+ cutoff_margin times the largest significance cutoff, i.e. the observation
+ is clearly not significant. The pseudo p-value of a stopped observation is
+ (count + 1) / (draws + 1) with its own number of draws, which is a valid
+ p-value, so the Bonferroni bound and the FDR computed from the p-values
+ remain correct. Observations that do not stop get the full number of
+ permutations, so their p-values are unchanged.
+
+ The rule stops against the largest cutoff of the significance filter menu
+ (0.05), or the user's cutoff if it is larger. A stopped observation is only
+ known to be non-significant at that cutoff, so the permutations have to be
+ run again if the user later selects a larger one (see IsValidFor()).
+ */
+class PermutationStopRule
+{
+public:
+    PermutationStopRule();
+
+    /** Enabled if GdaConst::gda_perm_early_stop is set */
+    void Init(int permutations, double cutoff);
+
+    bool IsEnabled() const { return enabled; }
+
+    /** Cutoff the observations were stopped against */
+    double GetCutoff() const { return max_cutoff; }
+
+    /** False if observations may have stopped although their p-value could
+     be below cutoff; the permutations must then be run again */
+    bool IsValidFor(double cutoff) const
+    {
+        return !enabled || cutoff <= max_cutoff;
+    }
+
+    /** count_larger of num_draws permuted statistics were at least the
+     observed one */
+    bool CanStop(uint64_t count_larger, uint64_t num_draws) const
+    {
+        if (!enabled || num_draws == 0) return false;
+        uint64_t extreme = num_draws - count_larger;
+        if (count_larger < extreme) extreme = count_larger;
+        return extreme >= min_exceedances && extreme >= stop_ratio * num_draws;
+    }
+
+    /** Permutations evaluated between two checks of the blocked kernels */
+    static const int check_interval = 32;
+    static const int min_exceedances = 20;
+    static const double cutoff_margin;
+
+protected:
+    bool enabled;
+    double max_cutoff;
+    double stop_ratio;
+};
+
+#endif
@@ -531,7 +531,7 @@ void AbstractClusterFactory::init()
     
     for (int i=0; i<rows; i++) {
         orig = nodes[i];
-        const std::vector<long>& nbrs = w[i].GetNbrs();
+        GalNbrs nbrs = w[i].GetNbrs();
         for (int j=0; j<w[i].Size(); j++) {
             int nbr = (int)nbrs[j];
             dest = nodes[nbr];
@@ -328,83 +328,72 @@ OGRColumnInteger::~OGRColumnInteger()
     if (undef_markers.size() > 0) undef_markers.clear();
 }
 
+// Decode the column from the OGRFeatures once; afterwards new_data holds
+// the values of the column and every write goes to both
+void OGRColumnInteger::InitMemoryData()
+{
+    if (is_new || (int)new_data.size() == rows) return;
+    int col_idx = GetColIndex();
+    new_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        new_data[i] = (wxInt64)ogr_layer->data[i]->GetFieldAsInteger64(col_idx);
+    }
+}
+
 // Return this column to a vector of wxInt64
 void OGRColumnInteger::FillData(std::vector<wxInt64> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)ogr_layer->data[i]->GetFieldAsInteger64(col_idx);
-        }
-    }
+    InitMemoryData();
+    std::copy(new_data.begin(), new_data.end(), data.begin());
 }
 
 // Return this column to a vector of double
 void OGRColumnInteger::FillData(std::vector<double> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = (double)new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (double)ogr_layer->data[i]->GetFieldAsInteger64(col_idx);
-        }
+    InitMemoryData();
+    for (int i=0; i<rows; ++i) {
+        data[i] = (double)new_data[i];
     }
 }
 
 // Return this column to a vector of wxString
 void OGRColumnInteger::FillData(std::vector<wxString> &data, wxCSConv* m_wx_encoding)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%"  wxLongLongFmtSpec  "d", new_data[i]);
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%" wxLongLongFmtSpec "d",
-                ogr_layer->data[i]->GetFieldAsInteger64(col_idx));
-        }
+    InitMemoryData();
+    for (int i=0; i<rows; ++i) {
+        data[i] = wxString::Format("%"  wxLongLongFmtSpec  "d", new_data[i]);
     }
 }
 
 // Update this column from a vector of wxInt64
 void OGRColumnInteger::UpdateData(const std::vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = data[i];
-            undef_markers[i] = false;
-        }
-    } else {
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, (GIntBig)data[i]);
-            undef_markers[i] = false;
         }
     }
+    new_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        new_data[i] = data[i];
+        undef_markers[i] = false;
+    }
 }
 
 void OGRColumnInteger::UpdateData(const std::vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = (int)data[i];
-            undef_markers[i] = false;
-        }
-    } else {
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, (GIntBig)data[i]);
-            undef_markers[i] = false;
         }
     }
+    new_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        new_data[i] = (wxInt64)data[i];
+        undef_markers[i] = false;
+    }
 }
 
 
@@ -415,15 +404,8 @@ bool OGRColumnInteger::GetCellValue(int row, wxInt64& val)
         val = 0;
         return false;
     }
-    
-    if (is_new) {
-        val = new_data[row];
-        
-    } else {
-        int col_idx = GetColIndex();
-        val = (wxInt64)ogr_layer->data[row]->GetFieldAsInteger64(col_idx);
-    }
-    
+    InitMemoryData();
+    val = new_data[row];
     return true;
 }
 
@@ -436,10 +418,11 @@ wxString OGRColumnInteger::GetValueAt(int row_idx, int disp_decimals,
     if ( undef_markers[row_idx] == true)
         return wxEmptyString;
     
-    if (is_new) {
+    if (is_new || (int)new_data.size() == rows) {
         return wxString::Format("%lld",new_data[row_idx]);
         
     } else {
+        // the grid only shows a few cells, don't decode the whole column
         int col_idx = GetColIndex();
         if (col_idx == -1)
             return wxEmptyString;
@@ -467,19 +450,19 @@ void OGRColumnInteger::SetValueAt(int row_idx, const wxString &value,
                 ogr_layer->data[row_idx]->UnsetField(col_idx);
             }
         }
+        if ((int)new_data.size() == rows) new_data[row_idx] = 0;
         return;
     }
     
     wxInt64 l_val;
 
     if (value.ToLongLong(&l_val)) {
-        if (is_new) {
-            new_data[row_idx] = l_val;
-        } else {
+        if (!is_new) {
             if (col_idx == -1)
                 return;
             ogr_layer->data[row_idx]->SetField(col_idx, (GIntBig)l_val);
         }
+        if ((int)new_data.size() == rows) new_data[row_idx] = l_val;
         undef_markers[row_idx] = false;
     }
 }
@@ -488,13 +471,12 @@ void OGRColumnInteger::SetValueAt(int row_idx, wxInt64 l_val)
 {
     int col_idx = GetColIndex();
     
-    if (is_new) {
-        new_data[row_idx] = l_val;
-    } else {
+    if (!is_new) {
         if (col_idx == -1)
             return;
         ogr_layer->data[row_idx]->SetField(col_idx, (GIntBig)l_val);
     }
+    if ((int)new_data.size() == rows) new_data[row_idx] = l_val;
     undef_markers[row_idx] = false;
 }
 
@@ -558,84 +540,71 @@ OGRColumnDouble::~OGRColumnDouble()
 }
 
 
+// Decode the column from the OGRFeatures once; afterwards new_data holds
+// the values of the column and every write goes to both
+void OGRColumnDouble::InitMemoryData()
+{
+    if (is_new || (int)new_data.size() == rows) return;
+    int col_idx = GetColIndex();
+    new_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        new_data[i] = ogr_layer->data[i]->GetFieldAsDouble(col_idx);
+    }
+}
+
 // Assign this column to a vector of wxInt64
 void OGRColumnDouble::FillData(std::vector<wxInt64> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)new_data[i];
-        }
-        
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)ogr_layer->data[i]->GetFieldAsDouble(col_idx);
-        }
-        
+    InitMemoryData();
+    for (int i=0; i<rows; ++i) {
+        data[i] = (wxInt64)new_data[i];
     }
 }
 
 // Assign this column to a vector of double
 void OGRColumnDouble::FillData(std::vector<double> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = ogr_layer->data[i]->GetFieldAsDouble(col_idx);
-        }
-    }
+    InitMemoryData();
+    std::copy(new_data.begin(), new_data.end(), data.begin());
 }
 
 void OGRColumnDouble::FillData(std::vector<wxString> &data, wxCSConv* m_wx_encoding)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%f", new_data[i]);
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%f",
-                ogr_layer->data[i]->GetFieldAsDouble(col_idx));
-        }
+    InitMemoryData();
+    for (int i=0; i<rows; ++i) {
+        data[i] = wxString::Format("%f", new_data[i]);
     }
 }
 
 // Update this column from a vector of double
 void OGRColumnDouble::UpdateData(const std::vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = data[i];
-            undef_markers[i] = false;
-        }
-    } else {
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, data[i]);
-            undef_markers[i] = false;
         }
     }
+    new_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        new_data[i] = data[i];
+        undef_markers[i] = false;
+    }
 }
 
 void OGRColumnDouble::UpdateData(const std::vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = (double)data[i];
-            undef_markers[i] = false;
-        }
-    } else {
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, (double)data[i]);
-            undef_markers[i] = false;
         }
     }
+    new_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        new_data[i] = (double)data[i];
+        undef_markers[i] = false;
+    }
 }
 
 
@@ -646,13 +615,8 @@ bool OGRColumnDouble::GetCellValue(int row, double& val)
         val = 0.0;
         return false;
     }
-    
-    if (is_new) {
-        val = new_data[row];
-    } else {
-        int col_idx = GetColIndex();
-        val = ogr_layer->data[row]->GetFieldAsDouble(col_idx);
-    }
+    InitMemoryData();
+    val = new_data[row];
     return true;
 }
 
@@ -702,37 +666,34 @@ void OGRColumnDouble::SetValueAt(int row_idx, const wxString &value,
     // if user inputs nothing for a double valued cell, GeoDa treats it as NULL
     if ( value.IsEmpty() ) {
         undef_markers[row_idx] = true;
-        if (is_new ) {
-            new_data[row_idx] = 0.0;
-        } else {
+        if (!is_new) {
             // set undefined/null
             int col_idx = GetColIndex();
             ogr_layer->data[row_idx]->UnsetField(col_idx);
         }
+        if ((int)new_data.size() == rows) new_data[row_idx] = 0.0;
         return;
     }
     
     double d_val;
     //if ( value.ToDouble(&d_val) ) {
     if (wxNumberFormatter::FromString(value, &d_val)) {
-        if (is_new) {
-            new_data[row_idx] = d_val;
-        } else {
+        if (!is_new) {
             int col_idx = GetColIndex();
             ogr_layer->data[row_idx]->SetField(col_idx, d_val);
         }
+        if ((int)new_data.size() == rows) new_data[row_idx] = d_val;
         undef_markers[row_idx] = false;
     }
 }
 
 void OGRColumnDouble::SetValueAt(int row_idx, double d_val)
 {
-    if (is_new) {
-        new_data[row_idx] = d_val;
-    } else {
+    if (!is_new) {
         int col_idx = GetColIndex();
         ogr_layer->data[row_idx]->SetField(col_idx, d_val);
     }
+    if ((int)new_data.size() == rows) new_data[row_idx] = d_val;
     undef_markers[row_idx] = false;
 }
 ////////////////////////////////////////////////////////////////////////////////
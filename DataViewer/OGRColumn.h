@@ -151,6 +151,8 @@ public:
 class OGRColumnInteger : public OGRColumn
 {
 private:
+    // values of a new column, or of a column from OGRLayer once it has been
+    // read: the column is decoded from the OGRFeatures only once
     std::vector<wxInt64> new_data;
     void InitMemoryData();
     
@@ -194,6 +196,8 @@ public:
 class OGRColumnDouble : public OGRColumn
 {
 private:
+    // values of a new column, or of a column from OGRLayer once it has been
+    // read: the column is decoded from the OGRFeatures only once
     std::vector<double> new_data;
     void InitMemoryData();
     
@@ -469,7 +469,7 @@ bool AbstractClusterDlg::CheckContiguity(GalElement* gal, std::vector<wxInt64>&
             fid = processed_ids.top();
             processed_ids.pop();
             g[fid] = true; // mark fid from current group as processed
-            const std::vector<long>& nbrs = gal[fid].GetNbrs();
+            GalNbrs nbrs = gal[fid].GetNbrs();
             for (int i=0; i<nbrs.size(); i++ ) {
                 int nid = nbrs[i];
                 if (g.find(nid) != g.end() && g[nid] == false) {
@@ -32,6 +32,7 @@
 #include "../DataViewer/TableState.h"
 #include "../DataViewer/TimeState.h"
 #include "../VarCalc/CalcHelp.h"
+#include "../VarCalc/GdaExprProgram.h"
 #include "../GeneralWxUtils.h"
 #include "../GenUtils.h"
 #include "../GeoDa.h"
@@ -464,17 +465,22 @@ void CalculatorDlg::AssignOrSelect(bool assign)
 		size_t val_obs = (*val).GetObs();
 	}
 	
-	GdaParser parser;
 	WeightsManInterface* wmi = 0;
 	if (project && project->GetWManInt()) wmi = project->GetWManInt();
-	bool parser_success = parser.eval(tokens, &full_parser_table, wmi);
-	if (!parser_success) {
-		wxString s(parser.GetErrorMsg());
-		msg_s_txt->SetLabelText(s);
-		Refresh();
-		return;
+	// the compiled program evaluates the whole table without temporaries;
+	// GdaParser handles the rest and reports the errors
+	GdaExprProgram program;
+	if (!program.Compile(tokens, &full_parser_table, wmi) || !program.Run()) {
+		GdaParser parser;
+		bool parser_success = parser.eval(tokens, &full_parser_table, wmi);
+		if (!parser_success) {
+			wxString s(parser.GetErrorMsg());
+			msg_s_txt->SetLabelText(s);
+			Refresh();
+			return;
+		}
+		program.SetValue(parser.GetEvalVal());
 	}
-	GdaFVSmtPtr v = parser.GetEvalVal();
 	
 	int targ_col = -1;
 	size_t targ_tms = -1;
@@ -488,16 +494,12 @@ void CalculatorDlg::AssignOrSelect(bool assign)
 		}
 		targ_tms = table_int->GetColTimeSteps(targ_col);
 	}
-	std::valarray<double>& V = (*v).GetValArrayRef();
-	size_t V_tms = (*v).GetTms();
-	size_t V_obs = (*v).GetObs();
+	size_t V_tms = program.GetTms();
 	if (assign && targ_tms < V_tms) {
 		msg_s_txt->SetLabelText("Error: Target has too few time periods.");
 		Refresh();
 		return;
 	}
-	size_t V_sz = V.size();
-	double V_first = V[0];
 
 	size_t obs = table_int->GetNumberRows();
 	
@@ -505,38 +507,12 @@ void CalculatorDlg::AssignOrSelect(bool assign)
 		std::vector<double> t_vec(obs);
 		std::vector<bool> undefined(obs);
 		// MMM must consider case of [1 2 3 4 5 ... tms]
-		if (V_obs == 1 && V_tms == 1) {
-			double val = (*v).GetDouble();
-			bool undef = false;
-			if (!Gda::IsFinite(val)) {
-				val = 0;
-				undef = true;
-			}
-			for (size_t i=0; i<obs; ++i) {
-				t_vec[i] = val;
-				undefined[i] = undef;
-			}
-		} else if (V_tms == 1) {
-			// fill t_vec from V.
-			for (size_t i=0; i<obs; ++i) {
-				double val = V[i];
-				if (Gda::IsFinite(val)) {
-					t_vec[i] = val;
-					undefined[i] = false;
-				} else {
-					t_vec[i] = 0;
-					undefined[i] = true;
-				}
-			}
-		}
 		for (size_t t=0; t<targ_tms; ++t) {
-			if (V_tms > 1) {
-				// fill t_vec from V for each time period.
-				//std::slice sl(t,obs,Vtms);
+			if (t == 0 || t < V_tms) {
+				// fill t_vec for each time period of the result
+				if (obs > 0) program.GetColumn(t, obs, &t_vec[0]);
 				for (size_t i=0; i<obs; ++i) {
-					double val = V[t+i*V_tms];
-					if (Gda::IsFinite(val)) {
-						t_vec[i] = val;
+					if (Gda::IsFinite(t_vec[i])) {
 						undefined[i] = false;
 					} else {
 						t_vec[i] = 0;
@@ -550,7 +526,7 @@ void CalculatorDlg::AssignOrSelect(bool assign)
 		
 		
 		wxString s("Success. First obs. and time value = ");
-		s << (*v).GetDouble();
+		s << program.GetDouble();
 		msg_s_txt->SetLabelText(s);
 	} else {
 		int t=0;
@@ -562,20 +538,13 @@ void CalculatorDlg::AssignOrSelect(bool assign)
                 t_str = project->GetTimeState()->GetCurrTimeString();
             }
 		}
+		std::vector<double> t_vec(obs);
+		if (obs > 0) program.GetColumn(t, obs, &t_vec[0]);
 		int num_obs_sel = 0;
 	    std::vector<bool> selected(obs);
-		if (V_obs == 1) {
-			bool val = V[t]!=0 ? true : false;
-			for (size_t i=0; i<obs; ++i) {
-				selected[i] = val;
-			}
-			if (val) num_obs_sel = obs;
-		} else {
-			// fill t_vec from V for time period t.
-			for (size_t i=0; i<obs; ++i) {
-				selected[i] = V[t+i*V_tms]!=0 ? true : false;
-				if (selected[i]) ++num_obs_sel;
-			}
+		for (size_t i=0; i<obs; ++i) {
+			selected[i] = t_vec[i]!=0 ? true : false;
+			if (selected[i]) ++num_obs_sel;
 		}
         if (project) {
             HighlightState& hs = *project->GetHighlightState();
@@ -47,6 +47,7 @@
 #include "../GenUtils.h"
 #include "../SpatialIndAlgs.h"
 #include "../PointSetAlgs.h"
+#include "../io/weights_binary.h"
 #include "WeightsManDlg.h"
 #include "AddIdVariable.h"
 #include "CreatingWeightDlg.h"
@@ -1299,7 +1300,7 @@ GalWeight* CreatingWeightDlg::CreateBlockWeights()
                 // check contiguity, and separate island
                 cluster[i] = c;
                 cluster_ids[i] = c;
-                std::vector<long> nbrs = gal[i].GetNbrs();
+                GalNbrs nbrs = gal[i].GetNbrs();
                 for (int j=0; j<nn; ++j) {
                     cluster[ nbrs[j] ] = c;
                     cluster_ids[ nbrs[j] ] = c;
@@ -1523,6 +1524,8 @@ void CreatingWeightDlg::CreateWeights()
             wildcard = _("GWT files (*.gwt)|*.gwt");
         }
     }
+    wildcard += "|";
+    wildcard += _("GeoDa binary weights files (*.gwb)|*.gwb");
     wxString working_dir = project->GetWorkingDir().GetPath();
     wxFileDialog dlg(this, _("Choose an output weights file name."),
                      working_dir, defaultFile, wildcard,
@@ -1863,8 +1866,35 @@ bool CreatingWeightDlg::WriteWeightFile(GalWeight* Wp_gal, GwtWeight* Wp_gwt,
     GeoDaWeight *Wp = NULL;
     
     int col = table_int->FindColId(idd);
+    bool is_gwb = wxFileName(ofn).GetExt().Lower() == "gwb";
 
-    if (Wp_gal) { // gal
+    if (Wp_gal && is_gwb) {
+        gal = Wp_gal->gal;
+        Wp = (GeoDaWeight*)Wp_gal;
+        if (table_int->GetColType(col) == GdaConst::long64_type){
+            std::vector<wxInt64> id_vec(m_num_obs);
+            table_int->GetColData(col, 0, id_vec);
+            flag = Gda::SaveGwb(gal, layer_name, ofn, idd, id_vec);
+        } else if (table_int->GetColType(col) == GdaConst::string_type) {
+            std::vector<wxString> id_vec(m_num_obs);
+            table_int->GetColData(col, 0, id_vec);
+            flag = Gda::SaveGwb(gal, layer_name, ofn, idd, id_vec);
+        }
+        
+    } else if (is_gwb) {
+        gwt = Wp_gwt->gwt;
+        Wp = (GeoDaWeight*)Wp_gwt;
+        if (table_int->GetColType(col) == GdaConst::long64_type){
+            std::vector<wxInt64> id_vec(m_num_obs);
+            table_int->GetColData(col, 0, id_vec);
+            flag = Gda::SaveGwb(gwt, layer_name, ofn, idd, id_vec);
+        } else if (table_int->GetColType(col) == GdaConst::string_type) {
+            std::vector<wxString> id_vec(m_num_obs);
+            table_int->GetColData(col, 0, id_vec);
+            flag = Gda::SaveGwb(gwt, layer_name, ofn, idd, id_vec);
+        }
+        
+    } else if (Wp_gal) { // gal
         gal = Wp_gal->gal;
         Wp = (GeoDaWeight*)Wp_gal;
         if (table_int->GetColType(col) == GdaConst::long64_type){
@@ -1919,11 +1949,13 @@ bool CreatingWeightDlg::WriteWeightFile(GalWeight* Wp_gal, GwtWeight* Wp_gwt,
         wxFileName t_ofn(ofn);
         wxString ext = t_ofn.GetExt().Lower();
         GalWeight* w = 0;
-        if (ext != "gal" && ext != "gwt" && ext != "kwt") {
+        if (ext != "gal" && ext != "gwt" && ext != "kwt" && ext != "gwb") {
             //LOG_MSG("File extention not gal or gwt");
         } else {
             GalElement* tempGal = 0;
-            if (ext == "gal") {
+            if (ext == "gwb") {
+                tempGal=ReadGwbAsGal(ofn, table_int);
+            } else if (ext == "gal") {
                 tempGal=WeightUtils::ReadGal(ofn, table_int);
             } else { // ext == "gwt"
                 tempGal=WeightUtils::ReadGwtAsGal(ofn, table_int);
@@ -205,7 +205,7 @@ void FieldNewCalcLagDlg::Apply()
                 r_undefined[i] = true;
             }
             double nn = 0;
-            const std::vector<double> & w_values = W[i].GetNbrWeights();
+            GalNbrWeights w_values = W[i].GetNbrWeights();
             
             if (m_median_lag->IsChecked()) {
                 // median 
@@ -215,7 +215,7 @@ void FieldNewCalcLagDlg::Apply()
                     nn -= 1;
                 }
                 std::vector<double> nbr_data(nn);
-                const std::vector<long>& nbrs = W[i].GetNbrs();
+                GalNbrs nbrs = W[i].GetNbrs();
                 for (size_t j=0, k=0; j<nbrs.size(); ++j) {
                     if (nbrs[j] != i) {
                         nbr_data[k++] = data[nbrs[j]];
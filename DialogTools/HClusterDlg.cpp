@@ -37,6 +37,7 @@
 #include <wx/checkbox.h>
 #include <wx/choice.h>
 #include <wx/dcbuffer.h>
+#include <wx/stopwatch.h>
 #include <boost/unordered_map.hpp>
 
 #include "../Explore/MapNewView.h"
@@ -46,6 +47,7 @@
 #include "../GenUtils.h"
 #include "../Algorithms/DataUtils.h"
 #include "../Algorithms/fastcluster.h"
+#include "../Algorithms/hclust.h"
 #include "../VarCalc/WeightsManInterface.h"
 #include "../ShapeOperations/WeightUtils.h"
 
@@ -168,6 +170,18 @@ void HClusterDlg::CreateControls()
     box13->SetSelection(0);
     gbox->Add(st13, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT | wxLEFT, 10);
     gbox->Add(box13, 1, wxEXPAND);
+
+    m_float_dist = NULL;
+    if (show_centroids) {
+        // average and complete linkage: store the distances as floats
+        wxStaticText* st14 = new wxStaticText(panel, wxID_ANY, "");
+        m_float_dist = new wxCheckBox(panel, wxID_ANY,
+                                      _("Single precision distances"));
+        m_float_dist->SetToolTip(_("Use half of the memory for the distances between observations"));
+        m_float_dist->Enable(false);
+        gbox->Add(st14, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT | wxLEFT, 10);
+        gbox->Add(m_float_dist, 1, wxEXPAND);
+    }
     
     wxStaticBoxSizer *hbox = new wxStaticBoxSizer(wxHORIZONTAL, panel, _("Parameters:"));
     hbox->Add(gbox, 1, wxEXPAND);
@@ -332,6 +346,10 @@ void HClusterDlg::OnMethodChoice(wxCommandEvent& event)
     } else {
         m_distance->Enable(true);
     }
+    if (m_float_dist) {
+        // complete or average linkage
+        m_float_dist->Enable(method_sel == 2 || method_sel == 3);
+    }
 }
 
 void HClusterDlg::OnClusterChoice(wxCommandEvent& event)
@@ -479,38 +497,32 @@ bool HClusterDlg::Run(std::vector<wxInt64>& clusters)
     // get input: weights (auto)
     weight = GetWeights(columns);
 
-    double* pwdist = NULL;
-    if (dist == 'e') {
-        pwdist = DataUtils::getPairWiseDistance(input_data, weight, rows,
-                                                columns,
-                                                DataUtils::EuclideanDistance);
-    } else {
-        pwdist = DataUtils::getPairWiseDistance(input_data, weight, rows,
-                                                columns,
-                                                DataUtils::ManhattanDistance);
-    }
+    bool use_float = m_float_dist && m_float_dist->IsEnabled() &&
+                     m_float_dist->GetValue();
+    double avail_bytes = wxGetFreeMemory().ToDouble();
+    HClustering::Path path = HClustering::ChoosePath(rows, method, dist,
+                                                     use_float, avail_bytes);
+    wxLogMessage("HClusterDlg::Run() %d rows, distances %s", rows,
+                 path == HClustering::dense_path ? "double" :
+                 path == HClustering::dense_float_path ? "float" :
+                 path == HClustering::vector_path ? "from data" : "kd-tree MST");
 
-    fastcluster::auto_array_ptr<t_index> members;
     if (htree != NULL) {
         delete[] htree;
         htree = NULL;
     }
-    htree = new GdaNode[rows-1];
     fastcluster::cluster_result Z2(rows-1);
 
-    if (method == 's') {
-        fastcluster::MST_linkage_core(rows, pwdist, Z2);
-    } else if (method == 'w') {
-        members.init(rows, 1);
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_WARD, t_index>(rows, pwdist, members, Z2);
-    } else if (method == 'm') {
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_COMPLETE, t_index>(rows, pwdist, NULL, Z2);
-    } else if (method == 'a') {
-        members.init(rows, 1);
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_AVERAGE, t_index>(rows, pwdist, members, Z2);
+    wxStopWatch sw;
+    HClustering hc(input_data, weight, rows, columns, method, dist);
+    if (!hc.Run(path, Z2)) {
+        wxString err_msg = _("There is not enough memory to compute the distances between observations. Please try Single-linkage, Ward's-linkage or the single precision distances.");
+        wxMessageDialog dlg(NULL, err_msg, _("Error"), wxOK | wxICON_ERROR);
+        dlg.ShowModal();
+        return false;
     }
-
-    delete[] pwdist;
+    wxLogMessage("HClusterDlg::Run() linkage in %ld ms", sw.Time());
+    htree = new GdaNode[rows-1];
 
     std::stable_sort(Z2[0], Z2[rows-1]);
     t_index node1, node2;
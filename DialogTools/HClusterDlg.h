@@ -290,6 +290,7 @@ protected:
     wxTextCtrl* m_textbox;
     wxChoice* m_method;
     wxChoice* m_distance;
+    wxCheckBox* m_float_dist;
     DendrogramPanel* m_panel;
     wxNotebook* notebook;
     wxStaticText* m_sctxt;
@@ -134,7 +134,7 @@ void PreferenceDlg::Init()
 	vis_page->SetBackgroundColour(*wxWHITE);
 #endif
 	notebook->AddPage(vis_page, _("System"));
-	wxFlexGridSizer* grid_sizer1 = new wxFlexGridSizer(22, 2, 8, 10);
+	wxFlexGridSizer* grid_sizer1 = new wxFlexGridSizer(26, 2, 8, 10);
 
 	grid_sizer1->Add(new wxStaticText(vis_page, wxID_ANY, _("Maps:")), 1);
 	grid_sizer1->AddSpacer(10);
@@ -364,6 +364,34 @@ void PreferenceDlg::Init()
     grid_sizer1->Add(lbl_txt20, 1, wxEXPAND);
     grid_sizer1->Add(cbox_gpu, 0, wxALIGN_RIGHT);
     cbox_gpu->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnUseGPU, this);
+
+    wxString lbl_cpu_kernel = _("Use CPU kernel for LISA and Local Join Count:");
+    wxStaticText* lbl_txt_cpu_kernel = new wxStaticText(vis_page, wxID_ANY, lbl_cpu_kernel);
+    cbox_cpu_kernel = new wxCheckBox(vis_page, XRCID("PREF_USE_CPU_KERNEL"), "", pos);
+    grid_sizer1->Add(lbl_txt_cpu_kernel, 1, wxEXPAND);
+    grid_sizer1->Add(cbox_cpu_kernel, 0, wxALIGN_RIGHT);
+    cbox_cpu_kernel->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnUseCPUKernel, this);
+
+    wxString lbl_legacy_perm = _("Use permutation sampler of GeoDa 1.x (reproduce earlier results):");
+    wxStaticText* lbl_txt_legacy_perm = new wxStaticText(vis_page, wxID_ANY, lbl_legacy_perm);
+    cbox_legacy_perm = new wxCheckBox(vis_page, XRCID("PREF_USE_LEGACY_PERM_SAMPLER"), "", pos);
+    grid_sizer1->Add(lbl_txt_legacy_perm, 1, wxEXPAND);
+    grid_sizer1->Add(cbox_legacy_perm, 0, wxALIGN_RIGHT);
+    cbox_legacy_perm->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnUseLegacyPermSampler, this);
+
+    wxString lbl_perm_early_stop = _("Stop permutations early for clearly non-significant observations:");
+    wxStaticText* lbl_txt_perm_early_stop = new wxStaticText(vis_page, wxID_ANY, lbl_perm_early_stop);
+    cbox_perm_early_stop = new wxCheckBox(vis_page, XRCID("PREF_PERM_EARLY_STOP"), "", pos);
+    grid_sizer1->Add(lbl_txt_perm_early_stop, 1, wxEXPAND);
+    grid_sizer1->Add(cbox_perm_early_stop, 0, wxALIGN_RIGHT);
+    cbox_perm_early_stop->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnPermEarlyStop, this);
+
+    wxString lbl_project_snapshot = _("Save the map geometry in a .gdasnap file:");
+    wxStaticText* lbl_txt_project_snapshot = new wxStaticText(vis_page, wxID_ANY, lbl_project_snapshot);
+    cbox_project_snapshot = new wxCheckBox(vis_page, XRCID("PREF_USE_PROJECT_SNAPSHOT"), "", pos);
+    grid_sizer1->Add(lbl_txt_project_snapshot, 1, wxEXPAND);
+    grid_sizer1->Add(cbox_project_snapshot, 0, wxALIGN_RIGHT);
+    cbox_project_snapshot->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnProjectSnapshot, this);
     
     //lbl_txt20->Hide();
     //cbox_gpu->Hide();
@@ -496,6 +524,10 @@ void PreferenceDlg::OnReset(wxCommandEvent& ev)
 {
     GdaConst::gda_create_csvt = false;
     GdaConst::gda_use_gpu = false;
+    GdaConst::gda_use_cpu_kernel = false;
+    GdaConst::gda_use_legacy_perm_sampler = false;
+    GdaConst::gda_perm_early_stop = false;
+    GdaConst::gda_use_project_snapshot = false;
     GdaConst::gda_ui_language = 0;
     GdaConst::gda_eigen_tol = 1.0E-8;
     GdaConst::gda_draw_map_labels = false;
@@ -561,6 +593,10 @@ void PreferenceDlg::OnReset(wxCommandEvent& ev)
 	ogr_adapt.AddEntry("gda_eigen_tol", "1.0E-8");
     ogr_adapt.AddEntry("gda_ui_language", "0");
     ogr_adapt.AddEntry("gda_use_gpu", "0");
+    ogr_adapt.AddEntry("gda_use_cpu_kernel", "0");
+    ogr_adapt.AddEntry("gda_use_legacy_perm_sampler", "0");
+    ogr_adapt.AddEntry("gda_perm_early_stop", "0");
+    ogr_adapt.AddEntry("gda_use_project_snapshot", "0");
     ogr_adapt.AddEntry("gda_displayed_decimals", "6");
     ogr_adapt.AddEntry("gda_autoweight_stop", "0.0001");
     ogr_adapt.AddEntry("gda_enable_set_transparency_windows", "0");
@@ -619,6 +655,10 @@ void PreferenceDlg::SetupControls()
     cmb113->SetSelection(GdaConst::gda_ui_language);
     
     cbox_gpu->SetValue(GdaConst::gda_use_gpu);
+    cbox_cpu_kernel->SetValue(GdaConst::gda_use_cpu_kernel);
+    cbox_legacy_perm->SetValue(GdaConst::gda_use_legacy_perm_sampler);
+    cbox_perm_early_stop->SetValue(GdaConst::gda_perm_early_stop);
+    cbox_project_snapshot->SetValue(GdaConst::gda_use_project_snapshot);
     cbox26->SetValue(GdaConst::gda_enable_set_transparency_windows);
 
     cbox_csvt->SetValue(GdaConst::gda_create_csvt);
@@ -870,6 +910,54 @@ void PreferenceDlg::ReadFromCache()
         }
     }
 
+    std::vector<wxString> gda_use_cpu_kernel = ogr_adapt.GetHistory("gda_use_cpu_kernel");
+    if (!gda_use_cpu_kernel.empty()) {
+        long sel_l = 0;
+        wxString sel = gda_use_cpu_kernel[0];
+        if (sel.ToLong(&sel_l)) {
+            if (sel_l == 1)
+                GdaConst::gda_use_cpu_kernel = true;
+            else if (sel_l == 0)
+                GdaConst::gda_use_cpu_kernel = false;
+        }
+    }
+
+    std::vector<wxString> gda_use_legacy_perm_sampler = ogr_adapt.GetHistory("gda_use_legacy_perm_sampler");
+    if (!gda_use_legacy_perm_sampler.empty()) {
+        long sel_l = 0;
+        wxString sel = gda_use_legacy_perm_sampler[0];
+        if (sel.ToLong(&sel_l)) {
+            if (sel_l == 1)
+                GdaConst::gda_use_legacy_perm_sampler = true;
+            else if (sel_l == 0)
+                GdaConst::gda_use_legacy_perm_sampler = false;
+        }
+    }
+
+    std::vector<wxString> gda_perm_early_stop = ogr_adapt.GetHistory("gda_perm_early_stop");
+    if (!gda_perm_early_stop.empty()) {
+        long sel_l = 0;
+        wxString sel = gda_perm_early_stop[0];
+        if (sel.ToLong(&sel_l)) {
+            if (sel_l == 1)
+                GdaConst::gda_perm_early_stop = true;
+            else if (sel_l == 0)
+                GdaConst::gda_perm_early_stop = false;
+        }
+    }
+
+    std::vector<wxString> gda_use_project_snapshot = ogr_adapt.GetHistory("gda_use_project_snapshot");
+    if (!gda_use_project_snapshot.empty()) {
+        long sel_l = 0;
+        wxString sel = gda_use_project_snapshot[0];
+        if (sel.ToLong(&sel_l)) {
+            if (sel_l == 1)
+                GdaConst::gda_use_project_snapshot = true;
+            else if (sel_l == 0)
+                GdaConst::gda_use_project_snapshot = false;
+        }
+    }
+
     std::vector<wxString> gda_create_csvt = ogr_adapt.GetHistory("gda_create_csvt");
     if (!gda_create_csvt.empty()) {
         long sel_l = 0;
@@ -1317,6 +1405,54 @@ void PreferenceDlg::OnUseGPU(wxCommandEvent& ev)
         OGRDataAdapter::GetInstance().AddEntry("gda_use_gpu", "1");
     }
 }
+void PreferenceDlg::OnUseCPUKernel(wxCommandEvent& ev)
+{
+    int sel = ev.GetSelection();
+    if (sel == 0) {
+        GdaConst::gda_use_cpu_kernel = false;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_cpu_kernel", "0");
+    }
+    else {
+        GdaConst::gda_use_cpu_kernel = true;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_cpu_kernel", "1");
+    }
+}
+void PreferenceDlg::OnUseLegacyPermSampler(wxCommandEvent& ev)
+{
+    int sel = ev.GetSelection();
+    if (sel == 0) {
+        GdaConst::gda_use_legacy_perm_sampler = false;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_legacy_perm_sampler", "0");
+    }
+    else {
+        GdaConst::gda_use_legacy_perm_sampler = true;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_legacy_perm_sampler", "1");
+    }
+}
+void PreferenceDlg::OnPermEarlyStop(wxCommandEvent& ev)
+{
+    int sel = ev.GetSelection();
+    if (sel == 0) {
+        GdaConst::gda_perm_early_stop = false;
+        OGRDataAdapter::GetInstance().AddEntry("gda_perm_early_stop", "0");
+    }
+    else {
+        GdaConst::gda_perm_early_stop = true;
+        OGRDataAdapter::GetInstance().AddEntry("gda_perm_early_stop", "1");
+    }
+}
+void PreferenceDlg::OnProjectSnapshot(wxCommandEvent& ev)
+{
+    int sel = ev.GetSelection();
+    if (sel == 0) {
+        GdaConst::gda_use_project_snapshot = false;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_project_snapshot", "0");
+    }
+    else {
+        GdaConst::gda_use_project_snapshot = true;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_project_snapshot", "1");
+    }
+}
 void PreferenceDlg::OnCreateCSVT(wxCommandEvent& ev)
 {
     int sel = ev.GetSelection();
@@ -111,6 +111,14 @@ protected:
     wxComboBox* cmb113;
     // gpu
     wxCheckBox* cbox_gpu;
+    // cpu kernel
+    wxCheckBox* cbox_cpu_kernel;
+    // legacy permutation sampler
+    wxCheckBox* cbox_legacy_perm;
+    // early stop of permutations
+    wxCheckBox* cbox_perm_early_stop;
+    // keep derived geometry in a .gdasnap file
+    wxCheckBox* cbox_project_snapshot;
     // transp
     wxCheckBox* cbox26;
     // csvt
@@ -150,6 +158,10 @@ protected:
    
     void OnPowerEpsEnter(wxCommandEvent& ev);
     void OnUseGPU(wxCommandEvent& ev);
+    void OnUseCPUKernel(wxCommandEvent& ev);
+    void OnUseLegacyPermSampler(wxCommandEvent& ev);
+    void OnPermEarlyStop(wxCommandEvent& ev);
+    void OnProjectSnapshot(wxCommandEvent& ev);
     void OnCreateCSVT(wxCommandEvent& ev);
     void OnEnableTransparencyWin(wxCommandEvent& ev);
     
@@ -23,6 +23,7 @@
 #include <wx/xrc/xmlres.h>
 #include <wx/dcbuffer.h>
 #include <wx/settings.h>
+#include <wx/stopwatch.h>
 
 #include "../rc/GeoDaIcon-16x16.xpm"
 #include "../ShapeOperations/GalWeight.h"
@@ -60,11 +61,12 @@ InferenceSettingsDlg::InferenceSettingsDlg(wxWindow* parent,
                                            double _p_cutoff,
                                            double* _p_vals,
                                            int _n,
+                                           const int* _draws,
                                            const wxString& title,
                                            wxWindowID id,
                                            const wxPoint& pos,
                                            const wxSize& size )
-: wxDialog(parent, id, title, pos, size), p_cutoff(_p_cutoff), p_vals(_p_vals), n(_n), fdr(0), bo(0), user_input(0)
+: wxDialog(parent, id, title, pos, size), p_cutoff(_p_cutoff), p_vals(_p_vals), draws(_draws), n(_n), fdr(0), bo(0), user_input(0)
 {
     wxLogMessage("Open InferenceSettingsDlg.");
     
@@ -137,21 +139,26 @@ int compare (const void * a, const void * b)
 
 void InferenceSettingsDlg::Init(double* p_vals, int n, double current_p)
 {
-    double bonferroni_bound = current_p / (double)n;
+    // only the observations that were tested count in the corrections
+    std::vector<double> pvals;
+    for (int i=0; i<n; i++) {
+        if (draws == NULL || draws[i] > 0) pvals.push_back(p_vals[i]);
+    }
+    size_t n_tests = pvals.size();
+    if (n_tests == 0) n_tests = 1;
+    
+    double bonferroni_bound = current_p / (double)n_tests;
     wxString bo_str = wxString::Format("%g", bonferroni_bound);;
     m_txt_bo->SetLabel(bo_str);
     
-    std::vector<double> pvals;
-    for (int i=0; i<n; i++) pvals.push_back(p_vals[i]);
-    
     // FDR
     // sort all p-values from smallest to largets
     std::sort(pvals.begin(), pvals.end());
 
     fdr = 0;
 
-    for (size_t i=0; i<n; i++) {
-        double val = (i+1) * current_p / (double)n;
+    for (size_t i=0; i<pvals.size(); i++) {
+        double val = (i+1) * current_p / (double)n_tests;
         if (i==0) fdr = val;
         if (pvals[i] >= val) {
             break;
@@ -235,9 +242,9 @@ wxPanel(parent, wxID_ANY, wxDefaultPosition, size)
     Connect(wxEVT_RIGHT_UP, wxMouseEventHandler(RandomizationPanel::OnMouse));
 
     if (reuse_user_seed)
-        rng = new Randik(user_specified_seed);
+        seed = user_specified_seed;
     else
-        rng = new Randik();
+        seed = (uint64_t)time(0);
     
 	CalcMoran();
     Init();
@@ -265,9 +272,9 @@ wxPanel(parent, wxID_ANY, wxDefaultPosition, size)
 	Connect(wxEVT_RIGHT_UP, wxMouseEventHandler(RandomizationPanel::OnMouse));
     
     if (reuse_user_seed)
-        rng = new Randik(user_specified_seed);
+        seed = user_specified_seed;
     else
-        rng = new Randik();
+        seed = (uint64_t)time(0);
     
 	CalcMoran();
     Init();
@@ -275,10 +282,10 @@ wxPanel(parent, wxID_ANY, wxDefaultPosition, size)
 
 RandomizationPanel::~RandomizationPanel()
 {
-	if (perm) delete [] perm;
-	if (theRands) delete [] theRands;
-	if (rng) 
-		delete rng;
+	trials_timer->Stop();
+	delete trials_timer;
+	// cancels the permutations that are still running
+	if (perm_engine) delete perm_engine;
 }
 
 void RandomizationPanel::OnMouse( wxMouseEvent& event )
@@ -293,8 +300,7 @@ void RandomizationPanel::OnMouse( wxMouseEvent& event )
 
 void RandomizationPanel::OnRunClick( wxCommandEvent& event )
 {
-	RunRandomTrials();
-	Refresh();
+	if (!IsRunning()) StartRandomTrials();
 }
 
 void RandomizationPanel::CalcMoran()
@@ -343,8 +349,9 @@ void RandomizationPanel::CalcMoran()
 
 void RandomizationPanel::Init()
 {
-	perm = new int[num_obs];
-	theRands = new long[num_obs];
+	perm_engine = new MoranPermutation(W, raw_data1,
+									   is_bivariate ? raw_data2 : raw_data1,
+									   undefs);
 	
 	if (Permutations <= 10) bins = 10;
 	else if (Permutations <= 100) bins = 20;
@@ -361,12 +368,14 @@ void RandomizationPanel::Init()
 	// take the last bin
 	else if (thresholdBin >= bins) thresholdBin = bins-1;
 	
+	ResetTrials();
 	experiment_run_once = false;
+	
+	trials_timer = new wxTimer(this);
+	Connect(wxEVT_TIMER, wxTimerEventHandler(RandomizationPanel::OnTrialsTimer));
 }
 
-
-// NOTE: must carefully look at thresholdBin!
-void RandomizationPanel::RunRandomTrials()
+void RandomizationPanel::ResetTrials()
 {
 	totFrequency = 0;
 	for (int i=0; i<bins; i++) 
@@ -378,36 +387,84 @@ void RandomizationPanel::RunRandomTrials()
 	minBin = thresholdBin; 
 	maxBin = thresholdBin;
 	
-	for (int i=0; i<Permutations; i++) {
-		//create a random permutation
-		rng->Perm(undefs, num_obs, perm, theRands);
-		double newMoran = 0;
-		if (is_bivariate) {
-			for (int i=0; i<num_obs; i++) {
-                if (undefs[perm[i]] || W[i].Size() == 0) {
-                    continue;
-                }
-				newMoran += (W[i].SpatialLag(raw_data2, perm, i)
-							 * raw_data1[perm[i]]);
-			}
-		} else {
-			for (int i=0; i<num_obs; i++) {
-                if (undefs[perm[i]] || W[i].Size() == 0) {
-                    continue;
-                }
-				newMoran += (W[i].SpatialLag(raw_data1, perm, i)
-							 * raw_data1[perm[i]]);
-			}
-		}
-        int valid_num_obs = 0;
-        for (int i=0; i<num_obs; i++) {
-            if (!undefs[i] && W[i].Size() > 0) {
-                valid_num_obs++;
-            }
-        }
-		newMoran /= (double) valid_num_obs - 1.0;
+	MMean = 0;
+	MSdev = 0;
+	pseudo_p_val = 1;
+	count_greater = true;
+	int valid_num_obs = perm_engine->GetNumValidObs();
+	expected_val = (double) -1/(valid_num_obs - 1);
+}
+
+
+// NOTE: must carefully look at thresholdBin!
+void RandomizationPanel::StartRandomTrials()
+{
+	ResetTrials();
+	Refresh();
+	if (Permutations <= 0) return;
+	
+	// the permutations run on the worker threads; every refresh_ms the
+	// timer redraws the histogram with the permutations finished so far
+	const int refresh_ms = 100;
+	trials_watch.Start();
+	perm_engine->Start(Permutations, seed, &MoranI[0]);
+	trials_timer->Start(refresh_ms);
+	RandomizationDlg* dlg = dynamic_cast<RandomizationDlg*>(GetParent());
+	if (dlg) dlg->UpdateRunButton();
+}
+
+void RandomizationPanel::CancelRandomTrials()
+{
+	if (!IsRunning()) return;
+	perm_engine->Cancel();
+	// keep the histogram of the permutations that are done
+	int n_done = perm_engine->WaitForResults(0);
+	if (n_done > totFrequency) {
+		AddTrials(totFrequency, n_done);
+		UpdateStatistics();
+	}
+	wxLogMessage("RandomizationPanel: cancelled after %d permutations",
+				 totFrequency);
+	FinishRandomTrials();
+}
+
+bool RandomizationPanel::IsRunning() const
+{
+	return trials_timer->IsRunning();
+}
+
+void RandomizationPanel::OnTrialsTimer(wxTimerEvent& event)
+{
+	int n_done = perm_engine->WaitForResults(0);
+	if (n_done > totFrequency) {
+		AddTrials(totFrequency, n_done);
+		UpdateStatistics();
+		Refresh();
+	}
+	if (totFrequency >= Permutations) {
+		perm_engine->Join();
+		wxLogMessage("RandomizationPanel: %d permutations with %d threads in %ld ms",
+					 Permutations, perm_engine->GetNumThreads(),
+					 trials_watch.Time());
+		FinishRandomTrials();
+	}
+}
+
+void RandomizationPanel::FinishRandomTrials()
+{
+	trials_timer->Stop();
+	// the next run continues the random streams, as Randik did
+	seed += (uint64_t)Permutations * perm_engine->GetStreamLength();
+	Refresh();
+	RandomizationDlg* dlg = dynamic_cast<RandomizationDlg*>(GetParent());
+	if (dlg) dlg->UpdateRunButton();
+}
+
+void RandomizationPanel::AddTrials(int first, int last)
+{
+	for (int i=first; i<last; i++) {
+		double newMoran = MoranI[i];
 		// find its place in the distribution
-		MoranI[ totFrequency++ ] = newMoran;
 		int newBin = (int)floor( (newMoran - start)/range );
         if (newBin < 0) {
             newBin = 0;
@@ -419,7 +476,7 @@ void RandomizationPanel::RunRandomTrials()
 		if (newBin < minBin) minBin = newBin;
 		if (newBin > maxBin) maxBin = newBin;
 	}
-	UpdateStatistics();
+	totFrequency = last;
 }
 
 /** For a pseudo p-val based on permutations, we use a one-sided test,
@@ -434,12 +491,7 @@ void RandomizationPanel::RunRandomTrials()
 
 void RandomizationPanel::UpdateStatistics()
 {
-    int valid_num_obs = 0;
-    for (int i=0; i<num_obs; i++) {
-        if (!undefs[i] && W[i].Size() > 0) {
-            valid_num_obs++;
-        }
-    }
+    int valid_num_obs = perm_engine->GetNumValidObs();
     
 	double sMoran = 0;
 	for (int i=0; i < totFrequency; i++) {
@@ -581,8 +633,8 @@ void RandomizationPanel::OnPaint( wxPaintEvent& event )
 		experiment_run_once = true;
 		//wxCommandEvent ev;
 		//OnOkClick(ev);
-        RunRandomTrials();
-        Refresh();
+        // start after this paint, the timer repaints while it runs
+        CallAfter(&RandomizationPanel::StartRandomTrials);
 	}
     wxAutoBufferedPaintDC dc(this);
 	dc.Clear();
@@ -647,6 +699,7 @@ RandomizationDlg::RandomizationDlg(const std::vector<double>& raw_data1_s,
 								   const wxPoint& pos, const wxSize& size,
 								   long style )
 : wxFrame(parent, id, "", wxDefaultPosition, wxSize(550,300)),
+panel(NULL), panel_sel(NULL), panel_unsel(NULL), run_button(NULL),
 copy_w(NULL), copy_w_sel(NULL), copy_w_unsel(NULL), is_regime(_is_regime)
 {
 	wxLogMessage("Open RandomizationDlg (bivariate).");
@@ -717,6 +770,7 @@ RandomizationDlg::RandomizationDlg( const std::vector<double>& raw_data1_s,
 								   const wxPoint& pos, const wxSize& size,
 								   long style )
 : wxFrame(parent, id, "", wxDefaultPosition, wxSize(550,300)),
+panel(NULL), panel_sel(NULL), panel_unsel(NULL), run_button(NULL),
 copy_w(NULL), copy_w_sel(NULL), copy_w_unsel(NULL), is_regime(_is_regime)
 {
 	wxLogMessage("Open RandomizationDlg (univariate).");
@@ -794,6 +848,7 @@ RandomizationDlg::~RandomizationDlg()
 void RandomizationDlg::CreateControls()
 {
     wxButton *button = new wxButton(this, ID_BUTTON, _("Run"));
+    run_button = button;
    
     if (wxSystemSettings::GetAppearance().IsDark()) {
         button->SetForegroundColour(*wxBLACK);
@@ -813,6 +868,7 @@ void RandomizationDlg::CreateControls()
 void RandomizationDlg::CreateControls_regime()
 {
     wxButton *button = new wxButton(this, ID_BUTTON, _("Run"));
+    run_button = button;
     
     wxBoxSizer* panel_box = new wxBoxSizer(wxVERTICAL);
     panel_box->Add(button, 0, wxALIGN_CENTER | wxALIGN_TOP | wxALL, 10);
@@ -845,19 +901,35 @@ void RandomizationDlg::OnClose( wxCloseEvent& event )
 void RandomizationDlg::OnRunAll( wxCommandEvent& event )
 {
     wxLogMessage("Click RandomizationDlg::OnRunAll");
-	panel->RunRandomTrials();
-	panel->Refresh();
-	panel_sel->RunRandomTrials();
-	panel_sel->Refresh();
-	panel_unsel->RunRandomTrials();
-	panel_unsel->Refresh();
+    if (panel->IsRunning() || panel_sel->IsRunning() ||
+        panel_unsel->IsRunning()) {
+        panel->CancelRandomTrials();
+        panel_sel->CancelRandomTrials();
+        panel_unsel->CancelRandomTrials();
+    } else {
+        panel->StartRandomTrials();
+        panel_sel->StartRandomTrials();
+        panel_unsel->StartRandomTrials();
+    }
 }
 
 void RandomizationDlg::OnOkClick( wxCommandEvent& event )
 {
     wxLogMessage("Click RandomizationDlg::OnOkClick");
-	panel->RunRandomTrials();
-	panel->Refresh();
+    if (panel->IsRunning()) {
+        panel->CancelRandomTrials();
+    } else {
+        panel->StartRandomTrials();
+    }
+}
+
+void RandomizationDlg::UpdateRunButton()
+{
+    if (run_button == NULL) return;
+    bool running = panel->IsRunning();
+    if (panel_sel && panel_sel->IsRunning()) running = true;
+    if (panel_unsel && panel_unsel->IsRunning()) running = true;
+    run_button->SetLabel(running ? _("Cancel") : _("Run"));
 }
 void RandomizationDlg::OnMouse( wxMouseEvent& event )
 {
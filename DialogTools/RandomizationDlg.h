@@ -24,14 +24,25 @@
 #include <wx/checkbox.h>
 #include <wx/textctrl.h>
 #include <wx/radiobut.h>
+#include <wx/stopwatch.h>
+#include <wx/timer.h>
 
 #include "../ShapeOperations/GalWeight.h"
-#include "../ShapeOperations/Randik.h"
+#include "../Algorithms/moran_perm.h"
 
 
 
 class GalElement;
 
+/**
+ Bonferroni bound and False Discovery Rate of the pseudo p-values.
+
+ draws[i] is the number of permutations used for observation i, which is
+ less than the number of permutations if the early stopping rule applied
+ (the p-value is then computed with its own number of draws), and 0 if
+ observation i was not tested (isolate). Untested observations are left
+ out of both corrections. draws can be NULL if every observation was tested.
+ */
 class InferenceSettingsDlg : public wxDialog
 {
 public:
@@ -39,6 +50,7 @@ public:
                          double p_cutoff,
                          double* p_vals,
                          int n,
+                         const int* draws,
                          const wxString& title = _("Inference Settings"),
                          wxWindowID id = wxID_ANY,
                          const wxPoint& pos = wxDefaultPosition,
@@ -56,6 +68,7 @@ protected:
     double p_cutoff;
     double user_input;
     double* p_vals;
+    const int* draws;
     int n;
     
     wxRadioButton* m_rdo_1;
@@ -110,7 +123,12 @@ public:
 	
     void SinglePermute();
 	void RunPermutations();
-	void RunRandomTrials();
+	void StartRandomTrials();
+	void CancelRandomTrials();
+	bool IsRunning() const;
+	void OnTrialsTimer(wxTimerEvent& event);
+	void ResetTrials();
+	void AddTrials(int first, int last);
 	void UpdateStatistics();
 	
     int	Width, Height, Left, Right, Top, Bottom;
@@ -138,11 +156,15 @@ public:
 	double  expected_val;
 	bool count_greater;
 	
-	int* perm;
-	long* theRands;
-	
-	Randik*  rng;
+	MoranPermutation* perm_engine;
+	uint64_t seed;
 	bool    experiment_run_once;
+	// polls perm_engine while the permutations run on the worker threads
+	wxTimer* trials_timer;
+	wxStopWatch trials_watch;
+	
+protected:
+	void FinishRandomTrials();
 };
 
 class RandomizationDlg: public wxFrame
@@ -187,11 +209,15 @@ public:
     void OnClose( wxCloseEvent& event );
     void OnOkClick( wxCommandEvent& event );
     void OnRunAll( wxCommandEvent& event );
+    /** "Cancel" while a panel runs its permutations, "Run" otherwise */
+    void UpdateRunButton();
 
     RandomizationPanel* panel;
     RandomizationPanel* panel_sel;
     RandomizationPanel* panel_unsel;
     
+    wxButton* run_button;
+    
     bool is_regime;
     GalWeight* copy_w;
     GalWeight* copy_w_sel;
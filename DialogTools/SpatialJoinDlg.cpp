@@ -5,7 +5,9 @@
 //  Created by Xun Li on 9/4/18.
 //
 #include <vector>
+#include <algorithm>
 #include <wx/wx.h>
+#include <wx/stopwatch.h>
 #include <wx/xrc/xmlres.h>
 
 #define BOOST_PHOENIX_STL_TUPLE_H_
@@ -22,9 +24,158 @@
 #include "ConnectDatasourceDlg.h"
 #include "SpatialJoinDlg.h"
 
+PreparedPolygon::PreparedPolygon()
+: minx(0), miny(0), maxx(0), maxy(0), band_scale(0), n_bands(0)
+{
+}
+
+void PreparedPolygon::AddRing(const double* x, const double* y, int n,
+                              int stride)
+{
+    if (n < 2) return;
+    for (int k=0; k<n; k++) {
+        // the closing edge, unless the ring repeats its first point
+        int l = k+1 < n ? k+1 : 0;
+        double x1 = x[k*stride], y1 = y[k*stride];
+        double x2 = x[l*stride], y2 = y[l*stride];
+        if (y1 == y2) continue; // never crossed by a horizontal ray
+        ring_edges.push_back(x1);
+        ring_edges.push_back(y1);
+        ring_edges.push_back(x2);
+        ring_edges.push_back(y2);
+    }
+}
+
+bool PreparedPolygon::Init(const Shapefile::PolygonContents* pc)
+{
+    ring_edges.clear();
+    if (pc == NULL || pc->num_points == 0 || pc->points.empty()) return false;
+    int n_parts = (int)pc->parts.size();
+    int n_points = (int)pc->points.size();
+    for (int p=0; p<n_parts; p++) {
+        int start = pc->parts[p];
+        int end = p+1 < n_parts ? pc->parts[p+1] : n_points;
+        if (start < 0 || end > n_points) return false;
+        AddRing(&pc->points[start].x, &pc->points[start].y, end - start,
+                sizeof(Shapefile::Point) / sizeof(double));
+    }
+    minx = pc->box[0];
+    miny = pc->box[1];
+    maxx = pc->box[2];
+    maxy = pc->box[3];
+    MakeBands();
+    return !edge_y1.empty();
+}
+
+bool PreparedPolygon::AddOGRGeometry(OGRGeometry* geom)
+{
+    OGRwkbGeometryType etype = wkbFlatten(geom->getGeometryType());
+    if (etype == wkbPolygon) {
+        OGRPolygon* poly = (OGRPolygon*)geom;
+        std::vector<OGRRawPoint> pts;
+        int n_rings = poly->getNumInteriorRings() + 1;
+        for (int r=0; r<n_rings; r++) {
+            OGRLinearRing* ring = r == 0 ? poly->getExteriorRing() :
+                                           poly->getInteriorRing(r-1);
+            if (ring == NULL || ring->getNumPoints() == 0) continue;
+            pts.resize(ring->getNumPoints());
+            ring->getPoints(&pts[0]);
+            AddRing(&pts[0].x, &pts[0].y, (int)pts.size(),
+                    sizeof(OGRRawPoint) / sizeof(double));
+        }
+        return true;
+    } else if (etype == wkbMultiPolygon) {
+        OGRMultiPolygon* mpoly = (OGRMultiPolygon*)geom;
+        for (int i=0; i<mpoly->getNumGeometries(); i++) {
+            if (!AddOGRGeometry(mpoly->getGeometryRef(i))) return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool PreparedPolygon::Init(OGRGeometry* geom)
+{
+    ring_edges.clear();
+    if (geom == NULL || !AddOGRGeometry(geom)) return false;
+    OGREnvelope box;
+    geom->getEnvelope(&box);
+    minx = box.MinX;
+    miny = box.MinY;
+    maxx = box.MaxX;
+    maxy = box.MaxY;
+    MakeBands();
+    return !edge_y1.empty();
+}
+
+void PreparedPolygon::MakeBands()
+{
+    int n_edges = (int)ring_edges.size() / 4;
+    n_bands = std::max(1, std::min(n_edges / 8, 256));
+    band_scale = maxy > miny ? n_bands / (maxy - miny) : 0;
+
+    // count, then fill the edges of each band
+    std::vector<int> b0(n_edges), b1(n_edges);
+    band_start.assign(n_bands + 1, 0);
+    for (int e=0; e<n_edges; e++) {
+        double y1 = ring_edges[4*e+1], y2 = ring_edges[4*e+3];
+        b0[e] = (int)((std::min(y1, y2) - miny) * band_scale);
+        b1[e] = (int)((std::max(y1, y2) - miny) * band_scale);
+        b0[e] = std::max(0, std::min(b0[e], n_bands-1));
+        b1[e] = std::max(0, std::min(b1[e], n_bands-1));
+        for (int b=b0[e]; b<=b1[e]; b++) band_start[b+1] += 1;
+    }
+    for (int b=0; b<n_bands; b++) band_start[b+1] += band_start[b];
+    int n = band_start[n_bands];
+    edge_y1.resize(n);
+    edge_y2.resize(n);
+    edge_x1.resize(n);
+    edge_dxdy.resize(n);
+    std::vector<int> pos(band_start.begin(), band_start.end() - 1);
+    for (int e=0; e<n_edges; e++) {
+        double x1 = ring_edges[4*e], y1 = ring_edges[4*e+1];
+        double x2 = ring_edges[4*e+2], y2 = ring_edges[4*e+3];
+        if (y1 > y2) {
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+        }
+        for (int b=b0[e]; b<=b1[e]; b++) {
+            int k = pos[b]++;
+            edge_y1[k] = y1;
+            edge_y2[k] = y2;
+            edge_x1[k] = x1;
+            edge_dxdy[k] = (x2 - x1) / (y2 - y1);
+        }
+    }
+    ring_edges.clear();
+}
+
+bool PreparedPolygon::Contains(double x, double y) const
+{
+    if (x < minx || x > maxx || y < miny || y > maxy || n_bands == 0) {
+        return false;
+    }
+    int b = (int)((y - miny) * band_scale);
+    if (b >= n_bands) b = n_bands - 1;
+    // no branch in the loop, so that it can be vectorized
+    int crossings = 0;
+    const double* y1 = &edge_y1[0];
+    const double* y2 = &edge_y2[0];
+    const double* x1 = &edge_x1[0];
+    const double* dxdy = &edge_dxdy[0];
+    for (int k=band_start[b], end=band_start[b+1]; k<end; k++) {
+        int straddles = (y1[k] <= y) & (y < y2[k]);
+        int left = x < x1[k] + (y - y1[k]) * dxdy[k];
+        crossings += straddles & left;
+    }
+    return (crossings & 1) == 1;
+}
+
 SpatialJoinWorker::SpatialJoinWorker(BackgroundMapLayer* _ml, Project* _project)
 {
     duplicate_count = false;
+    need_join_ids = false;
+    next_task = 0;
     ml = _ml;
     project = _project;
     int n_joins = project->GetNumRecords();
@@ -60,34 +211,52 @@ std::vector<wxInt64> SpatialJoinWorker::GetResults()
      return spatial_counts;
 }
 
+struct SpatialJoinCostGreater {
+    const std::vector<double>& cost;
+    SpatialJoinCostGreater(const std::vector<double>& c) : cost(c) {}
+    bool operator()(int a, int b) const { return cost[a] > cost[b]; }
+};
+
 void SpatialJoinWorker::Run()
 {
-    int initial = num_polygons;
+    wxStopWatch sw;
+    int n_joins = project->GetNumRecords();
+    if (join_variable) {
+        int n_vars = (int)join_values.size();
+        join_sum.assign(n_vars, std::vector<double>(n_joins, 0));
+        join_m2.assign(n_vars, std::vector<double>(n_joins, 0));
+        join_min.assign(n_vars, std::vector<double>(n_joins, 0));
+        join_max.assign(n_vars, std::vector<double>(n_joins, 0));
+        for (size_t k=0; k<join_operation.size(); ++k) {
+            if (join_operation[k] == MEDIAN) need_join_ids = true;
+        }
+    }
+
+    // the polygons are handed out one at a time, the most expensive first,
+    // so that the threads finish together
+    std::vector<double> cost(num_polygons);
+    task_order.resize(num_polygons);
+    for (int i=0; i<num_polygons; i++) {
+        cost[i] = GetCost(i);
+        task_order[i] = i;
+    }
+    std::stable_sort(task_order.begin(), task_order.end(),
+                     SpatialJoinCostGreater(cost));
+    next_task = 0;
+
     int nCPUs = boost::thread::hardware_concurrency();
     if (GdaConst::gda_set_cpu_cores) nCPUs = GdaConst::gda_cpu_cores;
-    int quotient = initial / nCPUs;
-    int remainder = initial % nCPUs;
-    int tot_threads = (quotient > 0) ? nCPUs : remainder;
+    if (nCPUs > num_polygons) nCPUs = num_polygons;
+    if (nCPUs < 1) nCPUs = 1;
 
     boost::thread_group threadPool;
-    for (int i=0; i<tot_threads; i++) {
-        int a=0;
-        int b=0;
-        if (i < remainder) {
-            a = i*(quotient+1);
-            b = a+quotient;
-        } else {
-            a = remainder*(quotient+1) + (i-remainder)*quotient;
-            b = a+quotient-1;
-        }
-        boost::thread* worker = new boost::thread(boost::bind(&SpatialJoinWorker::sub_run,this,a,b));
-        threadPool.add_thread(worker);
+    for (int i=0; i<nCPUs; i++) {
+        threadPool.create_thread(boost::bind(&SpatialJoinWorker::Worker, this));
     }
 
     threadPool.join_all();
 
     // check if duplicated counting
-    int n_joins = project->GetNumRecords();
     if (is_spatial_assign == false) {
         wxInt64 sum = 0;
         for (size_t i=0; i<spatial_counts.size(); i++) {
@@ -106,32 +275,68 @@ void SpatialJoinWorker::Run()
             spatial_joins[k].resize(n_joins);
         }
         for (size_t i=0; i<n_joins; ++i) {
-            size_t cnt = join_ids[i].size();
+            wxInt64 cnt = spatial_counts[i];
             
             for (size_t k=0; k<n_vars; ++k) {
-                std::vector<double> vals(cnt, 0);
-                
-                for (size_t j=0; j<cnt; ++j) {
-                    int idx = (int)join_ids[i][j];
-                    vals[j] = join_values[k][idx];
-                }
-                
                 if (join_operation[k] == STD) {
-                    double variance = GenUtils::GetVariance(vals);
+                    double variance = cnt > 1 ? join_m2[k][i] / cnt : 0;
                     spatial_joins[k][i] = sqrt(variance);
                 } else if (join_operation[k] == SUM) {
-                    double sum = GenUtils::Sum(vals);
-                    spatial_joins[k][i] = sum;
+                    spatial_joins[k][i] = join_sum[k][i];
                 } else if (join_operation[k] == MEAN) {
-                    double sum = GenUtils::Sum(vals);
-                    spatial_joins[k][i] = cnt == 0? 0 : sum / cnt;
+                    spatial_joins[k][i] = cnt == 0? 0 : join_sum[k][i] / cnt;
+                } else if (join_operation[k] == MIN) {
+                    spatial_joins[k][i] = join_min[k][i];
+                } else if (join_operation[k] == MAX) {
+                    spatial_joins[k][i] = join_max[k][i];
                 } else if (join_operation[k] == MEDIAN) {
+                    std::vector<double> vals(join_ids[i].size(), 0);
+                    for (size_t j=0; j<vals.size(); ++j) {
+                        int idx = (int)join_ids[i][j];
+                        vals[j] = join_values[k][idx];
+                    }
                     double median = GenUtils::Median(vals);
                     spatial_joins[k][i] = median;
                 }
             }
         }
     }
+    wxLogMessage("SpatialJoinWorker: %d polygons on %d threads in %ld ms",
+                 num_polygons, nCPUs, sw.Time());
+}
+
+void SpatialJoinWorker::Worker()
+{
+    int i = 0;
+    while (NextTask(i)) {
+        sub_run(i, i);
+    }
+}
+
+bool SpatialJoinWorker::NextTask(int& i)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if (next_task >= task_order.size()) return false;
+    i = task_order[next_task++];
+    return true;
+}
+
+void SpatialJoinWorker::AddJoin(int poly, int row)
+{
+    // poly is only handled by the thread that calls this
+    spatial_counts[poly] += 1;
+    if (!join_variable) return;
+    double n = (double)spatial_counts[poly];
+    for (size_t k=0; k<join_values.size(); ++k) {
+        double v = join_values[k][row];
+        double mean_prev = n > 1 ? join_sum[k][poly] / (n - 1) : 0;
+        join_sum[k][poly] += v;
+        double mean = join_sum[k][poly] / n;
+        if (n > 1) join_m2[k][poly] += (v - mean_prev) * (v - mean);
+        if (n == 1 || v < join_min[k][poly]) join_min[k][poly] = v;
+        if (n == 1 || v > join_max[k][poly]) join_max[k][poly] = v;
+    }
+    if (need_join_ids) join_ids[poly].push_back(row);
 }
 
 
@@ -169,6 +374,7 @@ void CountPointsInPolygon::sub_run(int start, int end)
     Shapefile::Main& main_data = project->main_data;
     OGRLayerProxy* ogr_layer = project->layer_proxy;
     Shapefile::PolygonContents* pc;
+    PreparedPolygon poly;
     for (int i=start; i<=end; i++) {
         pc = (Shapefile::PolygonContents*)main_data.records[i].contents_p;
         // create a box, tl, br
@@ -177,25 +383,33 @@ void CountPointsInPolygon::sub_run(int start, int end)
         // query points in this box
         std::vector<pt_2d_val> q;
         rtree.query(bgi::within(b), std::back_inserter(q));
-        OGRGeometry* ogr_poly = ogr_layer->GetGeometry(i);
+        if (q.empty()) continue;
+        bool prepared = poly.Init(pc);
+        OGRGeometry* ogr_poly = prepared ? NULL : ogr_layer->GetGeometry(i);
         for (int j=0; j<q.size(); j++) {
             const pt_2d_val& v = q[j];
             int pt_idx = v.second;
             double x = v.first.get<0>();
             double y = v.first.get<1>();
-            OGRPoint ogr_pt(x, y);
-            if (ogr_pt.Within(ogr_poly)) {
-                spatial_counts[i] += 1;
-                if (join_variable) {
-                    mutex.lock();
-                    join_ids[i].push_back(pt_idx);
-                    mutex.unlock();
-                }
+            bool inside = false;
+            if (prepared) {
+                inside = poly.Contains(x, y);
+            } else if (ogr_poly) {
+                OGRPoint ogr_pt(x, y);
+                inside = ogr_pt.Within(ogr_poly);
             }
+            if (inside) AddJoin(i, pt_idx);
         }
     }
 }
 
+double CountPointsInPolygon::GetCost(int i)
+{
+    Shapefile::PolygonContents* pc;
+    pc = (Shapefile::PolygonContents*)project->main_data.records[i].contents_p;
+    return pc->points.size();
+}
+
 
 
 AssignPolygonToPoint::AssignPolygonToPoint(BackgroundMapLayer* _ml,
@@ -226,6 +440,7 @@ AssignPolygonToPoint::AssignPolygonToPoint(BackgroundMapLayer* _ml,
 
 void AssignPolygonToPoint::sub_run(int start, int end)
 {
+    PreparedPolygon poly;
     // for every polygon in sub-layer
     for (int i=start; i<=end; i++) {
         OGRGeometry* ogr_poly = ml->geoms[i];
@@ -237,13 +452,21 @@ void AssignPolygonToPoint::sub_run(int start, int end)
         // query points in this box
         std::vector<pt_2d_val> q;
         rtree.query(bgi::within(b), std::back_inserter(q));
+        if (q.empty()) continue;
+        bool prepared = poly.Init(ogr_poly);
         for (int j=0; j<q.size(); j++) {
             const pt_2d_val& v = q[j];
             int pt_idx = v.second;
             double x = v.first.get<0>();
             double y = v.first.get<1>();
-            OGRPoint ogr_pt(x, y);
-            if (ogr_pt.Within(ogr_poly)) {
+            bool inside = false;
+            if (prepared) {
+                inside = poly.Contains(x, y);
+            } else {
+                OGRPoint ogr_pt(x, y);
+                inside = ogr_pt.Within(ogr_poly);
+            }
+            if (inside) {
                 spatial_counts[pt_idx] = poly_ids[i];
             }
         }
@@ -299,12 +522,7 @@ void CountLinesInPolygon::sub_run(int start, int end)
             int row_idx = v.second;
             OGRGeometry* geom = ml->geoms[row_idx];
             if (geom->Intersects(ogr_poly)) {
-                spatial_counts[i] += 1;
-                if (join_variable) {
-                    mutex.lock();
-                    join_ids[i].push_back(row_idx);
-                    mutex.unlock();
-                }
+                AddJoin(i, row_idx);
             }
         }
     }
@@ -408,12 +626,7 @@ void CountPolygonInPolygon::sub_run(int start, int end)
             int row_idx = v.second;
             OGRGeometry* geom = ml->geoms[row_idx];
             if (geom->Intersects(ogr_poly)) {
-                spatial_counts[i] += 1;
-                if (join_variable) {
-                    mutex.lock();
-                    join_ids[i].push_back(row_idx);
-                    mutex.unlock();
-                }
+                AddJoin(i, row_idx);
             }
         }
     }
@@ -555,6 +768,10 @@ void SpatialJoinDlg::OnAddRow(wxCommandEvent& e)
         join_op = "Median";
     } else if (op_sel == 3) {
         join_op = "Standard Deviation";
+    } else if (op_sel == 4) {
+        join_op = "Minimum";
+    } else if (op_sel == 5) {
+        join_op = "Maximum";
     }
     
     bool show_warning = false;
@@ -681,6 +898,8 @@ void SpatialJoinDlg::UpdateFieldList(wxString name)
             join_op_list->Append("Mean");
             join_op_list->Append("Median");
             join_op_list->Append("Standard Deviation");
+            join_op_list->Append("Minimum");
+            join_op_list->Append("Maximum");
         }
     }
 }
@@ -781,6 +1000,10 @@ void SpatialJoinDlg::OnOK(wxCommandEvent& e)
                     join_op = SpatialJoinWorker::MEDIAN;
                 } else if (op_name == "Standard Deviation") {
                     join_op = SpatialJoinWorker::STD;
+                } else if (op_name == "Minimum") {
+                    join_op = SpatialJoinWorker::MIN;
+                } else if (op_name == "Maximum") {
+                    join_op = SpatialJoinWorker::MAX;
                 }
                 join_var_nms.push_back(var_name);
                 join_ops.push_back(join_op);
@@ -8,6 +8,7 @@
 #ifndef SpatialJoinDlg_hpp
 #define SpatialJoinDlg_hpp
 
+#include <vector>
 #include <boost/thread/mutex.hpp>
 #include <wx/dialog.h>
 #include <wx/choice.h>
@@ -17,11 +18,50 @@ class Project;
 class BackgroundMapLayer;
 class MapLayerState;
 class MapLayerStateObserver;
+class OGRGeometry;
+namespace Shapefile {
+    struct PolygonContents;
+}
+
+/**
+ Point in polygon test on the rings of one polygon, without building an
+ OGRPoint and a GEOS geometry for every point.  The edges are put in
+ horizontal bands over the bounding box of the polygon; a point only
+ checks the edges of its band, and counts the crossings of a ray to its
+ right (even-odd rule, so the holes are outside).  A point on an edge is
+ in one of the two polygons that share it, where OGR Within() would put it
+ in neither.
+ */
+class PreparedPolygon
+{
+public:
+    PreparedPolygon();
+
+    /** false if there is no ring to test */
+    bool Init(const Shapefile::PolygonContents* pc);
+    /** false if there is no ring, or for curves: use OGR then */
+    bool Init(OGRGeometry* geom);
+    bool Contains(double x, double y) const;
+
+protected:
+    void AddRing(const double* x, const double* y, int n, int stride);
+    bool AddOGRGeometry(OGRGeometry* geom);
+    void MakeBands();
+
+    double minx, miny, maxx, maxy;
+    double band_scale; // bands per unit of y
+    int n_bands;
+    std::vector<int> band_start;
+    // edges of each band: y1 <= y2, x at y1, and dx/dy
+    std::vector<double> edge_y1, edge_y2, edge_x1, edge_dxdy;
+    // all edges while the polygon is read
+    std::vector<double> ring_edges;
+};
 
 class SpatialJoinWorker
 {
 public:
-    enum Operation {NONE, MEAN, MEDIAN, STD, SUM};
+    enum Operation {NONE, MEAN, MEDIAN, STD, SUM, MIN, MAX};
     SpatialJoinWorker(BackgroundMapLayer* ml, Project* project);
     virtual ~SpatialJoinWorker();
 
@@ -33,12 +73,23 @@ public:
     std::vector<wxInt64> GetResults();
     std::vector<std::vector<double> > GetJoinResults();
     virtual void sub_run(int start, int end) = 0;
+    /** Relative time to process polygon i; the most expensive ones are
+     handed out first */
+    virtual double GetCost(int i) { return 1; }
 
 protected:
+    void Worker();
+    bool NextTask(int& i);
+    /** Counts row of the joined layer in polygon poly, and adds its values
+     to the statistics of the join variables */
+    void AddJoin(int poly, int row);
+
     Project* project;
     BackgroundMapLayer* ml;
     int num_polygons;
     boost::mutex mutex;
+    std::vector<int> task_order;
+    size_t next_task;
 
     bool is_spatial_assign;
     bool duplicate_count;
@@ -53,7 +104,14 @@ protected:
     std::vector<std::vector<double>  > join_values;
     std::vector<Operation> join_operation;
     
+    // the values of each variable are summed up as they are joined; only
+    // the median needs all of them
+    bool need_join_ids;
     std::vector<std::vector<wxInt64> > join_ids;
+    std::vector<std::vector<double> > join_sum;
+    std::vector<std::vector<double> > join_m2; // sum of squared deviations
+    std::vector<std::vector<double> > join_min;
+    std::vector<std::vector<double> > join_max;
 };
 
 class CountPointsInPolygon : public SpatialJoinWorker
@@ -63,6 +121,7 @@ public:
                          std::vector<wxString> join_variable_nm,
                          std::vector<Operation> op);
     virtual void sub_run(int start, int end);
+    virtual double GetCost(int i);
 protected:
     rtree_pt_2d_t rtree;
 };
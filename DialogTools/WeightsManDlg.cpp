@@ -46,6 +46,7 @@
 #include "../io/arcgis_swm.h"
 #include "../io/matlab_mat.h"
 #include "../io/weights_interface.h"
+#include "../io/weights_binary.h"
 #include "WeightsManDlg.h"
 
 BEGIN_EVENT_TABLE(WeightsManFrame, TemplateFrame)
@@ -457,14 +458,14 @@ void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
     wxFileName default_dir = project_p->GetWorkingDir();
     wxString default_path = default_dir.GetPath();
 	wxFileDialog dlg( this, _("Choose Weights File"), default_path, "",
-                     "Weights Files (*.gal, *.gwt, *.kwt, *.swm, *.mat)|*.gal;*.gwt;*.kwt;*.swm;*.mat");
+                     "Weights Files (*.gal, *.gwt, *.kwt, *.swm, *.mat, *.gwb)|*.gal;*.gwt;*.kwt;*.swm;*.mat;*.gwb");
 	
     if (dlg.ShowModal() != wxID_OK) return;
 	wxString path  = dlg.GetPath();
 	wxString ext = GenUtils::GetFileExt(path).Lower();
 	
-	if (ext != "gal" && ext != "gwt" && ext != "kwt" && ext != "mat" && ext != "swm") {
-		wxString msg = _("Only 'gal', 'gwt', 'kwt', 'mat' and 'swm' weights files supported.");
+	if (ext != "gal" && ext != "gwt" && ext != "kwt" && ext != "mat" && ext != "swm" && ext != "gwb") {
+		wxString msg = _("Only 'gal', 'gwt', 'kwt', 'mat', 'swm' and 'gwb' weights files supported.");
 		wxMessageDialog dlg(this, msg, _("Error"), wxOK|wxICON_ERROR);
 		dlg.ShowModal();
 		return;
@@ -476,6 +477,8 @@ void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
         id_field = "Unknown";
     } else if (ext == "swm") {
         id_field = ReadIdFieldFromSwm(path);
+    } else if (ext == "gwb") {
+        id_field = ReadIdFieldFromGwb(path);
     } else {
         id_field = WeightUtils::ReadIdField(path);
     }
@@ -503,8 +506,12 @@ void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
 	}
 	
 	GalElement* tempGal = 0;
+    GalWeight* gwb_w = 0;
     try {
-        if (ext == "gal") {
+        if (ext == "gwb") {
+            gwb_w = ReadGwbAsGalWeight(path, table_int);
+            if (gwb_w) tempGal = gwb_w->gal;
+        } else if (ext == "gal") {
             tempGal = WeightUtils::ReadGal(path, table_int);
         } else if (ext == "swm") {
             tempGal = ReadSwmAsGal(path, table_int);
@@ -550,13 +557,15 @@ void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
 		return;
 	}
    
-    GalWeight* gw = new GalWeight();
+    // the binary weights come with their CSR arrays and symmetry flag
+    GalWeight* gw = gwb_w ? gwb_w : new GalWeight();
     gw->num_obs = table_int->GetNumberRows();
     gw->wflnm = wmi.filename;
     gw->id_field = id_field;
     gw->gal = tempGal;
     
     gw->GetNbrStats();
+    if (gw->symmetry_checked) wmi.SetSymmetric(gw->is_symmetric);
     wmi.num_obs = gw->GetNumObs();
     wmi.SetMinNumNbrs(gw->GetMinNumNbrs());
     wmi.SetMaxNumNbrs(gw->GetMaxNumNbrs());
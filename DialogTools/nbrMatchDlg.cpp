@@ -1630,7 +1630,7 @@ void LocalMatchSignificanceFrame::OnSigFilterSetup(wxCommandEvent& event)
         user_sig = gs_coord->user_sig_cutoff;
   
     if (n > 0) {
-        InferenceSettingsDlg dlg(this, user_sig, p_val, n, ttl);
+        InferenceSettingsDlg dlg(this, user_sig, p_val, n, NULL, ttl);
         if (dlg.ShowModal() == wxID_OK) {
             gs_coord->SetSignificanceFilter(-1);
             gs_coord->significance_cutoff = dlg.GetAlphaLevel();
@@ -644,6 +644,7 @@ void AbstractMapFrame::OnSigFilterSetup(wxCommandEvent& event)
     AbstractMapCanvas* lc = (AbstractMapCanvas*)template_canvas;
     int t = template_canvas->cat_data.GetCurrentCanvasTmStep();
     double* p = a_coord->GetLocalSignificanceValues(t);
+    int* draws = a_coord->GetPermutationDraws(t);
     int n = a_coord->num_obs;
     wxString ttl = _("Inference Settings (%d perm)");
     ttl = wxString::Format(ttl, a_coord->GetNumPermutations());
@@ -652,7 +653,7 @@ void AbstractMapFrame::OnSigFilterSetup(wxCommandEvent& event)
     int sig_filter = a_coord->GetSignificanceFilter();
     if (sig_filter < 0) user_sig = a_coord->GetUserCutoff();
     
-    InferenceSettingsDlg dlg(this, user_sig, p, n, ttl);
+    InferenceSettingsDlg dlg(this, user_sig, p, n, draws, ttl);
     if (dlg.ShowModal() == wxID_OK) {
         a_coord->SetSignificanceFilter(-1);
         a_coord->SetSignificanceCutoff(dlg.GetAlphaLevel());
@@ -21,6 +21,7 @@
 #include <boost/thread.hpp>
 #include <boost/bind/bind.hpp>
 
+#include <algorithm>
 #include <time.h>
 #include <math.h>
 #include <wx/log.h>
@@ -34,47 +35,10 @@
 #include "../VarCalc/WeightsManInterface.h"
 #include "../logger.h"
 #include "../Project.h"
+#include "../Algorithms/perm_sampler.h"
+#include "../Algorithms/perm_scheduler.h"
 #include "AbstractCoordinator.h"
 
-AbstractWorkerThread::AbstractWorkerThread(int obs_start_s,
-                                           int obs_end_s,
-                                           uint64_t	seed_start_s,
-                                           AbstractCoordinator* a_coord_s,
-                                           wxMutex* worker_list_mutex_s,
-                                           wxCondition* worker_list_empty_cond_s,
-                                           std::list<wxThread*> *worker_list_s,
-                                           int thread_id_s)
-: wxThread(),
-obs_start(obs_start_s),
-obs_end(obs_end_s),
-seed_start(seed_start_s),
-a_coord(a_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-AbstractWorkerThread::~AbstractWorkerThread()
-{
-}
-
-wxThread::ExitCode AbstractWorkerThread::Entry()
-{
-	// call work for assigned range of observations
-	a_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-    // if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	if (worker_list->empty()) {
-		worker_list_empty_cond->Signal();
-	}
-	return NULL;
-}
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 //
@@ -299,6 +263,15 @@ double AbstractCoordinator::GetUserCutoff()
 void AbstractCoordinator::SetUserCutoff(double val)
 {
     user_sig_cutoff = val;
+    // observations stopped early were only shown to be non-significant at
+    // the cutoff the permutations were run with; run them again with the
+    // same seed if the new cutoff is larger
+    if (!perm_stop_rule.IsValidFor(std::max(significance_cutoff, val))) {
+        bool reuse = reuse_last_seed;
+        reuse_last_seed = true;
+        CalcPseudoP();
+        reuse_last_seed = reuse;
+    }
 }
 
 double AbstractCoordinator::GetFDR()
@@ -343,6 +316,14 @@ int* AbstractCoordinator::GetSigCatIndicators(int t)
     return sig_cat_vecs[t];
 }
 
+int* AbstractCoordinator::GetPermutationDraws(int t)
+{
+    if (t < 0 || t >= (int)perm_draws.size() || perm_draws[t].empty()) {
+        return NULL;
+    }
+    return &perm_draws[t][0];
+}
+
 boost::uuids::uuid AbstractCoordinator::GetWeightsID()
 {
     return w_id;
@@ -422,105 +403,64 @@ void AbstractCoordinator::CalcPseudoP()
 void AbstractCoordinator::CalcPseudoP_threaded()
 {
 	wxLogMessage("Entering AbstractCoordinator::CalcPseudoP_threaded()");
-    int nCPUs = GdaConst::gda_cpu_cores;
-    if (!GdaConst::gda_set_cpu_cores)
-        nCPUs = wxThread::GetCPUCount();
+	if (!reuse_last_seed) last_seed_used = time(0);
     
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-    // mutex should be initially locked
-	worker_list_mutex.Lock();
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
-
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
+    // observations that are not isolates can be drawn as permuted neighbors
+    GalElement* w = Gal_vecs[num_time_vals-1]->gal;
+    std::vector<bool> candidates(num_obs);
+    for (int i=0; i<num_obs; i++) candidates[i] = w[i].Size() > 0;
+    perm_sampler.Init(candidates, PermutationSampler::GetDefaultType());
     
-    if (work_chunk == 0) {
-        work_chunk = 1;
-    }
+    // the workers read the CSR storage of the weights
+    Gal_csrs.resize(num_time_vals);
+    for (int t=0; t<num_time_vals; t++) Gal_csrs[t] = &Gal_vecs[t]->GetCsr();
     
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
-    //boost::thread_group threadPool;
-    
-	if (!reuse_last_seed) last_seed_used = time(0);
+    perm_stop_rule.Init(permutations,
+                        std::max(significance_cutoff, user_sig_cutoff));
+    perm_draws.resize(num_time_vals);
+    for (int t=0; t<num_time_vals; t++) perm_draws[t].assign(num_obs, 0);
     
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-        int thread_id = i+1;
-        //boost::thread* worker = new boost::thread(boost::bind(&AbstractCoordinator::CalcPseudoP_range,this, a, b, seed_start));
-        //threadPool.add_thread(worker);
-        AbstractWorkerThread* thread =
-        new AbstractWorkerThread(a, b, seed_start, this,
-                                 &worker_list_mutex,
-                                 &worker_list_empty_cond,
-                                 &worker_list, thread_id);
-        if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-            delete thread;
-            is_thread_error = true;
-        } else {
-            worker_list.push_front(thread);
-        }
-	}
-    if (is_thread_error) {
-        // fall back to single thread calculation mode
-        CalcPseudoP_range(0, num_obs-1, last_seed_used);
-    } else {
-        std::list<wxThread*>::iterator it;
-        for (it = worker_list.begin(); it != worker_list.end(); it++) {
-            (*it)->Run();
+    undef_masks.resize(num_time_vals);
+    for (int t=0; t<num_time_vals; t++) {
+        undef_masks[t].clear();
+        std::vector<bool>& undefs = undef_tms[t];
+        bool has_undef = false;
+        for (size_t i=0; i<undefs.size() && !has_undef; i++) {
+            has_undef = undefs[i];
         }
-        while (!worker_list.empty()) {
-            // wait until thread_list might be empty
-            worker_list_empty_cond.Wait();
-            // We have been woken up. If this was not a false
-            // alarm (sprious signal), the loop will exit.
+        if (has_undef) {
+            undef_masks[t].resize(undefs.size());
+            for (size_t i=0; i<undefs.size(); i++) undef_masks[t][i] = undefs[i];
         }
     }
-    //threadPool.join_all();
+    
+    PermutationScheduler scheduler(num_obs, Gal_vecs, permutations,
+                                   perm_sampler.GetType());
+    scheduler.Run(boost::bind(&AbstractCoordinator::CalcPseudoP_range, this,
+                              boost::placeholders::_1,
+                              boost::placeholders::_2,
+                              boost::placeholders::_3), last_seed_used);
+    
+    Gal_csrs.clear();
 	wxLogMessage("Exiting AbstractCoordinator::CalcPseudoP_threaded()");
 }
 
 void AbstractCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
                                             uint64_t seed_start)
 {
-	GeoDaSet workPermutation(num_obs);
-    int max_rand = num_obs-1;
+    PermutationSampler::Buffer perm_buf(perm_sampler);
+    std::vector<int> perm_table;
     
 	for (int cnt=obs_start; cnt<=obs_end; cnt++) {
         std::vector<uint64_t> countLarger(num_time_vals, 0);
         
-        GalElement* w;
-        
         // get full neighbors even if has undefined value
         int numNeighbors = 0;
         for (int t=0; t<num_time_vals; t++) {
-            w = Gal_vecs[t]->gal;
-            if (w[cnt].Size() > numNeighbors) {
-                numNeighbors = w[cnt].Size();
-                if (w[cnt].Check(cnt)) {
+            const GalCsr& w = *Gal_csrs[t];
+            if (w.Size(cnt) > numNeighbors) {
+                numNeighbors = w.Size(cnt);
+                if (w.Check(cnt, cnt)) {
                     // exclude self from neighbors
                     numNeighbors -= 1;
                 }
@@ -536,40 +476,44 @@ void AbstractCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
             continue;
         }
         
-		for (int perm=0; perm<permutations; perm++) {
-			int rand=0;
-            double rng_val;
-            int newRandom;
-			while (rand < numNeighbors) {
-				// computing 'perfect' permutation of given size
-                rng_val = Gda::ThomasWangHashDouble(seed_start++) * max_rand;
-                // round is needed to fix issue
-                // https://github.com/GeoDaCenter/geoda/issues/488
-				newRandom = (int)(rng_val<0.0?ceil(rng_val - 0.5):floor(rng_val + 0.5));
-                
-				if (newRandom != cnt && !workPermutation.Belongs(newRandom) && w[newRandom].Size()>0) {
-					workPermutation.Push(newRandom);
-					rand++;
-				}
-			}
-            std::vector<int> permNeighbors(numNeighbors);
-            for (int cp=0; cp<numNeighbors; cp++) {
-                permNeighbors[cp] = workPermutation.Pop();
+        // draw a block of permutations into a flat table, then evaluate
+        // all time periods over the same block
+        int block = perm_stop_rule.IsEnabled() ?
+            (int)PermutationStopRule::check_interval : (int)perm_block_size;
+        block = std::min(permutations, block);
+        perm_table.resize((size_t)block * numNeighbors);
+        uint64_t draws = 0;
+		for (int perm=0; perm<permutations; perm+=block) {
+            int num_perms = std::min(block, permutations - perm);
+            int nn = 0;
+            for (int p=0; p<num_perms; p++) {
+                nn = perm_sampler.Draw(perm_buf, cnt, numNeighbors, seed_start);
+                const int* nbrs = perm_buf.GetNeighbors();
+                std::copy(nbrs, nbrs + nn, perm_table.begin() + p * nn);
             }
             // for each time step, reuse permuation
-            ComputeLarger(cnt, permNeighbors, countLarger);
+            ComputeLarger(cnt, &perm_table[0], num_perms, nn, countLarger);
+            draws += num_perms;
+            
+            // stop once every time period is clearly not significant
+            bool can_stop = perm_stop_rule.IsEnabled();
+            for (int t=0; t<num_time_vals && can_stop; t++) {
+                can_stop = perm_stop_rule.CanStop(countLarger[t], draws);
+            }
+            if (can_stop) break;
 		}
         
         for (int t=0; t<num_time_vals; t++) {
             double* _sigLocal = sig_local_vecs[t];
             int* _sigCat = sig_cat_vecs[t];
 
+            perm_draws[t][cnt] = (int)draws;
     		// pick the smallest
-    		if (permutations-countLarger[t] <= countLarger[t]) {
-    			countLarger[t] = permutations-countLarger[t];
+    		if (draws-countLarger[t] <= countLarger[t]) {
+    			countLarger[t] = draws-countLarger[t];
     		}
     		
-    		_sigLocal[cnt] = (countLarger[t]+1.0)/(permutations+1);
+    		_sigLocal[cnt] = (countLarger[t]+1.0)/(draws+1);
     		// 'significance' of local Moran
     		if (_sigLocal[cnt] <= 0.00001) _sigCat[cnt] = 5;
             else if (_sigLocal[cnt] <= 0.0001) _sigCat[cnt] = 4;
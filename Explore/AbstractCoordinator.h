@@ -30,6 +30,8 @@
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
 #include "../ShapeOperations/OGRDataAdapter.h"
+#include "../Algorithms/perm_sampler.h"
+#include "../Algorithms/perm_stop_rule.h"
 
 
 class Project;
@@ -48,31 +50,6 @@ public:
 };
 
 
-class AbstractWorkerThread : public wxThread
-{
-public:
-	AbstractWorkerThread(int obs_start,
-                         int obs_end,
-                         uint64_t seed_start,
-                         AbstractCoordinator* a_coord,
-                         wxMutex* worker_list_mutex,
-                         wxCondition* worker_list_empty_cond,
-                         std::list<wxThread*> *worker_list,
-                         int thread_id);
-	virtual ~AbstractWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
-	int thread_id;
-	
-	AbstractCoordinator* a_coord;
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class AbstractCoordinator : public WeightsManStateObserver
 {
 public:
@@ -98,6 +75,8 @@ public:
     virtual void SetSignificanceCutoff(double val);
     
     virtual double GetUserCutoff();
+    /** Runs the permutations again if the early stopping rule was applied
+     with a smaller cutoff */
     virtual void SetUserCutoff(double val);
     
     virtual double GetBO();
@@ -145,7 +124,11 @@ public:
     virtual void CalcPseudoP_range(int obs_start, int obs_end,
                                    uint64_t seed_start);
     
-    virtual void ComputeLarger(int cnt, std::vector<int>& permNeighbors,
+    /** Count, for every time period, the permutations in perm_table whose
+     statistic is at least the observed one. perm_table holds num_perms
+     rows of numNeighbors ids each (row-major). */
+    virtual void ComputeLarger(int cnt, const int* perm_table, int num_perms,
+                               int numNeighbors,
                                std::vector<uint64_t>& countLarger) = 0;
     
     virtual std::vector<wxString> GetDefaultCategories();
@@ -166,6 +149,10 @@ public:
     
     int* GetSigCatIndicators(int t);
     
+    /** Number of permutations used for each observation; less than the
+     number of permutations if the early stopping rule applied */
+    int* GetPermutationDraws(int t);
+    
     boost::uuids::uuid GetWeightsID();
     
     wxString GetWeightsName(); 
@@ -189,6 +176,20 @@ protected:
     
     GalWeight* weights;
     
+    // draws the permuted neighbors in CalcPseudoP_range()
+    PermutationSampler perm_sampler;
+    
+    // early stopping of the permutations of an observation
+    PermutationStopRule perm_stop_rule;
+    std::vector<std::vector<int> > perm_draws; // perm_draws[t][obs]
+    
+    // byte copy of undef_tms[t] for the permutation kernels; left empty
+    // if period t has no undefined values
+    std::vector<std::vector<char> > undef_masks;
+    
+    // permutations drawn at once into the table passed to ComputeLarger()
+    static const int perm_block_size = 256;
+    
     std::vector<double*> sig_local_vecs;
     std::vector<int*> sig_cat_vecs;
     std::vector<int*> cluster_vecs;
@@ -199,6 +200,8 @@ protected:
 public:
     std::vector<GalWeight*> Gal_vecs;
     std::vector<GalWeight*> Gal_vecs_orig;
+    // CSR of Gal_vecs, while the permutation workers run
+    std::vector<const GalCsr*> Gal_csrs;
 
 	int num_obs; // total # obs including neighborless obs
 	int num_time_vals; // number of valid time periods based on var_info
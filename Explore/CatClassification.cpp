@@ -23,11 +23,9 @@
 #include <set>
 #include <stdlib.h>
 #include <boost/foreach.hpp>
-#include <boost/random.hpp>
-#include <boost/random/uniform_01.hpp>
-#include <boost/random/normal_distribution.hpp>
-#include <boost/random/uniform_int_distribution.hpp>
+#include <wx/log.h>
 #include <wx/msgdlg.h>
+#include <wx/stopwatch.h>
 #include "../DataViewer/TableInterface.h"
 #include "../DialogTools/NumCategoriesDlg.h"
 #include "../logger.h"
@@ -65,19 +63,118 @@ void create_unique_val_mapping(std::vector<UniqueValElem>& uv_mapping,
 	}
 }
 
-/** Assume that b.size() <= N-1 */
-void pick_rand_breaks(std::vector<int>& b, int N, boost::uniform_01<boost::mt19937>& X)
+/**
+ Exact natural breaks (Fisher-Jenks): the classes of consecutive unique
+ values that minimize the total within-class sum of squared deviations,
+ i.e. that maximize the GVF. Each unique value is weighted by its number
+ of observations, so equal values never end up in different classes.
+ 
+ D[m][i] is the smallest cost of m+1 classes over the unique values 0..i.
+ The start of the last class is monotone in i, so each row is computed by
+ divide and conquer in O(u log u) (as in Ckmeans.1d.dp), and the whole
+ search takes O(k u log u) for u unique values and k classes.
+ */
+class NaturalBreaksDP {
+public:
+    NaturalBreaksDP(const std::vector<UniqueValElem>& uv_mapping,
+                    const std::vector<double>& v,
+                    const std::vector<bool>& v_undef);
+    
+    /** unique value index where each of the classes 2..num_cats starts */
+    void Run(int num_cats, std::vector<int>& uv_breaks);
+    
+protected:
+    double SSD(int j, int i) const {
+        double w = W[i+1] - W[j];
+        double s = S[i+1] - S[j];
+        double ssd = (Q[i+1] - Q[j]) - s * s / w;
+        return ssd > 0 ? ssd : 0;
+    }
+    void FillRow(int m, int imin, int imax, int jmin, int jmax);
+    
+    int num_uv;
+    // prefix sums of counts, values and squared values per unique value;
+    // the values are shifted by the median to limit cancellation
+    std::vector<double> W, S, Q;
+    std::vector<double> D_prev, D_cur;
+    std::vector<std::vector<int> > J; // start of the last class
+};
+
+NaturalBreaksDP::NaturalBreaksDP(const std::vector<UniqueValElem>& uv_mapping,
+                                 const std::vector<double>& v,
+                                 const std::vector<bool>& v_undef)
 {
-	int num_breaks = b.size();
-	if (num_breaks > N-1) return;
+    num_uv = (int)uv_mapping.size();
+    W.assign(num_uv+1, 0);
+    S.assign(num_uv+1, 0);
+    Q.assign(num_uv+1, 0);
+    if (num_uv == 0) return;
+    
+    double shift = uv_mapping[num_uv/2].val;
+    int u = -1;
+    for (int i=0, iend=(int)v.size(); i<iend; i++) {
+        if (v_undef[i]) continue;
+        // same grouping as create_unique_val_mapping()
+        if (u < 0 || uv_mapping[u].val != v[i]) u++;
+        double x = v[i] - shift;
+        W[u+1] += 1;
+        S[u+1] += x;
+        Q[u+1] += x * x;
+    }
+    for (int i=0; i<num_uv; i++) {
+        W[i+1] += W[i];
+        S[i+1] += S[i];
+        Q[i+1] += Q[i];
+    }
+}
 
-	std::set<int> s;
-	while (s.size() != num_breaks) s.insert(1 + (N-1)*X());
-	int cnt=0;
-	for (std::set<int>::iterator it=s.begin(); it != s.end(); it++) {
-		b[cnt++] = *it;
-	}
-	std::sort(b.begin(), b.end());
+void NaturalBreaksDP::FillRow(int m, int imin, int imax, int jmin, int jmax)
+{
+    if (imin > imax) return;
+    int i = (imin + imax) / 2;
+    // last class is j..i; classes 0..m-1 hold the unique values 0..j-1
+    int lo = std::max(m, jmin);
+    int hi = std::min(i, jmax);
+    int best_j = lo;
+    double best = DBL_MAX;
+    for (int j=lo; j<=hi; j++) {
+        double d = D_prev[j-1] + SSD(j, i);
+        if (d < best) {
+            best = d;
+            best_j = j;
+        }
+    }
+    D_cur[i] = best;
+    J[m][i] = best_j;
+    FillRow(m, imin, i-1, jmin, best_j);
+    FillRow(m, i+1, imax, best_j, jmax);
+}
+
+void NaturalBreaksDP::Run(int num_cats, std::vector<int>& uv_breaks)
+{
+    uv_breaks.clear();
+    if (num_cats > num_uv) num_cats = num_uv;
+    if (num_cats < 2) return;
+    
+    D_prev.resize(num_uv);
+    D_cur.resize(num_uv);
+    J.assign(num_cats, std::vector<int>());
+    for (int i=0; i<num_uv; i++) D_prev[i] = SSD(0, i);
+    for (int m=1; m<num_cats; m++) {
+        J[m].assign(num_uv, 0);
+        std::fill(D_cur.begin(), D_cur.end(), DBL_MAX);
+        FillRow(m, m, num_uv-1, m, num_uv-1);
+        D_prev.swap(D_cur);
+    }
+    
+    // walk back from the last class
+    uv_breaks.resize(num_cats-1);
+    int i = num_uv-1;
+    for (int m=num_cats-1; m>0; m--) {
+        int j = J[m][i];
+        uv_breaks[m-1] = j;
+        i = j-1;
+    }
 }
 
 // translate unique value breaks into normal breaks given unique value mapping
@@ -1850,32 +1947,17 @@ void CatClassification::FindNaturalBreaks(int num_cats,
         gssd += (v[i]-mean)*(v[i]-mean);
     }
 	
-	std::vector<int> rand_b(t_cats-1);
-	std::vector<int> best_breaks(t_cats-1);
-	std::vector<int> uv_rand_b(t_cats-1);
-	double max_gvf_found = 0;
-	int max_gvf_ind = 0;
-    
-	// for 5000 permutations, 2200 obs, and 4 time periods, slow enough
-	// make sure permutations is such that this total is not exceeded.
-	double c = 5000*2200*4;
-	int perms = c / ((double) num_obs);
-	if (perms < 10) perms = 10;
-	if (perms > 10000) perms = 10000;
-
-    boost::mt19937 rng((unsigned int)GdaConst::gda_user_seed);
-    boost::uniform_01<boost::mt19937> X(rng);
-    
-	for (int i=0; i<perms; i++) {
-		pick_rand_breaks(uv_rand_b, num_unique_vals, X);
-		// translate uv_rand_b into normal breaks
-		unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
-		double new_gvf = calc_gvf(rand_b, v, gssd);
-		if (new_gvf > max_gvf_found) {
-			max_gvf_found = new_gvf;
-			max_gvf_ind = i;
-			best_breaks = rand_b;
-		}
+	wxStopWatch sw;
+	std::vector<int> uv_breaks;
+	std::vector<int> best_breaks;
+	NaturalBreaksDP dp(uv_mapping, v, v_undef);
+	dp.Run(t_cats, uv_breaks);
+	// translate uv_breaks into normal breaks
+	unique_to_normal_breaks(uv_breaks, uv_mapping, best_breaks);
+	if (gssd > 0) {
+		wxLogMessage("Natural breaks: %d obs, %d unique values, %d categories, GVF %f, %ld ms",
+					 valid_obs, num_unique_vals, t_cats,
+					 calc_gvf(best_breaks, v, gssd), sw.Time());
 	}
     
 	nat_breaks.resize(best_breaks.size());
@@ -1925,8 +2007,14 @@ SetNaturalBreaksCats(int num_cats,
 		if (!cats_valid[t])
             continue;
         
+		// undefined flags in the sorted order of v
+		std::vector<bool> v_undef(num_obs);
+		for (int i=0; i<num_obs; i++) {
+			v_undef[i] = var_undef[t][var[t][i].second];
+		}
+        
 		std::vector<UniqueValElem> uv_mapping;
-		create_unique_val_mapping(uv_mapping, v, var_undef[t]);
+		create_unique_val_mapping(uv_mapping, v, v_undef);
         
 		int num_unique_vals = (int)uv_mapping.size();
 		int t_cats = std::min(num_unique_vals, num_cats);
@@ -1951,33 +2039,17 @@ SetNaturalBreaksCats(int num_cats,
             gssd += (val-mean)*(val-mean);
         }
 		
-		std::vector<int> rand_b(t_cats-1);
-		std::vector<int> best_breaks(t_cats-1);
-		std::vector<int> uv_rand_b(t_cats-1);
-        
-		double max_gvf_found = 0;
-		int max_gvf_ind = 0;
-        
-		// for 5000 permutations, 2200 obs, and 4 time periods, slow enough
-		// make sure permutations is such that this total is not exceeded.
-		double c = 5000*2200*4;
-		int perms = c / ((double) num_time_vals * (double) valid_obs);
-		if (perms < 10) perms = 10;
-		if (perms > 10000) perms = 10000;
-	
-        boost::mt19937 rng((unsigned int)GdaConst::gda_user_seed);
-        boost::uniform_01<boost::mt19937> X(rng);
-        
-		for (int i=0; i<perms; i++) {
-			pick_rand_breaks(uv_rand_b, num_unique_vals, X);
-			// translate uv_rand_b into normal breaks
-			unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
-			double new_gvf = calc_gvf(rand_b, v, gssd);
-			if (new_gvf > max_gvf_found) {
-				max_gvf_found = new_gvf;
-				max_gvf_ind = i;
-				best_breaks = rand_b;
-			}
+		wxStopWatch sw;
+		std::vector<int> uv_breaks;
+		std::vector<int> best_breaks;
+		NaturalBreaksDP dp(uv_mapping, v, v_undef);
+		dp.Run(t_cats, uv_breaks);
+		// translate uv_breaks into normal breaks
+		unique_to_normal_breaks(uv_breaks, uv_mapping, best_breaks);
+		if (gssd > 0) {
+			wxLogMessage("Natural breaks: %d obs, %d unique values, %d categories, GVF %f, %ld ms",
+						 valid_obs, num_unique_vals, t_cats,
+						 calc_gvf(best_breaks, v, gssd), sw.Time());
 		}
 
         // check largest break
@@ -22,9 +22,12 @@
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <boost/bind/bind.hpp>
 #include <wx/log.h>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
+#include "../Algorithms/perm_sampler.h"
+#include "../Algorithms/perm_scheduler.h"
 #include "../DataViewer/TableInterface.h"
 #include "../ShapeOperations/Randik.h"
 #include "../ShapeOperations/WeightsManState.h"
@@ -34,47 +37,6 @@
 #include "GetisOrdMapNewView.h"
 #include "GStatCoordinator.h"
 
-GStatWorkerThread::GStatWorkerThread(int obs_start_s, int obs_end_s,
-									 uint64_t seed_start_s,
-									 GStatCoordinator* gstat_coord_s,
-									 wxMutex* worker_list_mutex_s,
-									 wxCondition* worker_list_empty_cond_s,
-									 std::list<wxThread*> *worker_list_s,
-									 int thread_id_s)
-: wxThread(),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-gstat_coord(gstat_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-GStatWorkerThread::~GStatWorkerThread()
-{
-}
-
-wxThread::ExitCode GStatWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("GStatWorkerThread %d started", thread_id));
-	
-	// call work for assigned range of observations
-	gstat_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-	// if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	if (worker_list->empty()) {
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
-
 GStatCoordinator::
 GStatCoordinator(boost::uuids::uuid weights_id,
                  Project* project,
@@ -92,7 +54,8 @@ var_info(var_info_s),
 data(var_info_s.size()),
 data_undef(var_info_s.size()),
 last_seed_used(123456789), reuse_last_seed(true),
-is_local_join_count(_is_local_joint_count)
+is_local_join_count(_is_local_joint_count),
+user_sig_cutoff(0)
 {
     wxLogMessage("Entering GStatCoordinator::GStatCoordinator().");
     reuse_last_seed = GdaConst::use_gda_user_seed;
@@ -587,74 +550,25 @@ void GStatCoordinator::CalcPseudoP()
 void GStatCoordinator::CalcPseudoP_threaded()
 {
 	LOG_MSG("Entering GStatCoordinator::CalcPseudoP_threaded");
-    int nCPUs = GdaConst::gda_cpu_cores;
-    if (!GdaConst::gda_set_cpu_cores)
-        nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
+	if (!reuse_last_seed) last_seed_used = time(0);
 	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
+	// observations that are not isolates can be drawn as permuted neighbors
+	GalElement* w = Gal_vecs[num_time_vals-1]->gal;
+	std::vector<bool> candidates(num_obs);
+	for (int i=0; i<num_obs; i++) candidates[i] = w[i].Size() > 0;
+	perm_sampler.Init(candidates, PermutationSampler::GetDefaultType());
 	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
+	perm_stop_rule.Init(permutations,
+                        std::max(significance_cutoff, user_sig_cutoff));
+	perm_draws.resize(num_time_vals);
+	for (int t=0; t<num_time_vals; t++) perm_draws[t].assign(num_obs, 0);
 	
-	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
-		
-		GStatWorkerThread* thread =
-			new GStatWorkerThread(a, b, seed_start, this,
-								  &worker_list_mutex,
-								  &worker_list_empty_cond,
-								  &worker_list, thread_id);
-		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-			delete thread;
-			is_thread_error = true;
-		} else {
-			worker_list.push_front(thread);
-		}
-	}
-	if (is_thread_error) {
-		// fall back to single thread calculation mode
-		CalcPseudoP_range(0, num_obs-1, last_seed_used);
-	} else {
-		std::list<wxThread*>::iterator it;
-		for (it = worker_list.begin(); it != worker_list.end(); it++) {
-			(*it)->Run();
-		}
-		
-		while (!worker_list.empty()) {
-			// wait until thread_list might be empty
-			worker_list_empty_cond.Wait();
-			// We have been woken up. If this was not a false
-			// alarm (spurious signal), the loop will exit.
-		}
-	}
+	PermutationScheduler scheduler(num_obs, Gal_vecs, permutations,
+                                   perm_sampler.GetType());
+	scheduler.Run(boost::bind(&GStatCoordinator::CalcPseudoP_range, this,
+                              boost::placeholders::_1,
+                              boost::placeholders::_2,
+                              boost::placeholders::_3), last_seed_used);
 	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP_threaded");
 }
 
@@ -663,8 +577,7 @@ void GStatCoordinator::CalcPseudoP_threaded()
  permutation code, we will disallow self-neighbors. */
 void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,uint64_t seed_start)
 {
-	GeoDaSet workPermutation(num_obs);
-	int max_rand = num_obs-1;
+    PermutationSampler::Buffer perm_buf(perm_sampler);
     
 	for (long i=obs_start; i<=obs_end; i++) {
         std::vector<uint64_t> countGLarger(num_time_vals, 0);
@@ -697,23 +610,10 @@ void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,uint64_t see
             continue;
         }
         
+        uint64_t draws = 0;
         for (int perm=0; perm < permutations; perm++) {
-            int rand = 0;
-            while (rand < numNeighbors) {
-                // computing 'perfect' permutation of given size
-                double rng_val = Gda::ThomasWangHashDouble(seed_start++) * max_rand;
-                // round is needed to fix issue
-                //https://github.com/GeoDaCenter/geoda/issues/488
-                int newRandom = (int) (rng_val < 0.0 ? ceil(rng_val - 0.5) : floor(rng_val + 0.5));
-                if (newRandom != i && !workPermutation.Belongs(newRandom) && w[newRandom].Size()>0) {
-                    workPermutation.Push(newRandom);
-                    rand++;
-                }
-            }
-            std::vector<int> permNeighbors(numNeighbors);
-            for (int cp=0; cp<numNeighbors; cp++) {
-                permNeighbors[cp] = workPermutation.Pop();
-            }
+            int nn = perm_sampler.Draw(perm_buf, i, numNeighbors, seed_start);
+            const int* permNeighbors = perm_buf.GetNeighbors();
             // for each time step, reuse permuation
             for (int t=0; t<num_time_vals; t++) {
                 std::vector<bool>& undefs = x_undefs[t];
@@ -732,7 +632,7 @@ void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,uint64_t see
                 double lag_i=0;
                 
                 // use permutation to compute the lags
-                for (int j=0; j<numNeighbors; j++) {
+                for (int j=0; j<nn; j++) {
                     int nb = permNeighbors[j];
                     if (!undefs[nb]) {
                         lag_i += _x[nb];
@@ -751,25 +651,59 @@ void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,uint64_t see
                 if (permutedG >= _G[i]) countGLarger[t]++;
                 if (permutedGStar >= _G_star[i]) countGStarLarger[t]++;
             }
+            draws++;
+            
+            // stop once G and G* of every time period are clearly not
+            // significant
+            bool can_stop = perm_stop_rule.IsEnabled();
+            for (int t=0; t<num_time_vals && can_stop; t++) {
+                if (x_undefs[t][i]) continue;
+                can_stop = perm_stop_rule.CanStop(countGLarger[t], draws) &&
+                           perm_stop_rule.CanStop(countGStarLarger[t], draws);
+            }
+            if (can_stop) break;
         }
         
         for (int t=0; t<num_time_vals; t++) {
             double* p_t = pseudo_p_vecs[t];
             double* ps_t = pseudo_p_star_vecs[t];
+            perm_draws[t][i] = (int)draws;
             // pick the smallest
-            if (permutations-countGLarger[t] < countGLarger[t]) {
-                countGLarger[t] = permutations-countGLarger[t];
+            if (draws-countGLarger[t] < countGLarger[t]) {
+                countGLarger[t] = draws-countGLarger[t];
             }
-            p_t[i] = (countGLarger[t] + 1.0)/(permutations+1.0);
+            p_t[i] = (countGLarger[t] + 1.0)/(draws+1.0);
             
-            if (permutations-countGStarLarger[t] < countGStarLarger[t]) {
-                countGStarLarger[t] = permutations-countGStarLarger[t];
+            if (draws-countGStarLarger[t] < countGStarLarger[t]) {
+                countGStarLarger[t] = draws-countGStarLarger[t];
             }
-            ps_t[i] = (countGStarLarger[t] + 1.0)/(permutations+1.0);
+            ps_t[i] = (countGStarLarger[t] + 1.0)/(draws+1.0);
         }
 	}
 }
 
+int* GStatCoordinator::GetPermutationDraws(int t)
+{
+	if (t < 0 || t >= (int)perm_draws.size() || perm_draws[t].empty()) {
+		return NULL;
+	}
+	return &perm_draws[t][0];
+}
+
+void GStatCoordinator::SetUserCutoff(double val)
+{
+    user_sig_cutoff = val;
+    // observations stopped early were only shown to be non-significant at
+    // the cutoff the permutations were run with; run them again with the
+    // same seed if the new cutoff is larger
+    if (!perm_stop_rule.IsValidFor(std::max(significance_cutoff, val))) {
+        bool reuse = reuse_last_seed;
+        reuse_last_seed = true;
+        CalcPseudoP();
+        reuse_last_seed = reuse;
+    }
+}
+
 void GStatCoordinator::SetSignificanceFilter(int filter_id)
 {
 	wxLogMessage("In GStatCoordinator::SetSignificanceFilter");
@@ -738,6 +738,12 @@ void GetisOrdMapFrame::OnSigFilterSetup(wxCommandEvent& event)
     } else { // (map_type == GiStar_clus_norm || map_type == GiStar_sig_norm)
         p_val_t = gs_coord->p_star_vecs[t];
     }
+    // the normal p-values don't depend on the permutations
+    int* draws_t = NULL;
+    if (map_type == Gi_clus_perm || map_type == Gi_sig_perm ||
+        map_type == GiStar_clus_perm || map_type == GiStar_sig_perm) {
+        draws_t = gs_coord->GetPermutationDraws(t);
+    }
     int n = gs_coord->num_obs;
     
     wxString ttl = _("Inference Settings");
@@ -756,16 +762,19 @@ void GetisOrdMapFrame::OnSigFilterSetup(wxCommandEvent& event)
         if (new_n > 0) {
             int j= 0;
             double* p_val = new double[new_n];
+            std::vector<int> draws(new_n, 0);
             for (int i=0; i<gs_coord->num_obs; i++) {
                 if (gs_coord->x_vecs[t][i] == 1) {
+                    if (draws_t) draws[j] = draws_t[i];
                     p_val[j++] = p_val_t[i];
                 }
             }
-            InferenceSettingsDlg dlg(this, user_sig, p_val, new_n, ttl);
+            InferenceSettingsDlg dlg(this, user_sig, p_val, new_n,
+                                     draws_t ? &draws[0] : NULL, ttl);
             if (dlg.ShowModal() == wxID_OK) {
                 gs_coord->SetSignificanceFilter(-1);
                 gs_coord->significance_cutoff = dlg.GetAlphaLevel();
-                gs_coord->user_sig_cutoff = dlg.GetUserInput();
+                gs_coord->SetUserCutoff(dlg.GetUserInput());
                 gs_coord->notifyObservers();
                 gs_coord->bo = dlg.GetBO();
                 gs_coord->fdr = dlg.GetFDR();
@@ -774,11 +783,11 @@ void GetisOrdMapFrame::OnSigFilterSetup(wxCommandEvent& event)
             delete[] p_val;
         }
     } else {
-        InferenceSettingsDlg dlg(this, user_sig, p_val_t, n, ttl);
+        InferenceSettingsDlg dlg(this, user_sig, p_val_t, n, draws_t, ttl);
         if (dlg.ShowModal() == wxID_OK) {
             gs_coord->SetSignificanceFilter(-1);
             gs_coord->significance_cutoff = dlg.GetAlphaLevel();
-            gs_coord->user_sig_cutoff = dlg.GetUserInput();
+            gs_coord->SetUserCutoff(dlg.GetUserInput());
             gs_coord->notifyObservers();
             gs_coord->bo = dlg.GetBO();
             gs_coord->fdr = dlg.GetFDR();
@@ -21,6 +21,7 @@
 #include <boost/thread.hpp>
 #include <boost/bind/bind.hpp>
 
+#include <algorithm>
 #include <time.h>
 #include <math.h>
 #include <wx/log.h>
@@ -39,6 +40,7 @@
 #include "../GenUtils.h"
 #include "LisaCoordinator.h"
 
+#include "../Algorithms/cpu_lisa.h"
 #include "../Algorithms/gpu_lisa.h"
 
 /** 
@@ -99,7 +101,7 @@ LisaCoordinator(wxString weights_path,
                 int permutations_s,
                 bool calc_significances_s,
                 bool row_standardize_s)
-: AbstractCoordinator()
+: AbstractCoordinator(), using_median(false)
 {
     wxLogMessage("Entering LisaCoordinator::LisaCoordinator()2.");
     num_obs = n;
@@ -511,7 +513,7 @@ void LisaCoordinator::Calc()
                     nn -= 1;
                 }
                 std::vector<double> nbr_data(nn);
-                const std::vector<long>& nbrs = W[i].GetNbrs();
+                GalNbrs nbrs = W[i].GetNbrs();
                 for (size_t j=0, k=0; j<nbrs.size(); ++j) {
                     if (nbrs[j] != i) {
                         nbr_data[k++] = data1[nbrs[j]];
@@ -555,12 +557,13 @@ void LisaCoordinator::CalcPseudoP()
 {
     wxStopWatch sw_vd;
     
-    if (GdaConst::gda_use_gpu == false) {
-        if (!calc_significances)
-            return;
-        CalcPseudoP_threaded();
-        
-    } else {
+    if (!calc_significances)
+        return;
+    
+    wxString path = "threads";
+    bool done = false;
+    
+    if (GdaConst::gda_use_gpu) {
         double* values = data1_vecs[0];
         double* local_moran = local_moran_vecs[0];
         GalElement* w = weights->gal;
@@ -572,85 +575,117 @@ void LisaCoordinator::CalcPseudoP()
 #else
         wxString clPath = exePath + "lisa_kernel.cl";
 #endif
-        bool flag = gpu_lisa(clPath.mb_str(), num_obs, permutations, last_seed_used, values, local_moran, w, _sigLocal);
-        
-		if (flag) {
-		   for (int cnt=0; cnt<num_obs; cnt++) {
-               int numNeighbors = w[cnt].Size();
-               int* _sigCat = sig_cat_vecs[0];
-               if (_sigLocal[cnt] <= 0.00001) _sigCat[cnt] = 5;
-               else if (_sigLocal[cnt] <= 0.0001) _sigCat[cnt] = 4;
-               else if (_sigLocal[cnt] <= 0.001) _sigCat[cnt] = 3;
-               else if (_sigLocal[cnt] <= 0.01) _sigCat[cnt] = 2;
-               else if (_sigLocal[cnt] <= 0.05) _sigCat[cnt]= 1;
-               else _sigCat[cnt]= 0;
-            
-               if (numNeighbors == 0) {
-                   _sigCat[cnt] = 6;
-               }
-           }
-		} else {
-			wxMessageDialog dlg(NULL, "GeoDa can't configure GPU device. Default CPU solution will be used instead.", _("Error"), wxOK | wxICON_ERROR);
-			dlg.ShowModal();
-			if (!calc_significances)
-				return;
-			CalcPseudoP_threaded();
-		}
+        done = gpu_lisa(clPath.mb_str(), num_obs, permutations, last_seed_used, values, local_moran, w, _sigLocal);
+        if (done) {
+            path = "GPU";
+        } else {
+            LOG_MSG("GeoDa can't configure GPU device. CPU kernel will be used instead.");
+        }
+    }
+    
+    if (!done && (GdaConst::gda_use_gpu || GdaConst::gda_use_cpu_kernel) &&
+        CanUseCPUKernel())
+    {
+        if (!reuse_last_seed) last_seed_used = time(0);
+        double* data2 = isBivariate ? data2_vecs[0] : data1_vecs[0];
+        done = cpu_lisa(num_obs, permutations, last_seed_used, data1_vecs[0],
+                        data2, local_moran_vecs[0], undef_tms[0],
+                        row_standardize, Gal_vecs[0]->gal, sig_local_vecs[0]);
+        if (done) path = "CPU kernel";
     }
-    LOG_MSG(wxString::Format("GPU took %ld ms", sw_vd.Time()));
+    
+    if (done) {
+        // same categories as AbstractCoordinator::CalcPseudoP_range()
+        GalElement* w = Gal_vecs[0]->gal;
+        double* _sigLocal = sig_local_vecs[0];
+        int* _sigCat = sig_cat_vecs[0];
+        perm_draws.resize(num_time_vals);
+        perm_draws[0].assign(num_obs, 0);
+        for (int cnt=0; cnt<num_obs; cnt++) {
+            int numNeighbors = w[cnt].Size();
+            if (numNeighbors > 0 && w[cnt].Check(cnt)) numNeighbors -= 1;
+            if (numNeighbors > 0) perm_draws[0][cnt] = permutations;
+            if (numNeighbors == 0) {
+                _sigCat[cnt] = 6;
+                continue;
+            }
+            if (_sigLocal[cnt] <= 0.00001) _sigCat[cnt] = 5;
+            else if (_sigLocal[cnt] <= 0.0001) _sigCat[cnt] = 4;
+            else if (_sigLocal[cnt] <= 0.001) _sigCat[cnt] = 3;
+            else if (_sigLocal[cnt] <= 0.01) _sigCat[cnt] = 2;
+            else if (_sigLocal[cnt] <= 0.05) _sigCat[cnt]= 1;
+            else _sigCat[cnt]= 0;
+        }
+    } else {
+        CalcPseudoP_threaded();
+    }
+    LOG_MSG(wxString::Format("LisaCoordinator::CalcPseudoP (%s) took %ld ms",
+                             path, sw_vd.Time()));
+}
+
+/** The CPU kernel covers the single period LISA without the median and
+ without early stopping; the other variants use CalcPseudoP_threaded(),
+ which gives the same p-values */
+bool LisaCoordinator::CanUseCPUKernel()
+{
+    return num_time_vals == 1 && !using_median &&
+           !GdaConst::gda_perm_early_stop;
 }
 
-void LisaCoordinator::ComputeLarger(int cnt, std::vector<int>& permNeighbors, std::vector<uint64_t>& countLarger)
+void LisaCoordinator::ComputeLarger(int cnt, const int* perm_table,
+                                    int num_perms, int numNeighbors,
+                                    std::vector<uint64_t>& countLarger)
 {
+    // scratch space for the median of the permuted neighbors
+    std::vector<double> nbr_data;
+    if (using_median) nbr_data.resize(numNeighbors);
+    
     // for each time step, reuse permuation
     for (int t=0; t<num_time_vals; t++) {
-        double *data1;
-        double *data2;
-        double *localMoran = local_moran_vecs[t];
-        std::vector<bool>& undefs = undef_tms[t];
+        const double* data1 = data1_vecs[t];
+        const double* lag_data = data1;
+        const double localMoran = local_moran_vecs[t][cnt];
+        const double xi = data1[cnt];
+        // byte mask of undefined values, NULL if there are none
+        const char* undefs = undef_masks[t].empty() ? NULL : &undef_masks[t][0];
+        uint64_t larger = 0;
         
-        data1 = data1_vecs[t];
-        if (isBivariate) {
-            data2 = data2_vecs[0];
+        if (isBivariate && !using_median) {
+            lag_data = data2_vecs[0];
             if (var_info[1].is_time_variant && var_info[1].sync_with_global_time)
-                data2 = data2_vecs[t];
+                lag_data = data2_vecs[t];
         }
         
-        int validNeighbors = 0;
-        double permutedLag = 0;
-        int numNeighbors = permNeighbors.size();
-        // use permutation to compute the lag
-        // compute the lag for binary weights
-
-        if (using_median) {
-            std::vector<double> nbr_data;
-            for (int cp=0; cp<numNeighbors; cp++) {
-                int nb = permNeighbors[cp];
-                if (!undefs[nb]) {
-                    nbr_data.push_back(data1[nb]);
-                    validNeighbors ++;
-                }
-            }
-            double nbr_median = GenUtils::Median(nbr_data);
-            const double localMoranPermuted = nbr_median * data1[cnt];
-            if (localMoranPermuted >= localMoran[cnt]) {
-                countLarger[t]++;
-            }
-
-        } else{
-            if (isBivariate) {
+        for (int perm=0; perm<num_perms; perm++) {
+            const int* permNeighbors = perm_table + perm * numNeighbors;
+            int validNeighbors = 0;
+            double permutedLag = 0;
+            
+            if (using_median) {
                 for (int cp=0; cp<numNeighbors; cp++) {
                     int nb = permNeighbors[cp];
-                    if (!undefs[nb]) {
-                        permutedLag += data2[nb];
-                        validNeighbors ++;
+                    if (undefs == NULL || !undefs[nb]) {
+                        nbr_data[validNeighbors++] = data1[nb];
                     }
                 }
+                permutedLag = Median(&nbr_data[0], validNeighbors);
+                const double localMoranPermuted = permutedLag * xi;
+                if (localMoranPermuted >= localMoran) larger++;
+                continue;
+            }
+            
+            // use permutation to compute the lag
+            // compute the lag for binary weights
+            if (undefs == NULL) {
+                for (int cp=0; cp<numNeighbors; cp++) {
+                    permutedLag += lag_data[permNeighbors[cp]];
+                }
+                validNeighbors = numNeighbors;
             } else {
                 for (int cp=0; cp<numNeighbors; cp++) {
                     int nb = permNeighbors[cp];
                     if (!undefs[nb]) {
-                        permutedLag += data1[nb];
+                        permutedLag += lag_data[nb];
                         validNeighbors ++;
                     }
                 }
@@ -660,10 +695,21 @@ void LisaCoordinator::ComputeLarger(int cnt, std::vector<int>& permNeighbors, st
             if (validNeighbors > 0 && row_standardize) {
                 permutedLag /= validNeighbors;
             }
-            const double localMoranPermuted = permutedLag * data1[cnt];
-            if (localMoranPermuted >= localMoran[cnt]) {
-                countLarger[t]++;
-            }
+            const double localMoranPermuted = permutedLag * xi;
+            if (localMoranPermuted >= localMoran) larger++;
         }
+        countLarger[t] += larger;
     }
 }
+
+/** Median of data[0..n), same value as GenUtils::Median() but partially
+ reorders data in place instead of sorting a copy */
+double LisaCoordinator::Median(double* data, int n)
+{
+    if (n <= 0) return 0;
+    int mid = n / 2;
+    std::nth_element(data, data + mid, data + n);
+    if (n % 2 == 1) return data[mid];
+    double lower = *std::max_element(data, data + mid);
+    return 0.5 * (lower + data[mid]);
+}
@@ -76,7 +76,8 @@ public:
 	bool isBivariate;
 	LisaType lisa_type;
 	
-    virtual void ComputeLarger(int cnt, std::vector<int>& permNeighbors,
+    virtual void ComputeLarger(int cnt, const int* perm_table, int num_perms,
+                               int numNeighbors,
                                std::vector<uint64_t>& countLarger);
 	virtual void Init();
     virtual void Calc();
@@ -86,6 +87,10 @@ public:
     
     void GetRawData(int time, double* data1, double* data2);
 	void StandardizeData();
+    
+protected:
+    bool CanUseCPUKernel();
+    static double Median(double* data, int n);
 };
 
 #endif
@@ -18,10 +18,14 @@
  */
 
 #include <time.h>
+#include <boost/bind/bind.hpp>
 #include <math.h>
+#include <algorithm>
 #include <wx/log.h>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
+#include "../Algorithms/perm_sampler.h"
+#include "../Algorithms/perm_scheduler.h"
 #include "../DataViewer/TableInterface.h"
 #include "../ShapeOperations/RateSmoothing.h"
 #include "../ShapeOperations/Randik.h"
@@ -34,48 +38,6 @@
 #include "LocalGearyCoordinatorObserver.h"
 #include "LocalGearyCoordinator.h"
 
-LocalGearyWorkerThread::LocalGearyWorkerThread(int obs_start_s, int obs_end_s,
-                                               uint64_t	seed_start_s,
-                                               LocalGearyCoordinator* local_geary_coord_s,
-                                               wxMutex* worker_list_mutex_s,
-                                               wxCondition* worker_list_empty_cond_s,
-                                               std::list<wxThread*> *worker_list_s,
-                                               int thread_id_s)
-: wxThread(),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-local_geary_coord(local_geary_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-LocalGearyWorkerThread::~LocalGearyWorkerThread()
-{
-}
-
-wxThread::ExitCode LocalGearyWorkerThread::Entry()
-{
-    LOG_MSG(wxString::Format("LocalGearyWorkerThread %d started", thread_id));
-    
-    // call work for assigned range of observations
-    local_geary_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
-    
-    wxMutexLocker lock(*worker_list_mutex);
-    
-    // remove ourself from the list
-    worker_list->remove(this);
-    
-    // if empty, signal on empty condition since only main thread
-    // should be waiting on this condition
-    if (worker_list->empty()) {
-        worker_list_empty_cond->Signal();
-    }
-    
-    return NULL;
-}
-
 LocalGearyCoordinator::LocalGearyCoordinator(boost::uuids::uuid weights_id,
                                 Project* project,
                                 const std::vector<GdaVarTools::VarInfo>& var_info_s,
@@ -96,7 +58,8 @@ data(var_info_s.size()),
 undef_data(var_info_s.size()),
 last_seed_used(123456789),
 reuse_last_seed(true),
-row_standardize(row_standardize_s)
+row_standardize(row_standardize_s),
+user_sig_cutoff(0)
 {
     wxLogMessage("In LocalGearyCoordinator::LocalGearyCoordinator()");
     reuse_last_seed = GdaConst::use_gda_user_seed;
@@ -118,6 +81,7 @@ row_standardize(row_standardize_s)
 }
 
 LocalGearyCoordinator::LocalGearyCoordinator(wxString weights_path, int n, std::vector<std::vector<double> >& vars, int permutations_s, bool calc_significances_s, bool row_standardize_s)
+: user_sig_cutoff(0)
 {
     wxLogMessage("In LocalGearyCoordinator::LocalGearyCoordinator()2");
     reuse_last_seed = GdaConst::use_gda_user_seed;
@@ -761,87 +725,38 @@ void LocalGearyCoordinator::CalcPseudoP()
 void LocalGearyCoordinator::CalcPseudoP_threaded()
 {
     wxLogMessage("In LocalGearyCoordinator::CalcPseudoP_threaded()");
-    int nCPUs = GdaConst::gda_cpu_cores;
-    if (!GdaConst::gda_set_cpu_cores)
-        nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-    std::list<wxThread*> worker_list;
-	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-    if (work_chunk == 0) work_chunk = 1;
-    
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-
-    bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
 	if (!reuse_last_seed) last_seed_used = time(0);
     
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used + a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-        int thread_id = i+1;
-        LocalGearyWorkerThread* thread =
-        new LocalGearyWorkerThread(a, b, seed_start, this,
-                                   &worker_list_mutex,
-                                   &worker_list_empty_cond,
-                                   &worker_list, thread_id);
-        if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-            delete thread;
-            is_thread_error = true;
-        } else {
-            worker_list.push_front(thread);
-        }
-	}
-    if (is_thread_error) {
-        // fall back to single thread calculation mode
-        CalcPseudoP_range(0, num_obs-1, last_seed_used);
-    } else {
-        std::list<wxThread*>::iterator it;
-        for (it = worker_list.begin(); it != worker_list.end(); it++) {
-            (*it)->Run();
-        }
-        
-        while (!worker_list.empty()) {
-            // wait until thread_list might be empty
-            worker_list_empty_cond.Wait();
-            // We have been woken up. If this was not a false
-            // alarm (sprious signal), the loop will exit.
-        }
-    }
+    // observations that are not isolates can be drawn as permuted neighbors
+    GalElement* w = Gal_vecs[num_time_vals-1]->gal;
+    std::vector<bool> candidates(num_obs);
+    for (int i=0; i<num_obs; i++) candidates[i] = w[i].Size() > 0;
+    perm_sampler.Init(candidates, PermutationSampler::GetDefaultType());
+    
+    perm_stop_rule.Init(permutations,
+                        std::max(significance_cutoff, user_sig_cutoff));
+    perm_draws.resize(num_time_vals);
+    for (int t=0; t<num_time_vals; t++) perm_draws[t].assign(num_obs, 0);
+    
+    PermutationScheduler scheduler(num_obs, Gal_vecs, permutations,
+                                   perm_sampler.GetType());
+    scheduler.Run(boost::bind(&LocalGearyCoordinator::CalcPseudoP_range, this,
+                              boost::placeholders::_1,
+                              boost::placeholders::_2,
+                              boost::placeholders::_3), last_seed_used);
     wxLogMessage("End LocalGearyCoordinator::CalcPseudoP_threaded()");
 }
 
 void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64_t seed_start)
 {
-	GeoDaSet workPermutation(num_obs);
-	int max_rand = num_obs-1;
+    PermutationSampler::Buffer perm_buf(perm_sampler);
     
 	for (int cnt=obs_start; cnt<=obs_end; cnt++) {
         std::vector<uint64_t> countLarger(num_time_vals, 0);
         std::vector<std::vector<double> > gci(num_time_vals);
         std::vector<double> gci_sum(num_time_vals, 0);
+        // permutations with gci <= local geary, for the stopping rule
+        std::vector<uint64_t> countSmaller(num_time_vals, 0);
         
         for (int t=0; t<num_time_vals; t++) gci[t].resize(permutations, 0);
        
@@ -863,23 +778,10 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
             continue;
         }
        
+        uint64_t draws = 0;
 		for (int perm=0; perm<permutations; perm++) {
-			int rand=0;
-			while (rand < numNeighbors) {
-				// computing 'perfect' permutation of given size
-                double rng_val = Gda::ThomasWangHashDouble(seed_start++) * max_rand;
-                // round is needed to fix issue
-                //https://github.com/GeoDaCenter/geoda/issues/488
-				int newRandom = (int) (rng_val < 0.0 ? ceil(rng_val - 0.5) : floor(rng_val + 0.5));
-				if (newRandom != cnt && !workPermutation.Belongs(newRandom) && w[newRandom].Size()>0) {
-					workPermutation.Push(newRandom);
-					rand++;
-				}
-			}
-            std::vector<int> permNeighbors(numNeighbors);
-            for (int cp=0; cp<numNeighbors; cp++) {
-                permNeighbors[cp] = workPermutation.Pop();
-            }
+            int nn = perm_sampler.Draw(perm_buf, cnt, numNeighbors, seed_start);
+            const int* permNeighbors = perm_buf.GetNeighbors();
             // for each time step, reuse permuation
             for (int t=0; t<num_time_vals; t++) {
                 std::vector<bool>& undefs = undef_tms[t];
@@ -927,7 +829,7 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
                         m_wwx[v] = 0;
                         m_wwx2[v] = 0;
                     }
-                    for (int cp=0; cp<numNeighbors; cp++) {
+                    for (int cp=0; cp<nn; cp++) {
                         // xx2 - 2.0 * xx * wwx + wwx2
                         int perm_idx = permNeighbors[cp];
                         if (!undefs[perm_idx]) {
@@ -953,7 +855,7 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
                     double wwx =0;
                     double wwx2 = 0;
                     if (isBivariate) {
-                        for (int cp=0; cp<numNeighbors; cp++) {
+                        for (int cp=0; cp<nn; cp++) {
                             int perm_idx = permNeighbors[cp];
                             if (!undefs[perm_idx]) {
                                 validNeighbors ++;
@@ -961,7 +863,7 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
                             }
                         }
                     } else {
-                        for (int cp=0; cp<numNeighbors; cp++) {
+                        for (int cp=0; cp<nn; cp++) {
                             // xx2 - 2.0 * xx * wwx + wwx2
                             int perm_idx = permNeighbors[cp];
                             if (!undefs[perm_idx]) {
@@ -981,7 +883,17 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
                     }
                 }
                 gci_sum[t] += gci[t][perm];
+                if (gci[t][perm] <= local_geary_vecs[t][cnt]) countSmaller[t]++;
             }
+            draws++;
+            
+            // stop once every time period is clearly not significant
+            bool can_stop = perm_stop_rule.IsEnabled();
+            for (int t=0; t<num_time_vals && can_stop; t++) {
+                if (undef_tms[t][cnt]) continue;
+                can_stop = perm_stop_rule.CanStop(countSmaller[t], draws);
+            }
+            if (can_stop) break;
 		}
         // end permutation
         // for each time step, reuse permuation
@@ -990,11 +902,12 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
             double* _siglocalGeary = sig_local_geary_vecs[t];
             int* _sigCat = sig_cat_vecs[t];
             int* _cluster = cluster_vecs[t];
+            perm_draws[t][cnt] = (int)draws;
             // calc mean of gci
-            double gci_mean = gci_sum[t] / permutations;
+            double gci_mean = gci_sum[t] / draws;
             if (_localGeary[cnt] <= gci_mean) {
                 // positive lisasign[cnt] = 1
-                for (int perm=0; perm<permutations; perm++) {
+                for (int perm=0; perm<(int)draws; perm++) {
                     if (gci[t][perm] <= _localGeary[cnt]) {
                         countLarger[t] += 1;
                     }
@@ -1014,7 +927,7 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
                 }
             } else {
                 // negative lisasign[cnt] = -1
-                for (int perm=0; perm<permutations; perm++) {
+                for (int perm=0; perm<(int)draws; perm++) {
                     if (gci[t][perm] > _localGeary[cnt]) {
                         countLarger[t] += 1;
                     }
@@ -1029,7 +942,7 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
                 }
             }
             int kp = local_geary_type == multivariate ? num_vars : 1;
-            _siglocalGeary[cnt] = (countLarger[t]+1.0)/(permutations+1);
+            _siglocalGeary[cnt] = (countLarger[t]+1.0)/(draws+1);
             
             // 'significance' of local Moran
             if (_siglocalGeary[cnt] <= 0.00001) _sigCat[cnt] = 5;
@@ -1050,6 +963,28 @@ void LocalGearyCoordinator::CalcPseudoP_range(int obs_start, int obs_end, uint64
     }
 }
 
+int* LocalGearyCoordinator::GetPermutationDraws(int t)
+{
+    if (t < 0 || t >= (int)perm_draws.size() || perm_draws[t].empty()) {
+        return NULL;
+    }
+    return &perm_draws[t][0];
+}
+
+void LocalGearyCoordinator::SetUserCutoff(double val)
+{
+    user_sig_cutoff = val;
+    // observations stopped early were only shown to be non-significant at
+    // the cutoff the permutations were run with; run them again with the
+    // same seed if the new cutoff is larger
+    if (!perm_stop_rule.IsValidFor(std::max(significance_cutoff, val))) {
+        bool reuse = reuse_last_seed;
+        reuse_last_seed = true;
+        CalcPseudoP();
+        reuse_last_seed = reuse;
+    }
+}
+
 void LocalGearyCoordinator::SetSignificanceFilter(int filter_id)
 {
     wxLogMessage("In LocalGearyCoordinator::SetSignificanceFilter()");
@@ -30,6 +30,8 @@
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
 #include "../ShapeOperations/OGRDataAdapter.h"
+#include "../Algorithms/perm_sampler.h"
+#include "../Algorithms/perm_stop_rule.h"
 
 class LocalGearyCoordinatorObserver;
 class LocalGearyCoordinator;
@@ -38,29 +40,6 @@ class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 typedef boost::multi_array<bool, 2> b_array_type;
 
-class LocalGearyWorkerThread : public wxThread
-{
-public:
-    LocalGearyWorkerThread(int obs_start, int obs_end, uint64_t seed_start,
-                           LocalGearyCoordinator* local_geary_coord,
-                           wxMutex* worker_list_mutex,
-                           wxCondition* worker_list_empty_cond,
-                           std::list<wxThread*> *worker_list,
-                           int thread_id);
-    virtual ~LocalGearyWorkerThread();
-    virtual void* Entry();  // thread execution starts here
-    
-    int obs_start;
-    int obs_end;
-    uint64_t seed_start;
-    int thread_id;
-    
-    LocalGearyCoordinator* local_geary_coord;
-    wxMutex* worker_list_mutex;
-    wxCondition* worker_list_empty_cond;
-    std::list<wxThread*> *worker_list;
-};
-
 class LocalGearyCoordinator : public WeightsManStateObserver
 {
 public:
@@ -105,6 +84,14 @@ public:
     
     double fdr; //False Discovery Rate
     double user_sig_cutoff; // user defined cutoff
+    
+    /** Set user_sig_cutoff; runs the permutations again if the early
+     stopping rule was applied with a smaller cutoff */
+    void SetUserCutoff(double val);
+    
+    /** Number of permutations used for each observation; less than
+     permutations if the early stopping rule applied */
+    int* GetPermutationDraws(int t);
 	
 	uint64_t GetLastUsedSeed() { return last_seed_used; }
     
@@ -231,6 +218,13 @@ protected:
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
+	
+	// draws the permuted neighbors in CalcPseudoP_range()
+	PermutationSampler perm_sampler;
+	
+	// early stopping of the permutations of an observation
+	PermutationStopRule perm_stop_rule;
+	std::vector<std::vector<int> > perm_draws; // perm_draws[t][obs]
     
     GalWeight* weights;
 };
@@ -840,6 +840,7 @@ void LocalGearyMapFrame::OnSigFilterSetup(wxCommandEvent& event)
     LocalGearyMapCanvas* lc = (LocalGearyMapCanvas*)template_canvas;
     int t = template_canvas->cat_data.GetCurrentCanvasTmStep();
     double* p = local_geary_coord->sig_local_geary_vecs[t];
+    int* draws = local_geary_coord->GetPermutationDraws(t);
     int n = local_geary_coord->num_obs;
     
     wxString ttl = _("Inference Settings");
@@ -848,11 +849,11 @@ void LocalGearyMapFrame::OnSigFilterSetup(wxCommandEvent& event)
     double user_sig = local_geary_coord->significance_cutoff;
     if (local_geary_coord->GetSignificanceFilter()<0) user_sig = local_geary_coord->user_sig_cutoff;
     
-    InferenceSettingsDlg dlg(this, user_sig, p, n, ttl);
+    InferenceSettingsDlg dlg(this, user_sig, p, n, draws, ttl);
     if (dlg.ShowModal() == wxID_OK) {
         local_geary_coord->SetSignificanceFilter(-1);
         local_geary_coord->significance_cutoff = dlg.GetAlphaLevel();
-        local_geary_coord->user_sig_cutoff = dlg.GetUserInput();
+        local_geary_coord->SetUserCutoff(dlg.GetUserInput());
         local_geary_coord->notifyObservers();
         local_geary_coord->bo = dlg.GetBO();
         local_geary_coord->fdr = dlg.GetFDR();
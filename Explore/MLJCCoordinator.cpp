@@ -22,11 +22,15 @@
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <boost/bind/bind.hpp>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
 #include <wx/msgdlg.h>
 
+#include "../Algorithms/cpu_lisa.h"
 #include "../Algorithms/gpu_lisa.h"
+#include "../Algorithms/perm_sampler.h"
+#include "../Algorithms/perm_scheduler.h"
 #include "../DataViewer/TableInterface.h"
 #include "../ShapeOperations/Randik.h"
 #include "../ShapeOperations/WeightsManState.h"
@@ -36,46 +40,6 @@
 #include "MLJCCoordinatorObserver.h"
 #include "MLJCCoordinator.h"
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// JCWorkerThread
-//
-///////////////////////////////////////////////////////////////////////////////
-JCWorkerThread::JCWorkerThread(int t_, int obs_start_s, int obs_end_s, uint64_t seed_start_s, JCCoordinator* jc_coord_s, wxMutex* worker_list_mutex_s, wxCondition* worker_list_empty_cond_s, std::list<wxThread*> *worker_list_s,int thread_id_s)
-: wxThread(),
-t(t_),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-jc_coord(jc_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-JCWorkerThread::~JCWorkerThread()
-{
-}
-
-wxThread::ExitCode JCWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("JCWorkerThread %d started", thread_id));
-	// call work for assigned range of observations
-	jc_coord->CalcPseudoP_range(t, obs_start, obs_end, seed_start);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-	// if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	if (worker_list->empty()) {
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 // JCCoordinator
@@ -90,7 +54,8 @@ permutations(999),
 var_info(var_info_s),
 data(var_info_s.size()),
 undef_data(var_info_s.size()),
-last_seed_used(123456789), reuse_last_seed(true)
+last_seed_used(123456789), reuse_last_seed(true),
+user_sig_cutoff(0)
 {
     reuse_last_seed = GdaConst::use_gda_user_seed;
     if ( GdaConst::use_gda_user_seed) {
@@ -456,11 +421,21 @@ void JCCoordinator::CalcPseudoP()
 	LOG_MSG("Entering JCCoordinator::CalcPseudoP");
 	wxStopWatch sw_vd;
     
+    wxString path = "threads";
+    // the GPU kernel doesn't report the draws of each observation
+    perm_draws.clear();
+    perm_draws.resize(num_time_vals);
     if (GdaConst::gda_use_gpu == false) {
         for (int t=0; t<num_time_vals; t++) {
-            CalcPseudoP_threaded(t);
+            if (GdaConst::gda_use_cpu_kernel) {
+                path = "CPU kernel";
+                CalcPseudoP_cpu_kernel(t);
+            } else {
+                CalcPseudoP_threaded(t);
+            }
         }
     } else {
+        path = "GPU";
         for (int t=0; t<num_time_vals; t++) {
             std::vector<int> local_t;
             for (int v=0; v<num_vars; v++) {
@@ -496,87 +471,72 @@ void JCCoordinator::CalcPseudoP()
             delete[] values;
             
             if (!flag) {
-                wxMessageDialog dlg(NULL, "GeoDa can't configure GPU device. Default CPU solution will be used instead.", _("Error"), wxOK | wxICON_ERROR);
-                dlg.ShowModal();
-                CalcPseudoP_threaded(t);
+                LOG_MSG("GeoDa can't configure GPU device. CPU kernel will be used instead.");
+                path = "CPU kernel";
+                CalcPseudoP_cpu_kernel(t);
             }
         }
     }
-    LOG_MSG(wxString::Format("JCCoordinator::GPU took %ld ms", sw_vd.Time()));
+    LOG_MSG(wxString::Format("JCCoordinator::CalcPseudoP (%s) took %ld ms",
+                             path, sw_vd.Time()));
 }
 
 void JCCoordinator::CalcPseudoP_threaded(int t)
 {
 	LOG_MSG("Entering JCCoordinator::CalcPseudoP_threaded");
-    int nCPUs = GdaConst::gda_cpu_cores;
-    if (!GdaConst::gda_set_cpu_cores)
-        nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
+	if (!reuse_last_seed) last_seed_used = time(0);
 	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
+	// observations with defined values can be drawn as permuted neighbors
+	std::vector<bool> candidates(num_obs);
+	for (int i=0; i<num_obs; i++) candidates[i] = !undef_tms[t][i];
+	perm_sampler.Init(candidates, PermutationSampler::GetDefaultType());
 	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
+	perm_stop_rule.Init(permutations,
+                        std::max(significance_cutoff, user_sig_cutoff));
+	perm_draws.resize(num_time_vals);
+	perm_draws[t].assign(num_obs, 0);
 	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
+	// the workers read the CSR storage of the weights
+	Gal_csrs.resize(num_time_vals);
+	Gal_csrs[t] = &Gal_vecs[t]->GetCsr();
 	
-	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
-		
-		JCWorkerThread* thread =
-			new JCWorkerThread(t, a, b, seed_start, this,
-								  &worker_list_mutex,
-								  &worker_list_empty_cond,
-								  &worker_list, thread_id);
-		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-			delete thread;
-			is_thread_error = true;
-		} else {
-			worker_list.push_front(thread);
-		}
+	PermutationScheduler scheduler(num_obs, Gal_vecs[t]->gal, permutations,
+                                   perm_sampler.GetType());
+	scheduler.Run(boost::bind(&JCCoordinator::CalcPseudoP_range, this, t,
+                              boost::placeholders::_1,
+                              boost::placeholders::_2,
+                              boost::placeholders::_3), last_seed_used);
+	Gal_csrs[t] = 0;
+	LOG_MSG("Exiting JCCoordinator::CalcPseudoP_threaded");
+}
+
+/** Same p-values as CalcPseudoP_threaded(t), computed by cpu_localjoincount()
+ over flat arrays. The kernel has no early stopping, so that case goes to
+ CalcPseudoP_threaded(t). */
+void JCCoordinator::CalcPseudoP_cpu_kernel(int t)
+{
+	if (GdaConst::gda_perm_early_stop) {
+		CalcPseudoP_threaded(t);
+		return;
 	}
-	if (is_thread_error) {
-		// fall back to single thread calculation mode
-		CalcPseudoP_range(t, 0, num_obs-1, last_seed_used);
-	} else {
-		std::list<wxThread*>::iterator it;
-		for (it = worker_list.begin(); it != worker_list.end(); it++) {
-			(*it)->Run();
-		}
-		
-		while (!worker_list.empty()) {
-			// wait until thread_list might be empty
-			worker_list_empty_cond.Wait();
-			// We have been woken up. If this was not a false
-			// alarm (spurious signal), the loop will exit.
+	LOG_MSG("Entering JCCoordinator::CalcPseudoP_cpu_kernel");
+	if (!reuse_last_seed) last_seed_used = time(0);
+	
+	cpu_localjoincount(num_obs, permutations, last_seed_used, zz_vecs[t],
+                       local_jc_vecs[t], undef_tms[t], Gal_vecs[t]->gal,
+                       sig_local_jc_vecs[t]);
+	
+	GalElement* W = Gal_vecs[t]->gal;
+	perm_draws.resize(num_time_vals);
+	perm_draws[t].assign(num_obs, 0);
+	for (int i=0; i<num_obs; i++) {
+		int numNeighsI = W[i].Size();
+		if (W[i].Check(i)) numNeighsI -= 1;
+		if (!undef_tms[t][i] && local_jc_vecs[t][i] != 0 && numNeighsI > 0) {
+			perm_draws[t][i] = permutations;
 		}
 	}
-	LOG_MSG("Exiting JCCoordinator::CalcPseudoP_threaded");
+	LOG_MSG("Exiting JCCoordinator::CalcPseudoP_cpu_kernel");
 }
 
 /** In the code that computes Gi and Gi*, we specifically checked for 
@@ -584,11 +544,9 @@ void JCCoordinator::CalcPseudoP_threaded(int t)
  permutation code, we will disallow self-neighbors. */
 void JCCoordinator::CalcPseudoP_range(int t, int obs_start, int obs_end, uint64_t seed_start)
 {
-	GeoDaSet workPermutation(num_obs);
-    
-	int max_rand = num_obs-1;
+    PermutationSampler::Buffer perm_buf(perm_sampler);
     
-    GalElement* W = Gal_vecs[t]->gal;
+    const GalCsr& W = *Gal_csrs[t];
     int* zz = zz_vecs[t];
     double* local_jc = local_jc_vecs[t];
     std::vector<bool>& undefs = undef_tms[t];
@@ -614,8 +572,8 @@ void JCCoordinator::CalcPseudoP_range(int t, int obs_start, int obs_end, uint64_
             pseudo_p[i] = 0;
             continue;
         }
-        int numNeighsI = W[i].Size();
-        if (W[i].Check(i)) {
+        int numNeighsI = W.Size(i);
+        if (W.Check(i, i)) {
             numNeighsI -= 1; // self-neighbor
         }
         //only compute for non-isolates
@@ -623,44 +581,55 @@ void JCCoordinator::CalcPseudoP_range(int t, int obs_start, int obs_end, uint64_
 			int countLarger = 0;
 			double permuted = 0;
             
+			int draws = 0;
 			for (int perm=0; perm < permutations; perm++) {
-				int rand = 0;
-				while (rand < numNeighsI) {
-					// computing 'perfect' permutation of given size
-                    double rng_val = Gda::ThomasWangHashDouble(seed_start++) * max_rand;
-                    // round is needed to fix issue
-                    //https://github.com/GeoDaCenter/geoda/issues/488
-                    int newRandom = (int) (rng_val < 0.0 ? ceil(rng_val - 0.5) : floor(rng_val + 0.5));
-                    
-					if (newRandom != i &&
-                        !workPermutation.Belongs(newRandom) &&
-                        undefs[newRandom] == false)
-					{
-						workPermutation.Push(newRandom);
-						rand++;
-					}
-				}
+				int nn = perm_sampler.Draw(perm_buf, i, numNeighsI, seed_start);
+				const int* permNeighbors = perm_buf.GetNeighbors();
 				
 				double perm_jc = 0;
 				// use permutation to compute the lags
-				for (int j=0; j<numNeighsI; j++) {
-                    int perm_idx = workPermutation.Pop();
-                    perm_jc += zz[perm_idx];
+				for (int j=0; j<nn; j++) {
+                    perm_jc += zz[permNeighbors[j]];
 				}
 		
                 // binary weights
                 permuted = perm_jc;
 				if (permuted >= local_jc[i]) countLarger++;
+				draws++;
+				if (perm_stop_rule.CanStop(countLarger, draws)) break;
 			}
+			perm_draws[t][i] = draws;
 			// pick the smallest
-			if (permutations-countLarger < countLarger) {
-				countLarger=permutations - countLarger;
+			if (draws-countLarger < countLarger) {
+				countLarger=draws - countLarger;
 			}
-			pseudo_p[i] = (countLarger + 1.0)/(permutations+1.0);
+			pseudo_p[i] = (countLarger + 1.0)/(draws+1.0);
 		}
 	}
 }
 
+int* JCCoordinator::GetPermutationDraws(int t)
+{
+    if (t < 0 || t >= (int)perm_draws.size() || perm_draws[t].empty()) {
+        return NULL;
+    }
+    return &perm_draws[t][0];
+}
+
+void JCCoordinator::SetUserCutoff(double val)
+{
+    user_sig_cutoff = val;
+    // observations stopped early were only shown to be non-significant at
+    // the cutoff the permutations were run with; run them again with the
+    // same seed if the new cutoff is larger
+    if (!perm_stop_rule.IsValidFor(std::max(significance_cutoff, val))) {
+        bool reuse = reuse_last_seed;
+        reuse_last_seed = true;
+        CalcPseudoP();
+        reuse_last_seed = reuse;
+    }
+}
+
 void JCCoordinator::SetSignificanceFilter(int filter_id)
 {
     if (filter_id == -1) {
@@ -40,6 +40,8 @@
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
 #include "../ShapeOperations/OGRDataAdapter.h"
+#include "../Algorithms/perm_sampler.h"
+#include "../Algorithms/perm_stop_rule.h"
 
 
 class JCCoordinatorObserver; 
@@ -49,32 +51,6 @@ class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 typedef boost::multi_array<bool, 2> b_array_type;
 
-class JCWorkerThread : public wxThread
-{
-public:
-    JCWorkerThread(int t,
-                   int obs_start, int obs_end, uint64_t seed_start,
-                   JCCoordinator* jc_coord,
-                   wxMutex* worker_list_mutex,
-                   wxCondition* worker_list_empty_cond,
-                   std::list<wxThread*> *worker_list,
-                   int thread_id);
-    
-	virtual ~JCWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-
-    int t;
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
-	int thread_id;
-	
-	JCCoordinator* jc_coord;
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class JCCoordinator : public WeightsManStateObserver
 {
 public:
@@ -94,6 +70,14 @@ public:
     double bo; //Bonferroni bound
     double fdr; //False Discovery Rate
     double user_sig_cutoff; // user defined cutoff
+    
+    /** Set user_sig_cutoff; runs the permutations again if the early
+     stopping rule was applied with a smaller cutoff */
+    void SetUserCutoff(double val);
+    
+    /** Number of permutations used for each observation; less than
+     permutations if the early stopping rule applied */
+    int* GetPermutationDraws(int t);
 
 	uint64_t GetLastUsedSeed() { return last_seed_used;}
     
@@ -136,6 +120,8 @@ public:
 
     std::vector<GalWeight*> Gal_vecs;
     std::vector<GalWeight*> Gal_vecs_orig;
+    // CSR of Gal_vecs, while the permutation workers run
+    std::vector<const GalCsr*> Gal_csrs;
 	
 	std::vector<bool> has_isolates;
 	std::vector<bool> has_undefined;
@@ -198,11 +184,19 @@ protected:
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
+	
+	// draws the permuted neighbors in CalcPseudoP_range()
+	PermutationSampler perm_sampler;
+	
+	// early stopping of the permutations of an observation
+	PermutationStopRule perm_stop_rule;
+	std::vector<std::vector<int> > perm_draws; // perm_draws[t][obs]
     
 	void DeallocateVectors();
 	void AllocateVectors();
     
 	void CalcPseudoP_threaded(int t);
+	void CalcPseudoP_cpu_kernel(int t);
     
 	void CalcMultiLocalJoinCount();
 };
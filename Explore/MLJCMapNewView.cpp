@@ -673,6 +673,7 @@ void MLJCMapFrame::OnSigFilterSetup(wxCommandEvent& event)
     MLJCMapCanvas* lc = (MLJCMapCanvas*)template_canvas;
     int t = template_canvas->cat_data.GetCurrentCanvasTmStep();
     double* p_val_t = gs_coord->sig_local_jc_vecs[t];
+    int* draws_t = gs_coord->GetPermutationDraws(t);
     int n = gs_coord->num_obs;
     
     wxString ttl = _("Inference Settings");
@@ -691,16 +692,19 @@ void MLJCMapFrame::OnSigFilterSetup(wxCommandEvent& event)
     if (new_n > 0) {
         int j= 0;
         double* p_val = new double[new_n];
+        std::vector<int> draws(new_n, 0);
         for (int i=0; i<gs_coord->num_obs; i++) {
             if (gs_coord->data[0][t][i] == 1) {
+                if (draws_t) draws[j] = draws_t[i];
                 p_val[j++] = p_val_t[i];
             }
         }
-        InferenceSettingsDlg dlg(this, user_sig, p_val, new_n, ttl);
+        InferenceSettingsDlg dlg(this, user_sig, p_val, new_n,
+                                 draws_t ? &draws[0] : NULL, ttl);
         if (dlg.ShowModal() == wxID_OK) {
             gs_coord->SetSignificanceFilter(-1);
             gs_coord->significance_cutoff = dlg.GetAlphaLevel();
-            gs_coord->user_sig_cutoff = dlg.GetUserInput();
+            gs_coord->SetUserCutoff(dlg.GetUserInput());
             gs_coord->notifyObservers();
             gs_coord->bo = dlg.GetBO();
             gs_coord->fdr = dlg.GetFDR();
@@ -9,6 +9,76 @@
 #include "../Project.h"
 #include "MapLayer.hpp"
 
+void LayerJoinIndex::Build(AssociateLayerInt* layer, const wxString& my_key,
+                           AssociateLayerInt* associated_layer,
+                           const wxString& key)
+{
+    std::vector<wxString> pid; // e.g. 1 2 3 4 5
+    layer->GetKeyColumnData(my_key, pid);
+    std::vector<wxString> fid; // e.g. 2 2 1 1 3 5 4 4
+    associated_layer->GetKeyColumnData(key, fid);
+    
+    // codes of the keys of the associated layer, and the number of rows of
+    // each code in offsets[code+1]
+    std::map<wxString, int> dict;
+    std::vector<int> fid_codes(fid.size());
+    offsets.assign(1, 0);
+    for (size_t i=0; i<fid.size(); i++) {
+        int c = (int)dict.size();
+        std::pair<std::map<wxString, int>::iterator, bool> r;
+        r = dict.insert(std::make_pair(fid[i], c));
+        if (r.second) {
+            offsets.push_back(0);
+        }
+        fid_codes[i] = r.first->second;
+        offsets[fid_codes[i] + 1] += 1;
+    }
+    for (size_t c=1; c<offsets.size(); c++) {
+        offsets[c] += offsets[c-1];
+    }
+    rows.resize(fid.size());
+    std::vector<int> pos(offsets.begin(), offsets.end() - 1);
+    for (size_t i=0; i<fid.size(); i++) {
+        rows[pos[fid_codes[i]]++] = (int)i;
+    }
+    
+    codes.resize(pid.size());
+    for (size_t i=0; i<pid.size(); i++) {
+        std::map<wxString, int>::iterator it = dict.find(pid[i]);
+        codes[i] = it == dict.end() ? -1 : it->second;
+    }
+    
+    keys = std::make_pair(my_key, key);
+    num_rows = (int)pid.size();
+    num_associated_rows = associated_layer->GetNumRecords();
+    is_valid = true;
+}
+
+bool LayerJoinIndex::IsValid(AssociateLayerInt* layer, const Association& al,
+                             AssociateLayerInt* associated_layer)
+{
+    return is_valid && keys == al && num_rows == layer->GetNumRecords() &&
+        num_associated_rows == associated_layer->GetNumRecords();
+}
+
+LayerJoinIndex& AssociateLayerInt::GetJoinIndex(AssociateLayerInt* layer)
+{
+    LayerJoinIndex& join = join_indexes[layer];
+    Association& al = associated_layers[layer];
+    if (!join.IsValid(this, al, layer)) {
+        join.Build(this, al.first, layer, al.second);
+    }
+    return join;
+}
+
+void AssociateLayerInt::InvalidateJoinIndexes()
+{
+    std::map<AssociateLayerInt*, LayerJoinIndex>::iterator it;
+    for (it=join_indexes.begin(); it!=join_indexes.end(); it++) {
+        it->second.Invalidate();
+    }
+}
+
 BackgroundMapLayer::BackgroundMapLayer()
 : AssociateLayerInt(),
 pen_color(wxColour(80, 80, 80)),
@@ -103,6 +173,7 @@ void BackgroundMapLayer::RemoveAssociatedLayer(AssociateLayerInt* layer)
     }
     if (del_key) {
         associated_layers.erase(del_key);
+        join_indexes.erase(del_key);
     }
 }
 
@@ -110,6 +181,7 @@ void BackgroundMapLayer::SetLayerAssociation(wxString my_key, AssociateLayerInt*
 {
     associated_layers[layer] = std::make_pair(my_key, key);
     associated_lines[layer] = show_connline;
+    join_indexes[layer].Build(this, my_key, layer, key);
 }
 
 bool BackgroundMapLayer::IsAssociatedWith(AssociateLayerInt* layer)
@@ -196,61 +268,51 @@ int BackgroundMapLayer::GetHighlightRecords()
 
 void BackgroundMapLayer::DrawHighlight(wxMemoryDC& dc, MapCanvas* map_canvas)
 {
+    // highlighted rows, the same for all connected layers
+    std::vector<int> hl_rows;
+    if (!associated_layers.empty()) {
+        for (int i=0; i<highlight_flags.size(); i++) {
+            if (highlight_flags[i]) {
+                hl_rows.push_back(i);
+            }
+        }
+    }
+    
     // draw any connected layers
     std::map<AssociateLayerInt*, Association>::iterator it;
     for (it=associated_layers.begin(); it!=associated_layers.end();it++) {
         AssociateLayerInt* associated_layer = it->first;
-        Association& al = it->second;
-        wxString primary_key = al.first;
-        wxString associated_key = al.second;
-        
-        std::vector<wxString> pid(shapes.size());  // e.g. 1 2 3 4 5
-        if (primary_key.IsEmpty() == false) {
-            GetKeyColumnData(primary_key, pid);
-        } else {
-            for (int i=0; i<shapes.size(); i++) {
-                pid[i] << i;
-            }
-        }
-        std::vector<wxString> fid; // e.g. 2 2 1 1 3 5 4 4
-        associated_layer->GetKeyColumnData(associated_key, fid);
+        const LayerJoinIndex& join = GetJoinIndex(associated_layer);
         associated_layer->ResetHighlight();
-
-        std::map<wxString, std::vector<wxInt64> > aid_idx;
-        for (int i=0; i<fid.size(); i++) {
-            aid_idx[fid[i]].push_back(i);
-        }
         
-        for (int i=0; i<highlight_flags.size(); i++) {
-            if (!highlight_flags[i]) {
-                continue;
-            }
-            wxString aid = pid[i];
-            if (aid_idx.find(aid) == aid_idx.end()) {
+        for (size_t k=0; k<hl_rows.size(); k++) {
+            int i = hl_rows[k];
+            int sz = join.Size(i);
+            if (sz == 0) {
                 continue;
             }
-            std::vector<wxInt64>& ids = aid_idx[aid];
-            for (int j=0; j<ids.size(); j++) {
+            const int* ids = join.GetRows(i);
+            for (int j=0; j<sz; j++) {
                 associated_layer->SetHighlight( ids[j] );
             }
         }
         associated_layer->DrawHighlight(dc, map_canvas);
         // draw lines to associated layer
+        if (!associated_lines[associated_layer] || associated_layer->IsHide()) {
+            continue;
+        }
         wxPen pen(this->GetAssociatePenColour());
         dc.SetPen(pen);
-        for (int i=0; i<highlight_flags.size(); i++) {
-            if (!highlight_flags[i]) {
+        for (size_t k=0; k<hl_rows.size(); k++) {
+            int i = hl_rows[k];
+            int sz = join.Size(i);
+            if (sz == 0) {
                 continue;
             }
-            wxString aid = pid[i];
-            if (aid_idx.find(aid) == aid_idx.end()) {
-                continue;
-            }
-            std::vector<wxInt64>& ids = aid_idx[aid];
-            for (int j=0; j<ids.size(); j++) {
-                if (associated_lines[associated_layer] && !associated_layer->IsHide()) {
-                    dc.DrawLine(shapes[i]->center, associated_layer->GetShape(ids[j])->center);
-                }
+            const int* ids = join.GetRows(i);
+            for (int j=0; j<sz; j++) {
+                dc.DrawLine(shapes[i]->center,
+                            associated_layer->GetShape(ids[j])->center);
             }
         }
     }
@@ -300,6 +362,7 @@ BackgroundMapLayer* BackgroundMapLayer::Clone(bool clone_style)
     copy->SetNumericFieldNames(num_field_names);
     copy->associated_layers = associated_layers;
     copy->associated_lines = associated_lines;
+    copy->join_indexes = join_indexes;
     copy->minx = minx;
     copy->miny = miny;
     copy->maxx = maxx;
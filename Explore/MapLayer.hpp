@@ -21,6 +21,39 @@ class AssociateLayerInt;
 // my_key, key from other layer
 typedef std::pair<wxString, wxString> Association;
 
+// Rows of an associated layer that share the key of each row of a layer. The
+// keys are dictionary-encoded once: row i of the layer has code codes[i] (-1
+// if its key is not in the associated layer), and the rows with that key are
+// rows[offsets[code]] .. rows[offsets[code+1]-1], in the order of the
+// associated layer.
+class LayerJoinIndex
+{
+public:
+    LayerJoinIndex() : is_valid(false) {}
+    
+    void Build(AssociateLayerInt* layer, const wxString& my_key,
+               AssociateLayerInt* associated_layer, const wxString& key);
+    void Invalidate() { is_valid = false; }
+    // false if the keys or the number of records of either layer changed
+    bool IsValid(AssociateLayerInt* layer, const Association& al,
+                 AssociateLayerInt* associated_layer);
+    
+    int Size(int i) const {
+        int c = codes[i];
+        return c < 0 ? 0 : offsets[c+1] - offsets[c];
+    }
+    const int* GetRows(int i) const { return &rows[0] + offsets[codes[i]]; }
+    
+protected:
+    bool is_valid;
+    Association keys;
+    int num_rows;
+    int num_associated_rows;
+    std::vector<int> codes;
+    std::vector<int> offsets;
+    std::vector<int> rows;
+};
+
 // Interfaces for map layer setting highlight association to any other map layer
 // It is implemented by: BackgroundMapLayer and MapCanvas
 class AssociateLayerInt
@@ -33,6 +66,8 @@ public:
     // primary key : AssociateLayer
     std::map<AssociateLayerInt*, Association> associated_layers;
     std::map<AssociateLayerInt*, bool> associated_lines;
+    // built by SetLayerAssociation(), see GetJoinIndex()
+    std::map<AssociateLayerInt*, LayerJoinIndex> join_indexes;
     
     AssociateLayerInt() : associate_pencolor(wxColour(50, 50, 50)) {}
     virtual ~AssociateLayerInt() {}
@@ -63,8 +98,13 @@ public:
     virtual bool IsAssociatedWith(AssociateLayerInt* layer) = 0;
     virtual void ClearLayerAssociation() {
         associated_layers.clear();
+        join_indexes.clear();
         ResetHighlight();
     }
+    // the join index of an associated layer, rebuilt if it is out of date
+    LayerJoinIndex& GetJoinIndex(AssociateLayerInt* layer);
+    // call when the values of a key column may have changed
+    void InvalidateJoinIndexes();
     
     virtual void SetHide(bool flag) { is_hide = flag; }
     virtual bool IsHide() { return is_hide; }
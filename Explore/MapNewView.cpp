@@ -26,6 +26,7 @@
 #include <wx/wx.h>
 
 #include "../DataViewer/TableInterface.h"
+#include "../DataViewer/TableState.h"
 #include "../DataViewer/TimeState.h"
 #include "../DialogTools/CatClassifDlg.h"
 #include "../DialogTools/SelectWeightsDlg.h"
@@ -39,6 +40,7 @@
 #include "../ShapeOperations/WeightsManState.h"
 #include "../ShapeOperations/OGRDatasourceProxy.h"
 #include "../ShapeOperations/OGRDataAdapter.h"
+#include "../ShapeOperations/PolygonLod.h"
 #include "../GdaConst.h"
 #include "../GeneralWxUtils.h"
 #include "../logger.h"
@@ -873,6 +875,7 @@ void MapCanvas::ResizeSelectableShps(int virtual_scrn_w,
         last_scale_trans.SetView(virtual_scrn_w, virtual_scrn_h);
 
         if (last_scale_trans.IsValid()) {
+            UpdatePolygonLod();
             BOOST_FOREACH( GdaShape* ms, background_shps ) {
                 if (ms) ms->applyScaleTrans(last_scale_trans);
             }
@@ -894,6 +897,32 @@ void MapCanvas::ResizeSelectableShps(int virtual_scrn_w,
     ResetFadedLayer();
 }
 
+/** Draws the polygons with the level of detail of the project, once it is
+ ready: the first map of a project starts to compute it in the background
+ and is drawn with all points until then. */
+void MapCanvas::UpdatePolygonLod()
+{
+    if (selectable_shps_type != polygons) return;
+    PolygonLod* lod = project->GetPolygonLod();
+    if (lod == NULL) return;
+    int n = (int)selectable_shps.size();
+    if (n > project->GetNumRecords()) n = project->GetNumRecords();
+    for (int i=0; i<n; i++) {
+        GdaPolygon* p = (GdaPolygon*) selectable_shps[i];
+        if (p && p->lod_tol == NULL) p->SetLod(lod->GetTolerances(i));
+    }
+}
+
+void MapCanvas::OnPolygonLodDone()
+{
+    // with a basemap the polygons are projected, and drawn with all points
+    if (isDrawBasemap || selectable_shps_type != polygons) return;
+    // OnIdle() calls ResizeSelectableShps(), which sets the level of detail
+    // of the polygons, and redraws the layers
+    isResize = true;
+    Refresh();
+}
+
 bool MapCanvas::InitBasemap()
 {
     if (basemap == NULL) {
@@ -1031,6 +1060,7 @@ void MapCanvas::DrawLayers()
         DrawLayerBase();
     }
     if (!layer0_valid) {
+        sel_shp_index.Invalidate();
         DrawLayer0();
     }
     if (!layer1_valid) {
@@ -1088,10 +1118,136 @@ void MapCanvas::DrawLayer0()
         map->paintSelf(dc);
     }
     dc.SelectObject(wxNullBitmap);
+    GetLayer0Categories(layer0_cats, layer0_pens, layer0_brushes);
     layer0_valid = true;
     layer1_valid = false;
 }
 
+/** The category of each polygon drawn by DrawSelectableShapes_dc (-1 if it
+ is not drawn), and the pen and brush of each category. */
+void MapCanvas::GetLayer0Categories(std::vector<int>& cats,
+                                    std::vector<wxPen>& pens,
+                                    std::vector<wxBrush>& brushes)
+{
+    cats.clear();
+    pens.clear();
+    brushes.clear();
+    if (selectable_shps_type != polygons || IsHide() || !display_map_with_graph)
+        return;
+    int cc_ts = cat_data.curr_canvas_tm_step;
+    int num_cats = cat_data.GetNumCategories(cc_ts);
+    cats.resize(selectable_shps.size(), -1);
+    for (int cat=0; cat<num_cats; cat++) {
+        if (selectable_outline_visible) {
+            pens.push_back(cat_data.GetCategoryPen(cc_ts, cat));
+        } else {
+            pens.push_back(wxPen(cat_data.GetCategoryColor(cc_ts, cat)));
+        }
+        brushes.push_back(cat_data.GetCategoryBrush(cc_ts, cat));
+        std::vector<int>& ids = cat_data.GetIdsRef(cc_ts, cat);
+        for (size_t i=0; i<ids.size(); i++) {
+            if (_IsShpValid(ids[i])) cats[ids[i]] = cat;
+        }
+    }
+}
+
+/** When only the categories of a map changed (a new theme, or a new time
+ step), paints layer0_bm again only where a polygon changed its pen or
+ brush, with the screen points the shapes already have, instead of
+ transforming and drawing all shapes. Returns false if layer0_bm has to be
+ drawn in full.
+
+ The clip is the union of the screen boxes of the changed polygons, grown
+ by the widest outline. It is cleared, and every polygon whose box reaches
+ into it is drawn again in the order of a full redraw, with the same DC, so
+ the pixels in the clip are those of a full redraw, antialiased or not. */
+bool MapCanvas::RepaintCategories()
+{
+    if (!layer0_valid || isResize || isDrawBasemap || layer0_cats.empty() ||
+        layer0_cats.size() != selectable_shps.size() ||
+        !background_shps.empty() || !background_maps.empty() ||
+        !foreground_maps.empty() || !last_scale_trans.IsValid()) {
+        return false;
+    }
+    std::vector<int> cats;
+    std::vector<wxPen> pens;
+    std::vector<wxBrush> brushes;
+    GetLayer0Categories(cats, pens, brushes);
+    if (cats.size() != layer0_cats.size()) return false;
+
+    std::vector<int> dirty;
+    for (size_t i=0; i<cats.size(); i++) {
+        int cat = cats[i];
+        int old_cat = layer0_cats[i];
+        if (cat < 0 && old_cat < 0) continue;
+        if (cat < 0 || old_cat < 0 ||
+            !(pens[cat] == layer0_pens[old_cat]) ||
+            !(brushes[cat] == layer0_brushes[old_cat])) {
+            dirty.push_back(i);
+        }
+    }
+    // past this, clipping costs more than it saves
+    if (dirty.size() > cats.size() / 2) return false;
+
+    if (!dirty.empty()) {
+        int pad = 2; // antialiased edge
+        int max_pen = 0;
+        for (size_t c=0; c<pens.size(); c++) {
+            max_pen = std::max(max_pen, pens[c].GetWidth());
+        }
+        for (size_t c=0; c<layer0_pens.size(); c++) {
+            max_pen = std::max(max_pen, layer0_pens[c].GetWidth());
+        }
+        pad += max_pen;
+
+        // the clip, and the polygons whose box reaches into it
+        wxRegion clip;
+        std::vector<bool> repaint(cats.size(), false);
+        std::vector<int> ids;
+        for (size_t d=0; d<dirty.size(); d++) {
+            GdaPolygon* p = (GdaPolygon*) selectable_shps[dirty[d]];
+            if (p->isNull()) continue;
+            int x0 = p->center.x, y0 = p->center.y;
+            int x1 = x0, y1 = y0;
+            for (int k=0; k<p->n; k++) {
+                x0 = std::min(x0, p->points[k].x);
+                y0 = std::min(y0, p->points[k].y);
+                x1 = std::max(x1, p->points[k].x);
+                y1 = std::max(y1, p->points[k].y);
+            }
+            x0 -= pad; y0 -= pad; x1 += pad; y1 += pad;
+            clip.Union(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+            QuerySelectableShps(x0 - pad, y0 - pad, x1 + pad, y1 + pad, ids);
+            for (size_t j=0; j<ids.size(); j++) {
+                if (cats[ids[j]] >= 0) repaint[ids[j]] = true;
+            }
+        }
+        if (!clip.IsEmpty()) {
+            wxMemoryDC dc(*layer0_bm);
+            dc.SetDeviceClippingRegion(clip);
+            wxRect box = clip.GetBox();
+            dc.SetPen(*wxTRANSPARENT_PEN);
+            dc.SetBrush(wxBrush(canvas_background_color));
+            dc.DrawRectangle(box);
+            DrawSelectableShapesClipped(dc, repaint, clip);
+            dc.DestroyClippingRegion();
+            dc.SelectObject(wxNullBitmap);
+            ResetFadedLayer();
+        }
+    }
+    layer0_cats.swap(cats);
+    layer0_pens.swap(pens);
+    layer0_brushes.swap(brushes);
+
+    // the foreground shapes are new
+    BOOST_FOREACH( GdaShape* ms, foreground_shps ) {
+        if (ms) ms->applyScaleTrans(last_scale_trans);
+    }
+    layer1_valid = false;
+    DrawLayers();
+    return true;
+}
+
 void MapCanvas::DrawLayer1()
 {
     // draw highlight
@@ -1406,6 +1562,27 @@ void MapCanvas::DrawSelectableShapes_dc(wxMemoryDC &_dc, bool hl_only,
 #endif
 }
 
+/** Draws the shapes set in hs inside clip, with the same DC as
+ DrawSelectableShapes_dc() */
+void MapCanvas::DrawSelectableShapesClipped(wxMemoryDC &_dc,
+                                            std::vector<bool>& hs,
+                                            const wxRegion& clip)
+{
+#ifdef __WXOSX__
+    wxGCDC dc(_dc);
+    dc.SetDeviceClippingRegion(clip);
+    helper_DrawSelectableShapes_dc(dc, hs, true, false, false);
+#else
+    if (GdaConst::gda_enable_set_transparency_windows) {
+        wxGCDC dc(_dc);
+        dc.SetDeviceClippingRegion(clip);
+        helper_DrawSelectableShapes_dc(dc, hs, true, false, false);
+    } else {
+        helper_DrawSelectableShapes_dc(_dc, hs, true, false, false);
+    }
+#endif
+}
+
 void MapCanvas::CleanBasemapCache()
 {
     if (basemap) {
@@ -2287,6 +2464,19 @@ void MapCanvas::RemoveLayer(wxString name)
     maplayer_state->notifyObservers(this);
 }
 
+void MapCanvas::InvalidateLayerJoins()
+{
+    // a key column of the table may have new values: the joins of this map
+    // and the joins of its layers with this map are built again when drawn
+    InvalidateJoinIndexes();
+    for (int i=0; i<bg_maps.size(); i++) {
+        bg_maps[i]->InvalidateJoinIndexes();
+    }
+    for (int i=0; i<fg_maps.size(); i++) {
+        fg_maps[i]->InvalidateJoinIndexes();
+    }
+}
+
 bool MapCanvas::IsCurrentMap()
 {
     return true;
@@ -2335,64 +2525,53 @@ void MapCanvas::DrawHighlight(wxMemoryDC& dc, MapCanvas* map_canvas)
 {
     std::vector<bool>& hs = highlight_state->GetHighlight();
     
+    // highlighted rows, the same for all connected layers
+    std::vector<int> hl_rows;
+    if (!associated_layers.empty()) {
+        for (int i=0; i<hs.size(); i++) {
+            if (hs[i]) {
+                hl_rows.push_back(i);
+            }
+        }
+    }
+    
     // draw any connected layers
     std::map<AssociateLayerInt*, Association>::iterator it;
     for (it=associated_layers.begin(); it!=associated_layers.end();it++) {
         AssociateLayerInt* associated_layer = it->first;
-        Association& al = it->second;
-        wxString primary_key = al.first;
-        wxString associated_key = al.second;
-
-        std::vector<wxString> pid(num_obs);  // e.g. 1 2 3 4 5
-        if (primary_key.IsEmpty() == false) {
-            GetKeyColumnData(primary_key, pid);
-        } else {
-            for (int i=0; i<num_obs; i++) {
-                pid[i] << i;
-            }
-        }
-        std::vector<wxString> fid; // e.g. 2 2 1 1 3 5 4 4
-        associated_layer->GetKeyColumnData(associated_key, fid);
+        const LayerJoinIndex& join = GetJoinIndex(associated_layer);
         associated_layer->ResetHighlight();
 
-        std::map<wxString, std::vector<wxInt64> > aid_idx;
-        for (int i=0; i<fid.size(); i++) {
-            aid_idx[fid[i]].push_back(i);
-        }
-
-        for (int i=0; i<hs.size(); i++) {
-            if (!hs[i]) {
+        for (size_t k=0; k<hl_rows.size(); k++) {
+            int i = hl_rows[k];
+            int sz = join.Size(i);
+            if (sz == 0) {
                 continue;
             }
-            wxString aid = pid[i];
-            if (aid_idx.find(aid) == aid_idx.end()) {
-                continue;
-            }
-            std::vector<wxInt64>& ids = aid_idx[aid];
-            for (int j=0; j<ids.size(); j++) {
+            const int* ids = join.GetRows(i);
+            for (int j=0; j<sz; j++) {
                 associated_layer->SetHighlight( ids[j] );
             }
         }
         draw_highlight_in_multilayers = false;
         associated_layer->DrawHighlight(dc, map_canvas);
         
-        for (int i=0; i<hs.size(); i++) {
-            if (!hs[i]) {
+        if (!associated_lines[associated_layer] ||
+            associated_layer->IsHide()) {
+            continue;
+        }
+        wxPen pen(this->GetAssociatePenColour());
+        dc.SetPen(pen);
+        for (size_t k=0; k<hl_rows.size(); k++) {
+            int i = hl_rows[k];
+            int sz = join.Size(i);
+            if (sz == 0) {
                 continue;
             }
-            wxString aid = pid[i];
-            if (aid_idx.find(aid) == aid_idx.end()) {
-                continue;
-            }
-            std::vector<wxInt64>& ids = aid_idx[aid];
-            wxPen pen(this->GetAssociatePenColour());
-            dc.SetPen(pen);
-            for (int j=0; j<ids.size(); j++) {
-                if (associated_lines[associated_layer] &&
-                    !associated_layer->IsHide()) {
-                    dc.DrawLine(selectable_shps[i]->center,
-                                associated_layer->GetShape(ids[j])->center);
-                }
+            const int* ids = join.GetRows(i);
+            for (int j=0; j<sz; j++) {
+                dc.DrawLine(selectable_shps[i]->center,
+                            associated_layer->GetShape(ids[j])->center);
             }
         }
     }
@@ -2411,6 +2590,7 @@ void MapCanvas::SetLayerAssociation(wxString my_key, AssociateLayerInt* layer,
 {
     associated_layers[layer] = std::make_pair(my_key, key);
     associated_lines[layer] = show_connline;
+    join_indexes[layer].Build(this, my_key, layer, key);
 }
 
 bool MapCanvas::IsAssociatedWith(AssociateLayerInt* layer)
@@ -2436,6 +2616,8 @@ void MapCanvas::PopulateCanvas()
 	background_shps.clear();
 	int canvas_ts = cat_data.GetCurrentCanvasTmStep();
 	if (!map_valid[canvas_ts]) full_map_redraw_needed = true;
+	// when the shapes are kept, only their categories can change
+	bool repaint_categories = !full_map_redraw_needed;
 
 	// Note: only need to delete selectable shapes if the map needs
 	// to be resized.  Otherwise, just reuse.
@@ -2587,7 +2769,9 @@ void MapCanvas::PopulateCanvas()
 		background_shps.push_back(txt_shp);
 	}
 
-    ReDraw();
+    if (!repaint_categories || !RepaintCategories()) {
+        ReDraw();
+    }
 }
 
 void MapCanvas::DrawConnectivityGraph(wxMemoryDC &dc)
@@ -3888,6 +4072,18 @@ void  MapFrame::update(TimeState* o)
 	if (template_legend) template_legend->Recreate();
 }
 
+/** Implementation of TableStateObserver interface */
+void MapFrame::update(TableState* o)
+{
+    TableState::EventType ev = o->GetEventType();
+    if (template_canvas && (ev == TableState::cols_delta ||
+                            ev == TableState::col_data_change ||
+                            ev == TableState::col_properties_change ||
+                            ev == TableState::refresh)) {
+        ((MapCanvas*) template_canvas)->InvalidateLayerJoins();
+    }
+}
+
 /** Implementation of WeightsManStateObserver interface */
 void MapFrame::update(WeightsManState* o)
 {
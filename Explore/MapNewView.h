@@ -108,6 +108,9 @@ public:
 	virtual void update(HLStateInt* o);
 	virtual void update(CatClassifState* o);
     virtual void update(MapLayerState* o);
+    /** The level of detail of the project is ready: applies it as a
+     resize would */
+    void OnPolygonLodDone();
 	virtual void SaveRates();
 	virtual void OnSaveCategories();
 	virtual void SetCheckMarks(wxMenu* menu);
@@ -184,6 +187,7 @@ public:
     void SetBackgroundMayLayers(std::vector<BackgroundMapLayer*>& val);
     std::vector<wxString> GetLayerNames();
     void RemoveLayer(wxString name);
+    void InvalidateLayerJoins();
     virtual bool IsCurrentMap();
     virtual wxString GetName();
     virtual std::vector<wxString> GetKeyNames();
@@ -293,6 +297,11 @@ protected:
 	std::vector<wxString> map_error_message;
 	bool full_map_redraw_needed;
 	boost::uuids::uuid weights_id;
+    // category of each observation, and pen and brush of each category, as
+    // drawn in layer0_bm; empty when it is not a map of polygons
+    std::vector<int> layer0_cats;
+    std::vector<wxPen> layer0_pens;
+    std::vector<wxBrush> layer0_brushes;
    
     // predefined/user-specified color, each label can be assigned with a color
     // user can specified using:
@@ -305,6 +314,12 @@ protected:
     void show_empty_shps_msgbox();
     void SaveThumbnail();
     bool InitBasemap();
+    void UpdatePolygonLod();
+    void GetLayer0Categories(std::vector<int>& cats, std::vector<wxPen>& pens,
+                             std::vector<wxBrush>& brushes);
+    bool RepaintCategories();
+    void DrawSelectableShapesClipped(wxMemoryDC &_dc, std::vector<bool>& hs,
+                                     const wxRegion& clip);
     virtual void DrawConnectivityGraph(wxMemoryDC &dc);
     virtual void CreateConnectivityGraph();
     
@@ -357,6 +372,9 @@ public:
 	/** Implementation of TimeStateObserver interface */
 	virtual void update(TimeState* o);
 	
+	/** Implementation of TableStateObserver interface */
+	virtual void update(TableState* o);
+	
 	/** Implementation of WeightsManStateObserver interface */
 	virtual void update(WeightsManState* o);
 	virtual int numMustCloseToRemove(boost::uuids::uuid id) const;
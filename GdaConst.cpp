@@ -330,6 +330,10 @@ bool GdaConst::gda_enable_set_transparency_windows = false;
 int GdaConst::default_display_decimals = 6; // move in preference
 double GdaConst::gda_autoweight_stop = 0.0001; // move in preference
 bool GdaConst::gda_use_gpu = false;
+bool GdaConst::gda_use_cpu_kernel = false;
+bool GdaConst::gda_use_legacy_perm_sampler = false;
+bool GdaConst::gda_perm_early_stop = false;
+bool GdaConst::gda_use_project_snapshot = false;
 int GdaConst::gda_ui_language = 0;
 double GdaConst::gda_eigen_tol = 0.00000001;
 bool GdaConst::gda_set_cpu_cores = true;
@@ -263,6 +263,10 @@ public:
     static bool gda_create_csvt;
     static wxString gda_basemap_sources;
     static bool gda_use_gpu;
+    static bool gda_use_cpu_kernel;
+    static bool gda_use_legacy_perm_sampler;
+    static bool gda_perm_early_stop;
+    static bool gda_use_project_snapshot;
     static int gda_ui_language;
     static double gda_eigen_tol;
     static int gda_cpu_cores;
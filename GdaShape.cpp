@@ -1151,7 +1151,9 @@ void GdaRectangle::paintSelf(wxGraphicsContext* gc)
 // GdaPolygon: polygon (for rendering)
 //
 ////////////////////////////////////////////////////////////////////////////////
-GdaPolygon::GdaPolygon() : points(0), points_o(0), count(0)
+const double GdaPolygon::lod_pixels = 0.5;
+
+GdaPolygon::GdaPolygon() : points(0), points_o(0), count(0), lod_tol(0)
 {
 	null_shape = true;
 }
@@ -1160,10 +1162,11 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
 	: GdaShape(s), //region(s.region),
 	n(s.n), pc(s.pc), points_o(s.points_o),
 	n_count(s.n_count), all_points_same(s.all_points_same),
-	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0)
+	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0), lod_tol(s.lod_tol)
 {
 	if (null_shape) return;
-	points = new wxPoint[n];
+	// with a level of detail, points and count can grow to all of pc
+	points = new wxPoint[lod_tol ? pc->num_points : n];
 	for (int i=0; i<n; i++) {
 		points[i].x = s.points[i].x;
 		points[i].y = s.points[i].y;
@@ -1175,7 +1178,7 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
 			points_o[i].y = s.points_o[i].y;
 		}
 	}
-	count = new int[s.n_count];
+	count = new int[lod_tol ? pc->num_parts : s.n_count];
 	for (int i=0; i<s.n_count; i++) {
 		count[i] = s.count[i];
 	}
@@ -1183,7 +1186,7 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
 
 GdaPolygon::GdaPolygon(wxPoint& pt1, wxPoint& pt2)
 : n(2), points_o(0), pc(0), points(0), n_count(1),
-all_points_same(false), count(0)
+all_points_same(false), count(0), lod_tol(0)
 {
     n = 2;
     count = new int[1];
@@ -1219,7 +1222,7 @@ all_points_same(false), count(0)
  will be deleted when the constructor is called. */
 GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
 	: n(n_s), points_o(0), pc(0), points(0), n_count(1),
-	all_points_same(false), count(0)
+	all_points_same(false), count(0), lod_tol(0)
 {
 	if (points_o_s == 0 || n == 0) {
 		null_shape = true;
@@ -1256,7 +1259,8 @@ GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
  part might contain holes.  Only a pointer to the original data is
  kept, and this memory is not deleted in the destructor. */
 GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s)
-  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0)
+  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0),
+lod_tol(0)
 {
 	assert(pc);
 	if (pc->shape_type == 0 || pc->num_points == 0) {
@@ -1345,6 +1349,8 @@ void GdaPolygon::applyScaleTrans(const GdaScaleTrans& A)
 		for (int i=0; i<n; i++) {
 			A.transform(points_o[i], &(points[i]));
 		}
+	} else if (lod_tol) {
+		applyScaleTransLod(A);
 	} else {
 		for (int i=0; i<n; i++) {
 			A.transform(pc->points[i], &(points[i]));
@@ -1352,6 +1358,58 @@ void GdaPolygon::applyScaleTrans(const GdaScaleTrans& A)
 	}
 }
 
+void GdaPolygon::SetLod(const float* tol)
+{
+	if (null_shape || pc == 0) return;
+	lod_tol = tol;
+	if (lod_tol == 0) UseAllPoints();
+}
+
+void GdaPolygon::UseAllPoints()
+{
+	n = pc->num_points;
+	n_count = pc->num_parts;
+	GdaShapeAlgs::partsToCount(pc->parts, pc->num_points, count);
+	all_points_same = false;
+}
+
+/** Keeps the points whose tolerance is at least lod_pixels at the scale of
+ A, and the points that fall on the same pixel only once.  A polygon that
+ is smaller than a pixel is drawn as its center, and a ring that is left
+ with less than three points is not drawn. */
+void GdaPolygon::applyScaleTransLod(const GdaScaleTrans& A)
+{
+	double sx = fabs(A.scale_x);
+	double sy = fabs(A.scale_y);
+	n = 0;
+	n_count = 0;
+	if ((bb_ur_o.x - bb_ll_o.x) * sx >= 1 ||
+		(bb_ur_o.y - bb_ll_o.y) * sy >= 1) {
+		float tol = (float) (lod_pixels / std::max(sx, sy));
+		for (int p=0; p<pc->num_parts; p++) {
+			int first = n;
+			int end = p+1 < pc->num_parts ? pc->parts[p+1] : pc->num_points;
+			for (int i=pc->parts[p]; i<end; i++) {
+				if (lod_tol[i] < tol) continue;
+				A.transform(pc->points[i], &(points[n]));
+				if (n == first || points[n] != points[n-1]) n++;
+			}
+			if (n - first < 3) {
+				n = first;
+			} else {
+				count[n_count++] = n - first;
+			}
+		}
+	}
+	all_points_same = (n_count == 0);
+	if (all_points_same) {
+		n = 1;
+		n_count = 1;
+		count[0] = 1;
+		points[0] = center;
+	}
+}
+
 
 void GdaPolygon::projectToBasemap(Gda::Basemap* basemap, double scale_factor)
 {
@@ -1359,6 +1417,7 @@ void GdaPolygon::projectToBasemap(Gda::Basemap* basemap, double scale_factor)
         return;
     
 	GdaShape::projectToBasemap(basemap, scale_factor);
+	if (lod_tol) UseAllPoints();
 	if (points_o) {
 		for (int i=0; i<n; i++) {
             basemap->LatLngToXY(points_o[i].x, points_o[i].y, 
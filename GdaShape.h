@@ -326,6 +326,9 @@ public:
 	static wxRealPoint CalculateCentroid(int n, wxRealPoint* pts);
 	virtual void paintSelf(wxDC& dc);
 	virtual void paintSelf(wxGraphicsContext* gc);
+	/** Tolerances of the points of pc (see PolygonLod), or NULL to draw
+	 all points.  Not owned. */
+	void SetLod(const float* tol);
 
 	// All values in points array are the same.  Can render render
 	// as a single point at points[0]
@@ -345,6 +348,15 @@ public:
 	wxRealPoint* points_o;
 	wxRealPoint bb_ll_o; // bounding box lower left
 	wxRealPoint bb_ur_o; // bounding box upper right
+
+	// with pc only: the points whose tolerance is below lod_pixels at the
+	// current scale are left out of points and count
+	const float* lod_tol;
+	static const double lod_pixels;
+
+protected:
+	void applyScaleTransLod(const GdaScaleTrans& A);
+	void UseAllPoints();
 };
 
 
@@ -30,6 +30,13 @@
 #include <wx/stdpaths.h>
 #include <wx/regex.h>
 
+#ifdef __WIN32__
+#include <wx/msw/wrapwin.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 #include "GdaConst.h"
 #include "GenUtils.h"
 #include "Explore/CatClassification.h"
@@ -2387,6 +2394,25 @@ wxString GenUtils::GetLoggerPath()
 #endif
 }
 
+size_t GenUtils::GetPeakMemoryUsage()
+{
+#ifdef __WIN32__
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return (size_t)pmc.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __WXOSX__
+    return (size_t)usage.ru_maxrss; // bytes
+#else
+    return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
 wxString GenUtils::GetUserSamplesDir()
 {
     // this function will be only called in linux env
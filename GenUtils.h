@@ -459,6 +459,8 @@ namespace GenUtils {
     wxString GetLangSearchPath();
 	wxString GetLangConfigPath();
     wxString GetLoggerPath();
+    /** Peak resident memory of this process in bytes, 0 if unknown */
+    size_t GetPeakMemoryUsage();
 
     bool less_vectors(const std::vector<int>& a,const std::vector<int>& b);
     bool smaller_pair(const std::pair<int, int>& a,
@@ -488,6 +488,13 @@ void GdaApp::MacOpenFiles(const wxArrayString& fileNames)
     }
 }
 
+void GdaApp::OnPolygonLodDone()
+{
+    // the project that started the thread could be closed by now
+    Project* project = GdaFrame::GetProject();
+    if (project) project->UpdatePolygonLod();
+}
+
 int GdaApp::OnExit(void)
 {
     if (checker) delete checker;
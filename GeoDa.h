@@ -58,6 +58,9 @@ public:
 	virtual void OnInitCmdLine(wxCmdLineParser& parser);
 	virtual bool OnCmdLineParsed(wxCmdLineParser& parser);
     virtual void MacOpenFiles(const wxArrayString& fileNames);
+    /** Queued by the thread that computes the level of detail of the
+     polygons, see Project::GetPolygonLod() */
+    void OnPolygonLodDone();
     static const wxCmdLineEntryDesc globalCmdLineDesc[];
 private:
     wxSingleInstanceChecker* checker;
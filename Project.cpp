@@ -21,6 +21,9 @@
 #include <set>
 #include <sstream>
 #include <vector>
+#define BOOST_PHOENIX_STL_TUPLE_H_
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
 #include <boost/property_tree/exceptions.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -67,8 +70,11 @@
 #include "ShapeOperations/WeightsManager.h"
 #include "ShapeOperations/WeightsManPtree.h"
 #include "ShapeOperations/OGRDataAdapter.h"
+#include "ShapeOperations/PolygonLod.h"
 #include "GeneralWxUtils.h"
 #include "MapLayerStateObserver.h"
+#include "io/project_snapshot.h"
+#include "GeoDa.h"
 #include "Project.h"
 
 // used by TemplateCanvas
@@ -83,7 +89,8 @@ save_manager(0),
 frames_manager(0),cat_classif_manager(0), mean_centers(0), centroids(0),
 voronoi_rook_nbr_gal(0), default_var_name(4), default_var_time(4),
 point_duplicates_initialized(false), point_dups_warn_prev_displayed(false),
-num_records(0), layer_proxy(NULL),
+num_records(0), layer_proxy(NULL), snapshot(NULL), polygon_lod(NULL),
+polygon_lod_thread(NULL),
 highlight_state(0), con_map_hl_state(0), pairs_hl_state(0),
 dist_metric(WeightsMetaInfo::DM_euclidean),
 dist_units(WeightsMetaInfo::DU_mile),
@@ -133,7 +140,8 @@ save_manager(0),
 frames_manager(0),cat_classif_manager(0), mean_centers(0), centroids(0),
 voronoi_rook_nbr_gal(0), default_var_name(4), default_var_time(4),
 point_duplicates_initialized(false), point_dups_warn_prev_displayed(false),
-num_records(0), layer_proxy(NULL),
+num_records(0), layer_proxy(NULL), snapshot(NULL), polygon_lod(NULL),
+polygon_lod_thread(NULL),
 highlight_state(0), con_map_hl_state(0), pairs_hl_state(0),
 dist_metric(WeightsMetaInfo::DM_euclidean),
 dist_units(WeightsMetaInfo::DU_mile),
@@ -202,6 +210,18 @@ Project::~Project()
 	for (size_t i=0, iend=centroids.size(); i<iend; i++)
         delete centroids[i];
     
+    if (polygon_lod_thread) {
+        polygon_lod->Cancel();
+        polygon_lod_thread->join();
+        delete polygon_lod_thread;
+    }
+    if (polygon_lod) delete polygon_lod;
+    if (snapshot) {
+        // sections computed during the session
+        snapshot->Flush();
+        delete snapshot;
+    }
+    
 	if (voronoi_rook_nbr_gal)
         delete [] voronoi_rook_nbr_gal;
     
@@ -1145,6 +1165,10 @@ const std::vector<GdaPoint*>& Project::GetMeanCenters()
 {
 	wxLogMessage("Project::GetMeanCenters()");
 	int num_obs = main_data.records.size();
+	if (mean_centers.size() == 0 && num_obs > 0 && snapshot &&
+        snapshot->GetMeanCenters(mean_centers)) {
+        return mean_centers;
+    }
 	if (mean_centers.size() == 0 && num_obs > 0) {
 		if (main_data.header.shape_type == Shapefile::POINT_TYP) {
 			mean_centers.resize(num_obs);
@@ -1173,6 +1197,7 @@ const std::vector<GdaPoint*>& Project::GetMeanCenters()
 				}
 			}
 		}
+        if (snapshot) snapshot->SetMeanCenters(mean_centers);
 	}
 	return mean_centers;
 }
@@ -1204,8 +1229,12 @@ const std::vector<GdaPoint*>& Project::GetCentroids()
                 centroids[row_idx] = new GdaPoint(pc->x, pc->y);
             }
         }
-    } else {
+    } else if (centroids.size() == 0 && num_records > 0) {
+        if (snapshot && snapshot->GetCentroids(centroids)) {
+            return centroids;
+        }
         layer_proxy->GetCentroids(centroids);
+        if (snapshot) snapshot->SetCentroids(centroids);
     }
 
 	return centroids;	
@@ -1217,8 +1246,74 @@ GdaPolygon* Project::GetMapBoundary()
     
     if (layer_proxy->IsTableOnly()) {
         return NULL;
-    } else {
-        return layer_proxy->GetMapBoundary();
+    }
+    if (snapshot) {
+        GdaPolygon* boundary = snapshot->GetMapBoundary();
+        if (boundary == NULL) {
+            boundary = layer_proxy->GetMapBoundary();
+            snapshot->SetMapBoundary(boundary);
+        }
+        return boundary;
+    }
+    return layer_proxy->GetMapBoundary();
+}
+
+PolygonLod* Project::GetPolygonLod()
+{
+    if (polygon_lod == NULL) {
+        if (isTableOnly || main_data.header.shape_type != Shapefile::POLYGON ||
+            main_data.records.empty()) {
+            return NULL;
+        }
+        std::vector<Shapefile::PolygonContents*> polys(main_data.records.size());
+        for (size_t i=0; i<polys.size(); i++) {
+            polys[i] = (Shapefile::PolygonContents*)
+            main_data.records[i].contents_p;
+        }
+        polygon_lod = new PolygonLod(polys);
+        std::vector<float> tol;
+        if (snapshot && snapshot->GetPolygonTolerances(tol) &&
+            polygon_lod->SetTolerances(tol)) {
+            return polygon_lod;
+        }
+        polygon_lod_thread =
+            new boost::thread(boost::bind(&Project::BuildPolygonLod, this));
+        return NULL;
+    }
+    if (polygon_lod_thread) {
+        if (!polygon_lod->IsDone()) return NULL;
+        polygon_lod_thread->join();
+        delete polygon_lod_thread;
+        polygon_lod_thread = NULL;
+        if (snapshot) {
+            snapshot->SetPolygonTolerances(polygon_lod->GetTolerances());
+        }
+    }
+    return polygon_lod;
+}
+
+/** Body of polygon_lod_thread */
+void Project::BuildPolygonLod()
+{
+    polygon_lod->Build();
+    // the maps are drawn with all points until the event loop gets this
+    if (polygon_lod->IsDone()) wxGetApp().CallAfter(&GdaApp::OnPolygonLodDone);
+}
+
+void Project::UpdatePolygonLod()
+{
+    // GetPolygonLod() joins the thread; don't start one that isn't there
+    if (frames_manager == NULL || polygon_lod == NULL ||
+        GetPolygonLod() == NULL) {
+        return;
+    }
+    std::list<FramesManagerObserver*> observers(frames_manager->getCopyObservers());
+    std::list<FramesManagerObserver*>::iterator it;
+    for (it=observers.begin(); it != observers.end(); ++it) {
+        if (MapFrame* w = dynamic_cast<MapFrame*>(*it)) {
+            MapCanvas* canvas = dynamic_cast<MapCanvas*>(w->template_canvas);
+            if (canvas) canvas->OnPolygonLodDone();
+        }
     }
 }
 
@@ -1507,7 +1602,7 @@ bool Project::CommonProjectInit()
     }
 	
 	num_records = table_int->GetNumberRows();
-   
+    
     if (!isTableOnly) {
         ogr_adapter.GetHistory("db_host");
     }
@@ -1726,7 +1821,33 @@ bool Project::InitFromOgrLayer()
 	isTableOnly = layer_proxy->IsTableOnly();
     if (ds_type == GdaConst::ds_dbf) isTableOnly = true;
     if (!isTableOnly) {
-        has_null_geometry = layer_proxy->ReadGeometries(main_data);
+        if (GdaConst::gda_use_project_snapshot) {
+            FileDataSource* fds = dynamic_cast<FileDataSource*>(datasource);
+            if (fds) {
+                wxString src_fname = fds->GetFilePath();
+                wxString snap_fname =
+                ProjectSnapshot::GetSnapshotPath(project_conf->GetFilePath(),
+                                                 src_fname);
+                snapshot = new ProjectSnapshot();
+                if (snapshot->Open(snap_fname, src_fname, layer_proxy->n_rows)) {
+                    wxLogMessage("Project snapshot: %s", snap_fname);
+                }
+            }
+        }
+        // the shapes in the snapshot save converting every OGR geometry
+        int geom_type = wkbUnknown;
+        if (snapshot == NULL ||
+            !snapshot->GetShapes(main_data, has_null_geometry, geom_type)) {
+            has_null_geometry = layer_proxy->ReadGeometries(main_data);
+            if (snapshot) {
+                snapshot->SetShapes(main_data, has_null_geometry,
+                                    (int)layer_proxy->eGType);
+                snapshot->Flush();
+            }
+        } else if (layer_proxy->eGType == wkbUnknown) {
+            // ReadGeometries() was skipped, DissolveMap() needs the type
+            layer_proxy->eGType = (OGRwkbGeometryType)geom_type;
+        }
     }
 	return true;
 }
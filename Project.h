@@ -69,6 +69,11 @@ class CovSpHLStateProxy;
 class ExportDataDlg;
 class BackgroundMapLayer;
 class MapLayerState;
+class ProjectSnapshot;
+class PolygonLod;
+namespace boost {
+    class thread;
+}
 
 class Project {
 public:
@@ -173,6 +178,12 @@ public:
 	void GetCentroids(std::vector<wxRealPoint>& pts);
 	const std::vector<GdaShape*>& GetVoronoiPolygons();
     GdaPolygon* GetMapBoundary();
+    /** Level of detail of the polygons for drawing, or NULL while it is
+     computed on a worker thread; the first call starts it */
+    PolygonLod* GetPolygonLod();
+    /** Redraws the open maps with the level of detail once the worker
+     thread is done; called on the main thread */
+    void UpdatePolygonLod();
 	void GetMapExtent(double& minx, double& miny, double& maxx, double& maxy);
     std::vector<wxFloat64> GetBBox(int idx);
 
@@ -260,10 +271,16 @@ public:
     std::vector<GdaPoint*> mean_centers;
     std::vector<GdaPoint*> centroids;
     std::vector<GdaShape*> voronoi_polygons;
+    // centroids, mean centers, boundary and polygon level of detail saved
+    // between sessions, or NULL
+    ProjectSnapshot* snapshot;
+    PolygonLod* polygon_lod;
+    boost::thread* polygon_lod_thread; // while polygon_lod is computed
 
 protected:
 	bool CommonProjectInit();
 	bool InitFromOgrLayer();
+    void BuildPolygonLod();
     // only for ESRI Shapefile .cpg file
     void SetupEncoding(wxString encode_str);
     wxString ConvertCpgCodePage(const wxString& code_page);
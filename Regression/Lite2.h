@@ -539,8 +539,8 @@ inline void Destroy(Iterator<T> it)  {
   return;
 }
 
-template <class X>
-inline void CopyInput(Vector<X> & dest, const std::vector<long>& nbl,
+template <class X, class L>
+inline void CopyInput(Vector<X> & dest, const L& nbl,
 					  INDEX size)  
 {
 	X   v;
@@ -0,0 +1,175 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <math.h>
+
+#include "GdaShape.h"
+#include "SelectableShpIndex.h"
+
+SelectableShpIndex::SelectableShpIndex()
+: valid(false), num_shps(0), x_min(0), y_min(0), cell_size(1), nx(0), ny(0),
+stamp(0)
+{
+}
+
+SelectableShpIndex::~SelectableShpIndex()
+{
+}
+
+bool SelectableShpIndex::GetBox(GdaShape* shp, int* box)
+{
+	// the screen extent of the shape, including its center, which is what
+	// the brushes test for points
+	box[0] = box[2] = shp->center.x;
+	box[1] = box[3] = shp->center.y;
+	const wxPoint* pts = 0;
+	int n = 0;
+	if (dynamic_cast<GdaPoint*>(shp)) {
+		return true;
+	} else if (GdaPolygon* p = dynamic_cast<GdaPolygon*>(shp)) {
+		pts = p->points;
+		n = p->n;
+	} else if (GdaPolyLine* p = dynamic_cast<GdaPolyLine*>(shp)) {
+		pts = p->points;
+		n = p->n;
+	} else if (GdaCircle* c = dynamic_cast<GdaCircle*>(shp)) {
+		int r = (int) ceil(c->radius);
+		box[0] -= r;
+		box[1] -= r;
+		box[2] += r;
+		box[3] += r;
+	} else if (GdaRectangle* r = dynamic_cast<GdaRectangle*>(shp)) {
+		box[0] = std::min(box[0], std::min(r->lower_left.x, r->upper_right.x));
+		box[1] = std::min(box[1], std::min(r->lower_left.y, r->upper_right.y));
+		box[2] = std::max(box[2], std::max(r->lower_left.x, r->upper_right.x));
+		box[3] = std::max(box[3], std::max(r->lower_left.y, r->upper_right.y));
+	} else {
+		return false;
+	}
+	for (int i=0; i<n; i++) {
+		if (pts[i].x < box[0]) box[0] = pts[i].x;
+		if (pts[i].y < box[1]) box[1] = pts[i].y;
+		if (pts[i].x > box[2]) box[2] = pts[i].x;
+		if (pts[i].y > box[3]) box[3] = pts[i].y;
+	}
+	return true;
+}
+
+int SelectableShpIndex::CellX(int x) const
+{
+	if (x < x_min) return 0;
+	int i = (x - x_min) / cell_size;
+	return i < nx ? i : nx-1;
+}
+
+int SelectableShpIndex::CellY(int y) const
+{
+	if (y < y_min) return 0;
+	int j = (y - y_min) / cell_size;
+	return j < ny ? j : ny-1;
+}
+
+void SelectableShpIndex::Build(const std::vector<GdaShape*>& shps,
+							   int scrn_w, int scrn_h)
+{
+	num_shps = (int)shps.size();
+	if (scrn_w < 1) scrn_w = 1;
+	if (scrn_h < 1) scrn_h = 1;
+
+	// about 4 shapes for each cell when they are spread over the screen
+	double area = (double) scrn_w * (double) scrn_h;
+	cell_size = (int) ceil(sqrt(4.0 * area / std::max(num_shps, 1)));
+	if (cell_size < 8) cell_size = 8;
+	if (cell_size > 256) cell_size = 256;
+	x_min = -cell_size;
+	y_min = -cell_size;
+	nx = (scrn_w + cell_size - 1) / cell_size + 2;
+	ny = (scrn_h + cell_size - 1) / cell_size + 2;
+
+	boxes.resize(4 * num_shps);
+	unindexed.clear();
+	std::vector<char> in_grid(num_shps, 0);
+	cell_start.assign(nx * ny + 1, 0);
+	for (int i=0; i<num_shps; i++) {
+		GdaShape* shp = shps[i];
+		if (shp == NULL || shp->isNull()) continue;
+		int* box = &boxes[4*i];
+		if (!GetBox(shp, box)) {
+			unindexed.push_back(i);
+			continue;
+		}
+		int cx0 = CellX(box[0]), cx1 = CellX(box[2]);
+		int cy0 = CellY(box[1]), cy1 = CellY(box[3]);
+		if ((cx1-cx0+1) * (cy1-cy0+1) > max_cells) {
+			unindexed.push_back(i);
+			continue;
+		}
+		in_grid[i] = 1;
+		for (int cy=cy0; cy<=cy1; cy++) {
+			for (int cx=cx0; cx<=cx1; cx++) cell_start[cy*nx + cx + 1]++;
+		}
+	}
+	for (int c=0; c<nx*ny; c++) cell_start[c+1] += cell_start[c];
+	cell_ids.resize(cell_start[nx*ny]);
+	std::vector<int> pos(cell_start.begin(), cell_start.end()-1);
+	for (int i=0; i<num_shps; i++) {
+		if (!in_grid[i]) continue;
+		const int* box = &boxes[4*i];
+		int cx0 = CellX(box[0]), cx1 = CellX(box[2]);
+		int cy0 = CellY(box[1]), cy1 = CellY(box[3]);
+		for (int cy=cy0; cy<=cy1; cy++) {
+			for (int cx=cx0; cx<=cx1; cx++) cell_ids[pos[cy*nx + cx]++] = i;
+		}
+	}
+	stamps.assign(num_shps, 0);
+	stamp = 0;
+	valid = true;
+}
+
+void SelectableShpIndex::Query(int x0, int y0, int x1, int y1,
+							   std::vector<int>& ids)
+{
+	ids.clear();
+	if (x0 > x1) std::swap(x0, x1);
+	if (y0 > y1) std::swap(y0, y1);
+	if (++stamp == 0) {
+		stamps.assign(num_shps, 0);
+		stamp = 1;
+	}
+	int cx0 = CellX(x0), cx1 = CellX(x1);
+	int cy0 = CellY(y0), cy1 = CellY(y1);
+	for (int cy=cy0; cy<=cy1; cy++) {
+		for (int cx=cx0; cx<=cx1; cx++) {
+			int c = cy*nx + cx;
+			for (int k=cell_start[c]; k<cell_start[c+1]; k++) {
+				int i = cell_ids[k];
+				if (stamps[i] == stamp) continue;
+				stamps[i] = stamp;
+				const int* box = &boxes[4*i];
+				if (box[0] > x1 || box[2] < x0 ||
+					box[1] > y1 || box[3] < y0) continue;
+				ids.push_back(i);
+			}
+		}
+	}
+	ids.insert(ids.end(), unindexed.begin(), unindexed.end());
+	std::sort(ids.begin(), ids.end());
+}
@@ -0,0 +1,77 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_SELECTABLE_SHP_INDEX_H__
+#define __GEODA_CENTER_SELECTABLE_SHP_INDEX_H__
+
+#include <vector>
+
+class GdaShape;
+
+/**
+ Uniform grid over the screen bounding boxes of the selectable shapes of a
+ canvas, so that a click, the brush or the mouse hover only tests the shapes
+ near the mouse instead of all of them.
+
+ The grid covers the client area plus a ring of one cell on every side;
+ the parts of shapes that are off the screen are clamped into the ring, so
+ queries inside the client area don't see them. A shape that would cover
+ more than max_cells cells, or that is not a point, circle, rectangle,
+ polygon or polyline, is not put in the grid and is returned by every query.
+
+ The index holds screen coordinates: it must be built again when the
+ shapes move, i.e. after a resize, zoom, pan or a new time period.
+ */
+class SelectableShpIndex
+{
+public:
+	SelectableShpIndex();
+	virtual ~SelectableShpIndex();
+
+	void Invalidate() { valid = false; }
+	bool IsValid() const { return valid; }
+
+	void Build(const std::vector<GdaShape*>& shps, int scrn_w, int scrn_h);
+
+	/** Sets ids to the shapes whose bounding box may intersect the
+	 rectangle [x0, x1] x [y0, y1], in increasing order */
+	void Query(int x0, int y0, int x1, int y1, std::vector<int>& ids);
+
+	static const int max_cells = 1024;
+
+protected:
+	static bool GetBox(GdaShape* shp, int* box);
+	int CellX(int x) const;
+	int CellY(int y) const;
+
+	bool valid;
+	int num_shps;
+	int x_min, y_min; // screen position of the first cell
+	int cell_size;
+	int nx, ny;
+	std::vector<int> cell_start; // nx*ny+1 offsets into cell_ids
+	std::vector<int> cell_ids;
+	std::vector<int> boxes; // x0, y0, x1, y1 of each shape
+	std::vector<int> unindexed;
+	std::vector<int> stamps; // last query that returned each shape
+	int stamp;
+};
+
+#endif
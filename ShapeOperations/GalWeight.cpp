@@ -19,17 +19,20 @@
 
 #include <algorithm>
 #include <iomanip>
+#include <limits>
 #include <fstream>
 #include <set>
 #include <map>
 #include <utility>
 #include <boost/uuid/uuid.hpp>
 #include <wx/filename.h>
+#include <wx/log.h>
 
 #include "../GenUtils.h"
 #include "../Project.h"
 #include "../VarCalc/WeightsManInterface.h"
 #include "../DataViewer/TableInterface.h"
+#include "../io/weights_binary.h"
 #include "GalWeight.h"
 
 
@@ -38,79 +41,233 @@
 // GalElement
 //
 ////////////////////////////////////////////////////////////////////////////////
+
+/** Row of a GalElement that is not a view of a GalCsr */
+struct GalElement::Buffer {
+    std::vector<int32_t> nbr;
+    std::vector<double> weights; // same size as nbr
+    std::vector<int32_t> lookup;
+};
+
+namespace {
+
+int GalRowOrder(const int32_t* ids, int sz)
+{
+    bool asc = true, desc = true;
+    for (int i=1; i<sz && (asc || desc); i++) {
+        if (ids[i] < ids[i-1]) asc = false;
+        if (ids[i] > ids[i-1]) desc = false;
+    }
+    if (asc) return GalElement::order_ascending;
+    if (desc) return GalElement::order_descending;
+    return GalElement::order_unsorted;
+}
+
+struct GalLookupLess {
+    const int32_t* ids;
+    GalLookupLess(const int32_t* ids_s) : ids(ids_s) {}
+    // by id, and the last position of an id first
+    bool operator()(int32_t a, int32_t b) const {
+        return ids[a] < ids[b] || (ids[a] == ids[b] && a > b);
+    }
+    bool operator()(int32_t pos, long id) const { return ids[pos] < id; }
+};
+
+void GalIndexRow(const int32_t* ids, int sz, int32_t* lookup)
+{
+    for (int i=0; i<sz; i++) lookup[i] = i;
+    std::sort(lookup, lookup + sz, GalLookupLess(ids));
+}
+
+/** Position of id in a row, the last one if it is listed twice, or -1 */
+int GalFindPos(const int32_t* ids, const int32_t* lookup, int sz, int order,
+               long id)
+{
+    if (order == GalElement::order_ascending) {
+        const int32_t* it = std::upper_bound(ids, ids + sz, id);
+        if (it == ids || *(it-1) != id) return -1;
+        return (int)(it - ids) - 1;
+    }
+    if (order == GalElement::order_descending) {
+        const int32_t* it = std::upper_bound(ids, ids + sz, id,
+                                             std::greater<long>());
+        if (it == ids || *(it-1) != id) return -1;
+        return (int)(it - ids) - 1;
+    }
+    const int32_t* it = std::lower_bound(lookup, lookup + sz, id,
+                                         GalLookupLess(ids));
+    if (it == lookup + sz || ids[*it] != id) return -1;
+    return *it;
+}
+
+/** Row-standardized lag, summed in row order; self_id, if not negative, is
+ left out of the row */
+double GalSpatialLag(const int32_t* nbr, const GalNbrWeights& w, int sz,
+                     const double* x, bool is_binary, int self_id)
+{
+    double lag = 0;
+    if (is_binary) {
+        if (self_id < 0) {
+            for (int i=0; i<sz; ++i) lag += x[nbr[i]];
+            if (sz>1) lag /= (double) sz;
+        } else {
+            // for case of using kernel weights with diagonal
+            int n_nbrs = 0;
+            for (int i=0; i<sz; ++i) {
+                if (nbr[i] != self_id) {
+                    lag += x[nbr[i]];
+                    n_nbrs += 1;
+                }
+            }
+            if (n_nbrs > 0) lag /= (double) n_nbrs;
+        }
+    } else {
+        double sumW = 0;
+        for (int i=0; i<sz; ++i) {
+            if (self_id < 0 || nbr[i] != self_id) { // exclude self-neighbor
+                sumW += w[i];
+            }
+        }
+        if (sumW != 0) {
+            for (int i=0; i<sz; ++i) {
+                if (self_id < 0 || nbr[i] != self_id) {
+                    lag += x[nbr[i]] * w[i] / sumW;
+                }
+            }
+        }
+    }
+    return lag;
+}
+
+}
+
 GalElement::GalElement()
+: nbr(0), nbr_w(0), lookup(0), csr(0), buf(0), sz(0),
+w_type(gal_unit_weights), order(order_ascending)
+{
+}
+
+GalElement::GalElement(const GalElement& e)
+: nbr(0), nbr_w(0), lookup(0), csr(0), buf(0), sz(0),
+w_type(gal_unit_weights), order(order_ascending)
+{
+    *this = e;
+}
+
+GalElement::~GalElement()
+{
+    if (buf) delete buf;
+}
+
+// a copy always holds its own row
+GalElement& GalElement::operator=(const GalElement& e)
+{
+    if (this == &e) return *this;
+    if (e.sz == 0 && buf == 0) {
+        csr = 0;
+        nbr = 0;
+        nbr_w = 0;
+        lookup = 0;
+        sz = 0;
+        w_type = gal_unit_weights;
+        order = order_ascending;
+        return *this;
+    }
+    if (buf == 0) buf = new Buffer;
+    csr = 0;
+    buf->nbr.assign(e.nbr, e.nbr + e.sz);
+    buf->weights = e.GetNbrWeights();
+    Modified();
+    return *this;
+}
+
+// copies a row read from a GalCsr into buf, before it is changed
+void GalElement::Own()
 {
-    is_nbrAvgW_empty = true;
+    if (buf) return;
+    Buffer* b = new Buffer;
+    b->nbr.assign(nbr, nbr + sz);
+    b->weights = GetNbrWeights();
+    buf = b;
+    csr = 0;
+    Modified();
+}
+
+// buf changed: the row is searched again when it is first needed
+void GalElement::Modified()
+{
+    sz = (int32_t)buf->nbr.size();
+    nbr = buf->nbr.empty() ? 0 : &buf->nbr[0];
+    nbr_w = buf->weights.empty() ? 0 : &buf->weights[0];
+    w_type = gal_double_weights;
+    buf->lookup.clear();
+    lookup = 0;
+    order = order_unknown;
+}
+
+int GalElement::GetPos(long nbrIdx)
+{
+    if (order == order_unknown) {
+        order = GalRowOrder(nbr, sz);
+        if (order == order_unsorted) {
+            buf->lookup.resize(sz);
+            GalIndexRow(nbr, sz, &buf->lookup[0]);
+            lookup = &buf->lookup[0];
+        }
+    }
+    return GalFindPos(nbr, lookup, sz, order, nbrIdx);
 }
 
 bool GalElement::Check(long nbrIdx)
 {
-    if (nbrLookup.find(nbrIdx) != nbrLookup.end())
-        return true;
-    return false;
+    return GetPos(nbrIdx) >= 0;
 }
 
 // return row standardized weights value
 double GalElement::GetRW(int idx)
 {
-    if (is_nbrAvgW_empty) {
-        size_t sz = nbr.size();
-        nbrAvgW.resize(sz);
-        double sumW = 0.0;
-        
-        for (size_t i=0; i<sz; i++)
-            sumW += nbrWeight[i];
-        
-        for (size_t i=0; i<sz; i++) {
-            nbrAvgW[i] = nbrWeight[i] / sumW;
-        }
-        is_nbrAvgW_empty = false;
-    }
+    int pos = GetPos(idx);
+    if (pos < 0) return 0;
     
-    if (nbrLookup.find(idx) != nbrLookup.end())
-        return nbrAvgW[nbrLookup[idx]];
-    return 0;
+    GalNbrWeights w = GetNbrWeights();
+    double sumW = 0.0;
+    for (int i=0; i<sz; i++) sumW += w[i];
+    return w[pos] / sumW;
 }
 
 void GalElement::SetSizeNbrs(size_t	sz)
 {
-	nbr.resize(sz);
-    nbrWeight.resize(sz);
-    for(size_t i=0; i<sz; i++) {
-        nbrWeight[i] = 1.0;
-    }
+    Own();
+	buf->nbr.resize(sz);
+    buf->weights.assign(sz, 1.0);
+    Modified();
 }
 
 // (which neighbor, what ID)
 void GalElement::SetNbr(size_t pos, long n)
 {
-    if (pos < nbr.size()) {
-        nbr[pos] = n;
-        nbrLookup[n] = pos;
-    }
     // this should be called by GAL created only
-    if (pos < nbrWeight.size()) {
-        nbrWeight[pos] = 1.0;
+    if (pos < (size_t)sz) {
+        Own();
+        buf->nbr[pos] = (int32_t)n;
+        buf->weights[pos] = 1.0;
+        Modified();
     }
 }
 
 // (which neighbor, what ID, what value)
 void GalElement::SetNbr(size_t pos, long n, double w)
 {
-    if (pos < nbr.size()) {
-        nbr[pos] = n;
-        nbrLookup[n] = pos;
+    // this should be called by GWT-GAL
+    Own();
+    if (pos < buf->nbr.size()) {
+        buf->nbr[pos] = (int32_t)n;
+        buf->weights[pos] = w;
     } else {
-        nbr.push_back(n);
-        nbrLookup[n] = pos;
-    }
-    
-    // this should be called by GWT-GAL 
-    if (pos < nbrWeight.size()) {
-        nbrWeight[pos] = w;
-    } else {
-        nbrWeight.push_back(w);
+        buf->nbr.push_back((int32_t)n);
+        buf->weights.push_back(w);
     }
+    Modified();
 }
 
 // for kernel weights (KWT), self-neighbor could be included in weights file
@@ -120,15 +277,12 @@ void GalElement::SetNbr(size_t pos, long n, double w)
 void GalElement::RemoveSelfNeighbor(int idx)
 {
     // check if self-neighbor presents
-    if (Check(idx)) {
-        int pos = nbrLookup[idx];
-        nbr.erase(nbr.begin()+pos);
-        nbrWeight.erase(nbrWeight.begin()+pos);
-        // rebuild lookup dictionary
-        nbrLookup.clear();
-        for (int i=0; i<nbr.size(); ++i) {
-            nbrLookup[nbr[i]] = i;
-        }
+    int pos = GetPos(idx);
+    if (pos >= 0) {
+        Own();
+        buf->nbr.erase(buf->nbr.begin()+pos);
+        buf->weights.erase(buf->weights.begin()+pos);
+        Modified();
     }
 }
 
@@ -136,160 +290,83 @@ void GalElement::RemoveSelfNeighbor(int idx)
 // NOTE: this has to be used with a copy of weights (keep the original weights!)
 void GalElement::Update(const std::vector<bool>& undefs)
 {
-    std::vector<int> undef_obj_positions;
-   
-    for (int i=0; i<nbr.size(); i++) {
-        int obj_id = nbr[i];
-        if (undefs[obj_id]) {
-            int pos = nbrLookup[obj_id];
-            undef_obj_positions.push_back(pos);
-        }
+    bool has_undef = false;
+    for (int i=0; i<sz && !has_undef; i++) {
+        has_undef = undefs[nbr[i]];
     }
-   
-    if (undef_obj_positions.empty())
+    if (!has_undef)
         return;
     
-    // sort the positions in descending order, for removing from std::vector
-	std::sort(undef_obj_positions.begin(),
-              undef_obj_positions.end(), std::greater<int>());
-   
-    for (int i=0; i<undef_obj_positions.size(); i++) {
-        int pos = undef_obj_positions[i];
-        if (pos < nbr.size()) {
-            nbrLookup.erase( nbr[pos] );
-            nbr.erase( nbr.begin() + pos);
-        }
-        if (pos < nbrWeight.size()) {
-            nbrWeight.erase( nbrWeight.begin() + pos);
-        }
+    Own();
+    size_t k = 0;
+    for (size_t i=0; i<buf->nbr.size(); i++) {
+        if (undefs[buf->nbr[i]]) continue;
+        buf->nbr[k] = buf->nbr[i];
+        buf->weights[k] = buf->weights[i];
+        k++;
     }
+    buf->nbr.resize(k);
+    buf->weights.resize(k);
+    Modified();
 }
 
-void GalElement::SetNbrs(const GalElement& gal)
+// bulk version of SetSizeNbrs() + SetNbr()
+void GalElement::SetNbrs(const std::vector<long>& nbrs,
+                         const std::vector<double>& weights)
 {
-    size_t sz = gal.Size();
-    nbr.resize(sz);
-    nbrWeight.resize(sz);
-    
-    nbr = gal.GetNbrs();
-    nbrLookup = gal.nbrLookup;
-    nbrWeight = gal.GetNbrWeights();
-    nbrLookup = gal.nbrLookup;
-    nbrAvgW = gal.nbrAvgW;
+    Own();
+    buf->nbr.assign(nbrs.begin(), nbrs.end());
+    buf->weights = weights;
+    buf->weights.resize(nbrs.size(), 1.0);
+    Modified();
 }
 
-const std::vector<long> & GalElement::GetNbrs() const
+void GalElement::SetNbrs(const GalElement& gal)
 {
-	return nbr;
+    *this = gal;
 }
 
-const std::vector<double> & GalElement::GetNbrWeights() const
+void GalElement::SortNbrs()
 {
-	return nbrWeight;
+    std::vector<std::pair<int32_t, double> > row(sz);
+    GalNbrWeights w = GetNbrWeights();
+    for (int i=0; i<sz; i++) row[i] = std::make_pair(nbr[i], w[i]);
+	std::sort(row.begin(), row.end(),
+              std::greater<std::pair<int32_t, double> >());
+    Own();
+    for (int i=0; i<sz; i++) {
+        buf->nbr[i] = row[i].first;
+        buf->weights[i] = row[i].second;
+    }
+    Modified();
 }
 
-void GalElement::SortNbrs()
+size_t GalElement::GetMemorySize() const
 {
-	std::sort(nbr.begin(), nbr.end(), std::greater<long>());
+    size_t bytes = sizeof(GalElement);
+    if (buf) {
+        bytes += sizeof(Buffer) + sizeof(int32_t) * buf->nbr.capacity() +
+                 sizeof(double) * buf->weights.capacity() +
+                 sizeof(int32_t) * buf->lookup.capacity();
+    }
+    return bytes;
 }
 
 /** Compute spatial lag for a contiguity weights matrix.
  Automatically performs standardization of the result. */
 double GalElement::SpatialLag(const std::vector<double>& x, bool is_binary, int self_id) const
 {
-	double lag = 0;
-	size_t sz = Size();
-
-    if (is_binary) {
-        if (self_id < 0) {
-            for (size_t i=0; i<sz; ++i) {
-                lag += x[nbr[i]];
-            }
-            if (sz>1) lag /= (double) sz;
-        } else {
-            // for case of using kernel weights with diagonal
-            int n_nbrs = 0;
-            for (size_t i=0; i<nbr.size(); ++i) {
-                if (nbr[i] != self_id) {
-                    lag += x[nbr[i]];
-                    n_nbrs += 1;
-                }
-            }
-            if (n_nbrs > 0) lag /= (double) n_nbrs;
-        }
-    } else {
-        double sumW = 0;
-        for (size_t i=0; i<sz; ++i) {
-            sumW += nbrWeight[i];
-        }
-
-        if (sumW == 0)
-            lag = 0;
-        else {
-            for (size_t i=0; i<sz; ++i) {
-                lag += x[nbr[i]] * nbrWeight[i] / sumW;
-            }
-        }
-    }
-	return lag;
+    if (x.empty()) return 0;
+    // the weighted lag keeps the self-neighbor here
+    return GalSpatialLag(nbr, GetNbrWeights(), sz, &x[0], is_binary,
+                         is_binary ? self_id : -1);
 }
 
 /** Compute spatial lag for a contiguity weights matrix.
  Automatically performs standardization of the result. */
 double GalElement::SpatialLag(const double *x, bool is_binary, int self_id) const
 {
-	double lag = 0;
-	size_t sz = Size();
-
-    if (is_binary) {
-        if (self_id < 0) {
-            for (size_t i=0; i<sz; ++i) lag += x[nbr[i]];
-            if (sz>1) lag /= (double) sz;
-        } else {
-            // for case of using kernel weights with diagonal
-            int n_nbrs = 0;
-            for (size_t i=0; i<nbr.size(); ++i) {
-                if (nbr[i] != self_id) {
-                    lag += x[nbr[i]];
-                    n_nbrs += 1;
-                }
-            }
-            if (n_nbrs > 0) lag /= (double) n_nbrs;
-        }
-    } else {
-        double sumW = 0;
-        if (self_id < 0) {
-            for (size_t i=0; i<sz; ++i) {
-                sumW += nbrWeight[i];
-            }
-
-            if (sumW == 0)
-                lag = 0;
-            else {
-                for (size_t i=0; i<sz; ++i) {
-                    lag += x[nbr[i]] * nbrWeight[i] / sumW;
-                }
-            }
-        } else {
-            // for case of using kernel weights with diagonal
-            for (size_t i=0; i<sz; ++i) {
-                if (nbr[i] != self_id) { // exclude self-neighbor
-                    sumW += nbrWeight[i];
-                }
-            }
-
-            if (sumW == 0)
-                lag = 0;
-            else {
-                for (size_t i=0; i<sz; ++i) {
-                    if (nbr[i] != self_id) { // exclude self-neighbor
-                        lag += x[nbr[i]] * nbrWeight[i] / sumW;
-                    }
-                }
-            }
-        }
-    }
-	return lag;
+    return GalSpatialLag(nbr, GetNbrWeights(), sz, x, is_binary, self_id);
 }
 
 double GalElement::SpatialLag(const std::vector<double>& x,
@@ -298,13 +375,12 @@ double GalElement::SpatialLag(const std::vector<double>& x,
     // todo: this should also handle ReadGWtAsGAL like previous 2 functions
 	double lag = 0;
     if (self_id < 0) {
-        size_t sz = Size();
-        for (size_t i=0; i<sz; ++i) lag += x[perm[nbr[i]]];
+        for (int i=0; i<sz; ++i) lag += x[perm[nbr[i]]];
         if (sz>1) lag /= (double) sz;
     } else {
         // for case of using kernel weights with diagonal
         int n_nbrs = 0;
-        for (size_t i=0; i<nbr.size(); ++i) {
+        for (int i=0; i<sz; ++i) {
             if (nbr[i] != self_id) {
                 lag += x[perm[nbr[i]]];
                 n_nbrs += 1;
@@ -315,30 +391,216 @@ double GalElement::SpatialLag(const std::vector<double>& x,
 	return lag;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// GalCsr
+//
+////////////////////////////////////////////////////////////////////////////////
+GalCsr::GalCsr()
+: num_obs(0), offsets(0), ids(0), weights(0), weights_type(gal_unit_weights)
+{
+}
+
+void GalCsr::Init(const GalElement* gal, int num_obs_s)
+{
+    if (gal == 0 || num_obs_s <= 0) {
+        Clear();
+        return;
+    }
+    
+    // the rows may be views of this object: build the arrays aside first
+    std::vector<int64_t> new_offsets(num_obs_s + 1);
+    new_offsets[0] = 0;
+    int type = gal_unit_weights;
+    for (int i=0; i<num_obs_s; i++) {
+        new_offsets[i+1] = new_offsets[i] + gal[i].Size();
+        GalNbrWeights w = gal[i].GetNbrWeights();
+        for (size_t j=0; j<w.size() && type != gal_double_weights; j++) {
+            double v = w[j];
+            if (v != 1.0) type = gal_float_weights;
+            if ((double)(float)v != v) type = gal_double_weights;
+        }
+    }
+    size_t nnz = (size_t)new_offsets[num_obs_s];
+    std::vector<int32_t> new_ids(nnz);
+    std::vector<float> new_float_weights;
+    std::vector<double> new_double_weights;
+    if (type == gal_float_weights) new_float_weights.resize(nnz);
+    if (type == gal_double_weights) new_double_weights.resize(nnz);
+    
+    for (int i=0; i<num_obs_s; i++) {
+        GalNbrs nbrs = gal[i].GetNbrs();
+        GalNbrWeights w = gal[i].GetNbrWeights();
+        int64_t start = new_offsets[i];
+        std::copy(nbrs.begin(), nbrs.end(), new_ids.begin() + start);
+        for (size_t j=0; j<w.size() && type != gal_unit_weights; j++) {
+            if (type == gal_float_weights) {
+                new_float_weights[start + j] = (float)w[j];
+            } else {
+                new_double_weights[start + j] = w[j];
+            }
+        }
+    }
+    Clear();
+    offsets_buf.swap(new_offsets);
+    ids_buf.swap(new_ids);
+    float_weights_buf.swap(new_float_weights);
+    double_weights_buf.swap(new_double_weights);
+    
+    num_obs = num_obs_s;
+    offsets = &offsets_buf[0];
+    ids = ids_buf.empty() ? 0 : &ids_buf[0];
+    weights_type = type;
+    if (type == gal_float_weights) weights = &float_weights_buf[0];
+    if (type == gal_double_weights) weights = &double_weights_buf[0];
+    IndexRows();
+}
+
+void GalCsr::Attach(int num_obs_s, const int64_t* offsets_s,
+                    const int32_t* ids_s, const double* weights_s)
+{
+    Clear();
+    if (num_obs_s <= 0 || offsets_s == 0) return;
+    num_obs = num_obs_s;
+    offsets = offsets_s;
+    ids = ids_s;
+    weights = weights_s;
+    weights_type = weights_s ? gal_double_weights : gal_unit_weights;
+    IndexRows();
+}
+
+// lookup is only filled for the unsorted rows
+void GalCsr::IndexRows()
+{
+    orders.resize(num_obs);
+    bool has_unsorted = false;
+    for (int i=0; i<num_obs; i++) {
+        orders[i] = (int8_t)GalRowOrder(GetNbrs(i), Size(i));
+        if (orders[i] == GalElement::order_unsorted) has_unsorted = true;
+    }
+    if (!has_unsorted) return;
+    lookup.resize((size_t)offsets[num_obs]);
+    for (int i=0; i<num_obs; i++) {
+        if (orders[i] != GalElement::order_unsorted) continue;
+        GalIndexRow(GetNbrs(i), Size(i), &lookup[offsets[i]]);
+    }
+}
+
+void GalCsr::MakeViews(GalElement* gal) const
+{
+    for (int i=0; i<num_obs; i++) {
+        GalElement& e = gal[i];
+        if (e.buf) delete e.buf;
+        e.buf = 0;
+        e.csr = this;
+        e.sz = Size(i);
+        e.nbr = GetNbrs(i);
+        e.w_type = (int8_t)weights_type;
+        e.nbr_w = 0;
+        if (weights_type == gal_float_weights) {
+            e.nbr_w = (const float*)weights + offsets[i];
+        } else if (weights_type == gal_double_weights) {
+            e.nbr_w = (const double*)weights + offsets[i];
+        }
+        e.order = orders[i];
+        e.lookup = 0;
+        if (orders[i] == GalElement::order_unsorted) {
+            e.lookup = &lookup[offsets[i]];
+        }
+    }
+}
+
+void GalCsr::Clear()
+{
+    num_obs = 0;
+    offsets = 0;
+    ids = 0;
+    weights = 0;
+    weights_type = gal_unit_weights;
+    std::vector<int64_t>().swap(offsets_buf);
+    std::vector<int32_t>().swap(ids_buf);
+    std::vector<float>().swap(float_weights_buf);
+    std::vector<double>().swap(double_weights_buf);
+    std::vector<int8_t>().swap(orders);
+    std::vector<int32_t>().swap(lookup);
+}
+
+GalNbrWeights GalCsr::GetNbrWeights(int obs) const
+{
+    const void* w = 0;
+    if (weights_type == gal_float_weights) {
+        w = (const float*)weights + offsets[obs];
+    } else if (weights_type == gal_double_weights) {
+        w = (const double*)weights + offsets[obs];
+    }
+    return GalNbrWeights(w, weights_type, Size(obs));
+}
+
+bool GalCsr::Check(int obs, int nbr_idx) const
+{
+    const int32_t* row_lookup = 0;
+    if (orders[obs] == GalElement::order_unsorted) {
+        row_lookup = &lookup[offsets[obs]];
+    }
+    return GalFindPos(GetNbrs(obs), row_lookup, Size(obs), orders[obs],
+                      nbr_idx) >= 0;
+}
+
+/** Same result as GalElement::SpatialLag(const double*, bool, int) */
+double GalCsr::SpatialLag(int obs, const double* x, bool is_binary,
+                          int self_id) const
+{
+    return GalSpatialLag(GetNbrs(obs), GetNbrWeights(obs), Size(obs), x,
+                         is_binary, self_id);
+}
+
+size_t GalCsr::GetMemorySize() const
+{
+    return sizeof(GalCsr) + sizeof(int64_t) * offsets_buf.capacity() +
+           sizeof(int32_t) * (ids_buf.capacity() + lookup.capacity()) +
+           sizeof(float) * float_weights_buf.capacity() +
+           sizeof(double) * double_weights_buf.capacity() +
+           orders.capacity();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // GalWeight
 //
 ////////////////////////////////////////////////////////////////////////////////
 GalWeight::GalWeight(const GalWeight& gw)
-: GeoDaWeight(gw)
+: GeoDaWeight(gw), gal(0), gwb_file(0)
 {
 	GalWeight::operator=(gw);
 }
 
+GalWeight::~GalWeight()
+{
+    if (gal) delete [] gal;
+    gal = 0;
+    if (gwb_file) delete gwb_file;
+    gwb_file = 0;
+}
+
 GalWeight& GalWeight::operator=(const GalWeight& gw)
 {
+    if (this == &gw) return *this;
 	GeoDaWeight::operator=(gw);
-	gal = new GalElement[num_obs];
-    
-    for (int i=0; i<num_obs; ++i) {
-        gal[i].SetNbrs(gw.gal[i]);
-    }
+    // the rows of the old gal may be views of csr
+    if (gal) delete [] gal;
+	gal = new GalElement[gw.num_obs];
     
     this->num_obs = gw.num_obs;
     this->wflnm = gw.wflnm;
     this->id_field = gw.id_field;
     
+    // the copy has a CSR of its own, not backed by the .gwb file
+    boost::mutex::scoped_lock lock(csr_mutex);
+    csr.Init(gw.gal, gw.num_obs);
+    csr.MakeViews(gal);
+    if (gwb_file) delete gwb_file;
+    gwb_file = 0;
+    
 	return *this;
 }
 
@@ -347,7 +609,57 @@ void GalWeight::Update(const std::vector<bool>& undefs)
     for (int i=0; i<num_obs; ++i) {
         gal[i].Update(undefs);
     }
+    Compact();
+}
 
+bool GalWeight::IsCompact() const
+{
+    if (gal == 0) return true;
+    if (csr.GetNumObs() != num_obs) return false;
+    for (int i=0; i<num_obs; i++) {
+        if (!gal[i].IsViewOf(&csr)) return false;
+    }
+    return true;
+}
+
+// rows that are still views of csr are read before it is rebuilt
+void GalWeight::CompactRows()
+{
+    if (IsCompact()) return;
+    csr.Init(gal, num_obs);
+    csr.MakeViews(gal);
+    if (gwb_file) delete gwb_file;
+    gwb_file = 0;
+}
+
+const GalCsr& GalWeight::GetCsr()
+{
+    boost::mutex::scoped_lock lock(csr_mutex);
+    CompactRows();
+    return csr;
+}
+
+void GalWeight::Compact()
+{
+    boost::mutex::scoped_lock lock(csr_mutex);
+    CompactRows();
+}
+
+void GalWeight::SetGwbFile(GwbFile* gwb)
+{
+    boost::mutex::scoped_lock lock(csr_mutex);
+    if (gwb == gwb_file) return;
+    if (gwb && gal && gwb->GetNumObs() == num_obs) {
+        csr.Attach(gwb->GetNumObs(), gwb->GetOffsets(), gwb->GetNbrs(),
+                   gwb->GetWeights());
+        csr.MakeViews(gal);
+    } else {
+        // keep the rows, in a CSR of their own
+        csr.Init(gal, num_obs);
+        if (gal) csr.MakeViews(gal);
+    }
+    if (gwb_file) delete gwb_file;
+    gwb_file = gwb;
 }
 
 bool GalWeight::HasIsolates(GalElement *gal, int num_obs)
@@ -381,7 +693,7 @@ void GalWeight::GetNbrStats()
     
     for (int i=0; i<num_obs; i++) {
         int n_nbrs = 0;
-        const std::vector<long>& nbrs = gal[i].GetNbrs();
+        GalNbrs nbrs = gal[i].GetNbrs();
         for (int j=0; j<nbrs.size();j++) {
             int nbr = nbrs[j];
             if (i != nbr) {
@@ -22,24 +22,100 @@
 
 #include <vector>
 #include <map>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
 #include "GeodaWeight.h"
 
+class GwbFile;
 class Project;
 class WeightsManInterface;
 class TableInterface;
 
+/** How the weights of a GalElement row or a GalCsr are stored */
+enum GalWeightsType {
+    gal_unit_weights = 0, // all 1.0, nothing stored
+    gal_float_weights,    // every weight is exactly a float
+    gal_double_weights
+};
+
+/** Neighbor ids of a GalElement, read in place */
+class GalNbrs {
+public:
+    typedef const int32_t* iterator;
+    typedef const int32_t* const_iterator;
+    
+    GalNbrs(const int32_t* ids_s, size_t sz_s) : ids(ids_s), sz(sz_s) {}
+    size_t size() const { return sz; }
+    bool empty() const { return sz == 0; }
+    long operator[](size_t n) const { return ids[n]; }
+    const_iterator begin() const { return ids; }
+    const_iterator end() const { return ids + sz; }
+    operator std::vector<long>() const {
+        return std::vector<long>(ids, ids + sz);
+    }
+    
+private:
+    const int32_t* ids;
+    size_t sz;
+};
+
+/** Weights of a GalElement, read in place */
+class GalNbrWeights {
+public:
+    GalNbrWeights(const void* w_s, int type_s, size_t sz_s)
+    : w(w_s), type(type_s), sz(sz_s) {}
+    size_t size() const { return sz; }
+    double operator[](size_t n) const {
+        if (type == gal_float_weights) return ((const float*)w)[n];
+        if (type == gal_double_weights) return ((const double*)w)[n];
+        return 1.0;
+    }
+    operator std::vector<double>() const {
+        std::vector<double> v(sz);
+        for (size_t i=0; i<sz; i++) v[i] = (*this)[i];
+        return v;
+    }
+    
+private:
+    const void* w;
+    int type;
+    size_t sz;
+};
+
+class GalCsr;
+
+/**
+ Neighbors of one observation. A new GalElement holds its own row, filled
+ with SetSizeNbrs() and SetNbr() or SetNbrs(). Once a GalWeight compacts its
+ rows (GalWeight::GetCsr()), every GalElement of it is a view of its row in
+ the GalCsr and holds no memory of its own; changing a viewed row (SetNbr(),
+ Update(), ...) copies that row back into the GalElement first.
+ 
+ Check(), GetRW() and RemoveSelfNeighbor() search the row by binary search:
+ in place if the row is in ascending or descending order, which is how the
+ weights of GeoDa are written, and otherwise through an index of the row
+ positions sorted by id. An id listed twice is found at its last position.
+ main_gal_weight_bench() in GalWeight_bench.cpp compares the memory and the
+ lag throughput of both forms.
+ */
 class GalElement {
 public:
 	GalElement();
+	GalElement(const GalElement& e);
+	GalElement& operator=(const GalElement& e);
+	~GalElement();
 	void SetSizeNbrs(size_t sz);
 	void SetNbr(size_t pos, long n);
 	void SetNbr(size_t pos, long n, double w);
-	//void SetNbrs(const std::vector<long>& nbrs);
+	void SetNbrs(const std::vector<long>& nbrs,
+                 const std::vector<double>& weights);
 	void SetNbrs(const GalElement& gal);
-	const std::vector<long>& GetNbrs() const;
-	const std::vector<double>& GetNbrWeights() const;
+	GalNbrs GetNbrs() const { return GalNbrs(nbr, sz); }
+	GalNbrWeights GetNbrWeights() const {
+        return GalNbrWeights(nbr_w, w_type, sz);
+    }
 	void SortNbrs();
-	long Size() const { return nbr.size(); }
+	long Size() const { return sz; }
 	long operator[](size_t n) const { return nbr[n]; }
 	double SpatialLag(const std::vector<double>& x, bool is_binary=true, int self_id=-1) const;
 	double SpatialLag(const double* x, bool is_binary=true, int self_id=-1) const;
@@ -47,27 +123,103 @@ public:
     double GetRW(int idx);
     bool   Check(long nbrIdx);
     void RemoveSelfNeighbor(int idx);
-   
-    bool is_nbrAvgW_empty;
-    std::vector<double> nbrAvgW;
-    std::map<long, int> nbrLookup; // nbr_id, idx_in_nbrWeight
     
     void Update(const std::vector<bool>& undefs);
     
+    /** true if the row is read from csr */
+    bool IsViewOf(const GalCsr* c) const { return buf == 0 && csr == c; }
+    /** Bytes used by this element, including its own row */
+    size_t GetMemorySize() const;
+    
+    enum RowOrder {
+        order_unknown = 0, order_ascending, order_descending, order_unsorted
+    };
+    
 private:
-	std::vector<long> nbr;
-	std::vector<double> nbrWeight;
+    friend class GalCsr;
+    struct Buffer;
+    
+    void Own();
+    void Modified();
+    int GetPos(long nbrIdx);
+    
+    const int32_t* nbr;
+    const void* nbr_w;     // see w_type; NULL for unit weights
+    const int32_t* lookup; // for an unsorted row, positions sorted by id
+    const GalCsr* csr;     // the GalCsr the row is read from
+    Buffer* buf;           // own row, or NULL for a view
+    int32_t sz;
+    int8_t w_type;
+    int8_t order;
+};
+
+/**
+ Compressed sparse row (CSR) storage of a GalElement array. The neighbors of
+ observation i are ids[offsets[i]] .. ids[offsets[i+1]-1] in their original
+ order, so SpatialLag() sums in the same order as GalElement::SpatialLag().
+ The arrays are either built by Init() and owned by this object, or are
+ those of a memory-mapped .gwb file (Attach()). The weights are left out if
+ they are all 1.0 and are stored as float if that holds them exactly.
+ lookup is only kept for the rows that are in neither ascending nor
+ descending order.
+ */
+class GalCsr {
+public:
+    GalCsr();
+    
+    /** Copies the rows of gal, which may be views of this object */
+    void Init(const GalElement* gal, int num_obs);
+    /** Uses CSR arrays kept elsewhere, without copying them; they have to
+     outlive this object. weights can be NULL for binary weights. */
+    void Attach(int num_obs, const int64_t* offsets, const int32_t* ids,
+                const double* weights);
+    /** Turns the num_obs elements of gal into views of their rows here and
+     frees the rows they held */
+    void MakeViews(GalElement* gal) const;
+    void Clear();
+    bool IsEmpty() const { return num_obs == 0; }
+    
+    int GetNumObs() const { return num_obs; }
+    int Size(int obs) const { return (int)(offsets[obs+1] - offsets[obs]); }
+    const int32_t* GetNbrs(int obs) const { return ids + offsets[obs]; }
+    GalNbrWeights GetNbrWeights(int obs) const;
+    bool Check(int obs, int nbr_idx) const;
+    double SpatialLag(int obs, const double* x, bool is_binary=true,
+                      int self_id=-1) const;
+    
+    /** Bytes of the arrays owned by this object */
+    size_t GetMemorySize() const;
+    
+protected:
+    void IndexRows();
+    
+    int num_obs;
+    const int64_t* offsets;
+    const int32_t* ids;
+    const void* weights;
+    int weights_type;
+    
+    std::vector<int64_t> offsets_buf;
+    std::vector<int32_t> ids_buf;
+    std::vector<float> float_weights_buf;
+    std::vector<double> double_weights_buf;
+    std::vector<int8_t> orders;   // GalElement::RowOrder of every row
+    std::vector<int32_t> lookup;  // nnz entries if a row is unsorted
+    
+private:
+    GalCsr(const GalCsr&);
+    GalCsr& operator=(const GalCsr&);
 };
 
 class GalWeight : public GeoDaWeight {
 public:
 	GalElement* gal;
     
-	GalWeight() : gal(0) { weight_type = gal_type; }
+	GalWeight() : gal(0), gwb_file(0) { weight_type = gal_type; }
     
 	GalWeight(const GalWeight& gw);
     
-	virtual ~GalWeight() { if (gal) delete [] gal; gal = 0; }
+	virtual ~GalWeight();
     
 	static bool HasIsolates(GalElement *gal, int num_obs);
     
@@ -91,7 +243,26 @@ public:
 
     virtual const std::vector<long> GetNeighbors(int obs_idx) const;
     
-    virtual void GetNbrStats();    
+    virtual void GetNbrStats();
+    
+    /** The CSR storage of gal, for the permutation workers. The rows of
+     gal are compacted into it on the first call and again after any of
+     them changed; it is done under a lock, so call it before the threads
+     start. */
+    const GalCsr& GetCsr();
+    /** Compacts the rows of gal into the CSR storage, see GetCsr() */
+    void Compact();
+    /** Makes gwb, the mapped .gwb file holding the rows of gal in the same
+     order, the storage of gal; the GalWeight deletes it */
+    void SetGwbFile(GwbFile* gwb);
+    
+protected:
+    bool IsCompact() const;
+    void CompactRows();
+    
+    GalCsr csr;
+    GwbFile* gwb_file;
+    boost::mutex csr_mutex;
 };
 
 namespace Gda {
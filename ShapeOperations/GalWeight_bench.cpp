@@ -0,0 +1,136 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ Benchmark of the GalWeight storage: memory and spatial lag throughput of
+ queen contiguity weights of a rows x cols grid, once with every GalElement
+ holding its own row (as built by the weights creation code) and once after
+ GalWeight::Compact() turned them into views of the CSR storage. The lags
+ of both layouts must be identical; main_gal_weight_bench() returns 1 if
+ they are not. Build with -DGEODA_GAL_WEIGHT_BENCH_MAIN to get a main() for
+ it; the arguments are the number of rows and columns (default 1000 1000)
+ and the number of passes over all observations (default 20).
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+#include "GalWeight.h"
+
+namespace {
+
+void make_queen_grid(GalElement* gal, int rows, int cols)
+{
+    std::vector<long> nbrs;
+    std::vector<double> w;
+    for (int r=0; r<rows; r++) {
+        for (int c=0; c<cols; c++) {
+            nbrs.clear();
+            // descending order, as GeoDa writes contiguity weights
+            for (int dr=1; dr>=-1; dr--) {
+                for (int dc=1; dc>=-1; dc--) {
+                    int rr = r + dr, cc = c + dc;
+                    if ((dr == 0 && dc == 0) || rr < 0 || rr >= rows ||
+                        cc < 0 || cc >= cols) continue;
+                    nbrs.push_back(rr * cols + cc);
+                }
+            }
+            w.assign(nbrs.size(), 1.0);
+            gal[r * cols + c].SetNbrs(nbrs, w);
+        }
+    }
+}
+
+size_t memory_size(const GalWeight& w)
+{
+    size_t bytes = 0;
+    for (int i=0; i<w.num_obs; i++) bytes += w.gal[i].GetMemorySize();
+    return bytes;
+}
+
+/** seconds for passes of SpatialLag() over all observations */
+double time_lags(const GalWeight& w, const std::vector<double>& x,
+                 int passes, std::vector<double>& lag)
+{
+    lag.resize(w.num_obs);
+    clock_t start = clock();
+    for (int p=0; p<passes; p++) {
+        for (int i=0; i<w.num_obs; i++) {
+            lag[i] = w.gal[i].SpatialLag(&x[0], true, i);
+        }
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+}
+
+int main_gal_weight_bench(int argc, char** argv)
+{
+    int rows = argc > 1 ? atoi(argv[1]) : 1000;
+    int cols = argc > 2 ? atoi(argv[2]) : 1000;
+    int passes = argc > 3 ? atoi(argv[3]) : 20;
+    int n = rows * cols;
+    if (n <= 0 || passes <= 0) return 1;
+
+    std::vector<double> x(n);
+    for (int i=0; i<n; i++) x[i] = (double)((i * 7919) % 1009);
+
+    GalWeight w;
+    w.num_obs = n;
+    w.gal = new GalElement[n];
+    clock_t start = clock();
+    make_queen_grid(w.gal, rows, cols);
+    double build_sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+    size_t own_bytes = memory_size(w);
+    std::vector<double> own_lag;
+    double own_sec = time_lags(w, x, passes, own_lag);
+
+    start = clock();
+    w.Compact();
+    double compact_sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+    size_t csr_bytes = memory_size(w) + w.GetCsr().GetMemorySize();
+    std::vector<double> csr_lag;
+    double csr_sec = time_lags(w, x, passes, csr_lag);
+
+    long edges = 0;
+    for (int i=0; i<n; i++) edges += w.gal[i].Size();
+    printf("queen weights of a %d x %d grid: %d observations, %ld edges\n",
+           rows, cols, n, edges);
+    printf("own rows:  %10.1f MB, built in %.3f s, %d lag passes in %.3f s\n",
+           own_bytes / 1048576.0, build_sec, passes, own_sec);
+    printf("CSR views: %10.1f MB, compacted in %.3f s, %d lag passes in %.3f s\n",
+           csr_bytes / 1048576.0, compact_sec, passes, csr_sec);
+
+    for (int i=0; i<n; i++) {
+        if (own_lag[i] != csr_lag[i]) {
+            printf("FAILED: lag of observation %d differs\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#ifdef GEODA_GAL_WEIGHT_BENCH_MAIN
+int main(int argc, char** argv)
+{
+    return main_gal_weight_bench(argc, argv);
+}
+#endif
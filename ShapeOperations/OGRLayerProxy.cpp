@@ -24,17 +24,19 @@
 #include <climits>
 #include <boost/thread.hpp>
 #include <boost/date_time.hpp>
-#include <boost/unordered_map.hpp>
+#include <wx/stopwatch.h>
 #include "../ShpFile.h"
 #include "../GdaException.h"
 #include "../logger.h"
 #include "../GeneralWxUtils.h"
 #include "../GdaShape.h"
 #include "../GdaCartoDB.h"
+#include "../GenUtils.h"
 #include "../GdaException.h"
 
 #include "OGRLayerProxy.h"
 #include "OGRFieldProxy.h"
+#include "PolygonDissolve.h"
 
 using namespace boost;
 namespace bt = boost::posix_time;
@@ -960,15 +962,31 @@ bool OGRLayerProxy::ReadData()
         // SDE engine. we will count it feature by feature
         n_rows = -1;
     }
+    size_t peak_mem = GenUtils::GetPeakMemoryUsage();
+    wxStopWatch sw;
+    // OGR hands over the ownership of every feature from GetNextFeature(),
+    // so the features are kept as they are read
+    if (n_rows > 0) data.reserve(n_rows);
 	int row_idx = 0;
+    // rows after the last non-empty one are dropped at the end: empty rows
+    // at the end of table often occur in a csv file, see issue#563
+    int n_valid_rows = 0;
 	OGRFeature *feature = NULL;
-    boost::unordered_map<int, OGRFeature*> feature_dict;
     layer->ResetReading();
 	while ((feature = layer->GetNextFeature()) != NULL) {
         // thread feature: user can stop reading
-		if (stop_reading) break;
-        feature_dict[row_idx] = feature;
-		load_progress = row_idx++;
+		if (stop_reading) {
+            OGRFeature::DestroyFeature(feature);
+            break;
+        }
+        data.push_back(feature);
+        bool is_empty = feature->GetGeometryRef() == NULL;
+        for (int j=0; is_empty && j<n_cols; j++) {
+            if (feature->IsFieldSet(j)) is_empty = false;
+        }
+        row_idx++;
+        if (!is_empty) n_valid_rows = row_idx;
+		load_progress = row_idx;
 	}
     if (row_idx == 0) {
         error_message << _("GeoDa can't read data from datasource. \n\nDetails: Datasource is empty.");
@@ -978,44 +996,23 @@ bool OGRLayerProxy::ReadData()
     if (stop_reading) {
         error_message << "Reading data was interrupted.";
         // clean just read OGRFeatures
-        for (int i = 0; i < row_idx; i++) {
-            OGRFeature::DestroyFeature(feature_dict[i]);
+        for (size_t i = 0; i < data.size(); i++) {
+            OGRFeature::DestroyFeature(data[i]);
         }
+        data.clear();
         return false;
     }
-	n_rows = row_idx;
-    // check empty rows at the end of table -- this often occurs in a csv file
-    // , then remove empty rows see issue#563
-    for (int i = n_rows-1; i >= 0; --i) {
-        OGRFeature* my_feature = feature_dict[i];
-        bool is_empty = true;
-        for (int j= 0; j<n_cols; j++) {
-            if (my_feature->IsFieldSet(j)) {
-                is_empty = false;
-                break;
-            }
-        }
-        if (is_empty) {
-            OGRGeometry* my_geom = my_feature->GetGeometryRef();
-            if (my_geom == NULL) {
-                n_rows -= 1;
-            }
-        } else {
-            // visit starts from the bottom of the table, so interupt if
-            // non-empty row is detected
-            break;
-        }
-    }
-    // create copies of OGRFeatures* from OGR,
-    // and manage the copies in this class
-    for (int i = 0; i < n_rows; i++) {
-        OGRFeature* my_feature = feature_dict[i]->Clone();
-        data.push_back(my_feature);
-        OGRFeature::DestroyFeature(feature_dict[i]);
+    for (size_t i = n_valid_rows; i < data.size(); i++) {
+        OGRFeature::DestroyFeature(data[i]);
     }
+    data.resize(n_valid_rows);
+	n_rows = n_valid_rows;
     // Set load_progress 100% to continue
     load_progress = row_idx;
-    feature_dict.clear();
+    wxLogMessage("OGRLayerProxy::ReadData() %d rows in %ld ms, peak memory "
+                 "%lu MB before, %lu MB after", n_rows, sw.Time(),
+                 (unsigned long)(peak_mem >> 20),
+                 (unsigned long)(GenUtils::GetPeakMemoryUsage() >> 20));
 	return true;
 }
 
@@ -1242,23 +1239,15 @@ OGRGeometry* OGRLayerProxy::GetGeometry(int idx)
 
 GdaPolygon* OGRLayerProxy::DissolvePolygons(std::vector<OGRGeometry*>& geoms)
 {
-    OGRMultiPolygon geocol;
-    for (size_t i=0; i < geoms.size(); i++ ) {
-        OGRGeometry* geometry= geoms[i];
-        OGRwkbGeometryType etype = wkbFlatten(geometry->getGeometryType());
-        if (IsWkbSinglePolygon(etype)) {
-            geocol.addGeometry(geometry);
-        } else if (IsWkbMultiPolygon(etype)) {
-            OGRMultiPolygon* mpolygon = (OGRMultiPolygon *) geometry;
-            for (size_t j = 0; j < mpolygon->getNumGeometries(); j++ ){
-                OGRGeometry* ogrGeom = mpolygon->getGeometryRef(j);
-                geocol.addGeometry(ogrGeom);
-            }
-        }
-    }
-    OGRGeometry* ogr_contour = geocol.UnionCascaded();
+    std::vector<std::vector<OGRGeometry*> > groups(1, geoms);
+    std::vector<OGRGeometry*> contours;
+    PolygonDissolve dissolve(groups);
+    dissolve.Run(contours);
+    OGRGeometry* ogr_contour = contours[0];
     if (ogr_contour) {
-        return OGRGeomToGdaShape(ogr_contour);
+        GdaPolygon* poly = OGRGeomToGdaShape(ogr_contour);
+        delete ogr_contour;
+        return poly;
     }
     return NULL;
 }
@@ -1266,26 +1255,16 @@ GdaPolygon* OGRLayerProxy::DissolvePolygons(std::vector<OGRGeometry*>& geoms)
 GdaPolygon* OGRLayerProxy::GetMapBoundary()
 {
     if (mapContour == NULL) {
-        OGRMultiPolygon geocol;
+        std::vector<std::vector<OGRGeometry*> > groups(1);
         for (size_t row_idx=0; row_idx < n_rows; row_idx++ ) {
             OGRFeature* feature = data[row_idx];
             OGRGeometry* geometry= feature->GetGeometryRef();
-            OGRwkbGeometryType etype = wkbFlatten(geometry->getGeometryType());
-            if (IsWkbSinglePolygon(etype)) {
-                geocol.addGeometry(geometry);
-                
-            } else if (IsWkbMultiPolygon(etype)) {
-                OGRMultiPolygon* mpolygon = (OGRMultiPolygon *) geometry;
-                int n_geom = mpolygon->getNumGeometries();
-                // if there is more than one polygon, then we need to count 
-                // which part is processing accumulatively
-                for (size_t i = 0; i < n_geom; i++ ){
-                    OGRGeometry* ogrGeom = mpolygon->getGeometryRef(i);
-                    geocol.addGeometry(ogrGeom);
-                }
-            }
+            if (geometry) groups[0].push_back(geometry);
         }
-        mapContour = geocol.UnionCascaded();
+        std::vector<OGRGeometry*> contours;
+        PolygonDissolve dissolve(groups);
+        dissolve.Run(contours);
+        mapContour = contours[0];
     }
     
     if (mapContour) {
@@ -1302,6 +1281,9 @@ std::vector<GdaShape*> OGRLayerProxy::DissolveMap(const std::map<wxString, std::
 
     if (IsWkbPoint(eGType) || IsWkbLine(eGType)) return results;
 
+    // the groups are dissolved together, so that small groups run
+    // alongside the tiles of the large ones
+    std::vector<std::vector<OGRGeometry*> > groups;
     std::map<wxString, std::vector<int> >::const_iterator it;
     for (it = cids.begin(); it != cids.end(); ++it) {
         std::vector<OGRGeometry*> geom_set;
@@ -1309,9 +1291,19 @@ std::vector<GdaShape*> OGRLayerProxy::DissolveMap(const std::map<wxString, std::
             int rid = it->second[j];
             OGRFeature* feature = data[rid];
             OGRGeometry* geometry= feature->GetGeometryRef();
-            geom_set.push_back(geometry);
+            if (geometry) geom_set.push_back(geometry);
+        }
+        groups.push_back(geom_set);
+    }
+    std::vector<OGRGeometry*> contours;
+    PolygonDissolve dissolve(groups);
+    dissolve.Run(contours);
+    for (size_t i=0; i<contours.size(); i++) {
+        GdaPolygon* new_poly = NULL;
+        if (contours[i]) {
+            new_poly = OGRGeomToGdaShape(contours[i]);
+            delete contours[i];
         }
-        GdaPolygon* new_poly = DissolvePolygons(geom_set);
         results.push_back((GdaShape*)new_poly);
     }
     return results;
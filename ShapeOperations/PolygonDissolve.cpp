@@ -0,0 +1,556 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#define BOOST_PHOENIX_STL_TUPLE_H_
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <wx/stopwatch.h>
+#include <wx/string.h>
+
+#include "../GdaConst.h"
+#include "../logger.h"
+#include "PolygonDissolve.h"
+
+/** A ring edge; a is the smaller end point, forward if the ring goes
+ from a to b */
+struct DissolveEdge {
+    double ax, ay, bx, by;
+    bool forward;
+};
+
+static bool DissolveEdgeLess(const DissolveEdge& e1, const DissolveEdge& e2)
+{
+    if (e1.ax != e2.ax) return e1.ax < e2.ax;
+    if (e1.ay != e2.ay) return e1.ay < e2.ay;
+    if (e1.bx != e2.bx) return e1.bx < e2.bx;
+    return e1.by < e2.by;
+}
+
+static bool DissolveEdgeSame(const DissolveEdge& e1, const DissolveEdge& e2)
+{
+    return e1.ax == e2.ax && e1.ay == e2.ay && e1.bx == e2.bx && e1.by == e2.by;
+}
+
+/** A directed edge that is left after the shared edges are removed */
+struct DissolveArc {
+    double sx, sy, ex, ey;
+};
+
+static bool DissolveArcLess(const DissolveArc& a1, const DissolveArc& a2)
+{
+    if (a1.sx != a2.sx) return a1.sx < a2.sx;
+    return a1.sy < a2.sy;
+}
+
+static void AddRingEdges(const OGRLinearRing* ring, std::vector<DissolveEdge>& edges)
+{
+    if (ring == NULL) return;
+    int n = ring->getNumPoints();
+    if (n < 2) return;
+    DissolveEdge e;
+    for (int i=0; i<n; i++) {
+        // the ring is closed by its last point, or else by an extra edge
+        int j = i+1 < n ? i+1 : 0;
+        if (j == 0 && ring->getX(0) == ring->getX(n-1) &&
+            ring->getY(0) == ring->getY(n-1)) {
+            break;
+        }
+        double x1 = ring->getX(i), y1 = ring->getY(i);
+        double x2 = ring->getX(j), y2 = ring->getY(j);
+        if (x1 == x2 && y1 == y2) continue;
+        e.forward = x1 < x2 || (x1 == x2 && y1 < y2);
+        if (e.forward) {
+            e.ax = x1; e.ay = y1; e.bx = x2; e.by = y2;
+        } else {
+            e.ax = x2; e.ay = y2; e.bx = x1; e.by = y1;
+        }
+        edges.push_back(e);
+    }
+}
+
+/** orient is the orientation of the exterior rings seen so far (0 before
+ the first one, 1 clockwise, -1 counterclockwise); false if a ring does not
+ follow it */
+static bool AddPolygonEdges(const OGRGeometry* geom, std::vector<DissolveEdge>& edges,
+                            int& orient)
+{
+    if (geom == NULL) return true;
+    OGRwkbGeometryType etype = wkbFlatten(geom->getGeometryType());
+    if (etype == wkbPolygon) {
+        const OGRPolygon* p = (const OGRPolygon*) geom;
+        const OGRLinearRing* ext = p->getExteriorRing();
+        if (ext == NULL) return true;
+        int o = ext->isClockwise() ? 1 : -1;
+        if (orient == 0) orient = o;
+        if (o != orient) return false;
+        AddRingEdges(ext, edges);
+        for (int i=0; i<p->getNumInteriorRings(); i++) {
+            const OGRLinearRing* hole = p->getInteriorRing(i);
+            if (hole == NULL) continue;
+            if ((hole->isClockwise() ? 1 : -1) == orient) return false;
+            AddRingEdges(hole, edges);
+        }
+        return true;
+    } else if (etype == wkbMultiPolygon) {
+        const OGRMultiPolygon* mp = (const OGRMultiPolygon*) geom;
+        for (int i=0; i<mp->getNumGeometries(); i++) {
+            if (!AddPolygonEdges(mp->getGeometryRef(i), edges, orient)) return false;
+        }
+        return true;
+    }
+    // curves etc.
+    return false;
+}
+
+/** True if segments p1-p2 and q1-q2 have any point in common */
+static bool DissolveSegmentsMeet(const OGRRawPoint& p1, const OGRRawPoint& p2,
+                                 const OGRRawPoint& q1, const OGRRawPoint& q2)
+{
+    if (std::max(p1.x, p2.x) < std::min(q1.x, q2.x) ||
+        std::max(q1.x, q2.x) < std::min(p1.x, p2.x) ||
+        std::max(p1.y, p2.y) < std::min(q1.y, q2.y) ||
+        std::max(q1.y, q2.y) < std::min(p1.y, p2.y)) {
+        return false;
+    }
+    double d1 = (q2.x-q1.x)*(p1.y-q1.y) - (q2.y-q1.y)*(p1.x-q1.x);
+    double d2 = (q2.x-q1.x)*(p2.y-q1.y) - (q2.y-q1.y)*(p2.x-q1.x);
+    double d3 = (p2.x-p1.x)*(q1.y-p1.y) - (p2.y-p1.y)*(q1.x-p1.x);
+    double d4 = (p2.x-p1.x)*(q2.y-p1.y) - (p2.y-p1.y)*(q2.x-p1.x);
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+        ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
+        return true;
+    }
+    // touching or collinear: the bounding boxes overlap, so an end point on
+    // the line of the other segment lies on it
+    return d1 == 0 || d2 == 0 || d3 == 0 || d4 == 0;
+}
+
+/** A segment of a ring, in the cells of DissolveRingsValid() */
+struct DissolveSeg {
+    int ring, k;
+};
+
+/**
+ The rings left by DissolveSharedEdges() are the boundary of the union only
+ if the polygons did not overlap.  This holds when no two rings meet (their
+ segments don't cross or touch, except consecutive ones) and each ring is
+ nested in as many others as its orientation says: an exterior ring (of
+ orientation orient) in an even number, a hole in an odd number.  Polygons
+ with crossing edges leave crossing rings, and a polygon inside another
+ without a matching hole leaves an exterior ring at an odd depth.
+ 
+ The segments are put in a grid of about one cell per segment, so that
+ only those in the same cell are compared, and the depth of a ring is the
+ number of rings that a ray from its first point crosses an odd number of
+ times.
+ */
+static bool DissolveRingsValid(const std::vector<std::vector<OGRRawPoint> >& rings,
+                               int orient)
+{
+    size_t n_segs = 0;
+    double min_x = DBL_MAX, min_y = DBL_MAX, max_x = -DBL_MAX, max_y = -DBL_MAX;
+    for (size_t r=0; r<rings.size(); r++) {
+        n_segs += rings[r].size() - 1;
+        for (size_t k=0; k<rings[r].size(); k++) {
+            min_x = std::min(min_x, rings[r][k].x);
+            max_x = std::max(max_x, rings[r][k].x);
+            min_y = std::min(min_y, rings[r][k].y);
+            max_y = std::max(max_y, rings[r][k].y);
+        }
+    }
+    int dim = (int) sqrt((double) n_segs);
+    if (dim < 1) dim = 1;
+    if (dim > 4096) dim = 4096;
+    double cw = (max_x - min_x) / dim;
+    double ch = (max_y - min_y) / dim;
+    if (cw <= 0) cw = 1;
+    if (ch <= 0) ch = 1;
+    
+    std::vector<std::vector<DissolveSeg> > cells(dim * dim);
+    DissolveSeg seg;
+    for (size_t r=0; r<rings.size(); r++) {
+        seg.ring = (int) r;
+        for (size_t k=0; k+1<rings[r].size(); k++) {
+            seg.k = (int) k;
+            const OGRRawPoint& a = rings[r][k];
+            const OGRRawPoint& b = rings[r][k+1];
+            int c0 = std::min(dim-1, (int)((std::min(a.x, b.x) - min_x) / cw));
+            int c1 = std::min(dim-1, (int)((std::max(a.x, b.x) - min_x) / cw));
+            int r0 = std::min(dim-1, (int)((std::min(a.y, b.y) - min_y) / ch));
+            int r1 = std::min(dim-1, (int)((std::max(a.y, b.y) - min_y) / ch));
+            for (int row=r0; row<=r1; row++) {
+                for (int col=c0; col<=c1; col++) {
+                    cells[row*dim + col].push_back(seg);
+                }
+            }
+        }
+    }
+    
+    // no two rings meet, and no ring meets itself
+    for (size_t c=0; c<cells.size(); c++) {
+        const std::vector<DissolveSeg>& cell = cells[c];
+        for (size_t i=0; i<cell.size(); i++) {
+            const std::vector<OGRRawPoint>& ri = rings[cell[i].ring];
+            int ki = cell[i].k;
+            int mi = (int) ri.size() - 1;
+            for (size_t j=i+1; j<cell.size(); j++) {
+                int kj = cell[j].k;
+                if (cell[i].ring == cell[j].ring &&
+                    (kj == ki || kj == (ki+1) % mi || ki == (kj+1) % mi)) {
+                    continue;
+                }
+                const std::vector<OGRRawPoint>& rj = rings[cell[j].ring];
+                if (DissolveSegmentsMeet(ri[ki], ri[ki+1], rj[kj], rj[kj+1])) {
+                    return false;
+                }
+            }
+        }
+    }
+    
+    // nesting depth against orientation
+    std::vector<int> crossings(rings.size(), 0);
+    std::vector<int> touched;
+    for (size_t r=0; r<rings.size(); r++) {
+        const OGRRawPoint& p = rings[r][0];
+        int row = std::min(dim-1, (int)((p.y - min_y) / ch));
+        int col0 = std::min(dim-1, (int)((p.x - min_x) / cw));
+        for (int col=col0; col<dim; col++) {
+            const std::vector<DissolveSeg>& cell = cells[row*dim + col];
+            for (size_t i=0; i<cell.size(); i++) {
+                if (cell[i].ring == (int) r) continue;
+                const OGRRawPoint& a = rings[cell[i].ring][cell[i].k];
+                const OGRRawPoint& b = rings[cell[i].ring][cell[i].k+1];
+                if ((a.y > p.y) == (b.y > p.y)) continue;
+                double x = a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y);
+                if (x <= p.x) continue;
+                // count a segment in the cell of the crossing only
+                int c = std::min(dim-1, (int)((x - min_x) / cw));
+                if (c != col && !(c < col0 && col == col0)) continue;
+                if (crossings[cell[i].ring] == 0) touched.push_back(cell[i].ring);
+                crossings[cell[i].ring] += 1;
+            }
+        }
+        int depth = 0;
+        for (size_t i=0; i<touched.size(); i++) {
+            depth += crossings[touched[i]] % 2;
+            crossings[touched[i]] = 0;
+        }
+        touched.clear();
+        
+        double area2 = 0; // twice the signed area, > 0 counterclockwise
+        const std::vector<OGRRawPoint>& ring = rings[r];
+        for (size_t k=0; k+1<ring.size(); k++) {
+            area2 += ring[k].x * ring[k+1].y - ring[k+1].x * ring[k].y;
+        }
+        int o = area2 < 0 ? 1 : -1;
+        if ((o == orient) != (depth % 2 == 0)) return false;
+    }
+    return true;
+}
+
+static void AddPolygons(const OGRGeometry* geom, OGRMultiPolygon& geocol)
+{
+    if (geom == NULL) return;
+    OGRwkbGeometryType etype = wkbFlatten(geom->getGeometryType());
+    if (etype == wkbPolygon || etype == wkbCurvePolygon) {
+        geocol.addGeometry(geom);
+    } else if (etype == wkbMultiPolygon || etype == wkbGeometryCollection) {
+        const OGRGeometryCollection* gc = (const OGRGeometryCollection*) geom;
+        for (int i=0; i<gc->getNumGeometries(); i++) {
+            AddPolygons(gc->getGeometryRef(i), geocol);
+        }
+    }
+}
+
+PolygonDissolve::PolygonDissolve(const std::vector<std::vector<OGRGeometry*> >& _groups)
+: groups(_groups), next_job(0), n_threads(1)
+{
+    n_threads = GdaConst::gda_cpu_cores;
+    if (!GdaConst::gda_set_cpu_cores) {
+        n_threads = boost::thread::hardware_concurrency();
+    }
+    if (n_threads < 1) n_threads = 1;
+}
+
+PolygonDissolve::~PolygonDissolve()
+{
+}
+
+OGRGeometry* PolygonDissolve::UnionCascaded(const std::vector<OGRGeometry*>& geoms)
+{
+    OGRMultiPolygon geocol;
+    for (size_t i=0; i<geoms.size(); i++) AddPolygons(geoms[i], geocol);
+    if (geocol.getNumGeometries() == 0) return NULL;
+    return geocol.UnionCascaded();
+}
+
+OGRGeometry* PolygonDissolve::DissolveSharedEdges(const std::vector<OGRGeometry*>& geoms)
+{
+    std::vector<DissolveEdge> edges;
+    int orient = 0;
+    for (size_t i=0; i<geoms.size(); i++) {
+        if (!AddPolygonEdges(geoms[i], edges, orient)) return NULL;
+    }
+    if (edges.empty()) return NULL;
+    std::sort(edges.begin(), edges.end(), DissolveEdgeLess);
+    
+    // an edge shared by two rings goes both ways and is removed; any other
+    // repeated edge means that the polygons overlap
+    std::vector<DissolveArc> arcs;
+    size_t n_edges = edges.size();
+    for (size_t i=0; i<n_edges; ) {
+        size_t j = i+1;
+        while (j < n_edges && DissolveEdgeSame(edges[i], edges[j])) j++;
+        if (j - i == 2 && edges[i].forward != edges[i+1].forward) {
+            i = j;
+            continue;
+        }
+        if (j - i != 1) return NULL;
+        const DissolveEdge& e = edges[i];
+        DissolveArc a;
+        if (e.forward) {
+            a.sx = e.ax; a.sy = e.ay; a.ex = e.bx; a.ey = e.by;
+        } else {
+            a.sx = e.bx; a.sy = e.by; a.ex = e.ax; a.ey = e.ay;
+        }
+        arcs.push_back(a);
+        i = j;
+    }
+    edges.clear();
+    if (arcs.empty()) return NULL;
+    
+    // chain the arcs into rings; a point where two arcs start (polygons
+    // that touch at a vertex) is left to GEOS
+    std::sort(arcs.begin(), arcs.end(), DissolveArcLess);
+    for (size_t i=1; i<arcs.size(); i++) {
+        if (arcs[i].sx == arcs[i-1].sx && arcs[i].sy == arcs[i-1].sy) {
+            return NULL;
+        }
+    }
+    std::vector<bool> used(arcs.size(), false);
+    std::vector<std::vector<OGRRawPoint> > rings;
+    DissolveArc key;
+    for (size_t i=0; i<arcs.size(); i++) {
+        if (used[i]) continue;
+        rings.push_back(std::vector<OGRRawPoint>());
+        std::vector<OGRRawPoint>& ring = rings.back();
+        size_t k = i;
+        ring.push_back(OGRRawPoint(arcs[k].sx, arcs[k].sy));
+        while (!used[k]) {
+            used[k] = true;
+            ring.push_back(OGRRawPoint(arcs[k].ex, arcs[k].ey));
+            if (arcs[k].ex == arcs[i].sx && arcs[k].ey == arcs[i].sy) break;
+            key.sx = arcs[k].ex;
+            key.sy = arcs[k].ey;
+            std::vector<DissolveArc>::iterator it =
+                std::lower_bound(arcs.begin(), arcs.end(), key, DissolveArcLess);
+            if (it == arcs.end() || it->sx != key.sx || it->sy != key.sy) {
+                return NULL;
+            }
+            k = it - arcs.begin();
+        }
+        if (ring.size() < 4 || ring.front().x != ring.back().x ||
+            ring.front().y != ring.back().y) {
+            return NULL;
+        }
+    }
+    // overlapping polygons are left to GEOS
+    if (!DissolveRingsValid(rings, orient)) return NULL;
+    
+    OGRMultiPolygon* result = new OGRMultiPolygon();
+    for (size_t r=0; r<rings.size(); r++) {
+        // each ring is a part, as in OGRLayerProxy::OGRGeomToGdaShape()
+        OGRLinearRing ring;
+        ring.setPoints((int) rings[r].size(), &rings[r][0]);
+        OGRPolygon polygon;
+        polygon.addRing(&ring);
+        result->addGeometry(&polygon);
+    }
+    return result;
+}
+
+void PolygonDissolve::MakeTiles(int group, std::vector<Job>& tiles)
+{
+    const std::vector<OGRGeometry*>& geoms = groups[group];
+    Job job;
+    job.group = group;
+    job.owns_geoms = false;
+    job.try_edges = false;
+    job.result = NULL;
+    if (geoms.size() <= tile_size) {
+        job.geoms = geoms;
+        tiles.push_back(job);
+        return;
+    }
+    
+    // sort the geometries along a Z-order curve of their centers, so that
+    // each tile is a compact area and has a short boundary
+    size_t n = geoms.size();
+    std::vector<OGREnvelope> env(n);
+    OGREnvelope all;
+    for (size_t i=0; i<n; i++) {
+        if (geoms[i]) {
+            geoms[i]->getEnvelope(&env[i]);
+            all.Merge(env[i]);
+        }
+    }
+    double w = all.MaxX - all.MinX;
+    double h = all.MaxY - all.MinY;
+    std::vector<std::pair<wxUint32, size_t> > order(n);
+    for (size_t i=0; i<n; i++) {
+        double cx = (env[i].MinX + env[i].MaxX) / 2.0;
+        double cy = (env[i].MinY + env[i].MaxY) / 2.0;
+        wxUint32 ix = w > 0 ? (wxUint32)((cx - all.MinX) / w * 65535.0) : 0;
+        wxUint32 iy = h > 0 ? (wxUint32)((cy - all.MinY) / h * 65535.0) : 0;
+        wxUint32 code = 0;
+        for (int b=0; b<16; b++) {
+            code |= ((ix >> b) & 1) << (2*b);
+            code |= ((iy >> b) & 1) << (2*b+1);
+        }
+        order[i] = std::make_pair(code, i);
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t start=0; start<n; start+=tile_size) {
+        size_t end = std::min(n, start + tile_size);
+        job.geoms.clear();
+        for (size_t i=start; i<end; i++) job.geoms.push_back(geoms[order[i].second]);
+        tiles.push_back(job);
+    }
+}
+
+void PolygonDissolve::Run(std::vector<OGRGeometry*>& results)
+{
+    wxStopWatch sw;
+    size_t n_groups = groups.size();
+    results.assign(n_groups, NULL);
+    
+    // 1. shared edges, one job per group
+    jobs.clear();
+    Job job;
+    job.owns_geoms = false;
+    job.try_edges = true;
+    job.result = NULL;
+    for (size_t g=0; g<n_groups; g++) {
+        if (groups[g].empty()) continue;
+        job.group = (int)g;
+        job.geoms = groups[g];
+        jobs.push_back(job);
+    }
+    RunJobs();
+    
+    // 2. GEOS unions of the tiles of the other groups
+    std::vector<Job> tiles;
+    int n_edge_groups = 0;
+    for (size_t i=0; i<jobs.size(); i++) {
+        if (jobs[i].result) {
+            results[jobs[i].group] = jobs[i].result;
+            n_edge_groups += 1;
+        } else {
+            MakeTiles(jobs[i].group, tiles);
+        }
+    }
+    jobs.swap(tiles);
+    RunJobs();
+    
+    // 3. merge the unions of the tiles, fan_in at a time
+    std::vector<std::vector<OGRGeometry*> > partials(n_groups);
+    std::vector<bool> failed(n_groups, false);
+    bool merging = true;
+    while (merging) {
+        for (size_t i=0; i<jobs.size(); i++) {
+            if (jobs[i].result) {
+                partials[jobs[i].group].push_back(jobs[i].result);
+            } else {
+                failed[jobs[i].group] = true;
+            }
+        }
+        jobs.clear();
+        merging = false;
+        job.owns_geoms = true;
+        job.try_edges = false;
+        for (size_t g=0; g<n_groups; g++) {
+            if (partials[g].size() <= 1) continue;
+            merging = true;
+            job.group = (int)g;
+            for (size_t start=0; start<partials[g].size(); start+=fan_in) {
+                size_t end = std::min(partials[g].size(), start + fan_in);
+                job.geoms.assign(partials[g].begin() + start,
+                                 partials[g].begin() + end);
+                jobs.push_back(job);
+            }
+            partials[g].clear();
+        }
+        if (merging) RunJobs();
+    }
+    for (size_t g=0; g<n_groups; g++) {
+        if (partials[g].empty()) continue;
+        if (failed[g]) {
+            // as a single UnionCascaded() of the group would have
+            delete partials[g][0];
+        } else {
+            results[g] = partials[g][0];
+        }
+    }
+    LOG_MSG(wxString::Format("PolygonDissolve: %d groups (%d by shared edges) on %d threads in %ld ms",
+                             (int)n_groups, n_edge_groups, n_threads, sw.Time()));
+}
+
+void PolygonDissolve::RunJobs()
+{
+    next_job = 0;
+    int n = std::min(n_threads, (int)jobs.size());
+    if (n <= 1) {
+        Worker();
+        return;
+    }
+    boost::thread_group workers;
+    for (int i=0; i<n; i++) {
+        workers.create_thread(boost::bind(&PolygonDissolve::Worker, this));
+    }
+    workers.join_all();
+}
+
+bool PolygonDissolve::NextJob(size_t& job)
+{
+    boost::mutex::scoped_lock lock(job_mutex);
+    if (next_job >= jobs.size()) return false;
+    job = next_job++;
+    return true;
+}
+
+void PolygonDissolve::Worker()
+{
+    size_t i = 0;
+    while (NextJob(i)) {
+        Job& job = jobs[i];
+        if (job.try_edges) {
+            job.result = DissolveSharedEdges(job.geoms);
+        } else {
+            job.result = UnionCascaded(job.geoms);
+        }
+        if (job.owns_geoms) {
+            for (size_t j=0; j<job.geoms.size(); j++) delete job.geoms[j];
+        }
+        job.geoms.clear();
+    }
+}
@@ -0,0 +1,86 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_POLYGON_DISSOLVE_H__
+#define __GEODA_CENTER_POLYGON_DISSOLVE_H__
+
+#include <vector>
+#include <ogrsf_frmts.h>
+#include <boost/thread/mutex.hpp>
+
+/**
+ Unions groups of polygons (the clusters of a map, the categories of
+ DissolveDlg, or the whole layer for the map boundary) on worker threads.
+ 
+ A group whose rings share their edges exactly, as the polygons of a
+ coverage (parcels, tracts) do, is dissolved without GEOS: the edges that
+ appear twice in opposite directions are removed and the others are
+ chained into rings.  The rings are kept only if they don't meet and are
+ nested as their orientations say, which fails if any polygons overlap.
+ When this fails (overlapping polygons, edges that only partly overlap,
+ polygons that touch at a vertex, rings with mixed orientations) the
+ group is unioned by GEOS.
+ 
+ A large group is sorted along a Z-order curve of the centers of its
+ polygons and split into tiles of tile_size polygons; the tiles are
+ unioned and their unions are merged by fan_in at a time until one is
+ left.  Every round of unions runs on the worker threads, and OGR creates
+ a GEOS context for each call, so the threads share nothing.
+ */
+class PolygonDissolve {
+public:
+    /** The geometries are not owned, and are only read */
+    PolygonDissolve(const std::vector<std::vector<OGRGeometry*> >& groups);
+    virtual ~PolygonDissolve();
+    
+    /** Fills results with the union of each group (NULL if empty or if
+     GEOS fails); the caller deletes them */
+    void Run(std::vector<OGRGeometry*>& results);
+    
+    /** Union of the shared edges only; NULL if the rings don't cancel or
+     the polygons overlap */
+    static OGRGeometry* DissolveSharedEdges(const std::vector<OGRGeometry*>& geoms);
+    
+    static const size_t tile_size = 2048;
+    static const size_t fan_in = 8;
+    
+protected:
+    struct Job {
+        int group;
+        std::vector<OGRGeometry*> geoms; // to union
+        bool owns_geoms; // the geoms are partial unions
+        bool try_edges; // try DissolveSharedEdges first
+        OGRGeometry* result;
+    };
+    
+    void RunJobs();
+    bool NextJob(size_t& job);
+    void Worker();
+    void MakeTiles(int group, std::vector<Job>& tiles);
+    static OGRGeometry* UnionCascaded(const std::vector<OGRGeometry*>& geoms);
+    
+    const std::vector<std::vector<OGRGeometry*> >& groups;
+    std::vector<Job> jobs;
+    size_t next_job;
+    int n_threads;
+    boost::mutex job_mutex;
+};
+
+#endif
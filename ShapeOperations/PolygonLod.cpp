@@ -0,0 +1,315 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "PolygonLod.h"
+
+/** A point of a ring; the points are sorted by their coordinates to find
+ the points that several rings share */
+struct LodVertex {
+    double x, y;
+    int ring;
+    int k; // position in the ring
+};
+
+/** Points first..last of a ring left to split, with the tolerance of the
+ point that split the arc above them */
+struct LodSpan {
+    int first, last;
+    float cap;
+};
+
+static bool LodVertexLess(const LodVertex& v1, const LodVertex& v2)
+{
+    if (v1.x != v2.x) return v1.x < v2.x;
+    if (v1.y != v2.y) return v1.y < v2.y;
+    if (v1.ring != v2.ring) return v1.ring < v2.ring;
+    return v1.k < v2.k;
+}
+
+static bool LodPointLess(const Shapefile::Point& a, const Shapefile::Point& b)
+{
+    if (a.x != b.x) return a.x < b.x;
+    return a.y < b.y;
+}
+
+static bool LodPointSame(const Shapefile::Point& a, const Shapefile::Point& b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+/** Distance from p to the segment ab, the same bits for ab and ba */
+static double LodSegmentDist(const Shapefile::Point& p,
+                             const Shapefile::Point& a_s,
+                             const Shapefile::Point& b_s)
+{
+    const Shapefile::Point& a = LodPointLess(b_s, a_s) ? b_s : a_s;
+    const Shapefile::Point& b = LodPointLess(b_s, a_s) ? a_s : b_s;
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double len2 = dx * dx + dy * dy;
+    double t = 0;
+    if (len2 > 0) {
+        t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / len2;
+        if (t < 0) t = 0;
+        else if (t > 1) t = 1;
+    }
+    double ex = a.x + t * dx - p.x;
+    double ey = a.y + t * dy - p.y;
+    return sqrt(ex * ex + ey * ey);
+}
+
+PolygonLod::PolygonLod(const std::vector<Shapefile::PolygonContents*>& polys_s)
+: polys(polys_s), is_done(false), is_cancelled(false)
+{
+    offsets.resize(polys.size() + 1, 0);
+    for (size_t i=0; i<polys.size(); i++) {
+        Shapefile::PolygonContents* pc = polys[i];
+        int64_t n = 0;
+        if (pc && pc->shape_type != 0) n = pc->num_points;
+        offsets[i+1] = offsets[i] + n;
+    }
+}
+
+PolygonLod::~PolygonLod()
+{
+}
+
+void PolygonLod::Cancel()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    is_cancelled = true;
+}
+
+bool PolygonLod::IsCancelled()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return is_cancelled;
+}
+
+bool PolygonLod::IsDone()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return is_done;
+}
+
+bool PolygonLod::SetTolerances(const std::vector<float>& tol)
+{
+    if ((int64_t)tol.size() != GetNumPoints()) return false;
+    boost::mutex::scoped_lock lock(mutex);
+    tolerances = tol;
+    is_done = true;
+    return true;
+}
+
+const float* PolygonLod::GetTolerances(int i) const
+{
+    if (tolerances.empty() || offsets[i+1] == offsets[i]) return NULL;
+    return &tolerances[0] + offsets[i];
+}
+
+const Shapefile::Point& PolygonLod::GetPoint(const Ring& ring, int k) const
+{
+    return polys[ring.poly]->points[ring.start - offsets[ring.poly] + k];
+}
+
+void PolygonLod::Build()
+{
+    std::vector<Ring> rings;
+    for (size_t i=0; i<polys.size(); i++) {
+        if (offsets[i+1] == offsets[i]) continue;
+        Shapefile::PolygonContents* pc = polys[i];
+        for (int p=0; p<pc->num_parts; p++) {
+            int s = pc->parts[p];
+            int e = p+1 < pc->num_parts ? pc->parts[p+1] : pc->num_points;
+            if (e > pc->num_points) e = pc->num_points;
+            if (s < 0 || e <= s) continue;
+            Ring ring;
+            ring.poly = (int)i;
+            ring.start = offsets[i] + s;
+            ring.m = e - s;
+            ring.closed = ring.m > 1 &&
+                LodPointSame(pc->points[s], pc->points[e-1]);
+            if (ring.closed) ring.m -= 1;
+            rings.push_back(ring);
+        }
+    }
+    if (IsCancelled()) return;
+
+    std::vector<char> junction(GetNumPoints(), 0);
+    FindJunctions(rings, junction);
+
+    // a point that is in no ring is always drawn
+    std::vector<float> tol(GetNumPoints(), std::numeric_limits<float>::max());
+    for (size_t r=0; r<rings.size(); r++) {
+        if (r % 1024 == 0 && IsCancelled()) return;
+        SimplifyRing(rings[r], junction, tol);
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+    tolerances.swap(tol);
+    is_done = true;
+}
+
+void PolygonLod::FindJunctions(const std::vector<Ring>& rings,
+                               std::vector<char>& junction)
+{
+    std::vector<LodVertex> verts;
+    verts.reserve(GetNumPoints());
+    for (size_t r=0; r<rings.size(); r++) {
+        for (int k=0; k<rings[r].m; k++) {
+            const Shapefile::Point& pt = GetPoint(rings[r], k);
+            LodVertex v;
+            v.x = pt.x;
+            v.y = pt.y;
+            v.ring = (int)r;
+            v.k = k;
+            verts.push_back(v);
+        }
+    }
+    std::sort(verts.begin(), verts.end(), LodVertexLess);
+
+    size_t i = 0;
+    while (i < verts.size()) {
+        size_t j = i + 1;
+        while (j < verts.size() && verts[j].x == verts[i].x &&
+               verts[j].y == verts[i].y) {
+            j++;
+        }
+        // a point inside an arc shared by two rings has the same two
+        // neighbors in both rings, in one or the other order
+        bool is_junction = j - i > 2;
+        if (j - i == 2) {
+            const LodVertex& a = verts[i];
+            const LodVertex& b = verts[i+1];
+            if (a.ring == b.ring) {
+                is_junction = true;
+            } else {
+                const Ring& ra = rings[a.ring];
+                const Ring& rb = rings[b.ring];
+                const Shapefile::Point& a0 = GetPoint(ra, (a.k + ra.m - 1) % ra.m);
+                const Shapefile::Point& a1 = GetPoint(ra, (a.k + 1) % ra.m);
+                const Shapefile::Point& b0 = GetPoint(rb, (b.k + rb.m - 1) % rb.m);
+                const Shapefile::Point& b1 = GetPoint(rb, (b.k + 1) % rb.m);
+                is_junction =
+                    !((LodPointSame(a0, b0) && LodPointSame(a1, b1)) ||
+                      (LodPointSame(a0, b1) && LodPointSame(a1, b0)));
+            }
+        }
+        if (is_junction) {
+            for (size_t k=i; k<j; k++) {
+                junction[rings[verts[k].ring].start + verts[k].k] = 1;
+            }
+        }
+        i = j;
+    }
+}
+
+void PolygonLod::SimplifyRing(const Ring& ring,
+                              const std::vector<char>& junction,
+                              std::vector<float>& tol)
+{
+    const float keep = std::numeric_limits<float>::max();
+    int m = ring.m;
+    if (m <= 3) {
+        for (int k=0; k<m; k++) tol[ring.start + k] = keep;
+        if (ring.closed) tol[ring.start + m] = keep;
+        return;
+    }
+
+    std::vector<int> anchors;
+    for (int k=0; k<m; k++) {
+        if (junction[ring.start + k]) anchors.push_back(k);
+    }
+    if (anchors.empty()) {
+        // the smallest point and the point farthest from it
+        int a = 0;
+        for (int k=1; k<m; k++) {
+            if (LodPointLess(GetPoint(ring, k), GetPoint(ring, a))) a = k;
+        }
+        const Shapefile::Point& pa = GetPoint(ring, a);
+        int b = -1;
+        double best = -1;
+        for (int k=0; k<m; k++) {
+            if (k == a) continue;
+            const Shapefile::Point& pk = GetPoint(ring, k);
+            double dx = pk.x - pa.x;
+            double dy = pk.y - pa.y;
+            double d = dx * dx + dy * dy;
+            if (d > best || (d == best && LodPointLess(pk, GetPoint(ring, b)))) {
+                best = d;
+                b = k;
+            }
+        }
+        anchors.push_back(std::min(a, b));
+        anchors.push_back(std::max(a, b));
+    }
+
+    for (size_t i=0; i<anchors.size(); i++) {
+        tol[ring.start + anchors[i]] = keep;
+    }
+    for (size_t i=0; i<anchors.size(); i++) {
+        int first = anchors[i];
+        int last = i+1 < anchors.size() ? anchors[i+1] : anchors[0] + m;
+        SimplifyArc(ring, first, last, tol);
+    }
+    if (ring.closed) tol[ring.start + m] = tol[ring.start];
+}
+
+/** Douglas-Peucker on the points first..last of a ring, positions taken
+ modulo the size of the ring. The point farthest from the chord splits the
+ arc, and its tolerance is its distance to the chord, at most the tolerance
+ of the point that split the arc above it: a point is never drawn without
+ the points that were kept before it. */
+void PolygonLod::SimplifyArc(const Ring& ring, int first, int last,
+                             std::vector<float>& tol)
+{
+    int m = ring.m;
+    std::vector<LodSpan> stack;
+    LodSpan top = { first, last, std::numeric_limits<float>::max() };
+    stack.push_back(top);
+    while (!stack.empty()) {
+        LodSpan s = stack.back();
+        stack.pop_back();
+        if (s.last - s.first < 2) continue;
+        const Shapefile::Point& a = GetPoint(ring, s.first % m);
+        const Shapefile::Point& b = GetPoint(ring, s.last % m);
+        int split = -1;
+        double best = -1;
+        for (int k=s.first+1; k<s.last; k++) {
+            const Shapefile::Point& p = GetPoint(ring, k % m);
+            double d = LodSegmentDist(p, a, b);
+            if (d > best ||
+                (d == best && LodPointLess(p, GetPoint(ring, split % m)))) {
+                best = d;
+                split = k;
+            }
+        }
+        float t = (float) best;
+        if (t > s.cap) t = s.cap;
+        tol[ring.start + split % m] = t;
+        LodSpan lo = { s.first, split, t };
+        LodSpan hi = { split, s.last, t };
+        stack.push_back(lo);
+        stack.push_back(hi);
+    }
+}
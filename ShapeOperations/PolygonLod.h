@@ -0,0 +1,93 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_POLYGON_LOD_H__
+#define __GEODA_CENTER_POLYGON_LOD_H__
+
+#include <vector>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+
+#include "../ShpFile.h"
+
+/**
+ Level of detail of the polygons of a layer, for drawing. Each vertex gets
+ a tolerance, in map units: the Douglas-Peucker tolerance at which the
+ vertex is left out. A map drawn at a scale keeps the vertices whose
+ tolerance is at least the size of a fraction of a pixel, so a single
+ array serves every zoom level.
+
+ Shared boundaries stay shared: a vertex where the boundaries of the
+ polygons meet or part (a junction) is never left out, and the arc between
+ two junctions is simplified on its own, by a rule that doesn't depend on
+ the direction the arc is walked. Two polygons that share an arc keep the
+ same vertices of it at every tolerance, so no gap or overlap opens
+ between them. A ring without junctions is split at its smallest vertex
+ and at the vertex farthest from it.
+
+ Build() can run on a worker thread; IsDone() tells when the tolerances
+ are ready.
+ */
+class PolygonLod
+{
+public:
+    /** The polygons are not owned, and are only read */
+    PolygonLod(const std::vector<Shapefile::PolygonContents*>& polys);
+    virtual ~PolygonLod();
+
+    void Build();
+    /** Asks a running Build() to stop, without the tolerances */
+    void Cancel();
+    bool IsDone();
+
+    /** Tolerances computed before, e.g. read from the project snapshot;
+     false if they are not one per vertex */
+    bool SetTolerances(const std::vector<float>& tol);
+    const std::vector<float>& GetTolerances() const { return tolerances; }
+    /** Tolerances of the points of polygon i, or NULL if not done */
+    const float* GetTolerances(int i) const;
+    int64_t GetNumPoints() const { return offsets.back(); }
+
+protected:
+    struct Ring {
+        int poly;
+        int64_t start; // first point of the ring, in all points
+        int m; // points, without the closing point
+        bool closed;
+    };
+
+    bool IsCancelled();
+    const Shapefile::Point& GetPoint(const Ring& ring, int k) const;
+    void FindJunctions(const std::vector<Ring>& rings,
+                       std::vector<char>& junction);
+    void SimplifyRing(const Ring& ring, const std::vector<char>& junction,
+                      std::vector<float>& tol);
+    void SimplifyArc(const Ring& ring, int first, int last,
+                     std::vector<float>& tol);
+
+    std::vector<Shapefile::PolygonContents*> polys;
+    std::vector<int64_t> offsets; // first point of each polygon
+
+    std::vector<float> tolerances;
+    bool is_done;
+    bool is_cancelled;
+    boost::mutex mutex;
+};
+
+#endif
@@ -25,11 +25,16 @@
 #include <cmath>
 #include <time.h>
 #include <vector>
+#include <algorithm>
 
+#define BOOST_PHOENIX_STL_TUPLE_H_
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
 #include <wx/wx.h>
 #endif
+#include <wx/stopwatch.h>
 
 
 
@@ -388,6 +393,77 @@ void PartitionM::remove(const int del)  {
 	return;
 }
 
+/*
+ ContigSweep
+ */
+ContigSweep::ContigSweep(Shapefile::Main& _main, std::vector<ContigTask>& _tasks,
+                         bool _is_queen, double _precision_threshold)
+: main(_main), tasks(_tasks), is_queen(_is_queen),
+precision_threshold(_precision_threshold), next_task(0)
+{
+}
+
+void ContigSweep::Run()
+{
+    int n_threads = GdaConst::gda_cpu_cores;
+    if (!GdaConst::gda_set_cpu_cores) {
+        n_threads = boost::thread::hardware_concurrency();
+    }
+    if (n_threads < 1) n_threads = 1;
+    int n_blocks = (int)(tasks.size() / block_size) + 1;
+    if (n_threads > n_blocks) n_threads = n_blocks;
+    
+    wxStopWatch sw;
+    if (n_threads == 1) {
+        Worker();
+    } else {
+        boost::thread_group workers;
+        for (int i=0; i<n_threads; i++) {
+            workers.create_thread(boost::bind(&ContigSweep::Worker, this));
+        }
+        workers.join_all();
+    }
+    LOG_MSG(wxString::Format("PolysToContigWeights: %d tasks on %d threads in %ld ms",
+                             (int)tasks.size(), n_threads, sw.Time()));
+}
+
+bool ContigSweep::NextBlock(size_t& start, size_t& end)
+{
+    boost::mutex::scoped_lock lock(task_mutex);
+    if (next_task >= tasks.size()) return false;
+    start = next_task;
+    end = std::min(tasks.size(), next_task + block_size);
+    next_task = end;
+    return true;
+}
+
+void ContigSweep::Worker()
+{
+    using namespace Shapefile;
+    size_t start = 0, end = 0;
+    while (NextBlock(start, end)) {
+        for (size_t t=start; t<end; ++t) {
+            ContigTask& task = tasks[t];
+            task.related.assign(task.nbrs.size(), 0);
+            if (task.nbrs.empty()) continue;
+            
+            RecordContents* rec = main.records[task.obs].contents_p;
+            PolygonContents* ply = dynamic_cast<PolygonContents*> (rec);
+            PolygonPartition testPoly(ply);
+            testPoly.MakePartition();
+            
+            for (size_t j=0; j<task.nbrs.size(); ++j) {
+                RecordContents* nbr_rec = main.records[task.nbrs[j]].contents_p;
+                PolygonContents* nbr_ply = dynamic_cast<PolygonContents*>(nbr_rec);
+                PolygonPartition nbrPoly(nbr_ply);
+                // run sweep with testPoly as a host and nbrPoly as a guest
+                task.related[j] = testPoly.sweep(nbrPoly, is_queen,
+                                                 precision_threshold) ? 1 : 0;
+            }
+        }
+    }
+}
+
 GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
                                  double precision_threshold)
 {
@@ -451,6 +527,10 @@ GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
     GeoDaSet   Neighbors(gRecords), Related(gRecords);
     //  cout << "total steps= " << gMinX.Cells() << std::endl;
     
+    // 1. the sweep over the bounding boxes only lists the candidate pairs,
+    // in the order they were tested before
+    std::vector<ContigTask> tasks;
+    tasks.reserve(gRecords);
     for (int step= 0; step < gMinX.Cells(); ++step) {
         // include all elements from xmin[step]
         for (curr= gMinX.first(step); curr != GdaConst::EMPTY;
@@ -465,8 +545,6 @@ GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
         {
             RecordContents* rec = main.records[curr].contents_p;
             PolygonContents* ply = dynamic_cast<PolygonContents*> (rec);
-            PolygonPartition testPoly(ply);
-            testPoly.MakePartition();
             
             // form a list of neighbors
             for (int cell=gY->lowest(curr); cell <= gY->upmost(curr); ++cell) {
@@ -477,38 +555,36 @@ GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
                 }
             }
             
-            // test each potential neighbor
+            tasks.push_back(ContigTask(curr));
+            ContigTask& task = tasks.back();
             for (int nbr = Neighbors.Pop(); nbr != GdaConst::EMPTY;
                  nbr = Neighbors.Pop()) {
                 RecordContents* nbr_rec = main.records[nbr].contents_p;
                 PolygonContents* nbr_ply = dynamic_cast<PolygonContents*>(nbr_rec);
-                
-                if (ply->intersect(nbr_ply)) {
-                    
-                    PolygonPartition nbrPoly(nbr_ply);
-                    //shp.seekg(gOffset[nbr]+12, std::ios::beg);
-                    //nbrPoly.ReadShape(shp);
-                    
-                    //if (curr == 0 && nbr == 0) {
-                    //
-                    //}
-                    // run sweep with testPoly as a host and nbrPoly as a guest
-                    int related = testPoly.sweep(nbrPoly, is_queen, precision_threshold);
-                    if (related) Related.Push(nbr);
-                }
-            }
-            
-            
-            if (size_t sz = Related.Size()) {
-                gl[curr].SetSizeNbrs(sz);
-                for (size_t i=0; i<sz; ++i) {
-                    gl[curr].SetNbr(i, Related.Pop());
-                }
+                if (ply->intersect(nbr_ply)) task.nbrs.push_back(nbr);
             }
             
             gY->remove(curr);       // remove from the partition
         }
     }
+    
+    // 2. the point sweeps of the candidate pairs run on worker threads
+    ContigSweep sweep(main, tasks, is_queen, precision_threshold);
+    sweep.Run();
+    
+    // 3. the neighbors are recorded in the same order as before
+    for (size_t t=0; t<tasks.size(); ++t) {
+        const ContigTask& task = tasks[t];
+        for (size_t j=0; j<task.nbrs.size(); ++j) {
+            if (task.related[j]) Related.Push(task.nbrs[j]);
+        }
+        if (size_t sz = Related.Size()) {
+            gl[task.obs].SetSizeNbrs(sz);
+            for (size_t i=0; i<sz; ++i) {
+                gl[task.obs].SetNbr(i, Related.Pop());
+            }
+        }
+    }
     // end MakeContiguity(main, is_queen, precision_threshold);
 	
 	if (gY) delete gY; gY = 0;
@@ -26,6 +26,8 @@
 
 #include <ogrsf_frmts.h>
 #include <cfloat>
+#include <vector>
+#include <boost/thread/mutex.hpp>
 #include "GalWeight.h"
 #include "../ShpFile.h"
 #include "../GdaConst.h"
@@ -189,6 +191,40 @@ class PartitionM  {
     int Sum() const;
 };
 
+/** Candidate neighbors of one polygon, i.e. the polygons whose bounding
+ box intersects its bounding box, in the order of the sweep */
+struct ContigTask {
+    int obs;
+    std::vector<int> nbrs;
+    std::vector<char> related; // 1 if nbrs[j] is a neighbor of obs
+    ContigTask(int o=0) : obs(o) {}
+};
+
+/**
+ Runs the point sweeps of PolysToContigWeights() on worker threads. The
+ tasks are handed out in small blocks, and each task only writes its own
+ results, so the weights don't depend on the number of threads.
+ */
+class ContigSweep {
+public:
+    ContigSweep(Shapefile::Main& main, std::vector<ContigTask>& tasks,
+                bool is_queen, double precision_threshold);
+    void Run();
+    
+    static const size_t block_size = 64;
+    
+protected:
+    bool NextBlock(size_t& start, size_t& end);
+    void Worker();
+    
+    Shapefile::Main& main;
+    std::vector<ContigTask>& tasks;
+    bool is_queen;
+    double precision_threshold;
+    size_t next_task;
+    boost::mutex task_mutex;
+};
+
 GalElement* PolysToContigWeights(Shapefile::Main& main,
                                  bool is_queen,
                                  double precision_threshold=0.0);
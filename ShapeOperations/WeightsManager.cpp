@@ -37,6 +37,7 @@
 #include "../SaveButtonManager.h"
 #include "../logger.h"
 #include "../VarCalc/GdaLexer.h"
+#include "../io/weights_binary.h"
 
 
 WeightsNewManager::WeightsNewManager(WeightsManState* w_man_state_,
@@ -116,6 +117,8 @@ bool WeightsNewManager::AssociateGal(boost::uuids::uuid w_uuid, GalWeight* gw)
 		delete it->second.gal_weight; it->second.gal_weight = 0;
 	}
 	it->second.gal_weight = gw;
+	// the rows built by the caller are kept in CSR form
+	if (gw) gw->Compact();
 	if (w_man_state) w_man_state->notifyObservers();
 	return true;
 }
@@ -387,9 +390,19 @@ GalWeight* WeightsNewManager::GetGal(boost::uuids::uuid w_uuid)
 	// Load file for first use
 	wxFileName t_fn(e.wpte.wmi.filename);
 	wxString ext = t_fn.GetExt().Lower();
-	if (ext != "gal" && ext != "gwt" && ext != "kwt") {
+	if (ext != "gal" && ext != "gwt" && ext != "kwt" && ext != "gwb") {
 		return 0;
 	}
+	if (ext == "gwb") {
+		// binary weights are mapped, not parsed
+		GalWeight* w = ReadGwbAsGalWeight(e.wpte.wmi.filename, table_int);
+		if (w != 0) {
+			w->id_field = e.wpte.wmi.id_var;
+			w->title = e.wpte.title;
+			e.gal_weight = w;
+		}
+		return e.gal_weight;
+	}
 	GalElement* gal=0;
 	if (ext == "gal") {
 		gal = WeightUtils::ReadGal(e.wpte.wmi.filename, table_int);
@@ -403,6 +416,7 @@ GalWeight* WeightsNewManager::GetGal(boost::uuids::uuid w_uuid)
         w->id_field = e.wpte.wmi.id_var;
 		w->title = e.wpte.title;
 		w->gal = gal;
+		w->Compact();
 		e.gal_weight = w;
 	}
 	return e.gal_weight;
@@ -417,7 +431,7 @@ GeoDaWeight* WeightsNewManager::GetWeights(boost::uuids::uuid w_uuid)
     
     wxFileName t_fn(tmpName);
     wxString ext = t_fn.GetExt().Lower();
-    if (ext != "gal" && ext != "gwt" && ext != "kwt") {
+    if (ext != "gal" && ext != "gwt" && ext != "kwt" && ext != "gwb") {
         return 0;
     }
     
@@ -426,7 +440,31 @@ GeoDaWeight* WeightsNewManager::GetWeights(boost::uuids::uuid w_uuid)
 	
 	// Load file for first use
 	
-	if (ext == "gal") {
+	if (ext == "gwb") {
+        GwbFile gwb;
+        if (gwb.Open(e.wpte.wmi.filename) && gwb.HasWeights()) {
+            gwb.Close();
+            GwtElement* gwt = ReadGwb(e.wpte.wmi.filename, table_int);
+            if (gwt != 0) {
+                GwtWeight* w = new GwtWeight();
+                w->num_obs = table_int->GetNumberRows();
+                w->wflnm = e.wpte.wmi.filename;
+                w->id_field = e.wpte.wmi.id_var;
+                w->title = e.wpte.title;
+                w->gwt = gwt;
+                e.geoda_weight = (GeoDaWeight*)w;
+            }
+        } else {
+            gwb.Close();
+            GalWeight* w = ReadGwbAsGalWeight(e.wpte.wmi.filename, table_int);
+            if (w != 0) {
+                w->id_field = e.wpte.wmi.id_var;
+                w->title = e.wpte.title;
+                e.geoda_weight = (GeoDaWeight*)w;
+            }
+        }
+        
+	} else if (ext == "gal") {
         GalElement* gal = WeightUtils::ReadGal(e.wpte.wmi.filename, table_int);
     	if (gal != 0) {
     		GalWeight* w = new GalWeight();
@@ -435,6 +473,7 @@ GeoDaWeight* WeightsNewManager::GetWeights(boost::uuids::uuid w_uuid)
             w->id_field = e.wpte.wmi.id_var;
     		w->title = e.wpte.title;
     		w->gal = gal;
+    		w->Compact();
     		e.geoda_weight = (GeoDaWeight*)w;
     	}
         
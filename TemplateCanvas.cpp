@@ -66,6 +66,10 @@
 ////////////////////////////////////////////////////////////////////////////////
 BOOST_GEOMETRY_REGISTER_C_ARRAY_CS(boost::geometry::cs::cartesian)
 
+// pixels around the mouse within which pointWithin() or the hover test of a
+// shape can be true
+static const int sel_point_tol = 5;
+
 IMPLEMENT_CLASS(TemplateCanvas, wxScrolledWindow)
 
 BEGIN_EVENT_TABLE(TemplateCanvas, wxScrolledWindow)
@@ -156,6 +160,7 @@ void TemplateCanvas::OnHighlightTimerEvent(wxTimerEvent &event)
     highlight_state->SetEventType(HLStateInt::delta);
     highlight_state->notifyObservers(this);
     highlight_timer->Stop();
+    ClearSelDeltas();
 }
 
 // We will handle drawing our background in a paint event
@@ -666,6 +671,7 @@ void TemplateCanvas::DrawLayers()
 	if (layer2_valid && layer1_valid && layer0_valid)
 		return;
     if (!layer0_valid) {
+        sel_shp_index.Invalidate();
         DrawLayer0();
     }
     if (!layer1_valid) {
@@ -1797,10 +1803,10 @@ void TemplateCanvas::UpdateSelectRegion(bool translate, wxPoint diff)
 	
 }
 
-// This is a good candidate for parallelization in the future.  Could
-// also use an r-tree to greatly reduce number of comparisons needed.
-// For efficency sake, will make this default solution assume that
-// selectable shapes and highlight state are in a one-to-one
+// Candidate shapes come from sel_shp_index, a grid over the screen
+// bounding boxes of the selectable shapes, so a brush only tests the
+// shapes near it.  For efficency sake, will make this default solution
+// assume that selectable shapes and highlight state are in a one-to-one
 // correspondence.  Special views such as histogram, or perhaps
 // even map legends will have to override UpdateSelection and
 // NotifyObservables.
@@ -1822,6 +1828,99 @@ void TemplateCanvas::UpdateSelection(bool shiftdown, bool pointsel)
     UpdateStatusBar();
 }
 
+void TemplateCanvas::QuerySelectableShps(int x0, int y0, int x1, int y1,
+                                         std::vector<int>& ids)
+{
+    if (!layer0_valid) {
+        // shapes changed and are not redrawn yet
+        sel_shp_index.Invalidate();
+    }
+    if (!sel_shp_index.IsValid()) {
+        int w = 0, h = 0;
+        GetClientSize(&w, &h);
+        sel_shp_index.Build(selectable_shps, w, h);
+    }
+    sel_shp_index.Query(x0, y0, x1, y1, ids);
+}
+
+// Sets the highlight of the shapes in hits, and when shiftdown is false,
+// removes it from the other valid shapes.  Each change is added to the
+// newly highlighted / unhighlighted lists of the HighlightState, which are
+// emptied after the observers are notified.
+void TemplateCanvas::ApplySelection(const std::vector<int>& hits,
+                                    bool shiftdown, bool toggle)
+{
+    std::vector<bool>& hs = GetSelBitVec();
+    int hl_size = hs.size();
+    if (sel_marks.size() != hl_size) sel_marks.assign(hl_size, 0);
+    bool selection_changed = false;
+    
+    int total_highlighted = 0;
+    if (shiftdown) {
+        total_highlighted = highlight_state->GetTotalHighlighted();
+    } else {
+        for (size_t k=0; k<hits.size(); k++) sel_marks[hits[k]] |= 1;
+        for (int i=0; i<hl_size; i++) {
+            if (!hs[i]) continue;
+            if (!(sel_marks[i] & 1) && _IsShpValid(i)) {
+                hs[i] = false;
+                AddSelDelta(i, false);
+                selection_changed = true;
+            } else {
+                total_highlighted += 1;
+            }
+        }
+        for (size_t k=0; k<hits.size(); k++) sel_marks[hits[k]] &= ~1;
+    }
+    for (size_t k=0; k<hits.size(); k++) {
+        int i = hits[k];
+        if (!hs[i]) {
+            hs[i] = true;
+            AddSelDelta(i, true);
+            total_highlighted += 1;
+            selection_changed = true;
+        } else if (toggle) {
+            hs[i] = false;
+            AddSelDelta(i, false);
+            total_highlighted -= 1;
+            selection_changed = true;
+        }
+    }
+    if (selection_changed) {
+        // used for MapCanvas::Drawlayer1
+        highlight_state->SetTotalHighlighted(total_highlighted);
+        highlight_timer->Start(50);
+    }
+}
+
+void TemplateCanvas::AddSelDelta(int i, bool highlighted)
+{
+    unsigned char bit = highlighted ? 2 : 4;
+    if (sel_marks[i] & bit) return;
+    sel_marks[i] |= bit;
+    std::vector<int>& ids = highlighted ? GetNewlySelList() : GetNewlyUnselList();
+    int n = highlighted ? GetNumNewlySel() : GetNumNewlyUnsel();
+    if (ids.size() <= n) ids.resize(n+1);
+    ids[n] = i;
+    if (highlighted) SetNumNewlySel(n+1);
+    else SetNumNewlyUnsel(n+1);
+}
+
+void TemplateCanvas::ClearSelDeltas()
+{
+    if (sel_marks.empty()) return;
+    std::vector<int>& nh = GetNewlySelList();
+    for (int k=0, n=GetNumNewlySel(); k<n && k<nh.size(); k++) {
+        if (nh[k] >= 0 && nh[k] < sel_marks.size()) sel_marks[nh[k]] &= ~2;
+    }
+    std::vector<int>& nuh = GetNewlyUnselList();
+    for (int k=0, n=GetNumNewlyUnsel(); k<n && k<nuh.size(); k++) {
+        if (nuh[k] >= 0 && nuh[k] < sel_marks.size()) sel_marks[nuh[k]] &= ~4;
+    }
+    SetNumNewlySel(0);
+    SetNumNewlyUnsel(0);
+}
+
 // The following function assumes that the set of selectable objects
 // being selected against are all points.  Since all GdaShape objects
 // define a center point, this is also the default function for
@@ -1831,82 +1930,45 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
     
-    std::vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
+    std::vector<int>& cands = sel_cands;
+    std::vector<int> hits;
     
 	if (pointsel) { // a point selection
-		for (int i=0; i<hl_size; i++) {
+		QuerySelectableShps(sel1.x - sel_point_tol, sel1.y - sel_point_tol,
+                            sel1.x + sel_point_tol, sel1.y + sel_point_tol,
+                            cands);
+		for (size_t k=0; k<cands.size(); k++) {
+            int i = cands[k];
             if ( !_IsShpValid(i))
                 continue;
-			if (selectable_shps[i]->pointWithin(sel1)) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}			
+			if (selectable_shps[i]->pointWithin(sel1)) hits.push_back(i);
 		}
 	} else { // determine which obs intersect the selection region.
 		if (brushtype == rectangle) {
 			wxRegion rect(wxRect(sel1, sel2));
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableShps(sel1.x, sel1.y, sel2.x, sel2.y, cands);
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i))
                     continue;
-				bool contains = (rect.Contains(selectable_shps[i]->center) !=
-								 wxOutRegion);
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (rect.Contains(selectable_shps[i]->center) != wxOutRegion) {
+                    hits.push_back(i);
+                }
 			}
 			
 		} else if (brushtype == circle) {
-			// using quad-tree to do pre-selection
 			double radius = GenUtils::distance(sel1, sel2);
+			int r = (int) ceil(radius);
+			QuerySelectableShps(sel1.x - r, sel1.y - r, sel1.x + r, sel1.y + r,
+                                cands);
 			// determine if each center is within radius of sel1
-			for (int i=0; i<hl_size; i++) {
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i) )
                     continue;
-				bool contains = (GenUtils::distance(sel1, selectable_shps[i]->center) <= radius);
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (GenUtils::distance(sel1, selectable_shps[i]->center) <= radius) {
+                    hits.push_back(i);
+                }
 			}
 		} else if (brushtype == line) {
 			wxRegion rect(wxRect(sel1, sel2));
@@ -1924,7 +1986,9 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 			double p2yMp1y = p2y - p1y;
 			double dp1p2 = GenUtils::distance(sel1, sel2);
 			double delta = 3.0 * dp1p2;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableShps(sel1.x, sel1.y, sel2.x, sel2.y, cands);
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i) )
                     continue;
 				bool contains = (rect.Contains(selectable_shps[i]->center) !=
@@ -1937,33 +2001,13 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 					if (abs(p2xMp1x * (p1y-p0y) - (p1x-p0x) * p2yMp1y) >
 						delta ) contains = false;
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}
-		}
+		} else {
+            return;
+        }
 	}
-    if (selection_changed) {
-        int total_highlighted = 0; // used for MapCanvas::Drawlayer1
-        for (int i=0; i<hl_size; i++) if (hs[i]) total_highlighted += 1;
-        highlight_state->SetTotalHighlighted(total_highlighted);
-        highlight_timer->Start(50);
-    }
+    ApplySelection(hits, shiftdown, pointsel);
 }
 
 // The following function assumes that the set of selectable objects
@@ -1973,29 +2017,19 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
     
-    std::vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
+    std::vector<int>& cands = sel_cands;
+    std::vector<int> hits;
 	
 	if (pointsel) { // a point selection
-		for (int i=0; i<hl_size; i++) {
+		QuerySelectableShps(sel1.x, sel1.y, sel1.x, sel1.y, cands);
+		for (size_t k=0; k<cands.size(); k++) {
+            int i = cands[k];
             if ( !_IsShpValid(i))
                 continue;
 			GdaCircle* s = (GdaCircle*) selectable_shps[i];
-			if (s->isNull()) continue;
 			if (GenUtils::distance(s->center, sel1) <= s->radius) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}			
+                hits.push_back(i);
+			}
 		}
 	} else {
 		if (brushtype == rectangle) {
@@ -2004,12 +2038,13 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 			double rect_y = rect.GetPosition().y;
 			double half_rect_w = fabs((double) (sel1.x - sel2.x))/2.0;
 			double half_rect_h = fabs((double) (sel1.y - sel2.y))/2.0;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableShps(sel1.x, sel1.y, sel2.x, sel2.y, cands);
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i))
                     continue;
                 
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
-				if (s->isNull()) continue;
 				double cdx = fabs((s->center.x - rect_x) - half_rect_w);
 				double cdy = fabs((s->center.y - rect_y) - half_rect_h);
 				bool contains = true;
@@ -2025,93 +2060,44 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 					double corner_dist_sq = t1*t1 + t2*t2;
 					contains = corner_dist_sq <= (s->radius)*(s->radius); 
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}
 		} else if (brushtype == circle) {
 			double radius = GenUtils::distance(sel1, sel2);
+			int r = (int) ceil(radius);
+			QuerySelectableShps(sel1.x - r, sel1.y - r, sel1.x + r, sel1.y + r,
+                                cands);
 			// determine if circles overlap
-			for (int i=0; i<hl_size; i++) {
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i))
                     continue;
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
-				if (s->isNull()) continue;
-				bool contains = (radius + s->radius >=
-								 GenUtils::distance(sel1, s->center));
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (radius + s->radius >= GenUtils::distance(sel1, s->center)) {
+                    hits.push_back(i);
+                }
 			}
 		} else if (brushtype == line) {
 			wxRealPoint hp((sel1.x+sel2.x)/2.0, (sel1.y+sel2.y)/2.0);
 			double hp_rad = GenUtils::distance(sel1, sel2)/2.0;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableShps(sel1.x, sel1.y, sel2.x, sel2.y, cands);
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i))
                     continue;
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
-				if (s->isNull()) continue;
 				bool contains = ((GenUtils::pointToLineDist(s->center,
 														   sel1, sel2) <=
 								 s->radius) &&
 								 (GenUtils::distance(hp, s->center) <=
 								  hp_rad + s->radius));
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}
-		}
+		} else {
+            return;
+        }
 	}
-    if (selection_changed) {
-        int total_highlighted = 1; // used for MapCanvas::Drawlayer1
-        highlight_state->SetTotalHighlighted(total_highlighted);
-        highlight_timer->Start(50);
-    }
+    ApplySelection(hits, shiftdown, pointsel);
 }
 
 // The following function assumes that the set of selectable objects
@@ -2121,20 +2107,21 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
     
-    std::vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
+    std::vector<int>& cands = sel_cands;
+    std::vector<int> hits;
 	
 	GdaPolyLine* p;
 	if (pointsel) { // a point selection
 		double radius = 3.0;
 		wxRealPoint hp;
 		double hp_rad;
-		for (int i=0; i<hl_size; i++) {
+		QuerySelectableShps(sel1.x - 3, sel1.y - 3, sel1.x + 3, sel1.y + 3,
+                            cands);
+		for (size_t k=0; k<cands.size(); k++) {
+            int i = cands[k];
             if ( !_IsShpValid(i))
                 continue;
 			p = (GdaPolyLine*) selectable_shps[i];
-			if (p->isNull()) continue;
-			bool contains = false;
 			for (int j=0, its=p->n-1; j<its; j++) {
 				hp.x = (p->points[j].x + p->points[j+1].x)/2.0;
 				hp.y = (p->points[j].y + p->points[j+1].y)/2.0;
@@ -2147,24 +2134,10 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 					 radius) &&
 					(GenUtils::distance(hp, sel1) <= hp_rad + radius))
 				{
-					contains = true;
+					hits.push_back(i);
 					break;
 				}
 			}
-			if (contains) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}
 		}
 	} else { // determine which obs intersect the selection region.
 		if (brushtype == rectangle) {
@@ -2177,12 +2150,12 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 			uleft.y = uright.y;
 			lright.x = uright.x;
 			lright.y = lleft.y;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableShps(sel1.x, sel1.y, sel2.x, sel2.y, cands);
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i))
                     continue;
 				p = (GdaPolyLine*) selectable_shps[i];
-				if (p->isNull()) continue;
-				bool contains = false;
 				for (int j=0, its=p->n-1; j<its; j++) {
                     wxPoint& pt = p->points[j];
                     wxPoint& next_pt = p->points[j+1];
@@ -2191,76 +2164,42 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 						GenGeomAlgs::LineSegsIntersect(pt, next_pt, uright, lright) ||
 						GenGeomAlgs::LineSegsIntersect(pt, next_pt, lright, lleft))
 					{
-						contains = true;
+						hits.push_back(i);
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
 			}
 		} else if (brushtype == line) {
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableShps(sel1.x, sel1.y, sel2.x, sel2.y, cands);
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i))
                     continue;
                 
 				p = (GdaPolyLine*) selectable_shps[i];
-				if (p->isNull()) continue;
-				bool contains = false;
 				for (int j=0, its=p->n-1; j<its; j++) {
                     wxPoint& pt = p->points[j];
                     wxPoint& next_pt = p->points[j+1];
 					if (GenGeomAlgs::LineSegsIntersect(pt, next_pt, sel1, sel2))
 					{
-						contains = true;
+						hits.push_back(i);
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
 			}	
 		} else if (brushtype == circle) {
 			double radius = GenUtils::distance(sel1, sel2);
+			int r = (int) ceil(radius);
 			wxRealPoint hp;
 			double hp_rad;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableShps(sel1.x - r, sel1.y - r, sel1.x + r, sel1.y + r,
+                                cands);
+			for (size_t k=0; k<cands.size(); k++) {
+                int i = cands[k];
                 if ( !_IsShpValid(i))
                     continue;
                 
 				p = (GdaPolyLine*) selectable_shps[i];
-				if (p->isNull()) continue;
-				bool contains = false;
 				for (int j=0, its=p->n-1; j<its; j++) {
                     wxPoint& pt = p->points[j];
                     wxPoint& next_pt = p->points[j+1];
@@ -2271,36 +2210,16 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 					if ((GenUtils::pointToLineDist(sel1, pt, next_pt) <= radius) &&
 						(GenUtils::distance(hp, sel1) <= hp_rad + radius))
 					{
-						contains = true;
+						hits.push_back(i);
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
 			}
-		}
+		} else {
+            return;
+        }
 	}
-    if (selection_changed) {
-        int total_highlighted = 1; // used for MapCanvas::Drawlayer1
-        highlight_state->SetTotalHighlighted(total_highlighted);
-        highlight_timer->Start(50);
-    }
+    ApplySelection(hits, shiftdown, pointsel);
 }
 
 void TemplateCanvas::SelectAllInCategory(int category,
@@ -2344,14 +2263,17 @@ void TemplateCanvas::DetermineMouseHoverObjects(wxPoint pt)
 {
 	total_hover_obs = 0;
     hover_obs.clear();
-	int total_obs = selectable_shps.size();
+    std::vector<int>& cands = sel_cands;
+    QuerySelectableShps(pt.x - sel_point_tol, pt.y - sel_point_tol,
+                        pt.x + sel_point_tol, pt.y + sel_point_tol, cands);
+	int total_cands = cands.size();
 	if (selectable_shps_type == circles) {
 		// slightly faster than GdaCircle::pointWithin
-		for (int i=0; i<total_obs && total_hover_obs<max_hover_obs; i++) {
+		for (int k=0; k<total_cands && total_hover_obs<max_hover_obs; k++) {
+            int i = cands[k];
             if ( !_IsShpValid(i))
                 continue;
 			GdaCircle* s = (GdaCircle*) selectable_shps[i];
-			if (s==NULL || s->isNull()) continue;
 			if (GenUtils::distance_sqrd(s->center, pt) <=
 				s->radius*s->radius) {
                 hover_obs.push_back(i);
@@ -2362,7 +2284,8 @@ void TemplateCanvas::DetermineMouseHoverObjects(wxPoint pt)
 			   selectable_shps_type == polylines ||
                selectable_shps_type == rectangles)
 	{
-		for (int i=0; i<total_obs && total_hover_obs<max_hover_obs; i++) {
+		for (int k=0; k<total_cands && total_hover_obs<max_hover_obs; k++) {
+            int i = cands[k];
             if ( !_IsShpValid(i))
                 continue;
 			if (selectable_shps[i]->pointWithin(pt)) {
@@ -2371,7 +2294,8 @@ void TemplateCanvas::DetermineMouseHoverObjects(wxPoint pt)
 			}
 		}
 	} else { // selectable_shps_type == points or anything without pointWithin
-		for (int i=0; i<total_obs && total_hover_obs<max_hover_obs; i++) {
+		for (int k=0; k<total_cands && total_hover_obs<max_hover_obs; k++) {
+            int i = cands[k];
             if ( !_IsShpValid(i))
                 continue;
 			if (GenUtils::distance_sqrd(selectable_shps[i]->center, pt)
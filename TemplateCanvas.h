@@ -38,6 +38,7 @@
 #include "HighlightStateObserver.h"
 #include "GdaShape.h"
 #include "GdaConst.h"
+#include "SelectableShpIndex.h"
 
 typedef boost::multi_array<GdaShape*, 2> shp_array_type;
 typedef boost::multi_array<int, 2> i_array_type;
@@ -155,6 +156,10 @@ public:
 										bool pointsel = false);
 	virtual void UpdateSelectionPolylines(bool shiftdown = false,
 										  bool pointsel = false);
+	/** Sets ids to the selectable shapes whose screen bounding box
+	 may intersect the rectangle, in increasing order */
+	void QuerySelectableShps(int x0, int y0, int x1, int y1,
+							 std::vector<int>& ids);
 	virtual void UpdateSelectRegion(bool translate = false,
 									wxPoint diff = wxPoint(0,0) );
 	/** Assumes selectable_shps.size() == num obs **/
@@ -362,6 +367,16 @@ protected:
 	wxPoint sel1;
 	wxPoint sel2;
     
+	SelectableShpIndex sel_shp_index; // built when first queried
+	std::vector<int> sel_cands; // for UpdateSelection and hover
+	// per obs: 1 hit by the brush, 2 and 4 in the newly highlighted and
+	// unhighlighted lists
+	std::vector<unsigned char> sel_marks;
+	void ApplySelection(const std::vector<int>& hits, bool shiftdown,
+						bool toggle);
+	void AddSelDelta(int i, bool highlighted);
+	void ClearSelDeltas();
+    
 	std::vector<int> hover_obs; // list of obs mouse is hovering over
 	int total_hover_obs; // total obs in list
 	int max_hover_obs;
@@ -0,0 +1,801 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#define BOOST_PHOENIX_STL_TUPLE_H_
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/math/special_functions/round.hpp>
+#include <boost/uuid/nil_generator.hpp>
+#include "../ShapeOperations/GalWeight.h"
+#include "../GdaConst.h"
+#include "NumericTests.h"
+#include "GdaExprProgram.h"
+
+namespace {
+	// element-wise kernels: simple loops over a block, vectorized by the
+	// compiler where the operation allows it
+	template <class Op>
+	void ApplyUnary(const double* x, double* r, int len, Op op)
+	{
+		for (int k=0; k<len; ++k) r[k] = op(x[k]);
+	}
+
+	template <class Op>
+	void ApplyBinary(const double* x, const double* y, double* r, int len,
+					 Op op)
+	{
+		for (int k=0; k<len; ++k) r[k] = op(x[k], y[k]);
+	}
+
+	struct NegOp { double operator()(double a) const { return -a; } };
+	struct NotOp { double operator()(double a) const { return a == 0; } };
+	struct RoundOp {
+		double operator()(double a) const { return boost::math::round(a); }
+	};
+	struct FuncOp {
+		double (*f)(double);
+		FuncOp(double (*f_)(double)) : f(f_) {}
+		double operator()(double a) const { return f(a); }
+	};
+
+	struct AddOp { double operator()(double a, double b) const { return a + b; } };
+	struct SubOp { double operator()(double a, double b) const { return a - b; } };
+	struct MulOp { double operator()(double a, double b) const { return a * b; } };
+	struct DivOp { double operator()(double a, double b) const { return a / b; } };
+	struct PowOp {
+		double operator()(double a, double b) const { return pow(a, b); }
+	};
+	// same results as Gda::lt, Gda::logical_or, ... of NumericTests
+	struct LtOp { double operator()(double a, double b) const { return a < b; } };
+	struct LeOp { double operator()(double a, double b) const { return a <= b; } };
+	struct GtOp { double operator()(double a, double b) const { return a > b; } };
+	struct GeOp { double operator()(double a, double b) const { return a >= b; } };
+	struct EqOp { double operator()(double a, double b) const { return a == b; } };
+	struct NeOp { double operator()(double a, double b) const { return a != b; } };
+	struct AndOp {
+		double operator()(double a, double b) const { return a != 0 && b != 0; }
+	};
+	struct OrOp {
+		double operator()(double a, double b) const { return a != 0 || b != 0; }
+	};
+	struct XorOp {
+		double operator()(double a, double b) const {
+			return (a != 0) != (b != 0);
+		}
+	};
+
+	/* runs job(a, b) on one range of [0, n) per core */
+	template <class Job>
+	void RunThreaded(size_t n, const Job& job)
+	{
+		int nCPUs = boost::thread::hardware_concurrency();
+		if (GdaConst::gda_set_cpu_cores) nCPUs = GdaConst::gda_cpu_cores;
+		if (nCPUs < 1) nCPUs = 1;
+		size_t max_threads = n / (4 * GdaExprProgram::block_size);
+		if ((size_t)nCPUs > max_threads) nCPUs = (int)max_threads;
+		if (nCPUs <= 1) {
+			job(0, n);
+			return;
+		}
+		boost::thread_group threadPool;
+		for (int i=0; i<nCPUs; i++) {
+			size_t a = n * i / nCPUs;
+			size_t b = n * (i+1) / nCPUs;
+			threadPool.create_thread(boost::bind<void>(job, a, b));
+		}
+		threadPool.join_all();
+	}
+
+	/* average of the neighbors, as WeightsNewManager::Lag() computes it,
+	   for all time periods of rows [a, b) */
+	struct LagJob {
+		const GalElement* W;
+		const double* x;
+		double* y;
+		size_t tms;
+		void operator()(size_t a, size_t b) const {
+			for (size_t i=a; i<b; ++i) {
+				double* yi = y + i*tms;
+				for (size_t t=0; t<tms; ++t) yi[t] = 0;
+				size_t nbrs = W[i].Size();
+				for (size_t n=0; n<nbrs; ++n) {
+					const double* xn = x + W[i][n]*tms;
+					for (size_t t=0; t<tms; ++t) yi[t] += xn[t];
+				}
+				for (size_t t=0; t<tms; ++t) yi[t] /= ((double) nbrs);
+			}
+		}
+	};
+}
+
+GdaExprProgram::GdaExprProgram()
+	: tok_i(0), data_table(0), w_man_int(0), root(-1)
+{
+	root_code.num_regs = 0;
+}
+
+GdaExprProgram::~GdaExprProgram()
+{
+}
+
+bool GdaExprProgram::Compile(const std::vector<GdaTokenDetails>& tokens_,
+							 std::map<wxString, GdaFVSmtPtr>* data_table_,
+							 WeightsManInterface* w_man_int_)
+{
+	tokens = tokens_;
+	data_table = data_table_;
+	w_man_int = w_man_int_;
+	tok_i = 0;
+	nodes.clear();
+	root_code.instrs.clear();
+	root_code.num_regs = 0;
+	root = expression();
+	if (root >= 0 && !IsData(root)) root = -1;
+	return root >= 0;
+}
+
+bool GdaExprProgram::Run()
+{
+	if (root < 0) return false;
+	try {
+		// nodes are in the order GdaParser evaluates them, so the
+		// argument functions with random numbers draw them in that order
+		for (size_t n=0; n<nodes.size(); ++n) {
+			if (!Evaluate((int)n)) return false;
+		}
+	}
+	catch (GdaFVException e) {
+		return false;
+	}
+	catch (std::bad_alloc e) {
+		return false;
+	}
+	MakeCode(root, root_code);
+	return true;
+}
+
+void GdaExprProgram::SetValue(GdaFVSmtPtr v)
+{
+	nodes.clear();
+	root = AddInput(v);
+	SetShape(root);
+	MakeCode(root, root_code);
+}
+
+size_t GdaExprProgram::GetObs() const
+{
+	return root < 0 ? 0 : nodes[root].obs;
+}
+
+size_t GdaExprProgram::GetTms() const
+{
+	return root < 0 ? 0 : nodes[root].tms;
+}
+
+double GdaExprProgram::GetDouble()
+{
+	if (root < 0 || nodes[root].obs < 1 || nodes[root].tms < 1) {
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+	double v = 0;
+	RunRows(root_code, root, 0, 0, 1, &v, 1);
+	return v;
+}
+
+void GdaExprProgram::GetColumn(size_t t, size_t num_obs, double* col)
+{
+	double nan = std::numeric_limits<double>::quiet_NaN();
+	if (root < 0 || nodes[root].obs < 1 || nodes[root].tms < 1) {
+		for (size_t i=0; i<num_obs; ++i) col[i] = nan;
+		return;
+	}
+	const Node& nd = nodes[root];
+	if (t >= nd.tms) t = nd.tms-1;
+	if (nd.obs == 1) {
+		double v = 0;
+		RunRows(root_code, root, t, 0, 1, &v, 1);
+		for (size_t i=0; i<num_obs; ++i) col[i] = v;
+		return;
+	}
+	size_t n = std::min(num_obs, nd.obs);
+	RunRowsThreaded(root_code, root, t, n, col, 1);
+	for (size_t i=n; i<num_obs; ++i) col[i] = nan;
+}
+
+bool GdaExprProgram::IsElementWise(int n) const
+{
+	OpEnum op = nodes[n].op;
+	return op >= op_neg && op <= op_xor;
+}
+
+bool GdaExprProgram::IsData(int n) const
+{
+	return nodes[n].op != op_weights;
+}
+
+int GdaExprProgram::AddNode(OpEnum op, int a, int b, int c)
+{
+	Node nd;
+	nd.op = op;
+	nd.a = a;
+	nd.b = b;
+	nd.c = c;
+	nd.value = 0;
+	nd.w_uuid = boost::uuids::nil_uuid();
+	nd.obs = 1;
+	nd.tms = 1;
+	nodes.push_back(nd);
+	return (int)nodes.size()-1;
+}
+
+int GdaExprProgram::AddInput(GdaFVSmtPtr v)
+{
+	int n = AddNode(op_input);
+	nodes[n].input = v;
+	return n;
+}
+
+int GdaExprProgram::expression()
+{
+	return logical_xor_expr();
+}
+
+int GdaExprProgram::binary(OpEnum op, int a, int b)
+{
+	if (a < 0 || b < 0 || !IsData(a) || !IsData(b)) return -1;
+	return AddNode(op, a, b);
+}
+
+int GdaExprProgram::unary(OpEnum op, int a)
+{
+	if (a < 0 || !IsData(a)) return -1;
+	return AddNode(op, a);
+}
+
+int GdaExprProgram::logical_xor_expr()
+{
+	int left = logical_or_expr();
+	while (left >= 0 && curr_token() == Gda::XOR) {
+		inc_token(); // consume XOR
+		left = binary(op_xor, left, logical_or_expr());
+	}
+	return left;
+}
+
+int GdaExprProgram::logical_or_expr()
+{
+	int left = logical_and_expr();
+	while (left >= 0 && curr_token() == Gda::OR) {
+		inc_token(); // consume OR
+		left = binary(op_or, left, logical_and_expr());
+	}
+	return left;
+}
+
+int GdaExprProgram::logical_and_expr()
+{
+	int left = logical_not_expr();
+	while (left >= 0 && curr_token() == Gda::AND) {
+		inc_token(); // consume AND
+		left = binary(op_and, left, logical_not_expr());
+	}
+	return left;
+}
+
+int GdaExprProgram::logical_not_expr()
+{
+	if (curr_token() == Gda::NOT) {
+		inc_token(); // consume NOT
+		return unary(op_not, expression());
+	}
+	return comp_expr();
+}
+
+int GdaExprProgram::comp_expr()
+{
+	int left = add_expr();
+	for (;;) {
+		if (left < 0) return left;
+		OpEnum op;
+		switch (curr_token()) {
+			case Gda::LT: op = op_lt; break;
+			case Gda::LE: op = op_le; break;
+			case Gda::GT: op = op_gt; break;
+			case Gda::GE: op = op_ge; break;
+			case Gda::EQ: op = op_eq; break;
+			case Gda::NE: op = op_ne; break;
+			default: return left;
+		}
+		inc_token(); // consume comparison
+		left = binary(op, left, add_expr());
+	}
+}
+
+int GdaExprProgram::add_expr()
+{
+	int left = mult_expr();
+	for (;;) {
+		if (left < 0) return left;
+		if (curr_token() == Gda::PLUS) {
+			inc_token(); // consume '+'
+			left = binary(op_add, left, mult_expr());
+		} else if (curr_token() == Gda::MINUS) {
+			inc_token(); // consume '-'
+			left = binary(op_sub, left, mult_expr());
+		} else {
+			return left;
+		}
+	}
+}
+
+int GdaExprProgram::mult_expr()
+{
+	int left = pow_expr();
+	for (;;) {
+		if (left < 0) return left;
+		if (curr_token() == Gda::MUL) {
+			inc_token(); // consume '*'
+			left = binary(op_mul, left, pow_expr());
+		} else if (curr_token() == Gda::DIV) {
+			inc_token(); // consume '/'
+			left = binary(op_div, left, pow_expr());
+		} else {
+			return left;
+		}
+	}
+}
+
+int GdaExprProgram::pow_expr()
+{
+	int left = func_expr();
+	if (left >= 0 && curr_token() == Gda::POW) {
+		inc_token(); // consume '^'
+		return binary(op_pow, left, expression());
+	}
+	return left;
+}
+
+int GdaExprProgram::func_expr()
+{
+	if (curr_token() != Gda::NAME || next_token() != Gda::LP) {
+		return primary();
+	}
+	wxString f = curr_tok_str_val();
+	inc_token(); // consume NAME token
+	inc_token(); // consume '('
+	// rook() and queen() are not supported by GdaParser either
+	if (curr_token() == Gda::RP) return -1;
+
+	int arg1 = expression();
+	if (arg1 < 0) return -1;
+	if (curr_token() == Gda::RP) {
+		inc_token(); // consume ')'
+		if (f.CmpNoCase("counts") == 0) {
+			if (!w_man_int || IsData(arg1)) return -1;
+			return AddNode(op_counts, arg1);
+		}
+		OpEnum op;
+		if (f.CmpNoCase("sqrt") == 0) op = op_sqrt;
+		else if (f.CmpNoCase("cos") == 0) op = op_cos;
+		else if (f.CmpNoCase("sin") == 0) op = op_sin;
+		else if (f.CmpNoCase("tan") == 0) op = op_tan;
+		else if (f.CmpNoCase("acos") == 0) op = op_acos;
+		else if (f.CmpNoCase("asin") == 0) op = op_asin;
+		else if (f.CmpNoCase("atan") == 0) op = op_atan;
+		else if (f.CmpNoCase("abs") == 0 ||
+				 f.CmpNoCase("fabs") == 0) op = op_fabs;
+		else if (f.CmpNoCase("ceil") == 0) op = op_ceil;
+		else if (f.CmpNoCase("floor") == 0) op = op_floor;
+		else if (f.CmpNoCase("round") == 0) op = op_round;
+		else if (f.CmpNoCase("log") == 0 ||
+				 f.CmpNoCase("ln") == 0) op = op_log;
+		else if (f.CmpNoCase("log10") == 0) op = op_log10;
+		else if (f.CmpNoCase("sum") == 0) op = op_sum;
+		else if (f.CmpNoCase("mean") == 0 ||
+				 f.CmpNoCase("avg") == 0) op = op_mean;
+		else if (f.CmpNoCase("stddev") == 0) op = op_stddev;
+		else if (f.CmpNoCase("dev_fr_mean") == 0) op = op_dev_fr_mean;
+		else if (f.CmpNoCase("standardize") == 0) op = op_standardize;
+		else if (f.CmpNoCase("shuffle") == 0) op = op_shuffle;
+		else if (f.CmpNoCase("rot_down") == 0) op = op_rot_down;
+		else if (f.CmpNoCase("rot_up") == 0) op = op_rot_up;
+		else if (f.CmpNoCase("unif_dist") == 0) op = op_unif_dist;
+		else if (f.CmpNoCase("norm_dist") == 0) op = op_norm_dist;
+		else if (f.CmpNoCase("enumerate") == 0) op = op_enumerate;
+		else if (f.CmpNoCase("max") == 0) op = op_max;
+		else if (f.CmpNoCase("min") == 0) op = op_min;
+		else if (f.CmpNoCase("is_defined") == 0) op = op_is_defined;
+		else if (f.CmpNoCase("is_finite") == 0) op = op_is_finite;
+		else if (f.CmpNoCase("is_nan") == 0) op = op_is_nan;
+		else if (f.CmpNoCase("is_pos_inf") == 0) op = op_is_pos_inf;
+		else if (f.CmpNoCase("is_neg_inf") == 0) op = op_is_neg_inf;
+		else if (f.CmpNoCase("is_inf") == 0) op = op_is_inf;
+		else return -1;
+		return unary(op, arg1);
+	}
+	if (curr_token() != Gda::COMMA) return -1;
+	inc_token(); // consume ','
+	int arg2 = expression();
+	if (arg2 < 0) return -1;
+	if (curr_token() == Gda::RP) {
+		inc_token(); // consume ')'
+		if (f.CmpNoCase("pow") == 0) {
+			return binary(op_pow, arg1, arg2);
+		} else if (f.CmpNoCase("lag") == 0) {
+			if (!w_man_int || IsData(arg1) || !IsData(arg2) ||
+				!w_man_int->WeightsExists(nodes[arg1].w_uuid)) {
+				return -1;
+			}
+			return AddNode(op_lag, arg1, arg2);
+		}
+		return -1;
+	}
+	if (curr_token() != Gda::COMMA) return -1;
+	inc_token(); // consume ','
+	int arg3 = expression();
+	if (arg3 < 0 || curr_token() != Gda::RP) return -1;
+	inc_token(); // consume ')'
+	if (!IsData(arg1) || !IsData(arg2) || !IsData(arg3)) return -1;
+	if (f.CmpNoCase("enumerate") == 0) {
+		return AddNode(op_enumerate, arg1, arg2, arg3);
+	} else if (f.CmpNoCase("norm_dist") == 0) {
+		return AddNode(op_norm_dist, arg1, arg2, arg3);
+	}
+	return -1;
+}
+
+int GdaExprProgram::primary()
+{
+	if (curr_token() == Gda::NUMBER) {
+		int n = AddNode(op_const);
+		nodes[n].value = tokens[tok_i].number_value;
+		inc_token(); // consume NUMBER token
+		return n;
+	} else if (curr_token() == Gda::NAME) {
+		wxString key(curr_tok_str_val());
+		inc_token(); // consume NAME token
+		std::map<wxString, GdaFVSmtPtr>::iterator it = data_table->find(key);
+		if (it != data_table->end()) {
+			// read in place: GdaParser copies the column here
+			return AddInput(it->second);
+		}
+		if (!w_man_int) return -1;
+		boost::uuids::uuid u = w_man_int->FindIdByTitle(key);
+		if (u.is_nil()) return -1;
+		int n = AddNode(op_weights);
+		nodes[n].w_uuid = u;
+		return n;
+	} else if (curr_token() == Gda::MINUS) { // unary minus
+		inc_token(); // consume '-'
+		return unary(op_neg, primary());
+	} else if (curr_token() == Gda::LP) {
+		inc_token(); // consume '('
+		int e = expression();
+		if (e < 0 || curr_token() != Gda::RP) return -1;
+		inc_token(); // consume ')'
+		return e;
+	}
+	// string literals are only used by GdaParser for error messages
+	return -1;
+}
+
+Gda::TokenEnum GdaExprProgram::curr_token()
+{
+	if (tok_i >= tokens.size()) return Gda::END;
+	return tokens[tok_i].token;
+}
+
+Gda::TokenEnum GdaExprProgram::next_token()
+{
+	size_t ii = tok_i + 1;
+	if (ii >= tokens.size()) return Gda::END;
+	return tokens[ii].token;
+}
+
+wxString GdaExprProgram::curr_tok_str_val()
+{
+	if (tok_i >= tokens.size() ||
+		(curr_token() != Gda::NAME &&
+		 curr_token() != Gda::STRING)) return "";
+	return tokens[tok_i].string_value;
+}
+
+void GdaExprProgram::inc_token()
+{
+	++tok_i;
+}
+
+bool GdaExprProgram::SetShape(int n)
+{
+	Node& nd = nodes[n];
+	if (nd.op == op_weights) return true;
+	if (nd.op == op_const) {
+		nd.obs = 1;
+		nd.tms = 1;
+		return true;
+	}
+	if (nd.input) {
+		nd.obs = nd.input->GetObs();
+		nd.tms = nd.input->GetTms();
+		return nd.obs > 0 && nd.tms > 0 &&
+			nd.input->GetValArrayRef().size() == nd.obs*nd.tms;
+	}
+	const Node& a = nodes[nd.a];
+	if (nd.b < 0) {
+		nd.obs = a.obs;
+		nd.tms = a.tms;
+		return true;
+	}
+	// the dimensions GdaFlexValue::grow_if_smaller() gives both operands
+	const Node& b = nodes[nd.b];
+	if (a.obs > 1 && b.obs > 1 && a.obs != b.obs) return false;
+	if (a.tms > 1 && b.tms > 1 && a.tms != b.tms) return false;
+	nd.obs = std::max(a.obs, b.obs);
+	nd.tms = std::max(a.tms, b.tms);
+	return true;
+}
+
+bool GdaExprProgram::Evaluate(int n)
+{
+	Node& nd = nodes[n];
+	if (nd.op == op_input || nd.op == op_const || nd.op == op_weights ||
+		IsElementWise(n)) {
+		return SetShape(n);
+	}
+	if (nd.op == op_lag) {
+		if (!Lag(n)) return false;
+		return SetShape(n);
+	}
+	if (nd.op == op_counts) {
+		std::vector<long> counts;
+		if (!w_man_int->GetCounts(nodes[nd.a].w_uuid, counts)) return false;
+		nd.input.reset(new GdaFlexValue(counts));
+		return SetShape(n);
+	}
+	double arg2 = 0, arg3 = 0;
+	if (nd.b >= 0) {
+		const Node& b = nodes[nd.b];
+		const Node& c = nodes[nd.c];
+		if (b.obs != 1 || b.tms != 1 || c.obs != 1 || c.tms != 1) {
+			return false;
+		}
+		arg2 = Materialize(nd.b)->GetDouble();
+		arg3 = Materialize(nd.c)->GetDouble();
+	}
+	GdaFVSmtPtr v = Materialize(nd.a);
+	switch (nd.op) {
+		case op_sum: v->Sum(); break;
+		case op_mean: v->Mean(); break;
+		case op_stddev: v->StdDev(); break;
+		case op_dev_fr_mean: v->DevFromMean(); break;
+		case op_standardize: v->Standardize(); break;
+		case op_shuffle: v->Shuffle(); break;
+		case op_rot_down: v->Rotate(-1); break;
+		case op_rot_up: v->Rotate(1); break;
+		case op_unif_dist: v->UniformDist(); break;
+		case op_max: v->Max(); break;
+		case op_min: v->Min(); break;
+		case op_norm_dist:
+			if (nd.b < 0) {
+				v->GaussianDist(0, 1);
+			} else {
+				// x-x == 0 is a reliable test for double being finite
+				if (arg3-arg3 != 0 || arg3 < 0) return false;
+				v->GaussianDist(arg2, arg3);
+			}
+			break;
+		case op_enumerate:
+			if (nd.b < 0) v->Enumerate(1, 1);
+			else v->Enumerate(arg2, arg3);
+			break;
+		default:
+			return false;
+	}
+	nodes[n].input = v;
+	return SetShape(n);
+}
+
+bool GdaExprProgram::Lag(int n)
+{
+	boost::uuids::uuid w_uuid = nodes[nodes[n].a].w_uuid;
+	const Node& x = nodes[nodes[n].b];
+	if (!w_man_int->WeightsExists(w_uuid)) return false;
+	if (x.obs == 1) {
+		// as in WeightsNewManager::Lag(), the data is the result
+		nodes[n].input = Materialize(nodes[n].b);
+		return true;
+	}
+	GalWeight* gw = w_man_int->GetGal(w_uuid);
+	if (!gw || !gw->gal || gw->num_obs != (int)x.obs) return false;
+
+	GdaFVSmtPtr xv = x.input ? x.input : Materialize(nodes[n].b);
+	GdaFVSmtPtr v(new GdaFlexValue(x.obs, x.tms));
+	LagJob job;
+	job.W = gw->gal;
+	job.x = &xv->GetValArrayRef()[0];
+	job.y = &v->GetValArrayRef()[0];
+	job.tms = x.tms;
+	RunThreaded(x.obs, job);
+	nodes[n].input = v;
+	return true;
+}
+
+GdaFVSmtPtr GdaExprProgram::Materialize(int n)
+{
+	const Node& nd = nodes[n];
+	if (nd.op == op_const) {
+		return GdaFVSmtPtr(new GdaFlexValue(nd.value));
+	}
+	if (nd.input) {
+		// the argument functions change their value in place
+		return GdaFVSmtPtr(new GdaFlexValue(*nd.input));
+	}
+	GdaFVSmtPtr v(new GdaFlexValue(nd.obs, nd.tms));
+	Code code;
+	MakeCode(n, code);
+	double* V = &v->GetValArrayRef()[0];
+	for (size_t t=0; t<nd.tms; ++t) {
+		RunRowsThreaded(code, n, t, nd.obs, V+t, nd.tms);
+	}
+	return v;
+}
+
+void GdaExprProgram::MakeCode(int n, Code& code)
+{
+	code.instrs.clear();
+	code.num_regs = 0;
+	MakeCode(n, code, 0);
+}
+
+void GdaExprProgram::MakeCode(int n, Code& code, int reg)
+{
+	const Node& nd = nodes[n];
+	Instr in;
+	in.dst = reg;
+	in.a = -1;
+	in.b = -1;
+	in.node = n;
+	if (nd.op == op_const) {
+		in.op = op_const;
+	} else if (nd.input) {
+		in.op = op_input;
+	} else {
+		in.op = nd.op;
+		MakeCode(nd.a, code, reg);
+		in.a = reg;
+		if (nd.b >= 0) {
+			MakeCode(nd.b, code, reg+1);
+			in.b = reg+1;
+		}
+	}
+	code.instrs.push_back(in);
+	if (reg+1 > code.num_regs) code.num_regs = reg+1;
+}
+
+void GdaExprProgram::RunRowsThreaded(const Code& code, int n, size_t t,
+									 size_t num_obs, double* out,
+									 size_t stride)
+{
+	RunThreaded(num_obs, boost::bind(&GdaExprProgram::RunRows, this,
+									 boost::cref(code), n, t,
+									 boost::placeholders::_1,
+									 boost::placeholders::_2, out, stride));
+}
+
+void GdaExprProgram::RunRows(const Code& code, int n, size_t t, size_t i0,
+							 size_t i1, double* out, size_t stride)
+{
+	std::vector<double> scratch(code.num_regs * block_size);
+	std::vector<const double*> regs(code.num_regs);
+	for (size_t i=i0; i<i1; i+=block_size) {
+		int len = (int)std::min((size_t)block_size, i1-i);
+		RunBlock(code, t, i, len, &scratch[0], &regs[0]);
+		const double* r = regs[0];
+		double* o = out + i*stride;
+		if (stride == 1) {
+			for (int k=0; k<len; ++k) o[k] = r[k];
+		} else {
+			for (int k=0; k<len; ++k) o[k*stride] = r[k];
+		}
+	}
+}
+
+void GdaExprProgram::RunBlock(const Code& code, size_t t, size_t i0, int len,
+							  double* scratch, const double** regs)
+{
+	for (size_t k=0; k<code.instrs.size(); ++k) {
+		const Instr& in = code.instrs[k];
+		double* r = scratch + in.dst * block_size;
+		const double* x = in.a >= 0 ? regs[in.a] : 0;
+		const double* y = in.b >= 0 ? regs[in.b] : 0;
+		switch (in.op) {
+			case op_const: {
+				double v = nodes[in.node].value;
+				for (int j=0; j<len; ++j) r[j] = v;
+				break;
+			}
+			case op_input: {
+				// broadcast a single observation or time period as
+				// GdaFlexValue does
+				const Node& nd = nodes[in.node];
+				const double* V = &nd.input->GetValArrayRef()[0];
+				size_t tt = nd.tms == 1 ? 0 : t;
+				if (nd.obs == 1) {
+					double v = V[tt];
+					for (int j=0; j<len; ++j) r[j] = v;
+				} else if (nd.tms == 1) {
+					// read the column in place
+					regs[in.dst] = V + i0;
+					continue;
+				} else {
+					const double* src = V + i0*nd.tms + tt;
+					for (int j=0; j<len; ++j) r[j] = src[j*nd.tms];
+				}
+				break;
+			}
+			case op_neg: ApplyUnary(x, r, len, NegOp()); break;
+			case op_not: ApplyUnary(x, r, len, NotOp()); break;
+			case op_sqrt: ApplyUnary(x, r, len, FuncOp(sqrt)); break;
+			case op_cos: ApplyUnary(x, r, len, FuncOp(cos)); break;
+			case op_sin: ApplyUnary(x, r, len, FuncOp(sin)); break;
+			case op_tan: ApplyUnary(x, r, len, FuncOp(tan)); break;
+			case op_acos: ApplyUnary(x, r, len, FuncOp(acos)); break;
+			case op_asin: ApplyUnary(x, r, len, FuncOp(asin)); break;
+			case op_atan: ApplyUnary(x, r, len, FuncOp(atan)); break;
+			case op_fabs: ApplyUnary(x, r, len, FuncOp(fabs)); break;
+			case op_ceil: ApplyUnary(x, r, len, FuncOp(ceil)); break;
+			case op_floor: ApplyUnary(x, r, len, FuncOp(floor)); break;
+			case op_round: ApplyUnary(x, r, len, RoundOp()); break;
+			case op_log: ApplyUnary(x, r, len, FuncOp(log)); break;
+			case op_log10: ApplyUnary(x, r, len, FuncOp(log10)); break;
+			case op_is_defined:
+				ApplyUnary(x, r, len, FuncOp(Gda::is_defined)); break;
+			case op_is_finite:
+				ApplyUnary(x, r, len, FuncOp(Gda::is_finite)); break;
+			case op_is_nan:
+				ApplyUnary(x, r, len, FuncOp(Gda::is_nan)); break;
+			case op_is_pos_inf:
+				ApplyUnary(x, r, len, FuncOp(Gda::is_pos_inf)); break;
+			case op_is_neg_inf:
+				ApplyUnary(x, r, len, FuncOp(Gda::is_neg_inf)); break;
+			case op_is_inf:
+				ApplyUnary(x, r, len, FuncOp(Gda::is_inf)); break;
+			case op_add: ApplyBinary(x, y, r, len, AddOp()); break;
+			case op_sub: ApplyBinary(x, y, r, len, SubOp()); break;
+			case op_mul: ApplyBinary(x, y, r, len, MulOp()); break;
+			case op_div: ApplyBinary(x, y, r, len, DivOp()); break;
+			case op_pow: ApplyBinary(x, y, r, len, PowOp()); break;
+			case op_lt: ApplyBinary(x, y, r, len, LtOp()); break;
+			case op_le: ApplyBinary(x, y, r, len, LeOp()); break;
+			case op_gt: ApplyBinary(x, y, r, len, GtOp()); break;
+			case op_ge: ApplyBinary(x, y, r, len, GeOp()); break;
+			case op_eq: ApplyBinary(x, y, r, len, EqOp()); break;
+			case op_ne: ApplyBinary(x, y, r, len, NeOp()); break;
+			case op_and: ApplyBinary(x, y, r, len, AndOp()); break;
+			case op_or: ApplyBinary(x, y, r, len, OrOp()); break;
+			case op_xor: ApplyBinary(x, y, r, len, XorOp()); break;
+			default: break;
+		}
+		regs[in.dst] = r;
+	}
+}
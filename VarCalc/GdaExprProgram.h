@@ -0,0 +1,160 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_GDA_EXPR_PROGRAM_H__
+#define __GEODA_CENTER_GDA_EXPR_PROGRAM_H__
+
+#include <map>
+#include <vector>
+#include <boost/uuid/uuid.hpp>
+#include <wx/string.h>
+#include "WeightsManInterface.h"
+#include "GdaFlexValue.h"
+#include "GdaLexer.h"
+
+/**
+ Calculator expression compiled once for the whole table. GdaParser
+ evaluates while it parses, and every operator copies its operands with one
+ value for each observation and time period. GdaExprProgram parses the same
+ grammar into nodes and turns every run of element-wise operators and
+ functions into one list of register instructions. Run() evaluates the list
+ on blocks of block_size rows, on all cores, with no full-length temporary.
+
+ A function that needs all of its argument (sum, mean, standardize, lag, ...)
+ is computed before the instructions that use it, with the same GdaFlexValue
+ method as GdaParser (lag loops over the neighbors of each row). Its result
+ is then read by the instructions like a table column.
+
+ Compile() returns false for what the program does not handle: string
+ literals, weights creation, unknown names or functions. Run() returns false
+ on an evaluation error, e.g. dimensions that don't match. In both cases the
+ caller evaluates the expression with GdaParser, which gives the error
+ message.
+ */
+class GdaExprProgram {
+public:
+	GdaExprProgram();
+	virtual ~GdaExprProgram();
+
+	bool Compile(const std::vector<GdaTokenDetails>& tokens,
+				 std::map<wxString, GdaFVSmtPtr>* data_table,
+				 WeightsManInterface* w_man_int);
+	bool Run();
+	/** Use a value computed by GdaParser instead of Compile() and Run() */
+	void SetValue(GdaFVSmtPtr v);
+
+	size_t GetObs() const;
+	size_t GetTms() const;
+	/** Value of the first observation and time period */
+	double GetDouble();
+	/** Values of time period t for num_obs rows; the value of a single
+	 observation is repeated */
+	void GetColumn(size_t t, size_t num_obs, double* col);
+
+	static const int block_size = 1024;
+
+protected:
+	enum OpEnum {
+		op_input, op_const, op_weights,
+		// element-wise
+		op_neg, op_not, op_sqrt, op_cos, op_sin, op_tan, op_acos, op_asin,
+		op_atan, op_fabs, op_ceil, op_floor, op_round, op_log, op_log10,
+		op_is_defined, op_is_finite, op_is_nan, op_is_pos_inf,
+		op_is_neg_inf, op_is_inf,
+		op_add, op_sub, op_mul, op_div, op_pow,
+		op_lt, op_le, op_gt, op_ge, op_eq, op_ne, op_and, op_or, op_xor,
+		// whole argument
+		op_sum, op_mean, op_stddev, op_dev_fr_mean, op_standardize,
+		op_shuffle, op_rot_down, op_rot_up, op_unif_dist, op_norm_dist,
+		op_enumerate, op_max, op_min, op_counts, op_lag
+	};
+
+	struct Node {
+		OpEnum op;
+		int a, b, c; // arguments, -1 if none
+		double value;
+		boost::uuids::uuid w_uuid;
+		GdaFVSmtPtr input; // table column or computed argument function
+		size_t obs, tms;
+	};
+
+	/** Register instruction: dst = op(a, b), or load node into dst */
+	struct Instr {
+		OpEnum op;
+		int dst, a, b;
+		int node;
+	};
+
+	struct Code {
+		std::vector<Instr> instrs;
+		int num_regs;
+	};
+
+	bool IsElementWise(int n) const;
+	bool IsData(int n) const;
+	int AddNode(OpEnum op, int a=-1, int b=-1, int c=-1);
+	int AddInput(GdaFVSmtPtr v);
+
+	// recursive descent as in GdaParser; -1 if the program can't run it
+	int expression();
+	int logical_xor_expr();
+	int logical_or_expr();
+	int logical_and_expr();
+	int logical_not_expr();
+	int comp_expr();
+	int add_expr();
+	int mult_expr();
+	int pow_expr();
+	int func_expr();
+	int primary();
+	int binary(OpEnum op, int a, int b);
+	int unary(OpEnum op, int a);
+
+	Gda::TokenEnum curr_token();
+	Gda::TokenEnum next_token();
+	wxString curr_tok_str_val();
+	void inc_token();
+
+	bool SetShape(int n);
+	bool Evaluate(int n);
+	bool Lag(int n);
+	GdaFVSmtPtr Materialize(int n);
+	void MakeCode(int n, Code& code);
+	void MakeCode(int n, Code& code, int reg);
+	/** values of node n at time period t for rows [i0, i1), written to
+	 out[i*stride]; the code must be made for node n */
+	void RunRows(const Code& code, int n, size_t t, size_t i0, size_t i1,
+				 double* out, size_t stride);
+	void RunRowsThreaded(const Code& code, int n, size_t t, size_t num_obs,
+						 double* out, size_t stride);
+	void RunBlock(const Code& code, size_t t, size_t i0, int len,
+				  double* scratch, const double** regs);
+
+	size_t tok_i;
+	std::vector<GdaTokenDetails> tokens;
+	std::map<wxString, GdaFVSmtPtr>* data_table;
+	WeightsManInterface* w_man_int;
+
+	std::vector<Node> nodes;
+	int root;
+	Code root_code;
+};
+
+#endif
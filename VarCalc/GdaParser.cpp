@@ -157,11 +157,7 @@ GdaFVSmtPtr GdaParser::add_expr()
 	for (;;) {
 		if (curr_token() == Gda::PLUS) {
 			inc_token(); // consume '+'
-			GdaFVSmtPtr right = mult_expr();
-			wxString ss;
-			ss << "GdaParser + op: operand " << (*left).ToStr();
-			ss << ", operand " << (*right).ToStr();
-			(*left) += (*right);
+			(*left) += (*mult_expr());
 		} else if (curr_token() == Gda::MINUS) {
 			inc_token(); // consume '-'
 			(*left) -= (*mult_expr());
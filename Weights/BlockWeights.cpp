@@ -80,7 +80,7 @@ BlockWeights::BlockWeights(const std::vector<std::vector<wxInt64>> &cat_values,
         cluster[i] = 0;
       } else {
         // check contiguity, and separate islands
-        std::vector<long> nbrs = gal[i].GetNbrs();
+        GalNbrs nbrs = gal[i].GetNbrs();
         cluster[i] = c;
         cluster_ids[i] = c;
         for (int j = 0; j < nn; ++j) {
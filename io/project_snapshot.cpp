@@ -0,0 +1,698 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <limits>
+#include <string.h>
+#include <math.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <wx/filename.h>
+#include <wx/file.h>
+#include <wx/log.h>
+
+#include "../GenUtils.h"
+#include "../GdaShape.h"
+#include "../ShpFile.h"
+#include "project_snapshot.h"
+
+using namespace boost::interprocess;
+
+const char* ProjectSnapshot::magic = "GEODASN";
+
+static int64_t SnapAlign(int64_t pos)
+{
+    return (pos + 7) & ~(int64_t)7;
+}
+
+template <class T>
+static void SnapWriteRaw(std::ostream& out, int64_t& pos, const T* v, size_t n)
+{
+    if (n > 0) out.write((const char*)v, (std::streamsize)(sizeof(T) * n));
+    pos += (int64_t)(sizeof(T) * n);
+}
+
+static void SnapPad(std::ostream& out, int64_t& pos)
+{
+    static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int64_t end = pos;
+    pos = SnapAlign(end);
+    if (pos > end) out.write(zeros, (std::streamsize)(pos - end));
+}
+
+template <class T>
+static void SnapWrite(std::ostream& out, int64_t& pos, const std::vector<T>& v)
+{
+    if (!v.empty()) SnapWriteRaw(out, pos, &v[0], v.size());
+    SnapPad(out, pos);
+}
+
+/** true if n values of type T at pos are inside the file */
+template <class T>
+static bool SnapCheck(int64_t fsz, int64_t pos, int64_t n)
+{
+    return pos >= (int64_t)sizeof(GdaSnapHeader) && pos % 8 == 0 && n >= 0 &&
+        pos + (int64_t)sizeof(T) * n <= fsz;
+}
+
+template <class T>
+static bool SnapRead(const char* base, int64_t fsz, int64_t pos, int64_t n,
+                     std::vector<T>& v)
+{
+    if (pos == 0 || !SnapCheck<T>(fsz, pos, n)) return false;
+    const T* p = (const T*)(base + pos);
+    v.assign(p, p + n);
+    return true;
+}
+
+ProjectSnapshot::ProjectSnapshot()
+: num_obs(0), source_size(0), source_mtime(0), source_hash(0),
+has_boundary(false), shapes(0), shapes_has_null(false), shapes_geom_type(0),
+must_rewrite(false)
+{
+    memset(&file_header, 0, sizeof(GdaSnapHeader));
+}
+
+ProjectSnapshot::~ProjectSnapshot()
+{
+}
+
+wxString ProjectSnapshot::GetSnapshotPath(const wxString& proj_fname,
+                                          const wxString& source_fname)
+{
+    wxFileName fn(proj_fname.IsEmpty() ? source_fname : proj_fname);
+    fn.SetExt("gdasnap");
+    return fn.GetFullPath();
+}
+
+bool ProjectSnapshot::ReadSourceInfo(const wxString& source_fname)
+{
+    wxFile src;
+    if (!wxFileExists(source_fname) || !src.Open(source_fname)) return false;
+
+    source_size = (int64_t)src.Length();
+    source_mtime = (int64_t)wxFileName(source_fname).GetModificationTime().GetTicks();
+
+    // FNV-1a of the first and the last 64 KB: enough to tell a rewritten
+    // file that kept its size and time, without reading a large file
+    const size_t block = 65536;
+    std::vector<unsigned char> buf(block);
+    uint64_t h = 14695981039346656037ULL;
+    for (int k=0; k<2; k++) {
+        wxFileOffset start = 0;
+        if (k == 1) {
+            if (source_size <= (int64_t)block) break;
+            start = (wxFileOffset)(source_size - block);
+        }
+        if (src.Seek(start) == wxInvalidOffset) return false;
+        ssize_t n = src.Read(&buf[0], block);
+        if (n < 0) return false;
+        for (ssize_t i=0; i<n; i++) {
+            h ^= buf[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    source_hash = h;
+    return true;
+}
+
+bool ProjectSnapshot::Open(const wxString& fname_s,
+                           const wxString& source_fname, int num_obs_s)
+{
+    fname = fname_s;
+    num_obs = num_obs_s;
+    centroids.clear();
+    mean_centers.clear();
+    parts.clear();
+    points.clear();
+    has_boundary = false;
+    tolerances.clear();
+    shapes = 0;
+    must_rewrite = false;
+    memset(&file_header, 0, sizeof(GdaSnapHeader));
+    if (!ReadSourceInfo(source_fname)) {
+        // no source file to check the snapshot against: don't keep one
+        fname = wxEmptyString;
+        return false;
+    }
+    if (!wxFileExists(fname)) return false;
+
+    try {
+        file_mapping file(GET_ENCODED_FILENAME(fname), read_only);
+        mapped_region region(file, read_only);
+        const char* base = (const char*)region.get_address();
+        int64_t fsz = (int64_t)region.get_size();
+        if (fsz < (int64_t)sizeof(GdaSnapHeader)) return false;
+
+        const GdaSnapHeader* header = (const GdaSnapHeader*)base;
+        if (strncmp(header->magic, magic, sizeof(header->magic)) != 0 ||
+            header->version != version ||
+            header->byte_order != byte_order_mark ||
+            header->file_size > fsz ||
+            header->num_obs != num_obs ||
+            header->source_size != source_size ||
+            header->source_mtime != source_mtime ||
+            header->source_hash != source_hash) {
+            wxLogMessage("ProjectSnapshot: %s is out of date", fname);
+            return false;
+        }
+        int64_t n2 = 2 * (int64_t)num_obs;
+        if (header->centroids_pos != 0 &&
+            !SnapRead(base, fsz, header->centroids_pos, n2, centroids)) {
+            return false;
+        }
+        if (header->mean_centers_pos != 0 &&
+            !SnapRead(base, fsz, header->mean_centers_pos, n2, mean_centers)) {
+            return false;
+        }
+        if (header->parts_pos != 0) {
+            if (!SnapRead(base, fsz, header->parts_pos, header->num_parts,
+                          parts) ||
+                !SnapRead(base, fsz, header->points_pos,
+                          2 * header->num_points, points)) {
+                parts.clear();
+                return false;
+            }
+            has_boundary = true;
+        }
+        if (header->tolerances_pos != 0 &&
+            !SnapRead(base, fsz, header->tolerances_pos,
+                      header->num_tolerances, tolerances)) {
+            tolerances.clear();
+            return false;
+        }
+        file_header = *header;
+    } catch (interprocess_exception& e) {
+        wxLogMessage("ProjectSnapshot::Open() %s: %s", fname, e.what());
+        centroids.clear();
+        mean_centers.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ProjectSnapshot::GetShapes(Shapefile::Main& main, bool& has_null_geometry,
+                                int& geom_type)
+{
+    const GdaSnapHeader& h = file_header;
+    if (fname.IsEmpty() || h.shape_kinds_pos == 0) return false;
+    int64_t n = num_obs;
+    bool success = true;
+    main.records.resize(num_obs);
+    try {
+        // the shapes are built straight from the mapped file, without
+        // copying the sections first
+        file_mapping file(GET_ENCODED_FILENAME(fname), read_only);
+        mapped_region region(file, read_only);
+        const char* base = (const char*)region.get_address();
+        int64_t fsz = (int64_t)region.get_size();
+        if (fsz < h.file_size ||
+            !SnapCheck<int32_t>(fsz, h.shape_kinds_pos, 2 * n) ||
+            !SnapCheck<double>(fsz, h.shape_boxes_pos, 4 * n) ||
+            !SnapCheck<int64_t>(fsz, h.shape_part_offsets_pos, n + 1) ||
+            !SnapCheck<int32_t>(fsz, h.shape_parts_pos, 2 * h.num_shape_parts) ||
+            !SnapCheck<int64_t>(fsz, h.shape_point_offsets_pos, n + 1) ||
+            !SnapCheck<double>(fsz, h.shape_points_pos, 2 * h.num_shape_points)) {
+            success = false;
+        } else {
+            const int32_t* kinds = (const int32_t*)(base + h.shape_kinds_pos);
+            const double* boxes = (const double*)(base + h.shape_boxes_pos);
+            const int64_t* part_offsets =
+                (const int64_t*)(base + h.shape_part_offsets_pos);
+            const int32_t* parts = (const int32_t*)(base + h.shape_parts_pos);
+            const int64_t* point_offsets =
+                (const int64_t*)(base + h.shape_point_offsets_pos);
+            const double* xy = (const double*)(base + h.shape_points_pos);
+            for (int i=0; i<num_obs && success; i++) {
+                int64_t p0 = part_offsets[i], p1 = part_offsets[i+1];
+                int64_t q0 = point_offsets[i], q1 = point_offsets[i+1];
+                if (p0 < 0 || p0 > p1 || p1 > h.num_shape_parts ||
+                    q0 < 0 || q0 > q1 || q1 > h.num_shape_points) {
+                    success = false;
+                } else if (kinds[2*i] == Shapefile::POINT_TYP && q1 == q0 + 1) {
+                    Shapefile::PointContents* pc =
+                        new Shapefile::PointContents();
+                    pc->shape_type = kinds[2*i+1];
+                    pc->x = xy[2*q0];
+                    pc->y = xy[2*q0+1];
+                    main.records[i].contents_p = pc;
+                } else if (kinds[2*i] == Shapefile::POLYGON) {
+                    Shapefile::PolygonContents* pc =
+                        new Shapefile::PolygonContents();
+                    pc->shape_type = kinds[2*i+1];
+                    pc->box.assign(boxes + 4*i, boxes + 4*i + 4);
+                    pc->num_parts = (wxInt32)(p1 - p0);
+                    pc->num_points = (wxInt32)(q1 - q0);
+                    pc->parts.resize(pc->num_parts);
+                    pc->isClockwise.resize(pc->num_parts);
+                    for (int j=0; j<pc->num_parts; j++) {
+                        pc->parts[j] = parts[2*(p0+j)];
+                        pc->isClockwise[j] = parts[2*(p0+j)+1] != 0;
+                        // rings start in increasing order inside the record
+                        if (pc->parts[j] < 0 ||
+                            pc->parts[j] >= pc->num_points ||
+                            (j > 0 && pc->parts[j] <= pc->parts[j-1])) {
+                            success = false;
+                        }
+                    }
+                    pc->points.resize(pc->num_points);
+                    for (int k=0; k<pc->num_points; k++) {
+                        pc->points[k].x = xy[2*(q0+k)];
+                        pc->points[k].y = xy[2*(q0+k)+1];
+                    }
+                    main.records[i].contents_p = pc;
+                } else {
+                    success = false;
+                }
+            }
+        }
+    } catch (interprocess_exception& e) {
+        wxLogMessage("ProjectSnapshot::GetShapes() %s: %s", fname, e.what());
+        success = false;
+    }
+    if (!success) {
+        wxLogMessage("ProjectSnapshot: the shapes in %s are not valid", fname);
+        main.records.clear();
+        return false;
+    }
+    main.header.shape_type = h.shape_type;
+    main.header.bbox_x_min = h.shape_bbox[0];
+    main.header.bbox_y_min = h.shape_bbox[1];
+    main.header.bbox_x_max = h.shape_bbox[2];
+    main.header.bbox_y_max = h.shape_bbox[3];
+    has_null_geometry = (h.flags & snap_has_null_geometry) != 0;
+    geom_type = h.geom_type;
+    shapes = &main;
+    shapes_has_null = has_null_geometry;
+    shapes_geom_type = geom_type;
+    return true;
+}
+
+void ProjectSnapshot::GetPoints(const std::vector<double>& xy,
+                                std::vector<GdaPoint*>& pts)
+{
+    int n = (int)xy.size() / 2;
+    pts.resize(n);
+    for (int i=0; i<n; i++) {
+        double x = xy[2*i];
+        double y = xy[2*i+1];
+        if (x != x) { // NaN: null shape
+            pts[i] = new GdaPoint();
+        } else {
+            pts[i] = new GdaPoint(x, y);
+        }
+    }
+}
+
+void ProjectSnapshot::SetPoints(const std::vector<GdaPoint*>& pts,
+                                std::vector<double>& xy)
+{
+    xy.resize(2 * pts.size());
+    for (size_t i=0; i<pts.size(); i++) {
+        if (pts[i]->isNull()) {
+            xy[2*i] = std::numeric_limits<double>::quiet_NaN();
+            xy[2*i+1] = std::numeric_limits<double>::quiet_NaN();
+        } else {
+            xy[2*i] = pts[i]->center_o.x;
+            xy[2*i+1] = pts[i]->center_o.y;
+        }
+    }
+}
+
+bool ProjectSnapshot::GetCentroids(std::vector<GdaPoint*>& pts) const
+{
+    if (centroids.empty()) return false;
+    GetPoints(centroids, pts);
+    return true;
+}
+
+bool ProjectSnapshot::GetMeanCenters(std::vector<GdaPoint*>& pts) const
+{
+    if (mean_centers.empty()) return false;
+    GetPoints(mean_centers, pts);
+    return true;
+}
+
+bool ProjectSnapshot::GetPolygonTolerances(std::vector<float>& tol) const
+{
+    if (tolerances.empty()) return false;
+    tol = tolerances;
+    return true;
+}
+
+GdaPolygon* ProjectSnapshot::GetMapBoundary() const
+{
+    if (!has_boundary) return NULL;
+    Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
+    pc->shape_type = Shapefile::POLYGON;
+    pc->num_parts = (wxInt32)parts.size();
+    pc->parts.assign(parts.begin(), parts.end());
+    pc->num_points = (wxInt32)(points.size() / 2);
+    pc->points.resize(pc->num_points);
+    for (int i=0; i<pc->num_points; i++) {
+        pc->points[i].x = points[2*i];
+        pc->points[i].y = points[2*i+1];
+    }
+    return new GdaPolygon(pc);
+}
+
+bool ProjectSnapshot::SetShapes(const Shapefile::Main& main,
+                                bool has_null_geometry, int geom_type)
+{
+    if (fname.IsEmpty() || (int)main.records.size() != num_obs) return false;
+    // only the point and polygon records that ReadGeometries() makes
+    for (size_t i=0; i<main.records.size(); i++) {
+        const Shapefile::RecordContents* rc = main.records[i].contents_p;
+        if (dynamic_cast<const Shapefile::PointContents*>(rc) == NULL &&
+            dynamic_cast<const Shapefile::PolygonContents*>(rc) == NULL) {
+            return false;
+        }
+    }
+    if (file_header.shape_kinds_pos != 0) must_rewrite = true;
+    shapes = &main;
+    shapes_has_null = has_null_geometry;
+    shapes_geom_type = geom_type;
+    return true;
+}
+
+bool ProjectSnapshot::SetCentroids(const std::vector<GdaPoint*>& pts)
+{
+    if (fname.IsEmpty() || (int)pts.size() != num_obs) return false;
+    if (file_header.centroids_pos != 0) must_rewrite = true;
+    SetPoints(pts, centroids);
+    return true;
+}
+
+bool ProjectSnapshot::SetMeanCenters(const std::vector<GdaPoint*>& pts)
+{
+    if (fname.IsEmpty() || (int)pts.size() != num_obs) return false;
+    if (file_header.mean_centers_pos != 0) must_rewrite = true;
+    SetPoints(pts, mean_centers);
+    return true;
+}
+
+bool ProjectSnapshot::SetMapBoundary(const GdaPolygon* poly)
+{
+    if (fname.IsEmpty() || poly == NULL || poly->pc == NULL) return false;
+    if (file_header.parts_pos != 0) must_rewrite = true;
+    const Shapefile::PolygonContents* pc = poly->pc;
+    parts.assign(pc->parts.begin(), pc->parts.end());
+    points.resize(2 * pc->points.size());
+    for (size_t i=0; i<pc->points.size(); i++) {
+        points[2*i] = pc->points[i].x;
+        points[2*i+1] = pc->points[i].y;
+    }
+    has_boundary = true;
+    return true;
+}
+
+bool ProjectSnapshot::SetPolygonTolerances(const std::vector<float>& tol)
+{
+    if (fname.IsEmpty() || tol.empty()) return false;
+    if (file_header.tolerances_pos != 0) must_rewrite = true;
+    tolerances = tol;
+    return true;
+}
+
+int ProjectSnapshot::GetSectionsInMemory() const
+{
+    int sections = 0;
+    if (!centroids.empty()) sections |= snap_centroids;
+    if (!mean_centers.empty()) sections |= snap_mean_centers;
+    if (has_boundary) sections |= snap_boundary;
+    if (!tolerances.empty()) sections |= snap_tolerances;
+    if (shapes) sections |= snap_shapes;
+    return sections;
+}
+
+int ProjectSnapshot::GetSectionsInFile() const
+{
+    int sections = 0;
+    if (file_header.centroids_pos != 0) sections |= snap_centroids;
+    if (file_header.mean_centers_pos != 0) sections |= snap_mean_centers;
+    if (file_header.parts_pos != 0) sections |= snap_boundary;
+    if (file_header.tolerances_pos != 0) sections |= snap_tolerances;
+    if (file_header.shape_kinds_pos != 0) sections |= snap_shapes;
+    return sections;
+}
+
+bool ProjectSnapshot::Flush()
+{
+    if (fname.IsEmpty()) return false;
+    int sections = GetSectionsInMemory();
+    int pending = sections & ~GetSectionsInFile();
+    if (!must_rewrite && pending == 0) return true;
+    if (!must_rewrite && file_header.file_size > 0 && Append(pending)) {
+        return true;
+    }
+    return Rewrite(sections);
+}
+
+// Places the given sections from pos on; returns the end of the last one
+int64_t ProjectSnapshot::Layout(GdaSnapHeader& header, int64_t pos,
+                                int sections) const
+{
+    if (sections & snap_centroids) {
+        header.centroids_pos = pos;
+        pos += sizeof(double) * centroids.size();
+    }
+    if (sections & snap_mean_centers) {
+        header.mean_centers_pos = pos;
+        pos += sizeof(double) * mean_centers.size();
+    }
+    if (sections & snap_boundary) {
+        header.parts_pos = pos;
+        header.num_parts = (int64_t)parts.size();
+        pos = SnapAlign(pos + sizeof(int32_t) * parts.size());
+        header.points_pos = pos;
+        header.num_points = (int64_t)points.size() / 2;
+        pos += sizeof(double) * points.size();
+    }
+    if (sections & snap_tolerances) {
+        header.tolerances_pos = pos;
+        header.num_tolerances = (int64_t)tolerances.size();
+        pos = SnapAlign(pos + sizeof(float) * tolerances.size());
+    }
+    if (sections & snap_shapes) {
+        int64_t n = num_obs;
+        header.num_shape_parts = 0;
+        header.num_shape_points = 0;
+        for (int i=0; i<num_obs; i++) {
+            const Shapefile::RecordContents* rc = shapes->records[i].contents_p;
+            const Shapefile::PolygonContents* pc =
+                dynamic_cast<const Shapefile::PolygonContents*>(rc);
+            if (pc) {
+                header.num_shape_parts += pc->parts.size();
+                header.num_shape_points += pc->points.size();
+            } else {
+                header.num_shape_points += 1;
+            }
+        }
+        if (shapes_has_null) header.flags |= snap_has_null_geometry;
+        else header.flags &= ~(uint32_t)snap_has_null_geometry;
+        header.shape_type = shapes->header.shape_type;
+        header.geom_type = shapes_geom_type;
+        header.shape_bbox[0] = shapes->header.bbox_x_min;
+        header.shape_bbox[1] = shapes->header.bbox_y_min;
+        header.shape_bbox[2] = shapes->header.bbox_x_max;
+        header.shape_bbox[3] = shapes->header.bbox_y_max;
+        header.shape_kinds_pos = pos;
+        pos = SnapAlign(pos + sizeof(int32_t) * 2 * n);
+        header.shape_boxes_pos = pos;
+        pos += sizeof(double) * 4 * n;
+        header.shape_part_offsets_pos = pos;
+        pos += sizeof(int64_t) * (n + 1);
+        header.shape_parts_pos = pos;
+        pos = SnapAlign(pos + sizeof(int32_t) * 2 * header.num_shape_parts);
+        header.shape_point_offsets_pos = pos;
+        pos += sizeof(int64_t) * (n + 1);
+        header.shape_points_pos = pos;
+        pos += sizeof(double) * 2 * header.num_shape_points;
+    }
+    return pos;
+}
+
+// Writes the given sections in the order of Layout()
+bool ProjectSnapshot::WriteSections(std::ostream& out, int64_t& pos,
+                                    int sections) const
+{
+    if (sections & snap_centroids) SnapWrite(out, pos, centroids);
+    if (sections & snap_mean_centers) SnapWrite(out, pos, mean_centers);
+    if (sections & snap_boundary) {
+        SnapWrite(out, pos, parts);
+        SnapWrite(out, pos, points);
+    }
+    if (sections & snap_tolerances) SnapWrite(out, pos, tolerances);
+    if (sections & snap_shapes) SaveShapes(out, pos);
+    return !out.fail();
+}
+
+// Adds the sections after the end of the file and then updates the header.
+// A reader that sees the old header ignores the bytes after its file_size,
+// so an append that is cut short leaves a valid snapshot.
+bool ProjectSnapshot::Append(int sections)
+{
+#ifdef __WIN32__
+    std::fstream out(fname.wc_str(),
+                     std::ios::binary|std::ios::in|std::ios::out);
+#else
+    std::fstream out;
+    out.open(GET_ENCODED_FILENAME(fname),
+             std::ios::binary|std::ios::in|std::ios::out);
+#endif
+    if (!(out.is_open() && out.good())) return false;
+    // the file must still be the one that was opened
+    GdaSnapHeader disk_header;
+    out.read((char*)&disk_header, sizeof(GdaSnapHeader));
+    if (!out.good() ||
+        memcmp(&disk_header, &file_header, sizeof(GdaSnapHeader)) != 0) {
+        return false;
+    }
+    GdaSnapHeader header = file_header;
+    int64_t pos = file_header.file_size;
+    header.file_size = Layout(header, SnapAlign(pos), sections);
+
+    out.seekp((std::streamoff)pos);
+    SnapPad(out, pos);
+    if (!WriteSections(out, pos, sections) || pos != header.file_size) {
+        return false;
+    }
+    out.flush();
+    if (out.fail()) return false;
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(GdaSnapHeader));
+    out.close();
+    if (out.fail()) {
+        wxLogMessage("ProjectSnapshot: can't update %s", fname);
+        return false;
+    }
+    file_header = header;
+    return true;
+}
+
+// Writes all sections to a temporary file that then replaces the snapshot,
+// so the snapshot is never left half written
+bool ProjectSnapshot::Rewrite(int sections)
+{
+    GdaSnapHeader header;
+    memset(&header, 0, sizeof(GdaSnapHeader));
+    strncpy(header.magic, magic, sizeof(header.magic));
+    header.version = version;
+    header.byte_order = byte_order_mark;
+    header.num_obs = num_obs;
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    header.source_hash = source_hash;
+    header.file_size = Layout(header, sizeof(GdaSnapHeader), sections);
+
+    wxString tmp_fname = fname + ".tmp";
+#ifdef __WIN32__
+    std::ofstream out(tmp_fname.wc_str(), std::ios::binary|std::ios::out);
+#else
+    std::ofstream out;
+    out.open(GET_ENCODED_FILENAME(tmp_fname), std::ios::binary|std::ios::out);
+#endif
+    if (!(out.is_open() && out.good())) {
+        wxLogMessage("ProjectSnapshot: can't write %s", tmp_fname);
+        return false;
+    }
+    out.write((const char*)&header, sizeof(GdaSnapHeader));
+    int64_t pos = sizeof(GdaSnapHeader);
+    WriteSections(out, pos, sections);
+    out.close();
+    if (pos != header.file_size || out.fail() ||
+        !wxRenameFile(tmp_fname, fname, true)) {
+        wxLogMessage("ProjectSnapshot: can't write %s", fname);
+        wxRemoveFile(tmp_fname);
+        return false;
+    }
+    file_header = header;
+    must_rewrite = false;
+    return true;
+}
+
+// Writes the shape sections record by record, so that no flat copy of the
+// geometry is held in memory
+bool ProjectSnapshot::SaveShapes(std::ostream& out, int64_t& pos) const
+{
+    const std::vector<Shapefile::MainRecord>& records = shapes->records;
+    for (int i=0; i<num_obs; i++) {
+        const Shapefile::RecordContents* rc = records[i].contents_p;
+        int32_t kind[2];
+        kind[0] = dynamic_cast<const Shapefile::PolygonContents*>(rc) ?
+            Shapefile::POLYGON : Shapefile::POINT_TYP;
+        kind[1] = rc->shape_type;
+        SnapWriteRaw(out, pos, kind, 2);
+    }
+    SnapPad(out, pos);
+    const double no_box[4] = {0, 0, 0, 0};
+    for (int i=0; i<num_obs; i++) {
+        const Shapefile::PolygonContents* pc =
+            dynamic_cast<const Shapefile::PolygonContents*>(records[i].contents_p);
+        if (pc && pc->box.size() == 4) SnapWriteRaw(out, pos, &pc->box[0], 4);
+        else SnapWriteRaw(out, pos, no_box, 4);
+    }
+    int64_t offset = 0;
+    SnapWriteRaw(out, pos, &offset, 1);
+    for (int i=0; i<num_obs; i++) {
+        const Shapefile::PolygonContents* pc =
+            dynamic_cast<const Shapefile::PolygonContents*>(records[i].contents_p);
+        if (pc) offset += pc->parts.size();
+        SnapWriteRaw(out, pos, &offset, 1);
+    }
+    for (int i=0; i<num_obs; i++) {
+        const Shapefile::PolygonContents* pc =
+            dynamic_cast<const Shapefile::PolygonContents*>(records[i].contents_p);
+        if (pc == NULL) continue;
+        for (size_t j=0; j<pc->parts.size(); j++) {
+            int32_t part[2];
+            part[0] = pc->parts[j];
+            part[1] = j < pc->isClockwise.size() && pc->isClockwise[j] ? 1 : 0;
+            SnapWriteRaw(out, pos, part, 2);
+        }
+    }
+    SnapPad(out, pos);
+    offset = 0;
+    SnapWriteRaw(out, pos, &offset, 1);
+    for (int i=0; i<num_obs; i++) {
+        const Shapefile::PolygonContents* pc =
+            dynamic_cast<const Shapefile::PolygonContents*>(records[i].contents_p);
+        offset += pc ? (int64_t)pc->points.size() : 1;
+        SnapWriteRaw(out, pos, &offset, 1);
+    }
+    for (int i=0; i<num_obs; i++) {
+        const Shapefile::RecordContents* rc = records[i].contents_p;
+        const Shapefile::PolygonContents* pc =
+            dynamic_cast<const Shapefile::PolygonContents*>(rc);
+        if (pc) {
+            // Shapefile::Point is a pair of doubles
+            if (!pc->points.empty()) {
+                SnapWriteRaw(out, pos, (const double*)&pc->points[0],
+                             2 * pc->points.size());
+            }
+        } else {
+            const Shapefile::PointContents* pt =
+                (const Shapefile::PointContents*)rc;
+            double xy[2] = {pt->x, pt->y};
+            SnapWriteRaw(out, pos, xy, 2);
+        }
+    }
+    return !out.fail();
+}
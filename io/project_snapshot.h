@@ -0,0 +1,200 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PROJECT_SNAPSHOT_H__
+#define __GEODA_CENTER_PROJECT_SNAPSHOT_H__
+
+#include <fstream>
+#include <vector>
+#include <stdint.h>
+#include <wx/string.h>
+#include "../ShpFile.h"
+
+class GdaPoint;
+class GdaPolygon;
+
+/**
+ Header of a project snapshot file (.gdasnap). The layout follows the .gwb
+ weights file: numbers in the byte order of the machine that wrote the
+ file (byte_order holds ProjectSnapshot::byte_order_mark), sections at
+ multiples of 8 bytes.
+
+   centroids     double[2*num_obs], x and y of each observation
+   mean_centers  double[2*num_obs], NaN for a null shape
+   parts         int32[num_parts], first point of each ring of the boundary
+   points        double[2*num_points]
+   tolerances    float[num_tolerances], level of detail of each point of
+                 the polygons (see PolygonLod)
+
+ The shapes of the data source, as Project::main_data holds them:
+
+   shape_kinds          int32[2*num_obs], record type (POINT_TYP or
+                        POLYGON) and shape_type of each record
+   shape_boxes          double[4*num_obs], box of each polygon
+   shape_part_offsets   int64[num_obs+1], rings of record i are
+                        shape_parts[offsets[i]..offsets[i+1])
+   shape_parts          int32[2*num_shape_parts], first point of the ring in
+                        the record and 1 if it is clockwise
+   shape_point_offsets  int64[num_obs+1], one point for a point record
+   shape_points         double[2*num_shape_points]
+
+ geom_type is the OGRwkbGeometryType of the layer, which is not read from
+ the data source when the shapes come from the snapshot.
+
+ A section with position 0 has not been computed yet. New sections are
+ appended after file_size and the header is written last; a reader ignores
+ any bytes after file_size. The source fields identify the file the
+ snapshot was made from: its size, its modification time and a hash of its
+ first and last 64 KB.
+ */
+struct GdaSnapHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t byte_order;
+    int32_t  shape_type;
+    int64_t  num_obs;
+    int64_t  source_size;
+    int64_t  source_mtime;
+    uint64_t source_hash;
+    int64_t  centroids_pos;
+    int64_t  mean_centers_pos;
+    int64_t  parts_pos;
+    int64_t  num_parts;
+    int64_t  points_pos;
+    int64_t  num_points;
+    int64_t  tolerances_pos;
+    int64_t  num_tolerances;
+    double   shape_bbox[4];
+    int64_t  shape_kinds_pos;
+    int64_t  shape_boxes_pos;
+    int64_t  shape_part_offsets_pos;
+    int64_t  shape_parts_pos;
+    int64_t  num_shape_parts;
+    int64_t  shape_point_offsets_pos;
+    int64_t  shape_points_pos;
+    int64_t  num_shape_points;
+    int32_t  geom_type;
+    int32_t  reserved;
+    int64_t  file_size;
+};
+
+/**
+ Geometry of the data source that is expensive to read or to compute and is
+ kept on disk between sessions: the shapes converted from the OGR features,
+ the centroids, the mean centers, the boundary of the map (the union of all
+ polygons) and the level of detail of the polygons. The snapshot is read
+ when the project is opened; a section that is not in the snapshot is
+ computed by the Project as before, kept by the snapshot and added to the
+ file by Flush().
+
+ The snapshot is discarded when the data source file changes.
+ */
+class ProjectSnapshot
+{
+public:
+    static const char* magic;
+    static const uint32_t version = 4;
+    static const uint32_t byte_order_mark = 0x01020304;
+    enum SnapFlags {
+        snap_has_null_geometry = 1
+    };
+    enum SnapSections {
+        snap_centroids = 1,
+        snap_mean_centers = 2,
+        snap_boundary = 4,
+        snap_tolerances = 8,
+        snap_shapes = 16
+    };
+
+    ProjectSnapshot();
+    virtual ~ProjectSnapshot();
+
+    /** Reads fname if it was made from source_fname with num_obs records;
+     returns false if the snapshot is missing or out of date */
+    bool Open(const wxString& fname, const wxString& source_fname,
+              int num_obs);
+
+    /** Fills the header and the records of main with the shapes of the
+     data source, read from the mapped file, and geom_type with the
+     OGRwkbGeometryType of the layer; false if not in the snapshot */
+    bool GetShapes(Shapefile::Main& main, bool& has_null_geometry,
+                   int& geom_type);
+    /** Fills pts with new GdaPoints; false if not in the snapshot */
+    bool GetCentroids(std::vector<GdaPoint*>& pts) const;
+    bool GetMeanCenters(std::vector<GdaPoint*>& pts) const;
+    /** A new polygon owned by the caller, or NULL */
+    GdaPolygon* GetMapBoundary() const;
+    bool GetPolygonTolerances(std::vector<float>& tol) const;
+
+    /** Keep a section until the next Flush(). main is written again each
+     time the file is rewritten, so it has to outlive the snapshot. */
+    bool SetShapes(const Shapefile::Main& main, bool has_null_geometry,
+                   int geom_type);
+    bool SetCentroids(const std::vector<GdaPoint*>& pts);
+    bool SetMeanCenters(const std::vector<GdaPoint*>& pts);
+    bool SetMapBoundary(const GdaPolygon* poly);
+    bool SetPolygonTolerances(const std::vector<float>& tol);
+    /** Writes the sections that were set since the last Flush(): appended
+     to the file if it only gains sections, otherwise the file is written
+     anew to a temporary file that replaces it */
+    bool Flush();
+
+    /** The snapshot of a project: next to the .gda file if there is one,
+     otherwise next to the data source file */
+    static wxString GetSnapshotPath(const wxString& proj_fname,
+                                    const wxString& source_fname);
+
+protected:
+    int GetSectionsInMemory() const;
+    int GetSectionsInFile() const;
+    int64_t Layout(GdaSnapHeader& header, int64_t pos, int sections) const;
+    bool WriteSections(std::ostream& out, int64_t& pos, int sections) const;
+    bool SaveShapes(std::ostream& out, int64_t& pos) const;
+    bool Append(int sections);
+    bool Rewrite(int sections);
+    bool ReadSourceInfo(const wxString& source_fname);
+    static void GetPoints(const std::vector<double>& xy,
+                          std::vector<GdaPoint*>& pts);
+    static void SetPoints(const std::vector<GdaPoint*>& pts,
+                          std::vector<double>& xy);
+
+    wxString fname;
+    int num_obs;
+    int64_t source_size;
+    int64_t source_mtime;
+    uint64_t source_hash;
+
+    std::vector<double> centroids;
+    std::vector<double> mean_centers;
+    std::vector<int32_t> parts;
+    std::vector<double> points;
+    bool has_boundary;
+    std::vector<float> tolerances;
+
+    /** header of the file as it is on disk, for GetShapes() and Flush() */
+    GdaSnapHeader file_header;
+    const Shapefile::Main* shapes;
+    bool shapes_has_null;
+    int shapes_geom_type;
+    /** a section in the file was replaced: Flush() writes the file anew */
+    bool must_rewrite;
+};
+
+#endif
@@ -0,0 +1,783 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <string.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/msgdlg.h>
+#include <wx/stopwatch.h>
+
+#include "../GdaConst.h"
+#include "../GenUtils.h"
+#include "../DataViewer/TableInterface.h"
+#include "../ShapeOperations/GalWeight.h"
+#include "../ShapeOperations/GwtWeight.h"
+#include "../ShapeOperations/WeightUtils.h"
+#include "weights_interface.h"
+#include "weights_binary.h"
+
+using namespace boost::interprocess;
+
+const char* GwbFile::magic = "GEODAWB";
+
+/** CSR arrays of a GalElement or GwtElement array, as written to .gwb; the
+ rows keep the order of the neighbors in the weights */
+struct GwbCsr {
+    std::vector<int64_t> offsets;
+    std::vector<int32_t> nbrs;
+    std::vector<double> weights; // empty for binary weights
+
+    void Init(const GalElement* g, int num_obs)
+    {
+        offsets.resize(num_obs + 1);
+        offsets[0] = 0;
+        bool is_binary = true;
+        for (int i=0; i<num_obs; i++) {
+            offsets[i+1] = offsets[i] + g[i].Size();
+            GalNbrWeights w = g[i].GetNbrWeights();
+            for (size_t j=0; j<w.size() && is_binary; j++) {
+                if (w[j] != 1.0) is_binary = false;
+            }
+        }
+        nbrs.resize(offsets[num_obs]);
+        if (!is_binary) weights.resize(offsets[num_obs], 1.0);
+        for (int i=0; i<num_obs; i++) {
+            GalNbrs nb = g[i].GetNbrs();
+            GalNbrWeights w = g[i].GetNbrWeights();
+            for (size_t j=0; j<nb.size(); j++) {
+                nbrs[offsets[i] + j] = (int32_t)nb[j];
+                if (!is_binary && j < w.size()) weights[offsets[i] + j] = w[j];
+            }
+        }
+    }
+
+    void Init(const GwtElement* g, int num_obs)
+    {
+        offsets.resize(num_obs + 1);
+        offsets[0] = 0;
+        bool is_binary = true;
+        for (int i=0; i<num_obs; i++) {
+            offsets[i+1] = offsets[i] + g[i].Size();
+            for (long j=0; j<g[i].Size() && is_binary; j++) {
+                if (g[i].elt(j).weight != 1.0) is_binary = false;
+            }
+        }
+        nbrs.resize(offsets[num_obs]);
+        if (!is_binary) weights.resize(offsets[num_obs]);
+        for (int i=0; i<num_obs; i++) {
+            for (long j=0; j<g[i].Size(); j++) {
+                const GwtNeighbor& e = g[i].elt(j);
+                nbrs[offsets[i] + j] = (int32_t)e.nbx;
+                if (!is_binary) weights[offsets[i] + j] = e.weight;
+            }
+        }
+    }
+
+    /** true if j is a neighbor of i with weight w iff i is a neighbor of j
+     with weight w */
+    bool IsSymmetric() const
+    {
+        // positions of the neighbors of every row sorted by neighbor, for
+        // the search; the rows themselves are left as they are
+        if (nbrs.empty()) return true;
+        int num_obs = (int)offsets.size() - 1;
+        std::vector<int32_t> pos(nbrs.size());
+        for (int i=0; i<num_obs; i++) {
+            int32_t* first = &pos[0] + offsets[i];
+            int32_t sz = (int32_t)(offsets[i+1] - offsets[i]);
+            for (int32_t k=0; k<sz; k++) first[k] = k;
+            std::sort(first, first + sz, RowLess(&nbrs[0] + offsets[i]));
+        }
+        for (int i=0; i<num_obs; i++) {
+            for (int64_t k=offsets[i]; k<offsets[i+1]; k++) {
+                int32_t j = nbrs[k];
+                if (j == i) continue;
+                double w = weights.empty() ? 1.0 : weights[k];
+                const int32_t* row = &nbrs[0] + offsets[j];
+                const int32_t* first = &pos[0] + offsets[j];
+                const int32_t* last = &pos[0] + offsets[j+1];
+                const int32_t* it = std::lower_bound(first, last, (long)i,
+                                                     RowLess(row));
+                if (it == last || row[*it] != i) return false;
+                if (!weights.empty() && weights[offsets[j] + *it] != w) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    struct RowLess {
+        const int32_t* row;
+        RowLess(const int32_t* row_s) : row(row_s) {}
+        bool operator()(int32_t a, int32_t b) const { return row[a] < row[b]; }
+        bool operator()(int32_t a, long id) const { return row[a] < id; }
+    };
+};
+
+static int64_t GwbAlign(int64_t pos)
+{
+    return (pos + 7) & ~(int64_t)7;
+}
+
+static void GwbPad(std::ofstream& out, int64_t& pos)
+{
+    static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int64_t next = GwbAlign(pos);
+    if (next > pos) out.write(zeros, (std::streamsize)(next - pos));
+    pos = next;
+}
+
+template <class T>
+static void GwbWrite(std::ofstream& out, int64_t& pos, const T* data, size_t n)
+{
+    if (n > 0) out.write((const char*)data, (std::streamsize)(sizeof(T) * n));
+    pos += sizeof(T) * n;
+}
+
+static bool WriteGwb(const GwbCsr& csr,
+                     const wxString& layer_name,
+                     const wxString& ofname,
+                     const wxString& id_var_name,
+                     const std::vector<wxInt64>* int_ids,
+                     const std::vector<wxString>* str_ids)
+{
+    int64_t num_obs = (int64_t)csr.offsets.size() - 1;
+    int64_t num_edges = (int64_t)csr.nbrs.size();
+
+    wxScopedCharBuffer layer_buf = layer_name.ToUTF8();
+    wxScopedCharBuffer id_buf = id_var_name.ToUTF8();
+
+    std::vector<int64_t> str_offsets;
+    std::string str_bytes;
+    if (str_ids) {
+        str_offsets.resize(num_obs + 1);
+        str_offsets[0] = 0;
+        for (int64_t i=0; i<num_obs; i++) {
+            str_bytes += (*str_ids)[i].ToUTF8().data();
+            str_offsets[i+1] = (int64_t)str_bytes.size();
+        }
+    }
+
+    GwbHeader header;
+    memset(&header, 0, sizeof(GwbHeader));
+    strncpy(header.magic, GwbFile::magic, sizeof(header.magic));
+    header.version = GwbFile::version;
+    header.byte_order = GwbFile::byte_order_mark;
+    if (csr.IsSymmetric()) header.flags |= GwbFile::gwb_symmetric;
+    if (!csr.weights.empty()) header.flags |= GwbFile::gwb_has_weights;
+    if (int_ids) header.flags |= GwbFile::gwb_int_keys;
+    if (str_ids) header.flags |= GwbFile::gwb_string_keys;
+    header.num_obs = num_obs;
+    header.num_edges = num_edges;
+
+    int64_t pos = sizeof(GwbHeader);
+    header.layer_pos = pos;
+    header.layer_len = (int64_t)layer_buf.length();
+    pos = GwbAlign(pos + header.layer_len);
+    header.id_field_pos = pos;
+    header.id_field_len = (int64_t)id_buf.length();
+    pos = GwbAlign(pos + header.id_field_len);
+    if (int_ids) {
+        header.keys_pos = pos;
+        pos += sizeof(int64_t) * num_obs;
+    } else if (str_ids) {
+        header.keys_pos = pos;
+        pos = GwbAlign(pos + sizeof(int64_t) * (num_obs + 1) + str_bytes.size());
+    }
+    header.offsets_pos = pos;
+    pos += sizeof(int64_t) * (num_obs + 1);
+    header.nbrs_pos = pos;
+    pos = GwbAlign(pos + sizeof(int32_t) * num_edges);
+    if (!csr.weights.empty()) {
+        header.weights_pos = pos;
+        pos += sizeof(double) * num_edges;
+    }
+    header.file_size = pos;
+
+    wxFileName wx_fn(ofname);
+    wxString final_ofn(wx_fn.GetFullPath());
+#ifdef __WIN32__
+    std::ofstream out(final_ofn.wc_str(), std::ios::binary|std::ios::out);
+#else
+    std::ofstream out;
+    out.open(GET_ENCODED_FILENAME(final_ofn), std::ios::binary|std::ios::out);
+#endif
+    if (!(out.is_open() && out.good())) return false;
+
+    pos = 0;
+    GwbWrite(out, pos, &header, 1);
+    GwbWrite(out, pos, layer_buf.data(), layer_buf.length());
+    GwbPad(out, pos);
+    GwbWrite(out, pos, id_buf.data(), id_buf.length());
+    GwbPad(out, pos);
+    if (int_ids) {
+        for (int64_t i=0; i<num_obs; i++) {
+            int64_t key = (*int_ids)[i];
+            GwbWrite(out, pos, &key, 1);
+        }
+    } else if (str_ids) {
+        GwbWrite(out, pos, &str_offsets[0], str_offsets.size());
+        GwbWrite(out, pos, str_bytes.data(), str_bytes.size());
+        GwbPad(out, pos);
+    }
+    GwbWrite(out, pos, &csr.offsets[0], csr.offsets.size());
+    if (num_edges > 0) GwbWrite(out, pos, &csr.nbrs[0], csr.nbrs.size());
+    GwbPad(out, pos);
+    if (!csr.weights.empty()) {
+        GwbWrite(out, pos, &csr.weights[0], csr.weights.size());
+    }
+    out.close();
+
+    return pos == header.file_size && !out.fail();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// GwbFile
+//
+////////////////////////////////////////////////////////////////////////////////
+GwbFile::GwbFile()
+: file(0), region(0), base(0), size(0), header(0)
+{
+}
+
+GwbFile::~GwbFile()
+{
+    Close();
+}
+
+bool GwbFile::Open(const wxString& fname)
+{
+    Close();
+    try {
+        file = new file_mapping(GET_ENCODED_FILENAME(fname), read_only);
+        region = new mapped_region(*file, read_only);
+    } catch (interprocess_exception& e) {
+        wxLogMessage("GwbFile::Open() %s: %s", fname, e.what());
+        Close();
+        return false;
+    }
+    base = (const char*)region->get_address();
+    size = region->get_size();
+    if (size < sizeof(GwbHeader)) {
+        Close();
+        return false;
+    }
+    header = (const GwbHeader*)base;
+    if (!Validate()) {
+        wxLogMessage("GwbFile::Open() %s: not a valid weights file", fname);
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void GwbFile::Close()
+{
+    if (region) delete region;
+    if (file) delete file;
+    region = 0;
+    file = 0;
+    base = 0;
+    size = 0;
+    header = 0;
+}
+
+bool GwbFile::Validate() const
+{
+    if (strncmp(header->magic, magic, sizeof(header->magic)) != 0 ||
+        header->version < 1 || header->version > version) {
+        return false;
+    }
+    if (header->byte_order != byte_order_mark) {
+        wxLogMessage("GwbFile: the file was written with another byte order");
+        return false;
+    }
+    int64_t n = header->num_obs;
+    int64_t nnz = header->num_edges;
+    if (n <= 0 || n > std::numeric_limits<int32_t>::max() || nnz < 0 ||
+        header->file_size != (int64_t)size) {
+        return false;
+    }
+
+    // every section lies inside the file; arrays are 8-byte aligned
+    int64_t hsz = sizeof(GwbHeader);
+    int64_t fsz = (int64_t)size;
+    if (header->layer_pos < hsz || header->layer_len < 0 ||
+        header->layer_pos + header->layer_len > fsz ||
+        header->id_field_pos < hsz || header->id_field_len < 0 ||
+        header->id_field_pos + header->id_field_len > fsz) {
+        return false;
+    }
+    int64_t arrays[4] = { header->offsets_pos, header->nbrs_pos,
+        header->keys_pos, header->weights_pos };
+    int64_t bytes[4] = { (int64_t)sizeof(int64_t) * (n + 1),
+        (int64_t)sizeof(int32_t) * nnz, 0, (int64_t)sizeof(double) * nnz };
+    if (header->flags & gwb_int_keys) bytes[2] = sizeof(int64_t) * n;
+    if (header->flags & gwb_string_keys) bytes[2] = sizeof(int64_t) * (n + 1);
+    bool used[4] = { true, true, bytes[2] > 0, HasWeights() };
+    for (int k=0; k<4; k++) {
+        if (!used[k]) continue;
+        if (arrays[k] < hsz || arrays[k] % 8 != 0 || arrays[k] + bytes[k] > fsz) {
+            return false;
+        }
+    }
+    if (header->flags & gwb_string_keys) {
+        const int64_t* key_offsets = (const int64_t*)(base + header->keys_pos);
+        int64_t chars_end = header->keys_pos + bytes[2] + key_offsets[n];
+        if (key_offsets[0] != 0 || chars_end > fsz) return false;
+        for (int64_t i=0; i<n; i++) {
+            if (key_offsets[i+1] < key_offsets[i]) return false;
+        }
+    }
+
+    // the CSR arrays are used without further checks
+    const int64_t* offsets = GetOffsets();
+    if (offsets[0] != 0 || offsets[n] != nnz) return false;
+    for (int64_t i=0; i<n; i++) {
+        if (offsets[i+1] < offsets[i]) return false;
+    }
+    const int32_t* nbrs = GetNbrs();
+    for (int64_t k=0; k<nnz; k++) {
+        if (nbrs[k] < 0 || nbrs[k] >= n) return false;
+    }
+    return true;
+}
+
+wxString GwbFile::GetString(int64_t pos, int64_t len) const
+{
+    if (len <= 0) return wxEmptyString;
+    return wxString::FromUTF8(base + pos, (size_t)len);
+}
+
+wxString GwbFile::GetLayerName() const
+{
+    return GetString(header->layer_pos, header->layer_len);
+}
+
+wxString GwbFile::GetIdField() const
+{
+    return GetString(header->id_field_pos, header->id_field_len);
+}
+
+const int64_t* GwbFile::GetOffsets() const
+{
+    return (const int64_t*)(base + header->offsets_pos);
+}
+
+const int32_t* GwbFile::GetNbrs() const
+{
+    return (const int32_t*)(base + header->nbrs_pos);
+}
+
+const double* GwbFile::GetWeights() const
+{
+    if (!HasWeights()) return 0;
+    return (const double*)(base + header->weights_pos);
+}
+
+bool GwbFile::GetTableRows(TableInterface* table_int, std::vector<int>& rows,
+                           bool& is_identity) const
+{
+    int num_obs = GetNumObs();
+    rows.clear();
+    is_identity = true;
+
+    if (table_int == NULL) return true;
+
+    if (num_obs != table_int->GetNumberRows()) {
+        wxString msg = "The number of observations specified in chosen ";
+        msg << "weights file is " << num_obs << ", but the number in the ";
+        msg << "current Table is " << table_int->GetNumberRows();
+        msg << ", which is incompatible.";
+        wxMessageDialog dlg(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+        dlg.ShowModal();
+        return false;
+    }
+
+    wxString key_field = GetIdField();
+    bool int_keys = (header->flags & gwb_int_keys) != 0;
+    bool str_keys = (header->flags & gwb_string_keys) != 0;
+    if (key_field.IsEmpty() || key_field == "ogc_fid" ||
+        (!int_keys && !str_keys)) {
+        // record order
+        return true;
+    }
+
+    int col=0, tm=0;
+    table_int->DbColNmToColAndTm(key_field, col, tm);
+    if (col == wxNOT_FOUND) {
+        wxString msg = _("Specified key value field \"%s\" on first line of weights file not found in currently loaded Table.");
+        msg = wxString::Format(msg, key_field);
+        wxMessageDialog dlg(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+        dlg.ShowModal();
+        return false;
+    }
+    GdaConst::FieldType col_type = table_int->GetColType(col);
+    if (col_type != GdaConst::long64_type &&
+        col_type != GdaConst::string_type) {
+        wxString msg = _("Specified key value field \"%s\" on first line of weights file is not an integer type in the currently loaded Table.");
+        msg = wxString::Format(msg, key_field);
+        wxMessageDialog dlg(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+        dlg.ShowModal();
+        return false;
+    }
+
+    const int64_t* key_vals = (const int64_t*)(base + header->keys_pos);
+    const char* key_chars = base + header->keys_pos + sizeof(int64_t) * (num_obs + 1);
+    std::vector<wxInt64> tbl_ints;
+    std::vector<wxString> tbl_strs;
+    if (col_type == GdaConst::long64_type) {
+        table_int->GetColData(col, 0, tbl_ints);
+    } else {
+        table_int->GetColData(col, 0, tbl_strs);
+    }
+
+    // usual case: the file was written from this Table, so the rows can be
+    // used as they are
+    if (int_keys && col_type == GdaConst::long64_type) {
+        for (int i=0; i<num_obs && is_identity; i++) {
+            if (key_vals[i] != tbl_ints[i]) is_identity = false;
+        }
+        if (is_identity) return true;
+    }
+
+    // otherwise match the keys as strings, as ReadGal() does
+    std::map<wxString, int> id_map;
+    for (int i=0; i<num_obs; i++) {
+        wxString str_id;
+        if (col_type == GdaConst::long64_type) {
+            str_id << tbl_ints[i];
+        } else {
+            str_id = tbl_strs[i];
+        }
+        id_map[str_id] = i;
+    }
+    if (id_map.size() != num_obs) {
+        wxString msg = _("Specified key value field \"%s\" in weights file contains duplicate values in the currently loaded Table.");
+        msg = wxString::Format(msg, key_field);
+        wxMessageDialog dlg(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+        dlg.ShowModal();
+        return false;
+    }
+
+    is_identity = true;
+    rows.resize(num_obs);
+    std::map<wxString, int>::iterator it;
+    for (int i=0; i<num_obs; i++) {
+        wxString obs;
+        if (int_keys) {
+            obs << (wxInt64)key_vals[i];
+        } else {
+            obs = wxString::FromUTF8(key_chars + key_vals[i],
+                                     (size_t)(key_vals[i+1] - key_vals[i]));
+        }
+        it = id_map.find(obs);
+        if (it == id_map.end()) {
+            wxString msg = "Observation id " + obs;
+            msg << " of weights file does not exist in field \"";
+            msg << key_field << "\" of the Table.";
+            wxMessageDialog dlg(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+            dlg.ShowModal();
+            rows.clear();
+            return false;
+        }
+        rows[i] = it->second;
+        if (rows[i] != i) is_identity = false;
+    }
+    if (is_identity) rows.clear();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Readers
+//
+////////////////////////////////////////////////////////////////////////////////
+static void ShowGwbNotValid()
+{
+    wxString msg = _("Weights file/format is not valid.");
+    wxMessageDialog dlg(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+    dlg.ShowModal();
+}
+
+static GalElement* GwbToGal(const GwbFile& gwb, const std::vector<int>& rows)
+{
+    int num_obs = gwb.GetNumObs();
+    const int64_t* offsets = gwb.GetOffsets();
+    const int32_t* nbrs = gwb.GetNbrs();
+    const double* weights = gwb.GetWeights();
+
+    GalElement* gal = new GalElement[num_obs];
+    std::vector<long> nb;
+    std::vector<double> w;
+    for (int i=0; i<num_obs; i++) {
+        size_t sz = (size_t)(offsets[i+1] - offsets[i]);
+        nb.resize(sz);
+        w.resize(sz);
+        for (size_t j=0; j<sz; j++) {
+            int32_t k = nbrs[offsets[i] + j];
+            nb[j] = rows.empty() ? k : rows[k];
+            w[j] = weights ? weights[offsets[i] + j] : 1.0;
+        }
+        gal[rows.empty() ? i : rows[i]].SetNbrs(nb, w);
+    }
+    return gal;
+}
+
+wxString ReadIdFieldFromGwb(const wxString& fname)
+{
+    GwbFile gwb;
+    if (!gwb.Open(fname)) return wxEmptyString;
+    return gwb.GetIdField();
+}
+
+GalElement* ReadGwbAsGal(const wxString& fname, TableInterface* table_int)
+{
+    GwbFile gwb;
+    if (!gwb.Open(fname)) {
+        ShowGwbNotValid();
+        return 0;
+    }
+    std::vector<int> rows;
+    bool is_identity = true;
+    if (!gwb.GetTableRows(table_int, rows, is_identity)) return 0;
+
+    return GwbToGal(gwb, rows);
+}
+
+GalWeight* ReadGwbAsGalWeight(const wxString& fname, TableInterface* table_int)
+{
+    wxStopWatch sw;
+    GwbFile* gwb = new GwbFile;
+    if (!gwb->Open(fname)) {
+        delete gwb;
+        ShowGwbNotValid();
+        return 0;
+    }
+    std::vector<int> rows;
+    bool is_identity = true;
+    if (!gwb->GetTableRows(table_int, rows, is_identity)) {
+        delete gwb;
+        return 0;
+    }
+
+    long num_edges = (long)gwb->GetNumEdges();
+    GalWeight* w = new GalWeight();
+    w->num_obs = gwb->GetNumObs();
+    w->wflnm = fname;
+    w->id_field = gwb->GetIdField();
+    w->symmetry_checked = true;
+    w->is_symmetric = gwb->IsSymmetric();
+    if (is_identity) {
+        // rows of the file are rows of the table: gal reads the mapping
+        w->gal = new GalElement[w->num_obs];
+        w->SetGwbFile(gwb);
+    } else {
+        w->gal = GwbToGal(*gwb, rows);
+        w->Compact();
+        delete gwb;
+    }
+    wxLogMessage("ReadGwbAsGalWeight(): %ld edges in %ld ms",
+                 num_edges, sw.Time());
+    return w;
+}
+
+GwtElement* ReadGwb(const wxString& fname, TableInterface* table_int)
+{
+    GwbFile gwb;
+    if (!gwb.Open(fname)) {
+        ShowGwbNotValid();
+        return 0;
+    }
+    std::vector<int> rows;
+    bool is_identity = true;
+    if (!gwb.GetTableRows(table_int, rows, is_identity)) return 0;
+
+    int num_obs = gwb.GetNumObs();
+    const int64_t* offsets = gwb.GetOffsets();
+    const int32_t* nbrs = gwb.GetNbrs();
+    const double* weights = gwb.GetWeights();
+
+    GwtElement* gwt = new GwtElement[num_obs];
+    for (int i=0; i<num_obs; i++) {
+        GwtElement& e = gwt[rows.empty() ? i : rows[i]];
+        int sz = (int)(offsets[i+1] - offsets[i]);
+        if (sz == 0) continue;
+        e.alloc(sz);
+        for (int64_t k=offsets[i]; k<offsets[i+1]; k++) {
+            long nbx = rows.empty() ? nbrs[k] : rows[nbrs[k]];
+            e.Push(GwtNeighbor(nbx, weights ? weights[k] : 1.0));
+        }
+    }
+    return gwt;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Writers
+//
+////////////////////////////////////////////////////////////////////////////////
+bool Gda::SaveGwb(const GalElement* g,
+                  const wxString& layer_name,
+                  const wxString& ofname,
+                  const wxString& id_var_name,
+                  const std::vector<wxInt64>& id_vec)
+{
+    if (g == NULL || ofname.IsEmpty() || id_vec.size() == 0) return false;
+    GwbCsr csr;
+    csr.Init(g, (int)id_vec.size());
+    return WriteGwb(csr, layer_name, ofname, id_var_name, &id_vec, 0);
+}
+
+bool Gda::SaveGwb(const GalElement* g,
+                  const wxString& layer_name,
+                  const wxString& ofname,
+                  const wxString& id_var_name,
+                  const std::vector<wxString>& id_vec)
+{
+    if (g == NULL || ofname.IsEmpty() || id_vec.size() == 0) return false;
+    GwbCsr csr;
+    csr.Init(g, (int)id_vec.size());
+    return WriteGwb(csr, layer_name, ofname, id_var_name, 0, &id_vec);
+}
+
+bool Gda::SaveGwb(const GwtElement* g,
+                  const wxString& layer_name,
+                  const wxString& ofname,
+                  const wxString& id_var_name,
+                  const std::vector<wxInt64>& id_vec)
+{
+    if (g == NULL || ofname.IsEmpty() || id_vec.size() == 0) return false;
+    GwbCsr csr;
+    csr.Init(g, (int)id_vec.size());
+    return WriteGwb(csr, layer_name, ofname, id_var_name, &id_vec, 0);
+}
+
+bool Gda::SaveGwb(const GwtElement* g,
+                  const wxString& layer_name,
+                  const wxString& ofname,
+                  const wxString& id_var_name,
+                  const std::vector<wxString>& id_vec)
+{
+    if (g == NULL || ofname.IsEmpty() || id_vec.size() == 0) return false;
+    GwbCsr csr;
+    csr.Init(g, (int)id_vec.size());
+    return WriteGwb(csr, layer_name, ofname, id_var_name, 0, &id_vec);
+}
+
+template <class T>
+static bool SaveWeightsAs(const GalElement* gal, const wxString& ext,
+                          const wxString& layer_name, const wxString& ofname,
+                          const wxString& id_var_name,
+                          const std::vector<T>& id_vec)
+{
+    if (ext == "gwb") {
+        return Gda::SaveGwb(gal, layer_name, ofname, id_var_name, id_vec);
+    } else if (ext == "gal") {
+        return Gda::SaveGal(gal, layer_name, ofname, id_var_name, id_vec);
+    } else if (ext == "gwt" || ext == "kwt") {
+        int num_obs = (int)id_vec.size();
+        GwtElement* gwt = new GwtElement[num_obs];
+        for (int i=0; i<num_obs; i++) {
+            GalNbrs nb = gal[i].GetNbrs();
+            GalNbrWeights w = gal[i].GetNbrWeights();
+            if (nb.empty()) continue;
+            gwt[i].alloc((int)nb.size());
+            for (size_t j=0; j<nb.size(); j++) {
+                gwt[i].Push(GwtNeighbor(nb[j], j < w.size() ? w[j] : 1.0));
+            }
+        }
+        bool flag = Gda::SaveGwt(gwt, layer_name, ofname, id_var_name, id_vec);
+        delete [] gwt;
+        return flag;
+    }
+    return false;
+}
+
+bool Gda::ConvertWeightsFile(const wxString& in_fname,
+                             const wxString& out_fname,
+                             TableInterface* table_int)
+{
+    if (table_int == NULL) return false;
+    wxString in_ext = GenUtils::GetFileExt(in_fname).Lower();
+    wxString out_ext = GenUtils::GetFileExt(out_fname).Lower();
+
+    wxString id_field;
+    GalElement* gal = 0;
+    try {
+        if (in_ext == "gal") {
+            id_field = WeightUtils::ReadIdField(in_fname);
+            gal = WeightUtils::ReadGal(in_fname, table_int);
+        } else if (in_ext == "gwt" || in_ext == "kwt") {
+            id_field = WeightUtils::ReadIdField(in_fname);
+            gal = WeightUtils::ReadGwtAsGal(in_fname, table_int);
+        } else if (in_ext == "swm") {
+            id_field = ReadIdFieldFromSwm(in_fname);
+            gal = ReadSwmAsGal(in_fname, table_int);
+        } else if (in_ext == "mat") {
+            gal = ReadMatAsGal(in_fname, table_int);
+        } else if (in_ext == "gwb") {
+            id_field = ReadIdFieldFromGwb(in_fname);
+            gal = ReadGwbAsGal(in_fname, table_int);
+        }
+    } catch (std::exception& e) {
+        wxLogMessage("Gda::ConvertWeightsFile() %s: %s", in_fname, e.what());
+        gal = 0;
+    }
+    if (gal == 0) return false;
+
+    int num_obs = table_int->GetNumberRows();
+    wxString layer_name = wxFileName(in_fname).GetName();
+    int col = wxNOT_FOUND;
+    if (!id_field.IsEmpty() && id_field != "Unknown") {
+        col = table_int->FindColId(id_field);
+    }
+
+    bool flag = false;
+    if (col != wxNOT_FOUND &&
+        table_int->GetColType(col) == GdaConst::long64_type) {
+        std::vector<wxInt64> id_vec(num_obs);
+        table_int->GetColData(col, 0, id_vec);
+        flag = SaveWeightsAs(gal, out_ext, layer_name, out_fname, id_field,
+                             id_vec);
+    } else if (col != wxNOT_FOUND &&
+               table_int->GetColType(col) == GdaConst::string_type) {
+        std::vector<wxString> id_vec(num_obs);
+        table_int->GetColData(col, 0, id_vec);
+        flag = SaveWeightsAs(gal, out_ext, layer_name, out_fname, id_field,
+                             id_vec);
+    } else {
+        // record order: ids 1 through num_obs without id field
+        std::vector<wxInt64> id_vec(num_obs);
+        for (int i=0; i<num_obs; i++) id_vec[i] = i + 1;
+        flag = SaveWeightsAs(gal, out_ext, layer_name, out_fname,
+                             wxEmptyString, id_vec);
+    }
+    delete [] gal;
+    return flag;
+}
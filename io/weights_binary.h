@@ -0,0 +1,170 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_WEIGHTS_BINARY_H__
+#define __GEODA_CENTER_WEIGHTS_BINARY_H__
+
+#include <vector>
+#include <stdint.h>
+#include <wx/string.h>
+
+namespace boost { namespace interprocess {
+    class file_mapping;
+    class mapped_region;
+} }
+
+class GalElement;
+class GalWeight;
+class GwtElement;
+class GwtWeight;
+class TableInterface;
+
+/**
+ Header of a GeoDa binary weights file (.gwb). All numbers are stored in
+ the byte order of the machine that wrote the file, and every section
+ starts at a multiple of 8 bytes, so the arrays can be used in place once
+ the file is memory-mapped. byte_order holds GwbFile::byte_order_mark; a
+ file written with the other byte order is rejected.
+
+   keys     int64[num_obs] (integer ids), or
+            int64[num_obs+1] offsets followed by the UTF-8 bytes (string ids)
+   offsets  int64[num_obs+1], neighbors of i are nbrs[offsets[i]..offsets[i+1])
+   nbrs     int32[num_edges], 0-based position of the neighbor in the file,
+            each row in the order of the weights it was written from
+   weights  double[num_edges], only if gwb_has_weights is set
+
+ The layer name and the id field are stored as UTF-8 strings. An empty id
+ field means record order.
+ */
+struct GwbHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t byte_order;
+    uint32_t reserved;
+    int64_t  num_obs;
+    int64_t  num_edges;
+    int64_t  layer_pos;
+    int64_t  layer_len;
+    int64_t  id_field_pos;
+    int64_t  id_field_len;
+    int64_t  keys_pos;
+    int64_t  offsets_pos;
+    int64_t  nbrs_pos;
+    int64_t  weights_pos;
+    int64_t  file_size;
+};
+
+/** Read-only memory-mapped view of a .gwb file */
+class GwbFile
+{
+public:
+    enum Flags {
+        gwb_symmetric = 1,
+        gwb_has_weights = 2,
+        gwb_int_keys = 4,
+        gwb_string_keys = 8
+    };
+    static const char* magic;
+    static const uint32_t version = 1;
+    static const uint32_t byte_order_mark = 0x01020304;
+
+    GwbFile();
+    virtual ~GwbFile();
+
+    /** Maps the file and checks the header and the CSR arrays. Returns
+     false if the file can't be opened or is not a valid .gwb file. */
+    bool Open(const wxString& fname);
+    void Close();
+    bool IsOpen() const { return header != 0; }
+
+    int GetNumObs() const { return (int)header->num_obs; }
+    int64_t GetNumEdges() const { return header->num_edges; }
+    bool IsSymmetric() const { return (header->flags & gwb_symmetric) != 0; }
+    bool HasWeights() const { return (header->flags & gwb_has_weights) != 0; }
+    wxString GetLayerName() const;
+    wxString GetIdField() const;
+
+    const int64_t* GetOffsets() const;
+    const int32_t* GetNbrs() const;
+    /** NULL for binary weights */
+    const double* GetWeights() const;
+
+    /** rows[i] is the row of the Table that holds observation i of the
+     file. Returns false (after telling the user) if the observations don't
+     match the Table; is_identity is true if the file is in Table order. */
+    bool GetTableRows(TableInterface* table_int, std::vector<int>& rows,
+                      bool& is_identity) const;
+
+protected:
+    bool Validate() const;
+    wxString GetString(int64_t pos, int64_t len) const;
+
+    boost::interprocess::file_mapping* file;
+    boost::interprocess::mapped_region* region;
+    const char* base;
+    size_t size;
+    const GwbHeader* header;
+};
+
+wxString ReadIdFieldFromGwb(const wxString& fname);
+
+GalElement* ReadGwbAsGal(const wxString& fname, TableInterface* table_int);
+
+/** Same as ReadGwbAsGal(), but the weights also keep the symmetry flag of
+ the file. If the file is in Table order, it stays mapped and is the CSR
+ storage of the GalWeight, so nothing is copied; otherwise its rows are
+ reordered into a CSR of their own. */
+GalWeight* ReadGwbAsGalWeight(const wxString& fname, TableInterface* table_int);
+
+GwtElement* ReadGwb(const wxString& fname, TableInterface* table_int);
+
+namespace Gda {
+    // Integer IDs
+    bool SaveGwb(const GalElement* g,
+                 const wxString& layer_name,
+                 const wxString& ofname,
+                 const wxString& id_var_name,
+                 const std::vector<wxInt64>& id_vec);
+    // String IDs
+    bool SaveGwb(const GalElement* g,
+                 const wxString& layer_name,
+                 const wxString& ofname,
+                 const wxString& id_var_name,
+                 const std::vector<wxString>& id_vec);
+    bool SaveGwb(const GwtElement* g,
+                 const wxString& layer_name,
+                 const wxString& ofname,
+                 const wxString& id_var_name,
+                 const std::vector<wxInt64>& id_vec);
+    bool SaveGwb(const GwtElement* g,
+                 const wxString& layer_name,
+                 const wxString& ofname,
+                 const wxString& id_var_name,
+                 const std::vector<wxString>& id_vec);
+
+    /** Converts a gal, gwt, kwt, swm, mat or gwb weights file to a gal,
+     gwt, kwt or gwb file, using the id field of the input file if it is in
+     table_int, and record order otherwise. */
+    bool ConvertWeightsFile(const wxString& in_fname,
+                            const wxString& out_fname,
+                            TableInterface* table_int);
+}
+
+#endif